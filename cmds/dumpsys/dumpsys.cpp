@@ -61,15 +61,21 @@ static void usage() {
             "usage: dumpsys\n"
             "         To dump all services.\n"
             "or:\n"
-            "       dumpsys [-t TIMEOUT] [--priority LEVEL] [--pid] [--thread] [--help | -l | "
-            "--skip SERVICES "
-            "| SERVICE [ARGS]]\n"
+            "       dumpsys [-t TIMEOUT] [--priority LEVEL] [--pid] [--thread] "
+            "[--transaction-stats] [--enable-transaction-stats] [--disable-transaction-stats] "
+            "[--help | -l | --skip SERVICES | SERVICE [ARGS]]\n"
             "         --help: shows this help\n"
             "         -l: only list services, do not dump them\n"
             "         -t TIMEOUT_SEC: TIMEOUT to use in seconds instead of default 10 seconds\n"
             "         -T TIMEOUT_MS: TIMEOUT to use in milliseconds instead of default 10 seconds\n"
             "         --pid: dump PID instead of usual dump\n"
             "         --thread: dump thread usage instead of usual dump\n"
+            "         --transaction-stats: dump binder transaction stats instead of usual dump,\n"
+            "               which the service process must have enabled, see below\n"
+            "         --enable-transaction-stats: start recording binder transaction stats in\n"
+            "               the service process instead of usual dump\n"
+            "         --disable-transaction-stats: stop recording binder transaction stats in\n"
+            "               the service process instead of usual dump\n"
             "         --proto: filter services that support dumping data in proto format. Dumps\n"
             "               will be in proto format.\n"
             "         --priority LEVEL: filter services based on specified priority\n"
@@ -129,6 +135,9 @@ int Dumpsys::main(int argc, char* const argv[]) {
     int timeoutArgMs = 10000;
     int priorityFlags = IServiceManager::DUMP_FLAG_PRIORITY_ALL;
     static struct option longOptions[] = {{"thread", no_argument, 0, 0},
+                                          {"transaction-stats", no_argument, 0, 0},
+                                          {"enable-transaction-stats", no_argument, 0, 0},
+                                          {"disable-transaction-stats", no_argument, 0, 0},
                                           {"pid", no_argument, 0, 0},
                                           {"priority", required_argument, 0, 0},
                                           {"proto", no_argument, 0, 0},
@@ -169,6 +178,12 @@ int Dumpsys::main(int argc, char* const argv[]) {
                 type = Type::PID;
             } else if (!strcmp(longOptions[optionIndex].name, "thread")) {
                 type = Type::THREAD;
+            } else if (!strcmp(longOptions[optionIndex].name, "transaction-stats")) {
+                type = Type::TRANSACTION_STATS;
+            } else if (!strcmp(longOptions[optionIndex].name, "enable-transaction-stats")) {
+                type = Type::ENABLE_TRANSACTION_STATS;
+            } else if (!strcmp(longOptions[optionIndex].name, "disable-transaction-stats")) {
+                type = Type::DISABLE_TRANSACTION_STATS;
             }
             break;
 
@@ -352,6 +367,28 @@ static status_t dumpThreadsToFd(const sp<IBinder>& service, const unique_fd& fd)
     return OK;
 }
 
+static status_t dumpTransactionStatsToFd(const sp<IBinder>& service, const unique_fd& fd) {
+    std::string stats;
+    status_t status = service->getTransactionStats(&stats);
+    if (status != OK) {
+        return status;
+    }
+    WriteStringToFd(stats, fd.get());
+    return OK;
+}
+
+static status_t setTransactionStatsEnabled(const sp<IBinder>& service, bool enabled,
+                                           const unique_fd& fd) {
+    status_t status = service->setTransactionStatsEnabled(enabled);
+    if (status != OK) {
+        return status;
+    }
+    WriteStringToFd(enabled ? "Binder transaction stats enabled\n"
+                            : "Binder transaction stats disabled\n",
+                    fd.get());
+    return OK;
+}
+
 status_t Dumpsys::startDumpThread(Type type, const String16& serviceName,
                                   const Vector<String16>& args) {
     sp<IBinder> service = sm_->checkService(serviceName);
@@ -385,6 +422,15 @@ status_t Dumpsys::startDumpThread(Type type, const String16& serviceName,
         case Type::THREAD:
             err = dumpThreadsToFd(service, remote_end);
             break;
+        case Type::TRANSACTION_STATS:
+            err = dumpTransactionStatsToFd(service, remote_end);
+            break;
+        case Type::ENABLE_TRANSACTION_STATS:
+            err = setTransactionStatsEnabled(service, true, remote_end);
+            break;
+        case Type::DISABLE_TRANSACTION_STATS:
+            err = setTransactionStatsEnabled(service, false, remote_end);
+            break;
         default:
             std::cerr << "Unknown dump type" << static_cast<int>(type) << std::endl;
             return;
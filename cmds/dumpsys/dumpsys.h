@@ -55,6 +55,9 @@ class Dumpsys {
         DUMP,    // dump using `dump` function
         PID,     // dump pid of server only
         THREAD,  // dump thread usage of server only
+        TRANSACTION_STATS,  // dump binder transaction stats of server only
+        ENABLE_TRANSACTION_STATS,  // start recording binder transaction stats of server
+        DISABLE_TRANSACTION_STATS,  // stop recording binder transaction stats of server
     };
 
     /**
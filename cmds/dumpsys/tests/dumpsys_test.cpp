@@ -25,6 +25,7 @@
 #include <android-base/file.h>
 #include <binder/Binder.h>
 #include <binder/ProcessState.h>
+#include <binder/TransactionStats.h>
 #include <serviceutils/PriorityDumper.h>
 #include <utils/String16.h>
 #include <utils/String8.h>
@@ -606,6 +607,29 @@ TEST_F(DumpsysTest, ListServiceWithThread) {
     AssertOutputFormat(format);
 }
 
+// Tests 'dumpsys --transaction-stats service_name'
+TEST_F(DumpsysTest, ListServiceWithTransactionStats) {
+    ExpectCheckService("Locksmith");
+
+    CallMain({"--transaction-stats", "Locksmith"});
+
+    AssertOutputContains("Binder transaction stats");
+}
+
+// Tests 'dumpsys --enable-transaction-stats service_name', and disabling them again
+TEST_F(DumpsysTest, EnableAndDisableTransactionStats) {
+    ExpectCheckService("Locksmith");
+
+    // the service is in this process
+    CallMain({"--enable-transaction-stats", "Locksmith"});
+    AssertOutputContains("Binder transaction stats enabled");
+    EXPECT_TRUE(TransactionStats::isEnabled());
+
+    CallMain({"--disable-transaction-stats", "Locksmith"});
+    AssertOutputContains("Binder transaction stats disabled");
+    EXPECT_FALSE(TransactionStats::isEnabled());
+}
+
 TEST_F(DumpsysTest, GetBytesWritten) {
     const char* serviceName = "service2";
     const char* dumpContents = "dump1";
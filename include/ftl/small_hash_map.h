@@ -0,0 +1,329 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <ftl/initializer_list.h>
+#include <ftl/small_vector.h>
+
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace android::ftl {
+
+// Associative container with unique, unordered keys, and the same interface as ftl::SmallMap.
+// Key-value pairs are stored in contiguous storage, which is allocated statically until its size
+// exceeds N, at which point mappings are relocated to dynamic memory. While static, lookup is a
+// linear search like SmallMap. Once dynamic, the mappings are indexed by an open-addressing hash
+// table with linear probing, so lookup stays constant-time for maps that outgrow N.
+//
+// Iteration order is unspecified, but the same as insertion order until the first erasure.
+//
+// SmallHashMap<K, V, 0> unconditionally allocates on the heap, and is always hashed.
+//
+// Example usage:
+//
+//   ftl::SmallHashMap<int, std::string, 2> map;
+//   assert(map.empty());
+//   assert(!map.dynamic());
+//
+//   map = ftl::init::map<int, std::string>(123, "abc")(-1);
+//   assert(map.size() == 2u);
+//   assert(!map.dynamic());
+//
+//   assert(map.try_emplace(42, 3u, '?').second);
+//   assert(map.dynamic());
+//
+//   assert(map.contains(123));
+//   assert(map.find(42, [](const std::string& s) { return s.size(); }) == 3u);
+//
+//   const auto opt = map.find(-1);
+//   assert(opt);
+//
+//   std::string& ref = *opt;
+//   assert(ref.empty());
+//   ref = "xyz";
+//
+//   assert(map.erase(123));
+//   assert(!map.contains(123));
+//   assert(map.size() == 2u);
+//
+template <typename K, typename V, std::size_t N, typename Hash = std::hash<K>>
+class SmallHashMap final {
+  using Map = SmallVector<std::pair<const K, V>, N>;
+
+ public:
+  using key_type = K;
+  using mapped_type = V;
+  using hasher = Hash;
+
+  using value_type = typename Map::value_type;
+  using size_type = typename Map::size_type;
+  using difference_type = typename Map::difference_type;
+
+  using reference = typename Map::reference;
+  using iterator = typename Map::iterator;
+
+  using const_reference = typename Map::const_reference;
+  using const_iterator = typename Map::const_iterator;
+
+  // Creates an empty map.
+  SmallHashMap() = default;
+
+  // Constructs at most N key-value pairs in place by forwarding per-pair constructor arguments.
+  // See SmallMap for the syntax.
+  template <typename U, std::size_t... Sizes, typename... Types>
+  SmallHashMap(InitializerList<U, std::index_sequence<Sizes...>, Types...>&& list)
+      : map_(std::move(list)) {
+    // TODO: Enforce unique keys.
+    if (dynamic()) reindex();
+  }
+
+  size_type max_size() const { return map_.max_size(); }
+  size_type size() const { return map_.size(); }
+  bool empty() const { return map_.empty(); }
+
+  // Returns whether the map is backed by static or dynamic storage, i.e. linear or hashed lookup.
+  bool dynamic() const {
+    if constexpr (N == 0) {
+      return true;
+    } else {
+      return map_.dynamic();
+    }
+  }
+
+  iterator begin() { return map_.begin(); }
+  const_iterator begin() const { return cbegin(); }
+  const_iterator cbegin() const { return map_.cbegin(); }
+
+  iterator end() { return map_.end(); }
+  const_iterator end() const { return cend(); }
+  const_iterator cend() const { return map_.cend(); }
+
+  // Returns whether a mapping exists for the given key.
+  bool contains(const key_type& key) const { return lookup(key); }
+
+  // Returns a reference to the value for the given key, or std::nullopt if the key was not found.
+  // See SmallMap::find.
+  auto find(const key_type& key) const -> std::optional<std::reference_wrapper<const mapped_type>> {
+    return find(key, [](const mapped_type& v) { return std::cref(v); });
+  }
+
+  auto find(const key_type& key) -> std::optional<std::reference_wrapper<mapped_type>> {
+    return find(key, [](mapped_type& v) { return std::ref(v); });
+  }
+
+  // Returns the result R of a unary operation F on (a constant or mutable reference to) the value
+  // for the given key, or std::nullopt if the key was not found. If F has a return type of void,
+  // then the Boolean result indicates whether the key was found. See SmallMap::find.
+  template <typename F, typename R = std::invoke_result_t<F, const mapped_type&>>
+  auto find(const key_type& key, F f) const
+      -> std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> {
+    const value_type* const pair = lookup(key);
+    if (!pair) return {};
+
+    if constexpr (std::is_void_v<R>) {
+      f(pair->second);
+      return true;
+    } else {
+      return f(pair->second);
+    }
+  }
+
+  template <typename F>
+  auto find(const key_type& key, F f) {
+    return std::as_const(*this).find(
+        key, [&f](const mapped_type& v) { return f(const_cast<mapped_type&>(v)); });
+  }
+
+  // Inserts a mapping constructed in place by forwarding the arguments to the value constructor,
+  // unless a mapping for the given key already exists. Returns an iterator to the mapping for the
+  // key, and whether the mapping was inserted. See SmallMap::try_emplace.
+  //
+  // If the map reaches its static or dynamic capacity, then all iterators are invalidated.
+  //
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args) {
+    std::uint32_t hash = 0;
+    std::size_t slot = 0;
+
+    if (slots_.empty()) {
+      if (const value_type* const pair = linear_lookup(key)) {
+        return {begin() + (pair - &*cbegin()), false};
+      }
+    } else {
+      hash = hash_of(key);
+      slot = probe(key, hash);
+      if (const std::uint32_t index = slots_[slot].index) {
+        return {begin() + (index - 1), false};
+      }
+    }
+
+    map_.emplace_back(std::piecewise_construct, std::forward_as_tuple(key),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+
+    if (dynamic()) {
+      if (slots_.empty() || slots_.size() < kMaxLoadInverse * size()) {
+        // Either the map just spilled, or the table exceeded its load factor.
+        reindex();
+      } else {
+        slots_[slot] = {hash, static_cast<std::uint32_t>(size())};
+      }
+    }
+
+    return {std::prev(end()), true};
+  }
+
+  // Removes the mapping for the given key, and returns whether it existed. The last mapping is
+  // moved into the vacated position, so iterators to it, and the end() iterator, are invalidated.
+  bool erase(const key_type& key) {
+    if (slots_.empty()) {
+      const value_type* const pair = linear_lookup(key);
+      if (!pair) return false;
+
+      map_.unstable_erase(begin() + (pair - &*cbegin()));
+      return true;
+    }
+
+    const std::size_t slot = probe(key, hash_of(key));
+    if (!slots_[slot].index) return false;
+
+    const std::size_t position = slots_[slot].index - 1;
+    remove_slot(slot);
+
+    // Point the slot of the last mapping to the position it is about to be moved to.
+    if (const std::size_t last = size() - 1; position != last) {
+      const key_type& last_key = map_[last].first;
+      slots_[probe(last_key, hash_of(last_key))].index = static_cast<std::uint32_t>(position + 1);
+    }
+
+    map_.unstable_erase(begin() + position);
+    return true;
+  }
+
+ private:
+  struct Slot {
+    std::uint32_t hash;
+    std::uint32_t index;  // One-based position in map_, or zero if the slot is empty.
+  };
+
+  // The table is resized to keep it at most half full, so that probe sequences stay short.
+  static constexpr std::size_t kMaxLoadInverse = 2;
+  static constexpr std::size_t kMinSlots = 16;
+
+  static std::uint32_t hash_of(const key_type& key) {
+    // std::hash is typically the identity for integers and pointers, so scramble the bits with
+    // Fibonacci hashing to avoid clustering of consecutive or aligned keys.
+    const std::uint64_t hash = static_cast<std::uint64_t>(hasher{}(key)) * 0x9e3779b97f4a7c15u;
+    return static_cast<std::uint32_t>(hash >> 32);
+  }
+
+  // Returns the mapping for the key, or nullptr if the key was not found.
+  const value_type* linear_lookup(const key_type& key) const {
+    for (const auto& pair : map_) {
+      if (pair.first == key) return &pair;
+    }
+    return nullptr;
+  }
+
+  const value_type* lookup(const key_type& key) const {
+    if (slots_.empty()) return linear_lookup(key);
+
+    const std::uint32_t index = slots_[probe(key, hash_of(key))].index;
+    return index ? &map_[index - 1] : nullptr;
+  }
+
+  // Returns the slot holding the given key, or the empty slot ending its probe sequence.
+  std::size_t probe(const key_type& key, std::uint32_t hash) const {
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+      const Slot& slot = slots_[i];
+      if (!slot.index || (slot.hash == hash && map_[slot.index - 1].first == key)) {
+        return i;
+      }
+    }
+  }
+
+  // Rebuilds the table with room for the current size.
+  void reindex() {
+    std::size_t capacity = kMinSlots;
+    while (capacity < 2 * kMaxLoadInverse * size()) capacity *= 2;
+
+    slots_.assign(capacity, Slot{0, 0});
+    const std::size_t mask = capacity - 1;
+
+    for (std::size_t position = 0; position < size(); ++position) {
+      const std::uint32_t hash = hash_of(map_[position].first);
+      std::size_t i = hash & mask;
+      while (slots_[i].index) i = (i + 1) & mask;
+      slots_[i] = {hash, static_cast<std::uint32_t>(position + 1)};
+    }
+  }
+
+  // Empties a slot by backward-shift deletion, which keeps probe sequences intact without the
+  // need for tombstones.
+  void remove_slot(std::size_t i) {
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t j = (i + 1) & mask; slots_[j].index; j = (j + 1) & mask) {
+      // Shift the entry at j into the hole, unless its home slot lies cyclically within (i, j].
+      const std::size_t home = slots_[j].hash & mask;
+      if (((j - home) & mask) >= ((j - i) & mask)) {
+        slots_[i] = slots_[j];
+        i = j;
+      }
+    }
+    slots_[i] = Slot{0, 0};
+  }
+
+  Map map_;
+  std::vector<Slot> slots_;
+};
+
+// Deduction guide for in-place constructor.
+template <typename K, typename V, std::size_t... Sizes, typename... Types>
+SmallHashMap(InitializerList<KeyValue<K, V>, std::index_sequence<Sizes...>, Types...>&&)
+    -> SmallHashMap<K, V, sizeof...(Sizes)>;
+
+// Returns whether the key-value pairs of two maps are equal.
+template <typename K, typename V, std::size_t N, typename H, typename Q, typename W, std::size_t M,
+          typename I>
+bool operator==(const SmallHashMap<K, V, N, H>& lhs, const SmallHashMap<Q, W, M, I>& rhs) {
+  if (lhs.size() != rhs.size()) return false;
+
+  for (const auto& [k, v] : lhs) {
+    const auto& lv = v;
+    if (!rhs.find(k, [&lv](const auto& rv) { return lv == rv; }).value_or(false)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// TODO: Remove in C++20.
+template <typename K, typename V, std::size_t N, typename H, typename Q, typename W, std::size_t M,
+          typename I>
+inline bool operator!=(const SmallHashMap<K, V, N, H>& lhs, const SmallHashMap<Q, W, M, I>& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace android::ftl
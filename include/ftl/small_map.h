@@ -20,7 +20,9 @@
 #include <ftl/small_vector.h>
 
 #include <functional>
+#include <iterator>
 #include <optional>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 
@@ -54,6 +56,16 @@ namespace android::ftl {
 //
 //   assert(map == SmallMap(ftl::init::map(-1, "xyz")(42, "???")(123, "abc")));
 //
+//   assert(map.try_emplace(7, "seven").second);
+//   assert(!map.try_emplace(7, "sept").second);
+//   assert(map.dynamic());
+//
+//   assert(map.erase(-1));
+//   assert(!map.erase(-1));
+//   assert(map.size() == 3u);
+//
+// See also ftl::SmallHashMap, which switches from linear search to hashing when it spills.
+//
 template <typename K, typename V, std::size_t N>
 class SmallMap final {
   using Map = SmallVector<std::pair<const K, V>, N>;
@@ -170,6 +182,44 @@ class SmallMap final {
         key, [&f](const mapped_type& v) { return f(const_cast<mapped_type&>(v)); });
   }
 
+  // Inserts a mapping constructed in place by forwarding the arguments to the value constructor,
+  // unless a mapping for the given key already exists. Returns an iterator to the mapping for the
+  // key, and whether the mapping was inserted.
+  //
+  // If the map reaches its static or dynamic capacity, then all iterators are invalidated.
+  //
+  //   ftl::SmallMap map = ftl::init::map(1, 'a')(2, 'b');
+  //
+  //   const auto [it, ok] = map.try_emplace(3, 'c');
+  //   assert(ok && it->second == 'c');
+  //
+  //   assert(!map.try_emplace(1, 'z').second);
+  //   assert(map.find(1) == 'a');
+  //
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args) {
+    for (auto it = begin(); it != end(); ++it) {
+      if (it->first == key) return {it, false};
+    }
+
+    map_.emplace_back(std::piecewise_construct, std::forward_as_tuple(key),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+    return {std::prev(end()), true};
+  }
+
+  // Removes the mapping for the given key, and returns whether it existed. The last mapping is
+  // moved into the vacated position, so iterators to it, and the end() iterator, are invalidated.
+  bool erase(const key_type& key) {
+    for (auto it = begin(); it != end(); ++it) {
+      if (it->first == key) {
+        map_.unstable_erase(it);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
  private:
   Map map_;
 };
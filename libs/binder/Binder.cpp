@@ -20,9 +20,14 @@
 #include <utils/misc.h>
 #include <binder/BpBinder.h>
 #include <binder/IInterface.h>
+#include <binder/IPCThreadState.h>
 #include <binder/IResultReceiver.h>
+#include <binder/IServiceManager.h>
 #include <binder/IShellCallback.h>
 #include <binder/Parcel.h>
+#include <binder/TransactionStats.h>
+#include <cutils/compiler.h>
+#include <private/android_filesystem_config.h>
 
 #include <linux/sched.h>
 #include <stdio.h>
@@ -136,6 +141,48 @@ status_t IBinder::getDebugPid(pid_t* out) {
     return OK;
 }
 
+// What TRANSACTION_STATS_TRANSACTION does, dumping the stats by default.
+enum : int32_t {
+    TRANSACTION_STATS_DUMP = 0,
+    TRANSACTION_STATS_ENABLE = 1,
+    TRANSACTION_STATS_DISABLE = 2,
+};
+
+status_t IBinder::getTransactionStats(std::string* out) {
+    BBinder* local = this->localBinder();
+    if (local != nullptr) {
+        *out = TransactionStats::dump();
+        return OK;
+    }
+
+    BpBinder* proxy = this->remoteBinder();
+    LOG_ALWAYS_FATAL_IF(proxy == nullptr);
+
+    Parcel data;
+    data.writeInt32(TRANSACTION_STATS_DUMP);
+    Parcel reply;
+    status_t status = transact(TRANSACTION_STATS_TRANSACTION, data, &reply);
+    if (status != OK) return status;
+
+    return reply.readUtf8FromUtf16(out);
+}
+
+status_t IBinder::setTransactionStatsEnabled(bool enabled) {
+    BBinder* local = this->localBinder();
+    if (local != nullptr) {
+        TransactionStats::setEnabled(enabled);
+        return OK;
+    }
+
+    BpBinder* proxy = this->remoteBinder();
+    LOG_ALWAYS_FATAL_IF(proxy == nullptr);
+
+    Parcel data;
+    data.writeInt32(enabled ? TRANSACTION_STATS_ENABLE : TRANSACTION_STATS_DISABLE);
+    Parcel reply;
+    return transact(TRANSACTION_STATS_TRANSACTION, data, &reply);
+}
+
 // ---------------------------------------------------------------------------
 
 class BBinder::Extras
@@ -178,6 +225,45 @@ const String16& BBinder::getInterfaceDescriptor() const
     return sEmptyDescriptor;
 }
 
+// The stats tell which calls a process makes and serves, so kernel binder
+// callers need to be allowed to dump it. RPC binder sockets are only shared
+// with trusted processes in the first place.
+static bool canAccessTransactionStats() {
+    IPCThreadState* ipc = IPCThreadState::selfOrNull();
+    // not serving a kernel binder transaction
+    if (ipc == nullptr || ipc->getServingStackPointer() == nullptr) return true;
+
+    uid_t uid = ipc->getCallingUid();
+    if (uid == AID_ROOT || uid == AID_SHELL || uid == AID_SYSTEM) return true;
+#if !defined(__ANDROID_VNDK__) && defined(__ANDROID__)
+    static const String16 kDumpPermission("android.permission.DUMP");
+    return checkCallingPermission(kDumpPermission);
+#else
+    return false;
+#endif
+}
+
+static status_t onTransactionStatsTransaction(const Parcel& data, Parcel* reply) {
+    if (!canAccessTransactionStats()) return PERMISSION_DENIED;
+
+    int32_t request = TRANSACTION_STATS_DUMP;
+    if (data.dataAvail() > 0) {
+        if (status_t status = data.readInt32(&request); status != OK) return status;
+    }
+    switch (request) {
+        case TRANSACTION_STATS_DUMP:
+            // nothing is being recorded
+            if (!TransactionStats::isEnabled()) return INVALID_OPERATION;
+            return reply->writeUtf8AsUtf16(TransactionStats::dump());
+        case TRANSACTION_STATS_ENABLE:
+        case TRANSACTION_STATS_DISABLE:
+            TransactionStats::setEnabled(request == TRANSACTION_STATS_ENABLE);
+            return OK;
+        default:
+            return BAD_VALUE;
+    }
+}
+
 // NOLINTNEXTLINE(google-default-arguments)
 status_t BBinder::transact(
     uint32_t code, const Parcel& data, Parcel* reply, uint32_t flags)
@@ -188,6 +274,10 @@ status_t BBinder::transact(
         reply->markSensitive();
     }
 
+    const bool recordStats = TransactionStats::isEnabled();
+    nsecs_t start = 0;
+    if (CC_UNLIKELY(recordStats)) start = systemTime(SYSTEM_TIME_MONOTONIC);
+
     status_t err = NO_ERROR;
     switch (code) {
         case PING_TRANSACTION:
@@ -199,11 +289,20 @@ status_t BBinder::transact(
         case DEBUG_PID_TRANSACTION:
             err = reply->writeInt32(getDebugPid());
             break;
+        case TRANSACTION_STATS_TRANSACTION:
+            err = onTransactionStatsTransaction(data, reply);
+            break;
         default:
             err = onTransact(code, data, reply, flags);
             break;
     }
 
+    if (CC_UNLIKELY(recordStats)) {
+        TransactionStats::record(TransactionStats::Direction::INCOMING, getInterfaceDescriptor(),
+                                 code, data.dataSize(), reply == nullptr ? 0 : reply->dataSize(),
+                                 systemTime(SYSTEM_TIME_MONOTONIC) - start);
+    }
+
     // In case this is being transacted on in the same process.
     if (reply != nullptr) {
         reply->setDataPosition(0);
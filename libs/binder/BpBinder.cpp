@@ -23,6 +23,7 @@
 #include <binder/IResultReceiver.h>
 #include <binder/RpcSession.h>
 #include <binder/Stability.h>
+#include <binder/TransactionStats.h>
 #include <cutils/compiler.h>
 #include <utils/Log.h>
 
@@ -62,6 +63,19 @@ BpBinder::ObjectManager::~ObjectManager()
     kill();
 }
 
+const BpBinder::ObjectManager::entry_t* BpBinder::ObjectManager::lookup(
+    const void* objectID) const
+{
+    for (size_t i = 0; i < mInlineCount; i++) {
+        if (mInline[i].objectID == objectID) return &mInline[i].entry;
+    }
+    if (mOverflow.empty()) return nullptr;
+
+    auto it = mOverflow.find(objectID);
+    if (it == mOverflow.end()) return nullptr;
+    return &it->second;
+}
+
 void BpBinder::ObjectManager::attach(
     const void* objectID, void* object, void* cleanupCookie,
     IBinder::object_cleanup_func func)
@@ -71,39 +85,64 @@ void BpBinder::ObjectManager::attach(
     e.cleanupCookie = cleanupCookie;
     e.func = func;
 
-    if (mObjects.indexOfKey(objectID) >= 0) {
+    if (lookup(objectID) != nullptr) {
         ALOGE("Trying to attach object ID %p to binder ObjectManager %p with object %p, but object ID already in use",
                 objectID, this,  object);
         return;
     }
 
-    mObjects.add(objectID, e);
+    if (mInlineCount < kInlineObjects) {
+        mInline[mInlineCount++] = {objectID, e};
+        return;
+    }
+
+    mOverflow.emplace(objectID, e);
 }
 
 void* BpBinder::ObjectManager::find(const void* objectID) const
 {
-    const ssize_t i = mObjects.indexOfKey(objectID);
-    if (i < 0) return nullptr;
-    return mObjects.valueAt(i).object;
+    const entry_t* e = lookup(objectID);
+    if (e == nullptr) return nullptr;
+    return e->object;
 }
 
 void BpBinder::ObjectManager::detach(const void* objectID)
 {
-    mObjects.removeItem(objectID);
+    for (size_t i = 0; i < mInlineCount; i++) {
+        if (mInline[i].objectID != objectID) continue;
+
+        // Order is not significant, so fill the hole with the last inline
+        // entry, and refill the inline array from the overflow table if needed.
+        mInline[i] = mInline[--mInlineCount];
+        if (!mOverflow.empty()) {
+            auto it = mOverflow.begin();
+            mInline[mInlineCount++] = {it->first, it->second};
+            mOverflow.erase(it);
+        }
+        return;
+    }
+
+    mOverflow.erase(objectID);
 }
 
 void BpBinder::ObjectManager::kill()
 {
-    const size_t N = mObjects.size();
+    const size_t N = mInlineCount + mOverflow.size();
     ALOGV("Killing %zu objects in manager %p", N, this);
-    for (size_t i=0; i<N; i++) {
-        const entry_t& e = mObjects.valueAt(i);
+    for (size_t i = 0; i < mInlineCount; i++) {
+        const inline_entry_t& e = mInline[i];
+        if (e.entry.func != nullptr) {
+            e.entry.func(e.objectID, e.entry.object, e.entry.cleanupCookie);
+        }
+    }
+    for (const auto& [objectID, e] : mOverflow) {
         if (e.func != nullptr) {
-            e.func(mObjects.keyAt(i), e.object, e.cleanupCookie);
+            e.func(objectID, e.object, e.cleanupCookie);
         }
     }
 
-    mObjects.clear();
+    mInlineCount = 0;
+    mOverflow.clear();
 }
 
 // ---------------------------------------------------------------------------
@@ -218,8 +257,10 @@ const String16& BpBinder::getInterfaceDescriptor() const
             Mutex::Autolock _l(mLock);
             // mDescriptorCache could have been assigned while the lock was
             // released.
-            if (mDescriptorCache.size() == 0)
+            if (mDescriptorCache.size() == 0) {
                 mDescriptorCache = res;
+                mDescriptorCached.store(true, std::memory_order_release);
+            }
         }
     }
 
@@ -267,23 +308,14 @@ status_t BpBinder::transact(
         // don't send userspace flags to the kernel
         flags = flags & ~FLAG_PRIVATE_VENDOR;
 
-        // user transactions require a given stability level
-        if (code >= FIRST_CALL_TRANSACTION && code <= LAST_CALL_TRANSACTION) {
-            using android::internal::Stability;
-
-            auto category = Stability::getCategory(this);
-            Stability::Level required = privateVendor ? Stability::VENDOR
-                : Stability::getLocalLevel();
-
-            if (CC_UNLIKELY(!Stability::check(category, required))) {
-                ALOGE("Cannot do a user transaction on a %s binder (%s) in a %s context.",
-                    category.debugString().c_str(),
-                    String8(getInterfaceDescriptor()).c_str(),
-                    Stability::levelString(required).c_str());
-                return BAD_TYPE;
-            }
+        if (CC_UNLIKELY(!isTransactionAllowed(code, privateVendor))) {
+            return BAD_TYPE;
         }
 
+        const bool recordStats = TransactionStats::isEnabled();
+        nsecs_t start = 0;
+        if (CC_UNLIKELY(recordStats)) start = systemTime(SYSTEM_TIME_MONOTONIC);
+
         status_t status;
         if (CC_UNLIKELY(isRpcBinder())) {
             status = rpcSession()->transact(rpcAddress(), code, data, reply, flags);
@@ -291,6 +323,17 @@ status_t BpBinder::transact(
             status = IPCThreadState::self()->transact(binderHandle(), code, data, reply, flags);
         }
 
+        if (CC_UNLIKELY(recordStats)) {
+            // not looked up here, since that would take another transaction
+            static const String16 kUnknownDescriptor;
+            const String16& descriptor = mDescriptorCached.load(std::memory_order_acquire)
+                    ? mDescriptorCache
+                    : kUnknownDescriptor;
+            TransactionStats::record(TransactionStats::Direction::OUTGOING, descriptor, code,
+                                     data.dataSize(), reply == nullptr ? 0 : reply->dataSize(),
+                                     systemTime(SYSTEM_TIME_MONOTONIC) - start);
+        }
+
         if (status == DEAD_OBJECT) mAlive = 0;
 
         return status;
@@ -299,6 +342,43 @@ status_t BpBinder::transact(
     return DEAD_OBJECT;
 }
 
+std::unique_ptr<RpcPendingTransaction> BpBinder::transactAsync(uint32_t code, const Parcel& data,
+                                                               Parcel* reply, uint32_t flags) {
+    LOG_ALWAYS_FATAL_IF(!isRpcBinder(), "Only RPC binders can start transactions asynchronously");
+
+    bool privateVendor = flags & FLAG_PRIVATE_VENDOR;
+    flags = flags & ~FLAG_PRIVATE_VENDOR;
+
+    status_t status = DEAD_OBJECT;
+    if (mAlive) {
+        if (CC_LIKELY(isTransactionAllowed(code, privateVendor))) {
+            return rpcSession()->transactAsync(rpcAddress(), code, data, reply, flags);
+        }
+        status = BAD_TYPE;
+    }
+    return std::unique_ptr<RpcPendingTransaction>(new RpcPendingTransaction(status));
+}
+
+bool BpBinder::isTransactionAllowed(uint32_t code, bool privateVendor) {
+    // user transactions require a given stability level
+    if (code >= FIRST_CALL_TRANSACTION && code <= LAST_CALL_TRANSACTION) {
+        using android::internal::Stability;
+
+        auto category = Stability::getCategory(this);
+        Stability::Level required = privateVendor ? Stability::VENDOR
+            : Stability::getLocalLevel();
+
+        if (CC_UNLIKELY(!Stability::check(category, required))) {
+            ALOGE("Cannot do a user transaction on a %s binder (%s) in a %s context.",
+                category.debugString().c_str(),
+                String8(getInterfaceDescriptor()).c_str(),
+                Stability::levelString(required).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
 // NOLINTNEXTLINE(google-default-arguments)
 status_t BpBinder::linkToDeath(
     const sp<DeathRecipient>& recipient, void* cookie, uint32_t flags)
@@ -29,6 +29,7 @@
 #include <utils/SystemClock.h>
 #include <utils/threads.h>
 
+#include <algorithm>
 #include <atomic>
 #include <errno.h>
 #include <inttypes.h>
@@ -533,6 +534,8 @@ status_t IPCThreadState::getAndExecuteCommand()
 
         pthread_mutex_lock(&mProcess->mThreadCountLock);
         mProcess->mExecutingThreadsCount++;
+        mProcess->mPeakExecutingThreadsCount = std::max(mProcess->mPeakExecutingThreadsCount,
+                                                        mProcess->mExecutingThreadsCount);
         if (mProcess->mExecutingThreadsCount >= mProcess->mMaxThreads &&
                 mProcess->mStarvationStartTimeMs == 0) {
             mProcess->mStarvationStartTimeMs = uptimeMillis();
@@ -546,6 +549,10 @@ status_t IPCThreadState::getAndExecuteCommand()
         if (mProcess->mExecutingThreadsCount < mProcess->mMaxThreads &&
                 mProcess->mStarvationStartTimeMs != 0) {
             int64_t starvationTimeMs = uptimeMillis() - mProcess->mStarvationStartTimeMs;
+            mProcess->mStarvationCount++;
+            mProcess->mTotalStarvationTimeMs += starvationTimeMs;
+            mProcess->mMaxStarvationTimeMs =
+                    std::max(mProcess->mMaxStarvationTimeMs, starvationTimeMs);
             if (starvationTimeMs > 100) {
                 ALOGE("binder thread pool (%zu threads) starved for %" PRId64 " ms",
                       mProcess->mMaxThreads, starvationTimeMs);
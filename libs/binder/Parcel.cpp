@@ -89,6 +89,66 @@ static std::atomic<size_t> gParcelGlobalAllocSize;
 
 static size_t gMaxFds = 0;
 
+// Most transactions (getters, callbacks, oneway notifications) carry less
+// than this, so the data of parcels is allocated with at least this capacity,
+// and a thread keeps a few such buffers once freed, to write the next parcels
+// into, instead of going through malloc for every transaction. This is kept
+// out of Parcel itself, whose size is fixed (see above).
+static constexpr size_t kSmallDataCapacity = 256;
+static constexpr size_t kSmallDataCachedPerThread = 4;
+
+namespace {
+struct SmallDataCache {
+    uint8_t* data[kSmallDataCachedPerThread] = {};
+    size_t count = 0;
+
+    ~SmallDataCache();
+};
+
+enum class SmallDataCacheState : uint8_t { UNUSED, LIVE, DESTROYED };
+} // namespace
+
+static thread_local SmallDataCache tSmallDataCache;
+// Parcels may still be freed after the cache is destroyed, while a thread exits
+// (e.g. those of IPCThreadState). Threads only construct the cache once they
+// allocate parcel data, and only keep data in it from then on, so that it is
+// never constructed once it would no longer be destroyed.
+static thread_local SmallDataCacheState tSmallDataCacheState = SmallDataCacheState::UNUSED;
+
+SmallDataCache::~SmallDataCache() {
+    tSmallDataCacheState = SmallDataCacheState::DESTROYED;
+    for (size_t i = 0; i < count; i++) free(data[i]);
+    count = 0;
+}
+
+// Allocates at least 'desired' bytes of parcel data, with the capacity
+// returned in 'outCapacity'.
+static uint8_t* allocParcelData(size_t desired, size_t* outCapacity) {
+    if (desired > kSmallDataCapacity) {
+        *outCapacity = desired;
+        return static_cast<uint8_t*>(malloc(desired));
+    }
+
+    *outCapacity = kSmallDataCapacity;
+    if (tSmallDataCacheState != SmallDataCacheState::DESTROYED) {
+        tSmallDataCacheState = SmallDataCacheState::LIVE;
+        SmallDataCache& cache = tSmallDataCache;
+        if (cache.count > 0) return cache.data[--cache.count];
+    }
+    return static_cast<uint8_t*>(malloc(kSmallDataCapacity));
+}
+
+static void freeParcelData(uint8_t* data, size_t capacity) {
+    if (capacity == kSmallDataCapacity && tSmallDataCacheState == SmallDataCacheState::LIVE) {
+        SmallDataCache& cache = tSmallDataCache;
+        if (cache.count < kSmallDataCachedPerThread) {
+            cache.data[cache.count++] = data;
+            return;
+        }
+    }
+    free(data);
+}
+
 // Maximum size of a blob to transfer in-place.
 static const size_t BLOB_INPLACE_LIMIT = 16 * 1024;
 
@@ -2238,8 +2298,10 @@ void Parcel::freeDataNoInit()
             gParcelGlobalAllocCount--;
             if (mDeallocZero) {
                 zeroMemory(mData, mDataSize);
+                free(mData);
+            } else {
+                freeParcelData(mData, mDataCapacity);
             }
-            free(mData);
         }
         if (mObjects) free(mObjects);
     }
@@ -2360,7 +2422,8 @@ status_t Parcel::continueWrite(size_t desired)
 
         // If there is a different owner, we need to take
         // posession.
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        uint8_t* data = allocParcelData(desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -2370,7 +2433,7 @@ status_t Parcel::continueWrite(size_t desired)
         if (objectsSize) {
             objects = (binder_size_t*)calloc(objectsSize, sizeof(binder_size_t));
             if (!objects) {
-                free(data);
+                freeParcelData(data, capacity);
 
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -2394,15 +2457,15 @@ status_t Parcel::continueWrite(size_t desired)
         mOwner(this, mData, mDataSize, mObjects, mObjectsSize);
         mOwner = nullptr;
 
-        LOG_ALLOC("Parcel %p: taking ownership of %zu capacity", this, desired);
-        gParcelGlobalAllocSize += desired;
+        LOG_ALLOC("Parcel %p: taking ownership of %zu capacity", this, capacity);
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
 
         mData = data;
         mObjects = objects;
         mDataSize = (mDataSize < desired) ? mDataSize : desired;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
         mObjectsSize = mObjectsCapacity = objectsSize;
         mNextObjectHint = 0;
         mObjectsSorted = false;
@@ -2465,7 +2528,8 @@ status_t Parcel::continueWrite(size_t desired)
 
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        uint8_t* data = allocParcelData(desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -2476,15 +2540,15 @@ status_t Parcel::continueWrite(size_t desired)
             ALOGE("continueWrite: %zu/%p/%zu/%zu", mDataCapacity, mObjects, mObjectsCapacity, desired);
         }
 
-        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, desired);
-        gParcelGlobalAllocSize += desired;
+        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, capacity);
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
 
         mData = data;
         mDataSize = mDataPos = 0;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
         ALOGV("continueWrite Setting data pos of %p to %zu", this, mDataPos);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     return NO_ERROR;
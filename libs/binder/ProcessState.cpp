@@ -343,6 +343,10 @@ void ProcessState::spawnPooledThread(bool isMain)
         ALOGV("Spawning new pooled thread, name=%s\n", name.string());
         sp<Thread> t = sp<PoolThread>::make(isMain);
         t->run(name.string());
+
+        pthread_mutex_lock(&mThreadCountLock);
+        mSpawnedThreadsCount++;
+        pthread_mutex_unlock(&mThreadCountLock);
     }
 }
 
@@ -359,6 +363,21 @@ status_t ProcessState::setThreadPoolMaxThreadCount(size_t maxThreads) {
     return result;
 }
 
+ProcessState::ThreadPoolStats ProcessState::getThreadPoolStats() {
+    pthread_mutex_lock(&mThreadCountLock);
+    ThreadPoolStats stats{
+            .maxThreads = mMaxThreads,
+            .spawnedThreads = mSpawnedThreadsCount,
+            .executingThreads = mExecutingThreadsCount,
+            .peakExecutingThreads = mPeakExecutingThreadsCount,
+            .starvationCount = mStarvationCount,
+            .totalStarvationTimeMs = mTotalStarvationTimeMs,
+            .maxStarvationTimeMs = mMaxStarvationTimeMs,
+    };
+    pthread_mutex_unlock(&mThreadCountLock);
+    return stats;
+}
+
 status_t ProcessState::enableOnewaySpamDetection(bool enable) {
     uint32_t enableDetection = enable ? 1 : 0;
     if (ioctl(mDriverFD, BINDER_ENABLE_ONEWAY_SPAM_DETECTION, &enableDetection) == -1) {
@@ -419,6 +438,11 @@ ProcessState::ProcessState(const char *driver)
     , mWaitingForThreads(0)
     , mMaxThreads(DEFAULT_MAX_BINDER_THREADS)
     , mStarvationStartTimeMs(0)
+    , mSpawnedThreadsCount(0)
+    , mPeakExecutingThreadsCount(0)
+    , mStarvationCount(0)
+    , mTotalStarvationTimeMs(0)
+    , mMaxStarvationTimeMs(0)
     , mThreadPoolStarted(false)
     , mThreadPoolSeq(1)
     , mCallRestriction(CallRestriction::NONE)
@@ -18,73 +18,141 @@
 
 #include <binder/Parcel.h>
 
+#include <pthread.h>
+
+#include <functional>
+#include <mutex>
+
 #include "Debug.h"
 #include "RpcState.h"
 #include "RpcWireFormat.h"
 
 namespace android {
 
+static_assert(sizeof(RpcWireAddress) == 32, "RpcAddress::kRawAddrSize must match RpcWireAddress");
+
 RpcAddress RpcAddress::zero() {
     return RpcAddress();
 }
 
 bool RpcAddress::isZero() const {
     RpcWireAddress ZERO{0};
-    return memcmp(mRawAddr.get(), &ZERO, sizeof(RpcWireAddress)) == 0;
+    return memcmp(mRawAddr, &ZERO, sizeof(RpcWireAddress)) == 0;
 }
 
-static void ReadRandomBytes(uint8_t* buf, size_t len) {
+static bool ReadRandomBytes(uint8_t* buf, size_t len) {
     int fd = TEMP_FAILURE_RETRY(open("/dev/urandom", O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
     if (fd == -1) {
         ALOGE("%s: cannot read /dev/urandom", __func__);
-        return;
+        return false;
     }
 
-    size_t n;
-    while ((n = TEMP_FAILURE_RETRY(read(fd, buf, len))) > 0) {
-        len -= n;
+    ssize_t n;
+    while (len > 0 && (n = TEMP_FAILURE_RETRY(read(fd, buf, len))) > 0) {
+        len -= static_cast<size_t>(n);
         buf += n;
     }
     if (len > 0) {
         ALOGW("%s: there are %d bytes skipped", __func__, (int)len);
     }
     close(fd);
+    return len == 0;
 }
 
+// Random bytes read from the kernel in batches, so that making an address
+// does not usually take a syscall.
+class RandomPool {
+public:
+    static RandomPool& get() {
+        // never destroyed, since binders may be sent while static destructors run
+        static RandomPool* pool = [] {
+            RandomPool* pool = new RandomPool;
+            // Otherwise, a forked child would make the same addresses as its
+            // parent. The prepare handler keeps fork() from copying the mutex
+            // while it is held.
+            pthread_atfork([] { get().mMutex.lock(); }, [] { get().mMutex.unlock(); },
+                           [] {
+                               get().discard();
+                               get().mMutex.unlock();
+                           });
+            return pool;
+        }();
+        return *pool;
+    }
+
+    void read(uint8_t* buf, size_t len) {
+        std::lock_guard<std::mutex> _l(mMutex);
+        LOG_ALWAYS_FATAL_IF(len > sizeof(mBytes), "Cannot read %zu random bytes at once", len);
+        if (mUsed + len > sizeof(mBytes)) {
+            LOG_ALWAYS_FATAL_IF(!ReadRandomBytes(mBytes, sizeof(mBytes)),
+                                "Cannot make unguessable RPC addresses");
+            mUsed = 0;
+        }
+        memcpy(buf, mBytes + mUsed, len);
+        mUsed += len;
+    }
+
+private:
+    void discard() {
+        memset(mBytes, 0, sizeof(mBytes));
+        mUsed = sizeof(mBytes);
+    }
+
+    std::mutex mMutex;
+    uint8_t mBytes[128 * sizeof(RpcWireAddress)]; // guarded by mMutex
+    size_t mUsed = sizeof(mBytes);                // guarded by mMutex
+};
+
 RpcAddress RpcAddress::unique() {
+    // Addresses are random throughout, since they are also sent to peers,
+    // which may send binders at any address back to us.
     RpcAddress ret;
-    ReadRandomBytes((uint8_t*)ret.mRawAddr.get(), sizeof(RpcWireAddress));
+    do {
+        RandomPool::get().read(ret.mRawAddr, sizeof(RpcWireAddress));
+    } while (ret.isZero());
     LOG_RPC_DETAIL("Creating new address: %s", ret.toString().c_str());
     return ret;
 }
 
 RpcAddress RpcAddress::fromRawEmbedded(const RpcWireAddress* raw) {
     RpcAddress addr;
-    memcpy(addr.mRawAddr.get(), raw, sizeof(RpcWireAddress));
+    memcpy(addr.mRawAddr, raw, sizeof(RpcWireAddress));
     return addr;
 }
 
 const RpcWireAddress& RpcAddress::viewRawEmbedded() const {
-    return *mRawAddr.get();
+    return *reinterpret_cast<const RpcWireAddress*>(mRawAddr);
 }
 
 bool RpcAddress::operator<(const RpcAddress& rhs) const {
-    return std::memcmp(mRawAddr.get(), rhs.mRawAddr.get(), sizeof(RpcWireAddress)) < 0;
+    return std::memcmp(mRawAddr, rhs.mRawAddr, sizeof(RpcWireAddress)) < 0;
+}
+
+bool RpcAddress::operator==(const RpcAddress& rhs) const {
+    return std::memcmp(mRawAddr, rhs.mRawAddr, sizeof(RpcWireAddress)) == 0;
+}
+
+size_t RpcAddress::Hash::operator()(const RpcAddress& address) const {
+    // Peers may choose addresses which collide, but that only slows down the
+    // node table of their own session.
+    uint64_t words[2];
+    memcpy(words, address.mRawAddr, sizeof(words));
+    return std::hash<uint64_t>()(words[0] ^ words[1]);
 }
 
 std::string RpcAddress::toString() const {
-    return hexString(mRawAddr.get(), sizeof(RpcWireAddress));
+    return hexString(mRawAddr, sizeof(RpcWireAddress));
 }
 
 status_t RpcAddress::writeToParcel(Parcel* parcel) const {
-    return parcel->write(mRawAddr.get(), sizeof(RpcWireAddress));
+    return parcel->write(mRawAddr, sizeof(RpcWireAddress));
 }
 
 status_t RpcAddress::readFromParcel(const Parcel& parcel) {
-    return parcel.read(mRawAddr.get(), sizeof(RpcWireAddress));
+    return parcel.read(mRawAddr, sizeof(RpcWireAddress));
 }
 
 RpcAddress::~RpcAddress() {}
-RpcAddress::RpcAddress() : mRawAddr(std::make_shared<RpcWireAddress>()) {}
+RpcAddress::RpcAddress() : mRawAddr{0} {}
 
 } // namespace android
@@ -19,6 +19,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include <algorithm>
 #include <thread>
 #include <vector>
 
@@ -29,6 +30,7 @@
 #include "RpcState.h"
 
 #include "RpcSocketAddress.h"
+#include "RpcThreadPool.h"
 #include "RpcWireFormat.h"
 
 namespace android {
@@ -36,7 +38,7 @@ namespace android {
 using base::ScopeGuard;
 using base::unique_fd;
 
-RpcServer::RpcServer() {}
+RpcServer::RpcServer() : mThreadPoolCounters(std::make_shared<RpcThreadPoolCounters>()) {}
 RpcServer::~RpcServer() {}
 
 sp<RpcServer> RpcServer::make() {
@@ -107,6 +109,35 @@ size_t RpcServer::getMaxThreads() {
     return mMaxThreads;
 }
 
+void RpcServer::setMinThreads(size_t threads) {
+    LOG_ALWAYS_FATAL_IF(mStarted, "must be called before started");
+    mMinThreads = threads;
+}
+
+size_t RpcServer::getMinThreads() {
+    return mMinThreads;
+}
+
+void RpcServer::setThreadIdleTimeout(std::chrono::nanoseconds timeout) {
+    LOG_ALWAYS_FATAL_IF(mStarted, "must be called before started");
+    mThreadIdleTimeout = timeout;
+}
+
+RpcServer::ThreadPoolStats RpcServer::getThreadPoolStats() {
+    const RpcThreadPoolCounters& counters = *mThreadPoolCounters;
+    return ThreadPoolStats{
+            .threads = counters.threads.load(std::memory_order_relaxed),
+            .idleThreads = counters.idleThreads.load(std::memory_order_relaxed),
+            .peakThreads = counters.peakThreads.load(std::memory_order_relaxed),
+            .threadsStarted = counters.threadsStarted.load(std::memory_order_relaxed),
+            .threadsRetired = counters.threadsRetired.load(std::memory_order_relaxed),
+            .calls = counters.calls.load(std::memory_order_relaxed),
+            .starvedCalls = counters.starvedCalls.load(std::memory_order_relaxed),
+            .totalWaitNs = counters.totalWaitNs.load(std::memory_order_relaxed),
+            .maxWaitNs = counters.maxWaitNs.load(std::memory_order_relaxed),
+    };
+}
+
 void RpcServer::setRootObject(const sp<IBinder>& binder) {
     std::lock_guard<std::mutex> _l(mLock);
     mRootObjectWeak = mRootObject = binder;
@@ -271,6 +302,15 @@ void RpcServer::onSessionTerminating(const sp<RpcSession>& session) {
     (void)mSessions.erase(it);
 }
 
+std::shared_ptr<RpcThreadPool> RpcServer::makeThreadPool() {
+    // a pool for each session, like the connections of sessions which are not
+    // multiplexed, see setMaxThreads
+    return RpcThreadPool::make({.minThreads = std::min(mMinThreads, mMaxThreads),
+                                .maxThreads = mMaxThreads,
+                                .idleTimeout = mThreadIdleTimeout},
+                               mThreadPoolCounters);
+}
+
 bool RpcServer::hasServer() {
     LOG_ALWAYS_FATAL_IF(!mAgreedExperimental, "no!");
     std::lock_guard<std::mutex> _l(mLock);
@@ -21,6 +21,7 @@
 #include <inttypes.h>
 #include <unistd.h>
 
+#include <limits>
 #include <string_view>
 
 #include <binder/Parcel.h>
@@ -28,8 +29,10 @@
 #include <binder/Stability.h>
 #include <utils/String8.h>
 
+#include "RpcSharedMemory.h"
 #include "RpcSocketAddress.h"
 #include "RpcState.h"
+#include "RpcThreadPool.h"
 #include "RpcWireFormat.h"
 
 #ifdef __GLIBC__
@@ -45,6 +48,8 @@ RpcSession::RpcSession() {
 
     mState = std::make_unique<RpcState>();
 }
+RpcSession::RpcConnection::~RpcConnection() {}
+
 RpcSession::~RpcSession() {
     LOG_RPC_DETAIL("RpcSession destroyed %p", this);
 
@@ -57,6 +62,42 @@ sp<RpcSession> RpcSession::make() {
     return sp<RpcSession>::make();
 }
 
+void RpcSession::setMultiplexedConnections(size_t connections) {
+    std::lock_guard<std::mutex> _l(mMutex);
+    LOG_ALWAYS_FATAL_IF(mClientConnections.size() != 0,
+                        "Must set multiplexed connections before setting up the session");
+    mMaxMultiplexedConnections = connections;
+}
+
+void RpcSession::setSharedMemoryTransport(bool enabled) {
+    std::lock_guard<std::mutex> _l(mMutex);
+    LOG_ALWAYS_FATAL_IF(mClientConnections.size() != 0,
+                        "Must set the transport before setting up the session");
+    mUseSharedMemory = enabled;
+}
+
+bool RpcSession::isUsingSharedMemory() {
+    std::lock_guard<std::mutex> _l(mMutex);
+    if (mClientConnections.size() == 0) return false;
+    for (const sp<RpcConnection>& connection : mClientConnections) {
+        if (connection->sharedMemory == nullptr) return false;
+    }
+    return true;
+}
+
+void RpcSession::setCompression(size_t minBytes) {
+    std::lock_guard<std::mutex> _l(mMutex);
+    LOG_ALWAYS_FATAL_IF(mClientConnections.size() != 0,
+                        "Must set compression before setting up the session");
+    LOG_ALWAYS_FATAL_IF(minBytes > std::numeric_limits<uint32_t>::max(),
+                        "Compression threshold %zu too large", minBytes);
+    mCompressionMinBytes = minBytes;
+}
+
+bool RpcSession::isUsingCompression() {
+    return state()->compressionMinBytes() != 0;
+}
+
 bool RpcSession::setupUnixDomainClient(const char* path) {
     return setupSocketClient(UnixSocketAddress(path));
 }
@@ -90,12 +131,14 @@ bool RpcSession::addNullDebuggingClient() {
 
 sp<IBinder> RpcSession::getRootObject() {
     ExclusiveConnection connection(sp<RpcSession>::fromExisting(this), ConnectionUse::CLIENT);
-    return state()->getRootObject(connection.fd(), sp<RpcSession>::fromExisting(this));
+    return state()->getRootObject(connection.get(), connection.callId(),
+                                  sp<RpcSession>::fromExisting(this));
 }
 
 status_t RpcSession::getRemoteMaxThreads(size_t* maxThreads) {
     ExclusiveConnection connection(sp<RpcSession>::fromExisting(this), ConnectionUse::CLIENT);
-    return state()->getMaxThreads(connection.fd(), sp<RpcSession>::fromExisting(this), maxThreads);
+    return state()->getMaxThreads(connection.get(), connection.callId(),
+                                  sp<RpcSession>::fromExisting(this), maxThreads);
 }
 
 status_t RpcSession::transact(const RpcAddress& address, uint32_t code, const Parcel& data,
@@ -103,14 +146,38 @@ status_t RpcSession::transact(const RpcAddress& address, uint32_t code, const Pa
     ExclusiveConnection connection(sp<RpcSession>::fromExisting(this),
                                    (flags & IBinder::FLAG_ONEWAY) ? ConnectionUse::CLIENT_ASYNC
                                                                   : ConnectionUse::CLIENT);
-    return state()->transact(connection.fd(), address, code, data,
+    return state()->transact(connection.get(), connection.callId(), address, code, data,
                              sp<RpcSession>::fromExisting(this), reply, flags);
 }
 
+std::unique_ptr<RpcPendingTransaction> RpcSession::transactAsync(const RpcAddress& address,
+                                                                 uint32_t code,
+                                                                 const Parcel& data,
+                                                                 Parcel* reply, uint32_t flags) {
+    // a thread has at most one call in flight on a connection of its own
+    if (!mMultiplexed || (flags & IBinder::FLAG_ONEWAY)) {
+        return std::unique_ptr<RpcPendingTransaction>(
+                new RpcPendingTransaction(transact(address, code, data, reply, flags)));
+    }
+
+    LOG_ALWAYS_FATAL_IF(reply == nullptr, "Reply parcel must be used for synchronous transaction.");
+
+    auto connection = std::make_unique<ExclusiveConnection>(sp<RpcSession>::fromExisting(this),
+                                                            ConnectionUse::CLIENT_PIPELINED);
+    if (status_t status = state()->sendTransaction(connection->get(), connection->callId(),
+                                                   address, code, data, flags);
+        status != OK) {
+        return std::unique_ptr<RpcPendingTransaction>(new RpcPendingTransaction(status));
+    }
+    return std::unique_ptr<RpcPendingTransaction>(
+            new RpcPendingTransaction(sp<RpcSession>::fromExisting(this), std::move(connection),
+                                      reply));
+}
+
 status_t RpcSession::sendDecStrong(const RpcAddress& address) {
     ExclusiveConnection connection(sp<RpcSession>::fromExisting(this),
                                    ConnectionUse::CLIENT_REFCOUNT);
-    return state()->sendDecStrong(connection.fd(), address);
+    return state()->sendDecStrong(connection.get(), address);
 }
 
 status_t RpcSession::readId() {
@@ -122,8 +189,8 @@ status_t RpcSession::readId() {
     int32_t id;
 
     ExclusiveConnection connection(sp<RpcSession>::fromExisting(this), ConnectionUse::CLIENT);
-    status_t status =
-            state()->getSessionId(connection.fd(), sp<RpcSession>::fromExisting(this), &id);
+    status_t status = state()->getSessionId(connection.get(), connection.callId(),
+                                            sp<RpcSession>::fromExisting(this), &id);
     if (status != OK) return status;
 
     LOG_RPC_DETAIL("RpcSession %p has id %d", this, id);
@@ -131,6 +198,29 @@ status_t RpcSession::readId() {
     return OK;
 }
 
+status_t RpcSession::enableMultiplexing() {
+    {
+        ExclusiveConnection connection(sp<RpcSession>::fromExisting(this), ConnectionUse::CLIENT);
+        status_t status = state()->enableMultiplexing(connection.get(), connection.callId(),
+                                                      sp<RpcSession>::fromExisting(this));
+        if (status != OK) return status;
+    }
+
+    std::lock_guard<std::mutex> _l(mMutex);
+    for (const sp<RpcConnection>& connection : mClientConnections) {
+        connection->multiplexed =
+                std::make_unique<RpcMultiplexedConnection>(false /*dedicatedReader*/);
+    }
+    mMultiplexed = true;
+    return OK;
+}
+
+status_t RpcSession::enableCompression(size_t minBytes) {
+    ExclusiveConnection connection(sp<RpcSession>::fromExisting(this), ConnectionUse::CLIENT);
+    return state()->enableCompression(connection.get(), connection.callId(),
+                                      sp<RpcSession>::fromExisting(this), minBytes);
+}
+
 void RpcSession::preJoin(std::thread thread) {
     LOG_ALWAYS_FATAL_IF(thread.get_id() != std::this_thread::get_id(), "Must own this thread");
 
@@ -147,7 +237,7 @@ void RpcSession::join(unique_fd client) {
 
     while (true) {
         status_t error =
-                state()->getAndExecuteCommand(connection->fd, sp<RpcSession>::fromExisting(this));
+                state()->getAndExecuteCommand(connection, sp<RpcSession>::fromExisting(this));
 
         if (error != OK) {
             ALOGI("Binder connection thread closing w/ status %s", statusToString(error).c_str());
@@ -213,8 +303,36 @@ bool RpcSession::setupSocketClient(const RpcSocketAddress& addr) {
         return false;
     }
 
+    size_t numConnections = numThreadsAvailable;
+    size_t maxMultiplexedConnections;
+    {
+        std::lock_guard<std::mutex> _l(mMutex);
+        maxMultiplexedConnections = mMaxMultiplexedConnections;
+    }
+    if (maxMultiplexedConnections > 0) {
+        if (status_t status = enableMultiplexing(); status == OK) {
+            // the server runs the calls on its threads, whichever connection they come from
+            numConnections = std::min(numThreadsAvailable, maxMultiplexedConnections);
+        } else {
+            ALOGW("Could not multiplex calls to %s, using a connection per call: %s",
+                  addr.toString().c_str(), statusToString(status).c_str());
+        }
+    }
+
+    size_t compressionMinBytes;
+    {
+        std::lock_guard<std::mutex> _l(mMutex);
+        compressionMinBytes = mCompressionMinBytes;
+    }
+    if (compressionMinBytes > 0) {
+        if (status_t status = enableCompression(compressionMinBytes); status != OK) {
+            ALOGW("Could not compress calls to %s, sending them as they are: %s",
+                  addr.toString().c_str(), statusToString(status).c_str());
+        }
+    }
+
     // we've already setup one client
-    for (size_t i = 0; i + 1 < numThreadsAvailable; i++) {
+    for (size_t i = 0; i + 1 < numConnections; i++) {
         // TODO(b/185167543): shutdown existing connections?
         if (!setupOneSocketClient(addr, mId.value())) return false;
     }
@@ -255,7 +373,26 @@ bool RpcSession::setupOneSocketClient(const RpcSocketAddress& addr, int32_t id)
 
         LOG_RPC_DETAIL("Socket at %s client with fd %d", addr.toString().c_str(), serverFd.get());
 
-        addClientConnection(std::move(serverFd));
+        sp<RpcConnection> connection = sp<RpcConnection>::make();
+        connection->fd = std::move(serverFd);
+
+        bool useSharedMemory;
+        {
+            std::lock_guard<std::mutex> _l(mMutex);
+            useSharedMemory = mUseSharedMemory;
+        }
+        // the memory is passed over the socket
+        if (useSharedMemory && addr.addr()->sa_family == AF_UNIX) {
+            if (status_t status = setupSharedMemory(connection); status == DEAD_OBJECT) {
+                ALOGE("Lost connection to %s while sharing memory", addr.toString().c_str());
+                return false;
+            } else if (status != OK) {
+                ALOGW("Could not share memory with %s, using the socket: %s",
+                      addr.toString().c_str(), statusToString(status).c_str());
+            }
+        }
+
+        addClientConnection(connection);
         return true;
     }
 
@@ -263,11 +400,33 @@ bool RpcSession::setupOneSocketClient(const RpcSocketAddress& addr, int32_t id)
     return false;
 }
 
+status_t RpcSession::setupSharedMemory(const sp<RpcConnection>& connection) {
+    std::unique_ptr<RpcSharedMemory> sharedMemory = RpcSharedMemory::make();
+    if (sharedMemory == nullptr) return NO_MEMORY;
+
+    status_t status = state()->shareMemory(connection, sp<RpcSession>::fromExisting(this));
+    if (status != OK) return status;
+
+    // the server now waits for the memory, so the connection is unusable without it
+    if (!sharedMemory->send(connection->fd)) return DEAD_OBJECT;
+
+    connection->sharedMemory = std::move(sharedMemory);
+    return OK;
+}
+
 void RpcSession::addClientConnection(unique_fd fd) {
+    sp<RpcConnection> connection = sp<RpcConnection>::make();
+    connection->fd = std::move(fd);
+    addClientConnection(connection);
+}
+
+void RpcSession::addClientConnection(const sp<RpcConnection>& connection) {
     std::lock_guard<std::mutex> _l(mMutex);
-    sp<RpcConnection> session = sp<RpcConnection>::make();
-    session->fd = std::move(fd);
-    mClientConnections.push_back(session);
+    if (mMultiplexed) {
+        connection->multiplexed =
+                std::make_unique<RpcMultiplexedConnection>(false /*dedicatedReader*/);
+    }
+    mClientConnections.push_back(connection);
 }
 
 void RpcSession::setForServer(const wp<RpcServer>& server, int32_t sessionId) {
@@ -280,6 +439,9 @@ sp<RpcSession::RpcConnection> RpcSession::assignServerToThisThread(unique_fd fd)
     sp<RpcConnection> session = sp<RpcConnection>::make();
     session->fd = std::move(fd);
     session->exclusiveTid = gettid();
+    if (mMultiplexed) {
+        session->multiplexed = std::make_unique<RpcMultiplexedConnection>(true /*dedicatedReader*/);
+    }
     mServerConnections.push_back(session);
 
     return session;
@@ -292,15 +454,55 @@ bool RpcSession::removeServerConnection(const sp<RpcConnection>& connection) {
         mServerConnections.erase(it);
         if (mServerConnections.size() == 0) {
             terminateLocked();
+            if (mThreadPool != nullptr) mThreadPool->shutdown();
         }
         return true;
     }
     return false;
 }
 
+status_t RpcSession::enableMultiplexingForServer(const sp<RpcConnection>& connection) {
+    std::lock_guard<std::mutex> _l(mMutex);
+    if (mMultiplexed) return OK;
+
+    // otherwise, other threads could be using the connections as it changes
+    if (mServerConnections.size() != 1 || mServerConnections[0] != connection) {
+        ALOGE("Can only multiplex calls from the first connection of a session.");
+        return INVALID_OPERATION;
+    }
+
+    sp<RpcServer> server = mForServer.promote();
+    if (server == nullptr) {
+        ALOGE("Cannot multiplex calls once the server is gone.");
+        return DEAD_OBJECT;
+    }
+    mThreadPool = server->makeThreadPool();
+
+    connection->multiplexed = std::make_unique<RpcMultiplexedConnection>(true /*dedicatedReader*/);
+    mMultiplexed = true;
+    return OK;
+}
+
+void RpcSession::dispatchMultiplexedCall(std::function<void()> call) {
+    std::shared_ptr<RpcThreadPool> threadPool;
+    {
+        std::lock_guard<std::mutex> _l(mMutex);
+        threadPool = mThreadPool;
+    }
+    LOG_ALWAYS_FATAL_IF(threadPool == nullptr, "Multiplexed session has no thread pool");
+    threadPool->dispatch(std::move(call));
+}
+
 RpcSession::ExclusiveConnection::ExclusiveConnection(const sp<RpcSession>& session,
                                                      ConnectionUse use)
       : mSession(session) {
+    if (mSession->mMultiplexed) {
+        findMultiplexedConnection(use);
+        return;
+    }
+    LOG_ALWAYS_FATAL_IF(use == ConnectionUse::CLIENT_PIPELINED,
+                        "Only multiplexed sessions can pipeline calls");
+
     pid_t tid = gettid();
     std::unique_lock<std::mutex> _l(mSession->mMutex);
 
@@ -363,6 +565,60 @@ RpcSession::ExclusiveConnection::ExclusiveConnection(const sp<RpcSession>& sessi
     mSession->mWaitingThreads--;
 }
 
+void RpcSession::ExclusiveConnection::findMultiplexedConnection(ConnectionUse use) {
+    mMultiplexed = true;
+
+    // Calls nested in a call which this thread runs go over its connection,
+    // with its ID, and so do dec strongs, so that a server needs no connection
+    // of its own to the client.
+    //
+    // asynchronous calls cannot be nested, and pipelined calls need an ID of
+    // their own, since they are waited for separately
+    if (use != ConnectionUse::CLIENT_ASYNC && use != ConnectionUse::CLIENT_PIPELINED) {
+        if (const ScopedCallContext* context = ScopedCallContext::find(mSession.get())) {
+            mConnection = context->connection();
+            mCallId = use == ConnectionUse::CLIENT ? context->callId() : 0;
+            mReentrant = true;
+            return;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> _l(mSession->mMutex);
+        LOG_ALWAYS_FATAL_IF(mSession->mClientConnections.size() == 0,
+                            "Not a client of any session. You must create a session to an "
+                            "RPC server to make any non-nested (e.g. oneway or on another thread) "
+                            "calls.");
+
+        // spread the calls over the connections, since only one thread reads
+        // from a connection at a time
+        for (const sp<RpcConnection>& connection : mSession->mClientConnections) {
+            if (mConnection == nullptr ||
+                connection->multiplexed->activeCalls < mConnection->multiplexed->activeCalls) {
+                mConnection = connection;
+            }
+        }
+        mConnection->multiplexed->activeCalls++;
+
+        // dec strongs are outside of any call
+        if (use != ConnectionUse::CLIENT_REFCOUNT) mCallId = mSession->mNextCallId++;
+    }
+
+    if (use == ConnectionUse::CLIENT || use == ConnectionUse::CLIENT_PIPELINED) {
+        {
+            // registered before the call is sent, so that its reply finds it
+            std::lock_guard<std::mutex> _l(mConnection->multiplexed->mutex);
+            mConnection->multiplexed->calls.try_emplace(mCallId);
+        }
+        mWaitsForReply = true;
+        // pipelined calls are only in the context of the thread waiting for
+        // them, see RpcPendingTransaction::wait
+        if (use == ConnectionUse::CLIENT) {
+            mCallContext.emplace(mSession.get(), mConnection, mCallId);
+        }
+    }
+}
+
 void RpcSession::ExclusiveConnection::findConnection(pid_t tid, sp<RpcConnection>* exclusive,
                                                      sp<RpcConnection>* available,
                                                      std::vector<sp<RpcConnection>>& sockets,
@@ -391,6 +647,17 @@ void RpcSession::ExclusiveConnection::findConnection(pid_t tid, sp<RpcConnection
 }
 
 RpcSession::ExclusiveConnection::~ExclusiveConnection() {
+    if (mMultiplexed) {
+        if (!mReentrant) {
+            if (mWaitsForReply) {
+                std::lock_guard<std::mutex> _l(mConnection->multiplexed->mutex);
+                mConnection->multiplexed->calls.erase(mCallId);
+            }
+            mConnection->multiplexed->activeCalls--;
+        }
+        return;
+    }
+
     // reentrant use of a session means something less deep in the call stack
     // is using this fd, and it retains the right to it. So, we don't give up
     // exclusive ownership, and no thread is freed.
@@ -404,4 +671,51 @@ RpcSession::ExclusiveConnection::~ExclusiveConnection() {
     }
 }
 
+thread_local const RpcSession::ScopedCallContext* RpcSession::ScopedCallContext::sCurrent =
+        nullptr;
+
+RpcSession::ScopedCallContext::ScopedCallContext(const RpcSession* session,
+                                                 const sp<RpcConnection>& connection,
+                                                 uint64_t callId)
+      : mSession(session), mConnection(connection), mCallId(callId), mPrevious(sCurrent) {
+    sCurrent = this;
+}
+
+RpcSession::ScopedCallContext::~ScopedCallContext() {
+    LOG_ALWAYS_FATAL_IF(sCurrent != this, "Call contexts must be nested");
+    sCurrent = mPrevious;
+}
+
+const RpcSession::ScopedCallContext* RpcSession::ScopedCallContext::find(
+        const RpcSession* session) {
+    for (const ScopedCallContext* context = sCurrent; context != nullptr;
+         context = context->mPrevious) {
+        if (context->mSession == session) return context;
+    }
+    return nullptr;
+}
+
+RpcPendingTransaction::RpcPendingTransaction(status_t status) : mStatus(status) {}
+
+RpcPendingTransaction::RpcPendingTransaction(
+        const sp<RpcSession>& session, std::unique_ptr<RpcSession::ExclusiveConnection> connection,
+        Parcel* reply)
+      : mSession(session), mConnection(std::move(connection)), mReply(reply) {}
+
+RpcPendingTransaction::~RpcPendingTransaction() {
+    (void)wait();
+}
+
+status_t RpcPendingTransaction::wait() {
+    if (mConnection == nullptr) return mStatus;
+
+    // calls the server makes back while running this one belong to it
+    RpcSession::ScopedCallContext context(mSession.get(), mConnection->get(),
+                                          mConnection->callId());
+    mStatus = mSession->state()->waitForReply(mConnection->get(), mConnection->callId(),
+                                              mSession, mReply);
+    mConnection = nullptr;
+    return mStatus;
+}
+
 } // namespace android
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RpcSharedMemory"
+
+#include "RpcSharedMemory.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <log/log.h>
+
+namespace android {
+
+using base::unique_fd;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "atomics are shared across processes");
+
+size_t RpcSharedMemory::memorySize() {
+    return 2 * sizeof(Ring);
+}
+
+std::unique_ptr<RpcSharedMemory> RpcSharedMemory::make() {
+    unique_fd memFd(memfd_create("binder_rpc_shared_memory", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (memFd == -1) {
+        ALOGE("Could not create shared memory: %s", strerror(errno));
+        return nullptr;
+    }
+    if (0 != ftruncate(memFd.get(), static_cast<off_t>(memorySize()))) {
+        ALOGE("Could not size shared memory: %s", strerror(errno));
+        return nullptr;
+    }
+    // the server relies on the memory staying the same size while it is mapped
+    if (0 != fcntl(memFd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+        ALOGE("Could not seal shared memory: %s", strerror(errno));
+        return nullptr;
+    }
+
+    Events events;
+    for (unique_fd& event : events) {
+        // non-blocking, so that neither side can block the other by draining it
+        event.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+        if (event == -1) {
+            ALOGE("Could not create shared memory event: %s", strerror(errno));
+            return nullptr;
+        }
+    }
+
+    return map(std::move(memFd), true /*isClient*/, std::move(events));
+}
+
+bool RpcSharedMemory::send(const unique_fd& socket) {
+    LOG_ALWAYS_FATAL_IF(mMemFd == -1, "Shared memory already sent on fd %d", socket.get());
+
+    int fds[1 + kEventCount];
+    fds[0] = mMemFd.get();
+    for (size_t i = 0; i < kEventCount; i++) fds[1 + i] = mEvents[i].get();
+
+    char byte = 0;
+    iovec iov{.iov_base = &byte, .iov_len = sizeof(byte)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent = TEMP_FAILURE_RETRY(sendmsg(socket.get(), &msg, MSG_NOSIGNAL));
+    if (sent != sizeof(byte)) {
+        ALOGE("Could not send shared memory on fd %d: %s", socket.get(), strerror(errno));
+        return false;
+    }
+    // the mapping and the events are all that is needed from now on
+    mMemFd.reset();
+    return true;
+}
+
+std::unique_ptr<RpcSharedMemory> RpcSharedMemory::receive(const unique_fd& socket) {
+    int fds[1 + kEventCount];
+
+    char byte;
+    iovec iov{.iov_base = &byte, .iov_len = sizeof(byte)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t recd = TEMP_FAILURE_RETRY(recvmsg(socket.get(), &msg, MSG_CMSG_CLOEXEC));
+    if (recd != sizeof(byte)) {
+        ALOGE("Could not receive shared memory on fd %d: %s", socket.get(), strerror(errno));
+        return nullptr;
+    }
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        ALOGE("Expecting shared memory on fd %d, but got no file descriptor", socket.get());
+        return nullptr;
+    }
+    // owned before anything else is checked, so that none of them leak
+    size_t fdCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    std::vector<unique_fd> received;
+    for (size_t i = 0; i < fdCount; i++) {
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+        received.emplace_back(fd);
+    }
+    if ((msg.msg_flags & MSG_CTRUNC) || fdCount != 1 + kEventCount) {
+        ALOGE("Expecting shared memory on fd %d, but got %zu file descriptors", socket.get(),
+              fdCount);
+        return nullptr;
+    }
+
+    unique_fd memFd = std::move(received[0]);
+    // Otherwise, the client could shrink the memory, and we would crash
+    // accessing it.
+    int seals = fcntl(memFd.get(), F_GET_SEALS);
+    if (seals == -1 || (seals & F_SEAL_SHRINK) == 0) {
+        ALOGE("Shared memory on fd %d is not sealed", socket.get());
+        return nullptr;
+    }
+    struct stat st;
+    if (0 != fstat(memFd.get(), &st) || static_cast<size_t>(st.st_size) != memorySize()) {
+        ALOGE("Shared memory on fd %d has the wrong size", socket.get());
+        return nullptr;
+    }
+
+    Events events;
+    for (size_t i = 0; i < kEventCount; i++) {
+        events[i] = std::move(received[1 + i]);
+        // otherwise, the client could block us reading it, or never wake us
+        if (!isEventFd(events[i])) {
+            ALOGE("Shared memory event on fd %d is not a non-blocking eventfd", socket.get());
+            return nullptr;
+        }
+    }
+
+    // the client keeps the memory, so there is no need to hold on to it
+    std::unique_ptr<RpcSharedMemory> sharedMemory =
+            map(std::move(memFd), false /*isClient*/, std::move(events));
+    if (sharedMemory != nullptr) sharedMemory->mMemFd.reset();
+    return sharedMemory;
+}
+
+bool RpcSharedMemory::isEventFd(const unique_fd& fd) {
+    int flags = fcntl(fd.get(), F_GETFL);
+    if (flags == -1 || (flags & O_NONBLOCK) == 0) return false;
+
+    std::string path;
+    if (!base::Readlink("/proc/self/fd/" + std::to_string(fd.get()), &path)) return false;
+    return path == "anon_inode:[eventfd]";
+}
+
+std::unique_ptr<RpcSharedMemory> RpcSharedMemory::map(unique_fd memFd, bool isClient,
+                                                      Events events) {
+    void* memory =
+            mmap(nullptr, memorySize(), PROT_READ | PROT_WRITE, MAP_SHARED, memFd.get(), 0);
+    if (memory == MAP_FAILED) {
+        ALOGE("Could not map shared memory: %s", strerror(errno));
+        return nullptr;
+    }
+    return std::unique_ptr<RpcSharedMemory>(
+            new RpcSharedMemory(memory, isClient, std::move(memFd), std::move(events)));
+}
+
+RpcSharedMemory::RpcSharedMemory(void* memory, bool isClient, unique_fd memFd, Events events)
+      : mMemory(memory), mMemFd(std::move(memFd)), mEvents(std::move(events)) {
+    // the client writes to the first ring, and the server to the second
+    size_t writeIndex = isClient ? 0 : 1;
+    size_t readIndex = isClient ? 1 : 0;
+
+    Ring* rings = static_cast<Ring*>(memory);
+    mWriteRing = &rings[writeIndex];
+    mReadRing = &rings[readIndex];
+
+    mWriteDataEvent = &mEvents[2 * writeIndex];
+    mWriteSpaceEvent = &mEvents[2 * writeIndex + 1];
+    mReadDataEvent = &mEvents[2 * readIndex];
+    mReadSpaceEvent = &mEvents[2 * readIndex + 1];
+}
+
+RpcSharedMemory::~RpcSharedMemory() {
+    // the other side may be waiting on us
+    mWriteRing->closed = 1;
+    signal(*mWriteDataEvent);
+    mReadRing->closed = 1;
+    signal(*mReadSpaceEvent);
+
+    munmap(mMemory, memorySize());
+}
+
+status_t RpcSharedMemory::write(const unique_fd& socket, const void* data, size_t size) {
+    Ring& ring = *mWriteRing;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        if (ring.closed) return DEAD_OBJECT;
+
+        uint32_t head = ring.head.load(std::memory_order_relaxed);
+        uint32_t tail = ring.tail.load(std::memory_order_acquire);
+        uint32_t used = head - tail;
+        if (used > kRingSize) {
+            ALOGE("Shared memory ring on fd %d is corrupt", socket.get());
+            return BAD_VALUE;
+        }
+        if (used == kRingSize) {
+            if (status_t status = wait(socket, ring, ring.tail, tail, ring.producerWaiting,
+                                       *mWriteSpaceEvent);
+                status != OK) {
+                return status;
+            }
+            continue;
+        }
+
+        uint32_t offset = head % kRingSize;
+        size_t chunk = std::min({size, static_cast<size_t>(kRingSize - used),
+                                 static_cast<size_t>(kRingSize - offset)});
+        memcpy(ring.data + offset, bytes, chunk);
+        // sequentially consistent, see wait()
+        ring.head = head + static_cast<uint32_t>(chunk);
+        if (ring.consumerWaiting) signal(*mWriteDataEvent);
+
+        bytes += chunk;
+        size -= chunk;
+    }
+    return OK;
+}
+
+status_t RpcSharedMemory::read(const unique_fd& socket, void* data, size_t size) {
+    Ring& ring = *mReadRing;
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+        uint32_t head = ring.head.load(std::memory_order_acquire);
+        uint32_t used = head - tail;
+        if (used > kRingSize) {
+            ALOGE("Shared memory ring on fd %d is corrupt", socket.get());
+            return BAD_VALUE;
+        }
+        if (used == 0) {
+            // as with sockets, what was written before closing can still be read
+            if (ring.closed) return DEAD_OBJECT;
+            if (status_t status = wait(socket, ring, ring.head, head, ring.consumerWaiting,
+                                       *mReadDataEvent);
+                status != OK) {
+                return status;
+            }
+            continue;
+        }
+
+        uint32_t offset = tail % kRingSize;
+        size_t chunk = std::min({size, static_cast<size_t>(used),
+                                 static_cast<size_t>(kRingSize - offset)});
+        memcpy(bytes, ring.data + offset, chunk);
+        // sequentially consistent, see wait()
+        ring.tail = tail + static_cast<uint32_t>(chunk);
+        if (ring.producerWaiting) signal(*mReadSpaceEvent);
+
+        bytes += chunk;
+        size -= chunk;
+    }
+    return OK;
+}
+
+status_t RpcSharedMemory::wait(const unique_fd& socket, const Ring& ring,
+                               std::atomic<uint32_t>& word, uint32_t value,
+                               std::atomic<uint32_t>& waiting, const unique_fd& event) {
+    // The other side updates 'word' before checking 'waiting', and we set
+    // 'waiting' before checking 'word', so that either it signals 'event', or
+    // we see the update.
+    waiting = 1;
+    status_t status = OK;
+    if (word == value && !ring.closed) {
+        // the socket hangs up when the other process dies
+        pollfd pfds[] = {
+                {.fd = event.get(), .events = POLLIN, .revents = 0},
+                {.fd = socket.get(), .events = POLLRDHUP, .revents = 0},
+        };
+        if (TEMP_FAILURE_RETRY(poll(pfds, 2, -1)) == -1) {
+            ALOGE("Could not wait for shared memory on fd %d: %s", socket.get(), strerror(errno));
+            status = DEAD_OBJECT;
+        } else {
+            if (pfds[0].revents & POLLIN) {
+                // non-blocking, in case the other side drained it from under us
+                eventfd_t count;
+                (void)eventfd_read(event.get(), &count);
+            }
+            // what was written before the other side went away can still be used
+            if ((pfds[1].revents & (POLLRDHUP | POLLHUP | POLLERR)) && word == value) {
+                status = DEAD_OBJECT;
+            }
+        }
+    }
+    waiting = 0;
+    return status;
+}
+
+void RpcSharedMemory::signal(const unique_fd& event) {
+    // only fails once the counter would overflow, in which case it is readable anyway
+    (void)eventfd_write(event.get(), 1);
+}
+
+} // namespace android
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <android-base/unique_fd.h>
+#include <utils/Errors.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+namespace android {
+
+/**
+ * A pair of byte rings in a memfd shared by the two sides of a connection,
+ * which carry the bytes that would otherwise go over its socket, without
+ * copying them through the kernel. A side blocks on an eventfd while its ring
+ * is empty (or full), which the other side signals once it changes the ring,
+ * and on the socket, which hangs up once the other side goes away.
+ *
+ * The client creates the memory and the eventfds, and passes them over the
+ * (Unix domain) socket of the connection, see RPC_SPECIAL_TRANSACT_SHARE_MEMORY.
+ */
+class RpcSharedMemory {
+public:
+    /**
+     * For clients. Creates the memory, to send to the server with send().
+     */
+    static std::unique_ptr<RpcSharedMemory> make();
+
+    /**
+     * For servers. Receives the memory of the client over the socket.
+     */
+    static std::unique_ptr<RpcSharedMemory> receive(const base::unique_fd& socket);
+
+    /**
+     * For clients. Sends the memory made by make() to the server over the socket.
+     */
+    [[nodiscard]] bool send(const base::unique_fd& socket);
+
+    ~RpcSharedMemory();
+
+    /**
+     * Same as a blocking send/recv of the whole data on the socket. Returns
+     * DEAD_OBJECT once the other side is gone.
+     */
+    [[nodiscard]] status_t write(const base::unique_fd& socket, const void* data, size_t size);
+    [[nodiscard]] status_t read(const base::unique_fd& socket, void* data, size_t size);
+
+private:
+    friend class RpcSharedMemoryTest;
+
+    // Large enough for most transactions to be written in one go. Larger ones
+    // are streamed through the ring, as they would be through a socket buffer.
+    static constexpr uint32_t kRingSize = 64 * 1024;
+    static_assert((kRingSize & (kRingSize - 1)) == 0, "positions must wrap around the ring");
+
+    struct Ring {
+        // Positions in the ring, which wrap around. head is only written by
+        // the producer, and tail by the consumer, though as the memory is
+        // shared with the other process, neither side may trust them.
+        alignas(64) std::atomic<uint32_t> head;
+        // whether the consumer waits for head to change
+        std::atomic<uint32_t> consumerWaiting;
+
+        alignas(64) std::atomic<uint32_t> tail;
+        // whether the producer waits for tail to change
+        std::atomic<uint32_t> producerWaiting;
+
+        // set by either side when it goes away
+        alignas(64) std::atomic<uint32_t> closed;
+
+        alignas(64) uint8_t data[kRingSize];
+    };
+
+    // For each ring, an eventfd signaled once data is written to it, and one
+    // signaled once data is read from it. Sent in this order after the memory.
+    static constexpr size_t kEventCount = 4;
+    using Events = std::array<base::unique_fd, kEventCount>;
+
+    RpcSharedMemory(void* memory, bool isClient, base::unique_fd memFd, Events events);
+
+    static size_t memorySize();
+    static std::unique_ptr<RpcSharedMemory> map(base::unique_fd memFd, bool isClient,
+                                                Events events);
+    static bool isEventFd(const base::unique_fd& fd);
+
+    // Waits for 'word' to change from 'value', as signaled by 'event', or for
+    // the other side to go away.
+    static status_t wait(const base::unique_fd& socket, const Ring& ring,
+                         std::atomic<uint32_t>& word, uint32_t value,
+                         std::atomic<uint32_t>& waiting, const base::unique_fd& event);
+    static void signal(const base::unique_fd& event);
+
+    void* mMemory;
+    Ring* mWriteRing;
+    Ring* mReadRing;
+
+    // until it is sent to the server
+    base::unique_fd mMemFd;
+    Events mEvents;
+    // Into mEvents. The data event of a ring is signaled by its producer, and
+    // the space event by its consumer.
+    const base::unique_fd* mWriteDataEvent;
+    const base::unique_fd* mWriteSpaceEvent;
+    const base::unique_fd* mReadDataEvent;
+    const base::unique_fd* mReadSpaceEvent;
+};
+
+} // namespace android
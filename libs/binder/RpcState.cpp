@@ -22,9 +22,11 @@
 #include <binder/RpcServer.h>
 
 #include "Debug.h"
+#include "RpcSharedMemory.h"
 #include "RpcWireFormat.h"
 
 #include <inttypes.h>
+#include <lz4.h>
 
 namespace android {
 
@@ -58,34 +60,41 @@ status_t RpcState::onBinderLeaving(const sp<RpcSession>& session, const sp<IBind
 
     std::lock_guard<std::mutex> _l(mNodeMutex);
 
-    // TODO(b/182939933): maybe move address out of BpBinder, and keep binder->address map
-    // in RpcState
-    for (auto& [addr, node] : mNodeForAddress) {
-        if (binder == node.binder) {
-            if (isRpc) {
-                const RpcAddress& actualAddr =
-                        binder->remoteBinder()->getPrivateAccessorForId().rpcAddress();
-                // TODO(b/182939933): this is only checking integrity of data structure
-                // a different data structure doesn't need this
-                LOG_ALWAYS_FATAL_IF(addr < actualAddr, "Address mismatch");
-                LOG_ALWAYS_FATAL_IF(actualAddr < addr, "Address mismatch");
-            }
-            node.timesSent++;
-            node.sentRef = binder; // might already be set
-            *outAddress = addr;
-            return OK;
-        }
+    // RPC binders carry their address, and the addresses of local binders which were already
+    // sent are indexed by binder.
+    auto it = mNodeForAddress.end();
+    if (isRpc) {
+        it = mNodeForAddress.find(binder->remoteBinder()->getPrivateAccessorForId().rpcAddress());
+        LOG_ALWAYS_FATAL_IF(it == mNodeForAddress.end() || binder != it->second.binder,
+                            "RPC binder must have known address at this point");
+    } else if (auto addrIt = mAddressForBinder.find(binder.get());
+               addrIt != mAddressForBinder.end()) {
+        it = mNodeForAddress.find(addrIt->second);
+        LOG_ALWAYS_FATAL_IF(it == mNodeForAddress.end() || binder != it->second.binder,
+                            "Binder %p indexed at unknown address %s", binder.get(),
+                            addrIt->second.toString().c_str());
     }
-    LOG_ALWAYS_FATAL_IF(isRpc, "RPC binder must have known address at this point");
 
-    auto&& [it, inserted] = mNodeForAddress.insert({RpcAddress::unique(),
-                                                    BinderNode{
-                                                            .binder = binder,
-                                                            .timesSent = 1,
-                                                            .sentRef = binder,
-                                                    }});
-    // TODO(b/182939933): better organization could avoid needing this log
-    LOG_ALWAYS_FATAL_IF(!inserted);
+    if (it != mNodeForAddress.end()) {
+        it->second.timesSent++;
+        it->second.sentRef = binder; // might already be set
+        *outAddress = it->first;
+        return OK;
+    }
+
+    // A peer may already have sent us a binder at the address we make, so
+    // make another one rather than replacing its node.
+    bool inserted = false;
+    while (!inserted) {
+        std::tie(it, inserted) = mNodeForAddress.try_emplace(RpcAddress::unique(),
+                                                             BinderNode{
+                                                                     .binder = binder,
+                                                                     .timesSent = 1,
+                                                                     .sentRef = binder,
+                                                             });
+        if (!inserted) ALOGW("Address %s is already in use", it->first.toString().c_str());
+    }
+    mAddressForBinder.insert_or_assign(binder.get(), it->first);
 
     *outAddress = it->first;
     return OK;
@@ -110,7 +119,7 @@ sp<IBinder> RpcState::onBinderEntering(const sp<RpcSession>& session, const RpcA
         return binder;
     }
 
-    auto&& [it, inserted] = mNodeForAddress.insert({address, BinderNode{}});
+    auto&& [it, inserted] = mNodeForAddress.try_emplace(address);
     LOG_ALWAYS_FATAL_IF(!inserted, "Failed to insert binder when creating proxy");
 
     // Currently, all binders are assumed to be part of the same session (no
@@ -179,9 +188,18 @@ void RpcState::terminate() {
         }
 
         mNodeForAddress.clear();
+        mAddressForBinder.clear();
     }
 }
 
+void RpcState::eraseNodeLocked(NodeMap::iterator it) {
+    if (auto addrIt = mAddressForBinder.find(it->second.binder.unsafe_get());
+        addrIt != mAddressForBinder.end() && addrIt->second == it->first) {
+        mAddressForBinder.erase(addrIt);
+    }
+    mNodeForAddress.erase(it);
+}
+
 RpcState::CommandData::CommandData(size_t size) : mSize(size) {
     // The maximum size for regular binder is 1MB for all concurrent
     // transactions. A very small proportion of transactions are even
@@ -203,7 +221,9 @@ RpcState::CommandData::CommandData(size_t size) : mSize(size) {
     mData.reset(new (std::nothrow) uint8_t[size]);
 }
 
-bool RpcState::rpcSend(const base::unique_fd& fd, const char* what, const void* data, size_t size) {
+bool RpcState::rpcSend(const sp<RpcSession::RpcConnection>& connection, const char* what,
+                       const void* data, size_t size) {
+    const base::unique_fd& fd = connection->fd;
     LOG_RPC_DETAIL("Sending %s on fd %d: %s", what, fd.get(), hexString(data, size).c_str());
 
     if (size > std::numeric_limits<ssize_t>::max()) {
@@ -212,6 +232,16 @@ bool RpcState::rpcSend(const base::unique_fd& fd, const char* what, const void*
         return false;
     }
 
+    if (connection->sharedMemory != nullptr) {
+        if (status_t status = connection->sharedMemory->write(fd, data, size); status != OK) {
+            ALOGE("Failed to send %s through shared memory of fd %d: %s", what, fd.get(),
+                  statusToString(status).c_str());
+            terminate();
+            return false;
+        }
+        return true;
+    }
+
     ssize_t sent = TEMP_FAILURE_RETRY(send(fd.get(), data, size, MSG_NOSIGNAL));
 
     if (sent < 0 || sent != static_cast<ssize_t>(size)) {
@@ -225,13 +255,32 @@ bool RpcState::rpcSend(const base::unique_fd& fd, const char* what, const void*
     return true;
 }
 
-bool RpcState::rpcRec(const base::unique_fd& fd, const char* what, void* data, size_t size) {
+bool RpcState::rpcRec(const sp<RpcSession::RpcConnection>& connection, const char* what,
+                      void* data, size_t size) {
+    const base::unique_fd& fd = connection->fd;
     if (size > std::numeric_limits<ssize_t>::max()) {
         ALOGE("Cannot rec %s at size %zu (too big)", what, size);
         terminate();
         return false;
     }
 
+    if (connection->sharedMemory != nullptr) {
+        if (status_t status = connection->sharedMemory->read(fd, data, size); status != OK) {
+            terminate();
+
+            if (status == DEAD_OBJECT) {
+                LOG_RPC_DETAIL("No more data when trying to read %s on fd %d", what, fd.get());
+                return false;
+            }
+
+            ALOGE("Failed to read %s through shared memory of fd %d: %s", what, fd.get(),
+                  statusToString(status).c_str());
+            return false;
+        }
+        LOG_RPC_DETAIL("Received %s on fd %d: %s", what, fd.get(), hexString(data, size).c_str());
+        return true;
+    }
+
     ssize_t recd = TEMP_FAILURE_RETRY(recv(fd.get(), data, size, MSG_WAITALL | MSG_NOSIGNAL));
 
     if (recd < 0 || recd != static_cast<ssize_t>(size)) {
@@ -252,13 +301,14 @@ bool RpcState::rpcRec(const base::unique_fd& fd, const char* what, void* data, s
     return true;
 }
 
-sp<IBinder> RpcState::getRootObject(const base::unique_fd& fd, const sp<RpcSession>& session) {
+sp<IBinder> RpcState::getRootObject(const sp<RpcSession::RpcConnection>& connection,
+                                    uint64_t callId, const sp<RpcSession>& session) {
     Parcel data;
     data.markForRpc(session);
     Parcel reply;
 
-    status_t status = transact(fd, RpcAddress::zero(), RPC_SPECIAL_TRANSACT_GET_ROOT, data, session,
-                               &reply, 0);
+    status_t status = transact(connection, callId, RpcAddress::zero(),
+                               RPC_SPECIAL_TRANSACT_GET_ROOT, data, session, &reply, 0);
     if (status != OK) {
         ALOGE("Error getting root object: %s", statusToString(status).c_str());
         return nullptr;
@@ -267,14 +317,15 @@ sp<IBinder> RpcState::getRootObject(const base::unique_fd& fd, const sp<RpcSessi
     return reply.readStrongBinder();
 }
 
-status_t RpcState::getMaxThreads(const base::unique_fd& fd, const sp<RpcSession>& session,
+status_t RpcState::getMaxThreads(const sp<RpcSession::RpcConnection>& connection,
+                                 uint64_t callId, const sp<RpcSession>& session,
                                  size_t* maxThreadsOut) {
     Parcel data;
     data.markForRpc(session);
     Parcel reply;
 
-    status_t status = transact(fd, RpcAddress::zero(), RPC_SPECIAL_TRANSACT_GET_MAX_THREADS, data,
-                               session, &reply, 0);
+    status_t status = transact(connection, callId, RpcAddress::zero(),
+                               RPC_SPECIAL_TRANSACT_GET_MAX_THREADS, data, session, &reply, 0);
     if (status != OK) {
         ALOGE("Error getting max threads: %s", statusToString(status).c_str());
         return status;
@@ -292,14 +343,15 @@ status_t RpcState::getMaxThreads(const base::unique_fd& fd, const sp<RpcSession>
     return OK;
 }
 
-status_t RpcState::getSessionId(const base::unique_fd& fd, const sp<RpcSession>& session,
+status_t RpcState::getSessionId(const sp<RpcSession::RpcConnection>& connection,
+                                uint64_t callId, const sp<RpcSession>& session,
                                 int32_t* sessionIdOut) {
     Parcel data;
     data.markForRpc(session);
     Parcel reply;
 
-    status_t status = transact(fd, RpcAddress::zero(), RPC_SPECIAL_TRANSACT_GET_SESSION_ID, data,
-                               session, &reply, 0);
+    status_t status = transact(connection, callId, RpcAddress::zero(),
+                               RPC_SPECIAL_TRANSACT_GET_SESSION_ID, data, session, &reply, 0);
     if (status != OK) {
         ALOGE("Error getting session ID: %s", statusToString(status).c_str());
         return status;
@@ -313,9 +365,70 @@ status_t RpcState::getSessionId(const base::unique_fd& fd, const sp<RpcSession>&
     return OK;
 }
 
-status_t RpcState::transact(const base::unique_fd& fd, const RpcAddress& address, uint32_t code,
-                            const Parcel& data, const sp<RpcSession>& session, Parcel* reply,
-                            uint32_t flags) {
+status_t RpcState::enableMultiplexing(const sp<RpcSession::RpcConnection>& connection,
+                                      uint64_t callId, const sp<RpcSession>& session) {
+    Parcel data;
+    data.markForRpc(session);
+    Parcel reply;
+
+    // servers which do not support it reply UNKNOWN_TRANSACTION
+    return transact(connection, callId, RpcAddress::zero(),
+                    RPC_SPECIAL_TRANSACT_ENABLE_MULTIPLEXING, data, session, &reply, 0);
+}
+
+status_t RpcState::enableCompression(const sp<RpcSession::RpcConnection>& connection,
+                                     uint64_t callId, const sp<RpcSession>& session,
+                                     size_t minBytes) {
+    LOG_ALWAYS_FATAL_IF(minBytes == 0 || minBytes > std::numeric_limits<uint32_t>::max(),
+                        "Invalid compression threshold %zu", minBytes);
+
+    Parcel data;
+    data.markForRpc(session);
+    if (status_t status = data.writeUint32(static_cast<uint32_t>(minBytes)); status != OK) {
+        return status;
+    }
+    Parcel reply;
+
+    // servers which do not support it reply UNKNOWN_TRANSACTION
+    status_t status = transact(connection, callId, RpcAddress::zero(),
+                               RPC_SPECIAL_TRANSACT_ENABLE_COMPRESSION, data, session, &reply, 0);
+    if (status != OK) return status;
+
+    mCompressionMinBytes = static_cast<uint32_t>(minBytes);
+    return OK;
+}
+
+status_t RpcState::shareMemory(const sp<RpcSession::RpcConnection>& connection,
+                               const sp<RpcSession>& session) {
+    Parcel data;
+    data.markForRpc(session);
+    Parcel reply;
+
+    // servers which do not support it reply UNKNOWN_TRANSACTION
+    return transact(connection, 0 /*callId*/, RpcAddress::zero(),
+                    RPC_SPECIAL_TRANSACT_SHARE_MEMORY, data, session, &reply, 0);
+}
+
+status_t RpcState::transact(const sp<RpcSession::RpcConnection>& connection, uint64_t callId,
+                            const RpcAddress& address, uint32_t code, const Parcel& data,
+                            const sp<RpcSession>& session, Parcel* reply, uint32_t flags) {
+    if (status_t status = sendTransaction(connection, callId, address, code, data, flags);
+        status != OK) {
+        return status;
+    }
+
+    if (flags & IBinder::FLAG_ONEWAY) {
+        return OK; // do not wait for result
+    }
+
+    LOG_ALWAYS_FATAL_IF(reply == nullptr, "Reply parcel must be used for synchronous transaction.");
+
+    return waitForReply(connection, callId, session, reply);
+}
+
+status_t RpcState::sendTransaction(const sp<RpcSession::RpcConnection>& connection,
+                                   uint64_t callId, const RpcAddress& address, uint32_t code,
+                                   const Parcel& data, uint32_t flags) {
     uint64_t asyncNumber = 0;
 
     if (!address.isZero()) {
@@ -363,54 +476,221 @@ status_t RpcState::transact(const base::unique_fd& fd, const RpcAddress& address
     RpcWireHeader command{
             .command = RPC_COMMAND_TRANSACT,
             .bodySize = static_cast<uint32_t>(transactionData.size()),
+            .callId = callId,
     };
 
-    if (!rpcSend(fd, "transact header", &command, sizeof(command))) {
+    return sendCommand(connection, "transact", command, transactionData.data());
+}
+
+static void cleanup_reply_data(Parcel* p, const uint8_t* data, size_t dataSize,
+                               const binder_size_t* objects, size_t objectsCount) {
+    (void)p;
+    delete[] const_cast<uint8_t*>(data - offsetof(RpcWireReply, data));
+    (void)dataSize;
+    LOG_ALWAYS_FATAL_IF(objects != nullptr);
+    LOG_ALWAYS_FATAL_IF(objectsCount, 0);
+}
+
+bool RpcState::compressCommand(RpcWireHeader* command, const void* body,
+                               CommandData* compressed) {
+    size_t minBytes = compressionMinBytes();
+    if (minBytes == 0 || command->bodySize < minBytes) return false;
+    if (command->command != RPC_COMMAND_TRANSACT && command->command != RPC_COMMAND_REPLY) {
+        return false;
+    }
+    if (command->bodySize <= sizeof(RpcWireCompressed)) return false;
+
+    // only worth sending if it ends up smaller, which is all the room LZ4 gets
+    *compressed = CommandData(command->bodySize - 1);
+    if (!compressed->valid()) return false;
+
+    int compressedSize =
+            LZ4_compress_default(reinterpret_cast<const char*>(body),
+                                 reinterpret_cast<char*>(compressed->data() +
+                                                         sizeof(RpcWireCompressed)),
+                                 static_cast<int>(command->bodySize),
+                                 static_cast<int>(compressed->size() - sizeof(RpcWireCompressed)));
+    if (compressedSize <= 0) return false;
+
+    RpcWireCompressed header{
+            .command = command->command,
+            .bodySize = command->bodySize,
+    };
+    memcpy(compressed->data(), &header, sizeof(RpcWireCompressed));
+
+    LOG_RPC_DETAIL("Compressed command %u from %u to %zu bytes", command->command,
+                   command->bodySize, sizeof(RpcWireCompressed) + compressedSize);
+    command->command = RPC_COMMAND_COMPRESSED;
+    command->bodySize = static_cast<uint32_t>(sizeof(RpcWireCompressed) + compressedSize);
+    return true;
+}
+
+status_t RpcState::decompressCommand(RpcWireHeader* command, CommandData* body) {
+    if (body->size() < sizeof(RpcWireCompressed)) {
+        ALOGE("Expecting %zu but got %zu bytes for compressed command. Terminating!",
+              sizeof(RpcWireCompressed), body->size());
+        terminate();
+        return BAD_VALUE;
+    }
+    RpcWireCompressed* compressed = reinterpret_cast<RpcWireCompressed*>(body->data());
+    if (compressed->command != RPC_COMMAND_TRANSACT && compressed->command != RPC_COMMAND_REPLY) {
+        ALOGE("Unexpected compressed command %u. Terminating!", compressed->command);
+        terminate();
+        return BAD_VALUE;
+    }
+
+    CommandData decompressed(compressed->bodySize);
+    if (!decompressed.valid()) {
+        return NO_MEMORY;
+    }
+
+    // both are capped by CommandData, far below INT_MAX
+    int decompressedSize =
+            LZ4_decompress_safe(reinterpret_cast<const char*>(compressed->data),
+                                reinterpret_cast<char*>(decompressed.data()),
+                                static_cast<int>(body->size() - sizeof(RpcWireCompressed)),
+                                static_cast<int>(decompressed.size()));
+    if (decompressedSize < 0 || static_cast<size_t>(decompressedSize) != decompressed.size()) {
+        ALOGE("Corrupt compressed command of %zu bytes (expanding to %d of %zu). Terminating!",
+              body->size(), decompressedSize, decompressed.size());
+        terminate();
+        return BAD_VALUE;
+    }
+
+    command->command = compressed->command;
+    command->bodySize = compressed->bodySize;
+    *body = std::move(decompressed);
+    return OK;
+}
+
+status_t RpcState::sendCommand(const sp<RpcSession::RpcConnection>& connection,
+                               const char* what, const RpcWireHeader& command, const void* body) {
+    // compressed before taking the connection, so that other calls may be sent meanwhile
+    RpcWireHeader header = command;
+    CommandData compressed(0);
+    if (compressCommand(&header, body, &compressed)) {
+        body = compressed.data();
+    }
+
+    std::unique_lock<std::mutex> _l;
+    if (connection->multiplexed != nullptr) {
+        _l = std::unique_lock<std::mutex>(connection->multiplexed->writeMutex);
+    }
+
+    if (!rpcSend(connection, what, &header, sizeof(header))) {
         return DEAD_OBJECT;
     }
-    if (!rpcSend(fd, "command body", transactionData.data(), transactionData.size())) {
+    if (!rpcSend(connection, what, body, header.bodySize)) {
         return DEAD_OBJECT;
     }
+    return OK;
+}
 
-    if (flags & IBinder::FLAG_ONEWAY) {
-        return OK; // do not wait for result
+status_t RpcState::readCommand(const sp<RpcSession::RpcConnection>& connection,
+                               RpcWireHeader* command, CommandData* body) {
+    if (!rpcRec(connection, "command header", command, sizeof(*command))) {
+        return DEAD_OBJECT;
     }
 
-    LOG_ALWAYS_FATAL_IF(reply == nullptr, "Reply parcel must be used for synchronous transaction.");
+    *body = CommandData(command->bodySize);
+    if (!body->valid()) {
+        return NO_MEMORY;
+    }
+    if (!rpcRec(connection, "command body", body->data(), body->size())) {
+        return DEAD_OBJECT;
+    }
 
-    return waitForReply(fd, session, reply);
+    // Accepted whether or not this side compresses what it sends, since the
+    // other side only starts compressing once it is negotiated.
+    if (command->command == RPC_COMMAND_COMPRESSED) {
+        return decompressCommand(command, body);
+    }
+    return OK;
 }
 
-static void cleanup_reply_data(Parcel* p, const uint8_t* data, size_t dataSize,
-                               const binder_size_t* objects, size_t objectsCount) {
-    (void)p;
-    delete[] const_cast<uint8_t*>(data - offsetof(RpcWireReply, data));
-    (void)dataSize;
-    LOG_ALWAYS_FATAL_IF(objects != nullptr);
-    LOG_ALWAYS_FATAL_IF(objectsCount, 0);
+bool RpcState::routeMultiplexedCommand(RpcMultiplexedConnection& multiplexed,
+                                       const RpcWireHeader& command, CommandData* body) {
+    if (command.callId == 0) return false;
+
+    auto it = multiplexed.calls.find(command.callId);
+    if (it == multiplexed.calls.end()) return false;
+
+    it->second.push_back(RpcMultiplexedConnection::Message{
+            .command = command,
+            .body = std::move(*body),
+    });
+    multiplexed.cv.notify_all();
+    return true;
 }
 
-status_t RpcState::waitForReply(const base::unique_fd& fd, const sp<RpcSession>& session,
-                                Parcel* reply) {
-    RpcWireHeader command;
+status_t RpcState::readCommandForCall(const sp<RpcSession::RpcConnection>& connection,
+                                      uint64_t callId, const sp<RpcSession>& session,
+                                      RpcWireHeader* command, CommandData* body) {
+    if (connection->multiplexed == nullptr) {
+        return readCommand(connection, command, body);
+    }
+
+    RpcMultiplexedConnection& multiplexed = *connection->multiplexed;
+    std::unique_lock<std::mutex> _l(multiplexed.mutex);
     while (true) {
-        if (!rpcRec(fd, "command header", &command, sizeof(command))) {
-            return DEAD_OBJECT;
+        auto it = multiplexed.calls.find(callId);
+        LOG_ALWAYS_FATAL_IF(it == multiplexed.calls.end(),
+                            "Waiting for call %" PRIu64 " which is not registered", callId);
+        if (!it->second.empty()) {
+            *command = it->second.front().command;
+            *body = std::move(it->second.front().body);
+            it->second.pop_front();
+            return OK;
         }
 
-        if (command.command == RPC_COMMAND_REPLY) break;
+        if (multiplexed.terminated) return DEAD_OBJECT;
+
+        if (multiplexed.dedicatedReader || multiplexed.reading) {
+            multiplexed.cv.wait(_l);
+            continue;
+        }
 
-        status_t status = processServerCommand(fd, session, command);
+        // no other thread is reading, so read the next command ourselves
+        multiplexed.reading = true;
+        _l.unlock();
+        status_t status = readCommand(connection, command, body);
+        _l.lock();
+        multiplexed.reading = false;
+        // another waiting thread may take over reading
+        multiplexed.cv.notify_all();
+
+        if (status != OK) {
+            multiplexed.terminated = true;
+            return status;
+        }
+
+        if (command->callId == callId) return OK;
+        if (routeMultiplexedCommand(multiplexed, *command, body)) continue;
+
+        // Nobody waits for this command (e.g. a dec strong, or a call which
+        // the other side makes while running a oneway call). Process it
+        // without holding up the other calls on this connection.
+        _l.unlock();
+        status = processUnsolicitedCommand(connection, session, *command, std::move(*body));
+        _l.lock();
         if (status != OK) return status;
     }
+}
 
-    CommandData data(command.bodySize);
-    if (!data.valid()) {
-        return NO_MEMORY;
-    }
+status_t RpcState::waitForReply(const sp<RpcSession::RpcConnection>& connection, uint64_t callId,
+                                const sp<RpcSession>& session, Parcel* reply) {
+    RpcWireHeader command;
+    CommandData data(0);
+    while (true) {
+        if (status_t status = readCommandForCall(connection, callId, session, &command, &data);
+            status != OK) {
+            return status;
+        }
 
-    if (!rpcRec(fd, "reply body", data.data(), command.bodySize)) {
-        return DEAD_OBJECT;
+        if (command.command == RPC_COMMAND_REPLY) break;
+
+        status_t status = processCommand(connection, session, command, std::move(data));
+        if (status != OK) return status;
     }
 
     if (command.bodySize < sizeof(RpcWireReply)) {
@@ -431,7 +711,8 @@ status_t RpcState::waitForReply(const base::unique_fd& fd, const sp<RpcSession>&
     return OK;
 }
 
-status_t RpcState::sendDecStrong(const base::unique_fd& fd, const RpcAddress& addr) {
+status_t RpcState::sendDecStrong(const sp<RpcSession::RpcConnection>& connection,
+                                 const RpcAddress& addr) {
     {
         std::lock_guard<std::mutex> _l(mNodeMutex);
         if (mTerminated) return DEAD_OBJECT; // avoid fatal only, otherwise races
@@ -443,7 +724,7 @@ status_t RpcState::sendDecStrong(const base::unique_fd& fd, const RpcAddress& ad
 
         it->second.timesRecd--;
         if (it->second.timesRecd == 0 && it->second.timesSent == 0) {
-            mNodeForAddress.erase(it);
+            eraseNodeLocked(it);
         }
     }
 
@@ -451,30 +732,114 @@ status_t RpcState::sendDecStrong(const base::unique_fd& fd, const RpcAddress& ad
             .command = RPC_COMMAND_DEC_STRONG,
             .bodySize = sizeof(RpcWireAddress),
     };
-    if (!rpcSend(fd, "dec ref header", &cmd, sizeof(cmd))) return DEAD_OBJECT;
-    if (!rpcSend(fd, "dec ref body", &addr.viewRawEmbedded(), sizeof(RpcWireAddress)))
-        return DEAD_OBJECT;
-    return OK;
+    return sendCommand(connection, "dec ref", cmd, &addr.viewRawEmbedded());
+}
+
+static bool isSpecialTransaction(RpcState::CommandData& body) {
+    if (body.size() < sizeof(RpcWireTransaction)) return false;
+    const RpcWireTransaction* transaction =
+            reinterpret_cast<const RpcWireTransaction*>(body.data());
+    return RpcAddress::fromRawEmbedded(&transaction->address).isZero();
 }
 
-status_t RpcState::getAndExecuteCommand(const base::unique_fd& fd, const sp<RpcSession>& session) {
-    LOG_RPC_DETAIL("getAndExecuteCommand on fd %d", fd.get());
+status_t RpcState::getAndExecuteCommand(const sp<RpcSession::RpcConnection>& connection,
+                                        const sp<RpcSession>& session) {
+    LOG_RPC_DETAIL("getAndExecuteCommand on fd %d", connection->fd.get());
 
     RpcWireHeader command;
-    if (!rpcRec(fd, "command header", &command, sizeof(command))) {
-        return DEAD_OBJECT;
+    CommandData body(0);
+    status_t status = readCommand(connection, &command, &body);
+
+    if (connection->multiplexed == nullptr) {
+        if (status != OK) return status;
+        return processCommand(connection, session, command, std::move(body));
+    }
+
+    RpcMultiplexedConnection& multiplexed = *connection->multiplexed;
+    auto terminateCalls = [&]() {
+        // calls waiting for commands on this connection will not get them
+        std::lock_guard<std::mutex> _l(multiplexed.mutex);
+        multiplexed.terminated = true;
+        multiplexed.cv.notify_all();
+    };
+    if (status != OK) {
+        terminateCalls();
+        return status;
     }
 
-    return processServerCommand(fd, session, command);
+    {
+        std::lock_guard<std::mutex> _l(multiplexed.mutex);
+        if (routeMultiplexedCommand(multiplexed, command, &body)) return OK;
+    }
+
+    // Special transactions are answered right away, since setting up the
+    // connection relies on them being run by the thread reading from it.
+    if (command.command != RPC_COMMAND_TRANSACT || isSpecialTransaction(body)) {
+        status = processCommand(connection, session, command, std::move(body));
+        if (status != OK) terminateCalls();
+        return status;
+    }
+
+    if (command.callId != 0) {
+        // registered before it runs, so that the commands of its nested calls
+        // are handed over to it
+        std::lock_guard<std::mutex> _l(multiplexed.mutex);
+        multiplexed.calls.try_emplace(command.callId);
+    }
+
+    // std::function must be copyable
+    auto sharedBody = std::make_shared<CommandData>(std::move(body));
+    session->dispatchMultiplexedCall([connection, session, command, sharedBody]() {
+        RpcSession::ScopedCallContext context(session.get(), connection, command.callId);
+        status_t status = session->state()->processTransactInternal(connection, command.callId,
+                                                                    session,
+                                                                    std::move(*sharedBody));
+        if (status != OK) {
+            LOG_RPC_DETAIL("Multiplexed call %" PRIu64 " failed: %s", command.callId,
+                           statusToString(status).c_str());
+        }
+
+        if (command.callId != 0) {
+            std::lock_guard<std::mutex> _l(connection->multiplexed->mutex);
+            connection->multiplexed->calls.erase(command.callId);
+        }
+    });
+    return OK;
+}
+
+status_t RpcState::processUnsolicitedCommand(const sp<RpcSession::RpcConnection>& connection,
+                                             const sp<RpcSession>& session,
+                                             const RpcWireHeader& command, CommandData body) {
+    if (command.command != RPC_COMMAND_TRANSACT || command.callId == 0) {
+        return processCommand(connection, session, command, std::move(body));
+    }
+
+    // a new call from the other side, whose nested calls belong to it
+    RpcMultiplexedConnection& multiplexed = *connection->multiplexed;
+    {
+        std::lock_guard<std::mutex> _l(multiplexed.mutex);
+        multiplexed.calls.try_emplace(command.callId);
+    }
+    status_t status;
+    {
+        RpcSession::ScopedCallContext context(session.get(), connection, command.callId);
+        status = processCommand(connection, session, command, std::move(body));
+    }
+    {
+        std::lock_guard<std::mutex> _l(multiplexed.mutex);
+        multiplexed.calls.erase(command.callId);
+    }
+    return status;
 }
 
-status_t RpcState::processServerCommand(const base::unique_fd& fd, const sp<RpcSession>& session,
-                                        const RpcWireHeader& command) {
+status_t RpcState::processCommand(const sp<RpcSession::RpcConnection>& connection,
+                                  const sp<RpcSession>& session, const RpcWireHeader& command,
+                                  CommandData body) {
     switch (command.command) {
         case RPC_COMMAND_TRANSACT:
-            return processTransact(fd, session, command);
+            return processTransactInternal(connection, command.callId, session, std::move(body));
         case RPC_COMMAND_DEC_STRONG:
-            return processDecStrong(fd, command);
+            return processDecStrong(command, std::move(body));
     }
 
     // We should always know the version of the opposing side, and since the
@@ -486,20 +851,6 @@ status_t RpcState::processServerCommand(const base::unique_fd& fd, const sp<RpcS
     terminate();
     return DEAD_OBJECT;
 }
-status_t RpcState::processTransact(const base::unique_fd& fd, const sp<RpcSession>& session,
-                                   const RpcWireHeader& command) {
-    LOG_ALWAYS_FATAL_IF(command.command != RPC_COMMAND_TRANSACT, "command: %d", command.command);
-
-    CommandData transactionData(command.bodySize);
-    if (!transactionData.valid()) {
-        return NO_MEMORY;
-    }
-    if (!rpcRec(fd, "transaction body", transactionData.data(), transactionData.size())) {
-        return DEAD_OBJECT;
-    }
-
-    return processTransactInternal(fd, session, std::move(transactionData));
-}
 
 static void do_nothing_to_transact_data(Parcel* p, const uint8_t* data, size_t dataSize,
                                         const binder_size_t* objects, size_t objectsCount) {
@@ -510,7 +861,8 @@ static void do_nothing_to_transact_data(Parcel* p, const uint8_t* data, size_t d
     (void)objectsCount;
 }
 
-status_t RpcState::processTransactInternal(const base::unique_fd& fd, const sp<RpcSession>& session,
+status_t RpcState::processTransactInternal(const sp<RpcSession::RpcConnection>& connection,
+                                           uint64_t callId, const sp<RpcSession>& session,
                                            CommandData transactionData) {
     if (transactionData.size() < sizeof(RpcWireTransaction)) {
         ALOGE("Expecting %zu but got %zu bytes for RpcWireTransaction. Terminating!",
@@ -520,11 +872,10 @@ status_t RpcState::processTransactInternal(const base::unique_fd& fd, const sp<R
     }
     RpcWireTransaction* transaction = reinterpret_cast<RpcWireTransaction*>(transactionData.data());
 
-    // TODO(b/182939933): heap allocation just for lookup in mNodeForAddress,
-    // maybe add an RpcAddress 'view' if the type remains 'heavy'
     auto addr = RpcAddress::fromRawEmbedded(&transaction->address);
 
     status_t replyStatus = OK;
+    bool waitsForSharedMemory = false;
     sp<IBinder> target;
     if (!addr.isZero()) {
         std::lock_guard<std::mutex> _l(mNodeMutex);
@@ -611,6 +962,26 @@ status_t RpcState::processTransactInternal(const base::unique_fd& fd, const sp<R
                         replyStatus = reply.writeInt32(id);
                         break;
                     }
+                    case RPC_SPECIAL_TRANSACT_ENABLE_MULTIPLEXING: {
+                        replyStatus = session->enableMultiplexingForServer(connection);
+                        break;
+                    }
+                    case RPC_SPECIAL_TRANSACT_ENABLE_COMPRESSION: {
+                        uint32_t minBytes;
+                        replyStatus = data.readUint32(&minBytes);
+                        if (replyStatus == OK && minBytes == 0) replyStatus = BAD_VALUE;
+                        if (replyStatus == OK) mCompressionMinBytes = minBytes;
+                        break;
+                    }
+                    case RPC_SPECIAL_TRANSACT_SHARE_MEMORY: {
+                        // the client sends the memory once this is replied to
+                        if (connection->sharedMemory == nullptr) {
+                            waitsForSharedMemory = true;
+                        } else {
+                            replyStatus = INVALID_OPERATION;
+                        }
+                        break;
+                    }
                     default: {
                         replyStatus = UNKNOWN_TRANSACTION;
                     }
@@ -665,7 +1036,7 @@ status_t RpcState::processTransactInternal(const base::unique_fd& fd, const sp<R
                         const_cast<BinderNode::AsyncTodo&>(it->second.asyncTodo.top()).data);
                 it->second.asyncTodo.pop();
                 _l.unlock();
-                return processTransactInternal(fd, session, std::move(data));
+                return processTransactInternal(connection, callId, session, std::move(data));
             }
         }
         return OK;
@@ -691,28 +1062,36 @@ status_t RpcState::processTransactInternal(const base::unique_fd& fd, const sp<R
     RpcWireHeader cmdReply{
             .command = RPC_COMMAND_REPLY,
             .bodySize = static_cast<uint32_t>(replyData.size()),
+            .callId = callId,
     };
 
-    if (!rpcSend(fd, "reply header", &cmdReply, sizeof(RpcWireHeader))) {
-        return DEAD_OBJECT;
+    if (status_t status = sendCommand(connection, "reply", cmdReply, replyData.data());
+        status != OK || !waitsForSharedMemory) {
+        return status;
     }
-    if (!rpcSend(fd, "reply body", replyData.data(), replyData.size())) {
+    return receiveSharedMemory(connection);
+}
+
+status_t RpcState::receiveSharedMemory(const sp<RpcSession::RpcConnection>& connection) {
+    std::unique_ptr<RpcSharedMemory> sharedMemory = RpcSharedMemory::receive(connection->fd);
+    if (sharedMemory == nullptr) {
+        ALOGE("Client did not share memory on fd %d. Terminating!", connection->fd.get());
+        terminate();
         return DEAD_OBJECT;
     }
+
+    // on multiplexed connections, other threads may be sending
+    std::unique_lock<std::mutex> _l;
+    if (connection->multiplexed != nullptr) {
+        _l = std::unique_lock<std::mutex>(connection->multiplexed->writeMutex);
+    }
+    connection->sharedMemory = std::move(sharedMemory);
     return OK;
 }
 
-status_t RpcState::processDecStrong(const base::unique_fd& fd, const RpcWireHeader& command) {
+status_t RpcState::processDecStrong(const RpcWireHeader& command, CommandData commandData) {
     LOG_ALWAYS_FATAL_IF(command.command != RPC_COMMAND_DEC_STRONG, "command: %d", command.command);
 
-    CommandData commandData(command.bodySize);
-    if (!commandData.valid()) {
-        return NO_MEMORY;
-    }
-    if (!rpcRec(fd, "dec ref body", commandData.data(), commandData.size())) {
-        return DEAD_OBJECT;
-    }
-
     if (command.bodySize < sizeof(RpcWireAddress)) {
         ALOGE("Expecting %zu but got %" PRId32 " bytes for RpcWireAddress. Terminating!",
               sizeof(RpcWireAddress), command.bodySize);
@@ -721,7 +1100,6 @@ status_t RpcState::processDecStrong(const base::unique_fd& fd, const RpcWireHead
     }
     RpcWireAddress* address = reinterpret_cast<RpcWireAddress*>(commandData.data());
 
-    // TODO(b/182939933): heap allocation just for lookup
     auto addr = RpcAddress::fromRawEmbedded(address);
     std::unique_lock<std::mutex> _l(mNodeMutex);
     auto it = mNodeForAddress.find(addr);
@@ -754,7 +1132,7 @@ status_t RpcState::processDecStrong(const base::unique_fd& fd, const RpcWireHead
         it->second.sentRef = nullptr;
 
         if (it->second.timesRecd == 0) {
-            mNodeForAddress.erase(it);
+            eraseNodeLocked(it);
         }
     }
 
@@ -20,13 +20,18 @@
 #include <binder/Parcel.h>
 #include <binder/RpcSession.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <queue>
+#include <unordered_map>
 
-namespace android {
+#include "RpcWireFormat.h"
 
-struct RpcWireHeader;
+namespace android {
 
 /**
  * Log a lot more information about RPC calls, when debugging issues. Usually,
@@ -51,20 +56,66 @@ public:
     RpcState();
     ~RpcState();
 
+    // Calls are sent with 'callId', which only matters on multiplexed
+    // connections, see RpcWireHeader::callId.
+
     // TODO(b/182940634): combine some special transactions into one "getServerInfo" call?
-    sp<IBinder> getRootObject(const base::unique_fd& fd, const sp<RpcSession>& session);
-    status_t getMaxThreads(const base::unique_fd& fd, const sp<RpcSession>& session,
-                           size_t* maxThreadsOut);
-    status_t getSessionId(const base::unique_fd& fd, const sp<RpcSession>& session,
-                          int32_t* sessionIdOut);
-
-    [[nodiscard]] status_t transact(const base::unique_fd& fd, const RpcAddress& address,
-                                    uint32_t code, const Parcel& data,
-                                    const sp<RpcSession>& session, Parcel* reply, uint32_t flags);
-    [[nodiscard]] status_t sendDecStrong(const base::unique_fd& fd, const RpcAddress& address);
-    [[nodiscard]] status_t getAndExecuteCommand(const base::unique_fd& fd,
+    sp<IBinder> getRootObject(const sp<RpcSession::RpcConnection>& connection, uint64_t callId,
+                              const sp<RpcSession>& session);
+    status_t getMaxThreads(const sp<RpcSession::RpcConnection>& connection, uint64_t callId,
+                           const sp<RpcSession>& session, size_t* maxThreadsOut);
+    status_t getSessionId(const sp<RpcSession::RpcConnection>& connection, uint64_t callId,
+                          const sp<RpcSession>& session, int32_t* sessionIdOut);
+    status_t enableMultiplexing(const sp<RpcSession::RpcConnection>& connection, uint64_t callId,
+                                const sp<RpcSession>& session);
+    // see RPC_SPECIAL_TRANSACT_ENABLE_COMPRESSION
+    status_t enableCompression(const sp<RpcSession::RpcConnection>& connection, uint64_t callId,
+                               const sp<RpcSession>& session, size_t minBytes);
+    // The size from which transactions and replies are compressed, or zero if they are not.
+    size_t compressionMinBytes() const {
+        return mCompressionMinBytes.load(std::memory_order_relaxed);
+    }
+    // first command on a connection, see RPC_SPECIAL_TRANSACT_SHARE_MEMORY
+    status_t shareMemory(const sp<RpcSession::RpcConnection>& connection,
+                         const sp<RpcSession>& session);
+
+    [[nodiscard]] status_t transact(const sp<RpcSession::RpcConnection>& connection,
+                                    uint64_t callId, const RpcAddress& address, uint32_t code,
+                                    const Parcel& data, const sp<RpcSession>& session,
+                                    Parcel* reply, uint32_t flags);
+    // The two halves of a synchronous transact, for transactions whose reply is waited for
+    // later, see RpcSession::transactAsync.
+    [[nodiscard]] status_t sendTransaction(const sp<RpcSession::RpcConnection>& connection,
+                                           uint64_t callId, const RpcAddress& address,
+                                           uint32_t code, const Parcel& data, uint32_t flags);
+    [[nodiscard]] status_t waitForReply(const sp<RpcSession::RpcConnection>& connection,
+                                        uint64_t callId, const sp<RpcSession>& session,
+                                        Parcel* reply);
+
+    [[nodiscard]] status_t sendDecStrong(const sp<RpcSession::RpcConnection>& connection,
+                                         const RpcAddress& address);
+    /**
+     * Reads the next command on a server connection and executes it. On
+     * multiplexed connections, it is instead handed over to the call it belongs
+     * to, or a new call is dispatched to a thread of the session.
+     */
+    [[nodiscard]] status_t getAndExecuteCommand(const sp<RpcSession::RpcConnection>& connection,
                                                 const sp<RpcSession>& session);
 
+    // Alternative to std::vector<uint8_t> that doesn't abort on allocation failure and caps
+    // large allocations to avoid being requested from allocating too much data.
+    struct CommandData {
+        explicit CommandData(size_t size);
+        bool valid() { return mSize == 0 || mData != nullptr; }
+        size_t size() { return mSize; }
+        uint8_t* data() { return mData.get(); }
+        uint8_t* release() { return mData.release(); }
+
+    private:
+        std::unique_ptr<uint8_t[]> mData;
+        size_t mSize;
+    };
+
     /**
      * Called by Parcel for outgoing binders. This implies one refcount of
      * ownership to the outgoing binder.
@@ -101,36 +152,44 @@ private:
      */
     void terminate();
 
-    // Alternative to std::vector<uint8_t> that doesn't abort on allocation failure and caps
-    // large allocations to avoid being requested from allocating too much data.
-    struct CommandData {
-        explicit CommandData(size_t size);
-        bool valid() { return mSize == 0 || mData != nullptr; }
-        size_t size() { return mSize; }
-        uint8_t* data() { return mData.get(); }
-        uint8_t* release() { return mData.release(); }
-
-    private:
-        std::unique_ptr<uint8_t[]> mData;
-        size_t mSize;
-    };
+    [[nodiscard]] bool rpcSend(const sp<RpcSession::RpcConnection>& connection, const char* what,
+                               const void* data, size_t size);
+    [[nodiscard]] bool rpcRec(const sp<RpcSession::RpcConnection>& connection, const char* what,
+                              void* data, size_t size);
 
-    [[nodiscard]] bool rpcSend(const base::unique_fd& fd, const char* what, const void* data,
-                               size_t size);
-    [[nodiscard]] bool rpcRec(const base::unique_fd& fd, const char* what, void* data, size_t size);
+    // Sends a command, without interleaving it with the commands other threads send on a
+    // multiplexed connection.
+    [[nodiscard]] status_t sendCommand(const sp<RpcSession::RpcConnection>& connection,
+                                       const char* what, const RpcWireHeader& command,
+                                       const void* body);
+    // Compresses the body of a transaction or reply into 'compressed', if it is large enough
+    // and compression pays off, and makes 'command' an RPC_COMMAND_COMPRESSED.
+    bool compressCommand(RpcWireHeader* command, const void* body, CommandData* compressed);
+    // Turns an RPC_COMMAND_COMPRESSED back into the command it carries.
+    [[nodiscard]] status_t decompressCommand(RpcWireHeader* command, CommandData* body);
+    // Reads the next command on the connection, whichever call it belongs to.
+    [[nodiscard]] status_t readCommand(const sp<RpcSession::RpcConnection>& connection,
+                                       RpcWireHeader* command, CommandData* body);
+    // Reads the next command of the call, reading the commands of other calls on the way on a
+    // multiplexed connection.
+    [[nodiscard]] status_t readCommandForCall(const sp<RpcSession::RpcConnection>& connection,
+                                              uint64_t callId, const sp<RpcSession>& session,
+                                              RpcWireHeader* command, CommandData* body);
+    // Hands a command over to the call it belongs to, if that call waits for it.
+    bool routeMultiplexedCommand(RpcMultiplexedConnection& multiplexed,
+                                 const RpcWireHeader& command, CommandData* body);
 
-    [[nodiscard]] status_t waitForReply(const base::unique_fd& fd, const sp<RpcSession>& session,
-                                        Parcel* reply);
-    [[nodiscard]] status_t processServerCommand(const base::unique_fd& fd,
-                                                const sp<RpcSession>& session,
-                                                const RpcWireHeader& command);
-    [[nodiscard]] status_t processTransact(const base::unique_fd& fd, const sp<RpcSession>& session,
-                                           const RpcWireHeader& command);
-    [[nodiscard]] status_t processTransactInternal(const base::unique_fd& fd,
-                                                   const sp<RpcSession>& session,
+    [[nodiscard]] status_t processCommand(const sp<RpcSession::RpcConnection>& connection,
+                                          const sp<RpcSession>& session,
+                                          const RpcWireHeader& command, CommandData body);
+    [[nodiscard]] status_t processUnsolicitedCommand(
+            const sp<RpcSession::RpcConnection>& connection, const sp<RpcSession>& session,
+            const RpcWireHeader& command, CommandData body);
+    [[nodiscard]] status_t processTransactInternal(const sp<RpcSession::RpcConnection>& connection,
+                                                   uint64_t callId, const sp<RpcSession>& session,
                                                    CommandData transactionData);
-    [[nodiscard]] status_t processDecStrong(const base::unique_fd& fd,
-                                            const RpcWireHeader& command);
+    [[nodiscard]] status_t processDecStrong(const RpcWireHeader& command, CommandData body);
+    [[nodiscard]] status_t receiveSharedMemory(const sp<RpcSession::RpcConnection>& connection);
 
     struct BinderNode {
         // Two cases:
@@ -179,10 +238,56 @@ private:
         // (no additional data specific to remote binders)
     };
 
+    using NodeMap = std::unordered_map<RpcAddress, BinderNode, RpcAddress::Hash>;
+
+    // Removes the node, along with the index of its binder.
+    void eraseNodeLocked(NodeMap::iterator it);
+
+    // set once, when compression is negotiated
+    std::atomic<uint32_t> mCompressionMinBytes = 0;
+
     std::mutex mNodeMutex;
     bool mTerminated = false;
     // binders known by both sides of a session
-    std::map<RpcAddress, BinderNode> mNodeForAddress;
+    NodeMap mNodeForAddress;
+    // addresses of the local binders which were sent, since the address of a binder proxy
+    // is kept in the proxy itself
+    std::unordered_map<IBinder*, RpcAddress> mAddressForBinder;
+};
+
+/**
+ * State of a multiplexed connection, on which the commands of many calls
+ * interleave, see RpcSession::setMultiplexedConnections.
+ */
+struct RpcMultiplexedConnection {
+    explicit RpcMultiplexedConnection(bool dedicatedReader) : dedicatedReader(dedicatedReader) {}
+
+    struct Message {
+        RpcWireHeader command;
+        RpcState::CommandData body;
+    };
+
+    // On servers, the thread joined on the connection reads all commands, and
+    // hands them over to the threads running the calls they belong to. On
+    // clients, whichever thread waits for a command reads the next one, and
+    // hands it over if it belongs to another call.
+    const bool dedicatedReader;
+
+    // held while sending a command
+    std::mutex writeMutex;
+
+    // number of calls using the connection, to spread calls over connections
+    std::atomic<size_t> activeCalls = 0;
+
+    std::mutex mutex; // for all below
+
+    std::condition_variable cv;
+    // whether a thread is reading from the connection
+    bool reading = false;
+    bool terminated = false;
+    // calls waiting for commands on this connection, with the commands read
+    // for them
+    std::map<uint64_t, std::deque<Message>> calls;
 };
 
 } // namespace android
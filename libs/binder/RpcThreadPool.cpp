@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RpcThreadPool"
+
+#include "RpcThreadPool.h"
+
+#include <thread>
+
+#include <log/log.h>
+
+#include "RpcState.h"
+
+namespace android {
+
+template <typename T>
+static void updateMax(std::atomic<T>& max, T value) {
+    T current = max.load(std::memory_order_relaxed);
+    while (value > current &&
+           !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+std::shared_ptr<RpcThreadPool> RpcThreadPool::make(
+        const Policy& policy, std::shared_ptr<RpcThreadPoolCounters> counters) {
+    LOG_ALWAYS_FATAL_IF(policy.maxThreads == 0, "RpcThreadPool is useless without threads");
+    LOG_ALWAYS_FATAL_IF(policy.minThreads > policy.maxThreads,
+                        "RpcThreadPool min threads %zu > max threads %zu", policy.minThreads,
+                        policy.maxThreads);
+
+    auto pool = std::make_shared<RpcThreadPool>(policy, std::move(counters));
+    std::lock_guard<std::mutex> _l(pool->mMutex);
+    for (size_t i = 0; i < policy.minThreads; i++) {
+        pool->startThreadLocked();
+    }
+    return pool;
+}
+
+RpcThreadPool::RpcThreadPool(const Policy& policy, std::shared_ptr<RpcThreadPoolCounters> counters)
+      : mPolicy(policy), mCounters(std::move(counters)) {}
+
+void RpcThreadPool::dispatch(std::function<void()> call) {
+    std::lock_guard<std::mutex> _l(mMutex);
+    mCalls.push_back({.call = std::move(call), .queuedAt = systemTime(SYSTEM_TIME_MONOTONIC)});
+    mCounters->calls.fetch_add(1, std::memory_order_relaxed);
+
+    // Idle threads only stop counting as idle once they have woken up, so
+    // there is only a thread to spare for this call if there are more of them
+    // than calls waiting.
+    if (mIdleThreads > 0) mCallCv.notify_one();
+    if (mIdleThreads >= mCalls.size()) return;
+
+    if (mThreads < mPolicy.maxThreads) {
+        startThreadLocked();
+    } else {
+        // the call waits for one of the threads to be done
+        mCounters->starvedCalls.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RpcThreadPool::shutdown() {
+    std::lock_guard<std::mutex> _l(mMutex);
+    mShutdown = true;
+    mCallCv.notify_all();
+}
+
+void RpcThreadPool::startThreadLocked() {
+    mThreads++;
+    size_t threads = mCounters->threads.fetch_add(1, std::memory_order_relaxed) + 1;
+    updateMax(mCounters->peakThreads, threads);
+    mCounters->threadsStarted.fetch_add(1, std::memory_order_relaxed);
+    LOG_RPC_DETAIL("RpcThreadPool %p starting thread %zu", this, mThreads);
+
+    std::thread(&RpcThreadPool::run, shared_from_this()).detach();
+}
+
+void RpcThreadPool::run() {
+    std::unique_lock<std::mutex> _l(mMutex);
+    while (true) {
+        if (!mCalls.empty()) {
+            QueuedCall queued = std::move(mCalls.front());
+            mCalls.pop_front();
+            _l.unlock();
+
+            uint64_t waitNs =
+                    static_cast<uint64_t>(systemTime(SYSTEM_TIME_MONOTONIC) - queued.queuedAt);
+            mCounters->totalWaitNs.fetch_add(waitNs, std::memory_order_relaxed);
+            updateMax(mCounters->maxWaitNs, waitNs);
+
+            queued.call();
+            queued.call = nullptr;
+            _l.lock();
+            continue;
+        }
+
+        if (mShutdown) break;
+
+        mIdleThreads++;
+        mCounters->idleThreads.fetch_add(1, std::memory_order_relaxed);
+        bool timedOut = false;
+        if (mPolicy.idleTimeout == std::chrono::nanoseconds::max()) {
+            mCallCv.wait(_l);
+        } else {
+            timedOut = mCallCv.wait_for(_l, mPolicy.idleTimeout) == std::cv_status::timeout;
+        }
+        mCounters->idleThreads.fetch_sub(1, std::memory_order_relaxed);
+        mIdleThreads--;
+
+        if (timedOut && mCalls.empty() && mThreads > mPolicy.minThreads) {
+            LOG_RPC_DETAIL("RpcThreadPool %p retiring idle thread", this);
+            mCounters->threadsRetired.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    mThreads--;
+    mCounters->threads.fetch_sub(1, std::memory_order_relaxed);
+}
+
+} // namespace android
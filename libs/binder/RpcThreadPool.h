@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace android {
+
+/**
+ * Counters of all thread pools of a server, see RpcServer::getThreadPoolStats.
+ */
+struct RpcThreadPoolCounters {
+    std::atomic<size_t> threads = 0;
+    std::atomic<size_t> idleThreads = 0;
+    std::atomic<size_t> peakThreads = 0;
+    std::atomic<uint64_t> threadsStarted = 0;
+    std::atomic<uint64_t> threadsRetired = 0;
+    std::atomic<uint64_t> calls = 0;
+    std::atomic<uint64_t> starvedCalls = 0;
+    std::atomic<uint64_t> totalWaitNs = 0;
+    std::atomic<uint64_t> maxWaitNs = 0;
+};
+
+/**
+ * The threads which run the calls read from the multiplexed connections of a
+ * server session. Threads are started while calls outnumber the idle threads,
+ * up to a maximum, and those past a minimum stop again once they have been
+ * idle for a while.
+ */
+class RpcThreadPool : public std::enable_shared_from_this<RpcThreadPool> {
+public:
+    struct Policy {
+        // started with the pool, and kept when idle
+        size_t minThreads = 0;
+        size_t maxThreads = 1;
+        // how long the other threads are kept when idle
+        std::chrono::nanoseconds idleTimeout = std::chrono::nanoseconds::max();
+    };
+
+    static std::shared_ptr<RpcThreadPool> make(const Policy& policy,
+                                               std::shared_ptr<RpcThreadPoolCounters> counters);
+
+    /**
+     * Runs 'call' on one of the threads. If all of them are busy, and there are
+     * fewer than the maximum, one is started for it, and otherwise it waits.
+     */
+    void dispatch(std::function<void()> call);
+
+    /**
+     * Makes the threads stop once the calls dispatched so far are done.
+     */
+    void shutdown();
+
+    // use make()
+    RpcThreadPool(const Policy& policy, std::shared_ptr<RpcThreadPoolCounters> counters);
+
+private:
+    struct QueuedCall {
+        std::function<void()> call;
+        nsecs_t queuedAt;
+    };
+
+    void startThreadLocked();
+    void run();
+
+    const Policy mPolicy;
+    const std::shared_ptr<RpcThreadPoolCounters> mCounters;
+
+    std::mutex mMutex; // for below
+    std::condition_variable mCallCv;
+    std::deque<QueuedCall> mCalls;
+    size_t mThreads = 0;
+    size_t mIdleThreads = 0;
+    bool mShutdown = false;
+};
+
+} // namespace android
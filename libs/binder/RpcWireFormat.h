@@ -37,6 +37,10 @@ enum : uint32_t {
      * want to create a 'Parcel' object for every decref)
      */
     RPC_COMMAND_DEC_STRONG,
+    /**
+     * follows is RpcWireCompressed, see RPC_SPECIAL_TRANSACT_ENABLE_COMPRESSION
+     */
+    RPC_COMMAND_COMPRESSED,
 };
 
 /**
@@ -49,6 +53,25 @@ enum : uint32_t {
     RPC_SPECIAL_TRANSACT_GET_ROOT = 0,
     RPC_SPECIAL_TRANSACT_GET_MAX_THREADS = 1,
     RPC_SPECIAL_TRANSACT_GET_SESSION_ID = 2,
+    /**
+     * Switches the session to multiplexed connections, see RpcWireHeader::callId.
+     * Servers which do not know about this reply UNKNOWN_TRANSACTION.
+     */
+    RPC_SPECIAL_TRANSACT_ENABLE_MULTIPLEXING = 3,
+    /**
+     * Sent as the first command on a Unix domain socket connection. Once the
+     * server replies OK, the client sends it a memfd over the socket, and from
+     * then on, both sides exchange commands through it, see RpcSharedMemory.
+     * Servers which do not know about this reply UNKNOWN_TRANSACTION.
+     */
+    RPC_SPECIAL_TRANSACT_SHARE_MEMORY = 4,
+    /**
+     * Carries a uint32_t, the size from which the client compresses the bodies
+     * of its transactions. Once the server replies OK, both sides may send
+     * transactions and replies of at least that size as RPC_COMMAND_COMPRESSED.
+     * Servers which do not know about this reply UNKNOWN_TRANSACTION.
+     */
+    RPC_SPECIAL_TRANSACT_ENABLE_COMPRESSION = 5,
 };
 
 constexpr int32_t RPC_SESSION_ID_NEW = -1;
@@ -60,7 +83,12 @@ struct RpcWireHeader {
     uint32_t command; // RPC_COMMAND_*
     uint32_t bodySize;
 
-    uint32_t reserved[2];
+    // On multiplexed connections, the call which this command belongs to, so
+    // that the commands of concurrent calls may interleave. Nested calls share
+    // the ID of the call which made them, and the reply of a call carries its
+    // ID. Zero for commands outside of any call, such as dec strongs, and on
+    // connections which are not multiplexed (this used to be reserved).
+    uint64_t callId;
 };
 
 struct RpcWireAddress {
@@ -84,6 +112,12 @@ struct RpcWireReply {
     uint8_t data[0];
 };
 
+struct RpcWireCompressed {
+    uint32_t command;  // RPC_COMMAND_TRANSACT or RPC_COMMAND_REPLY
+    uint32_t bodySize; // of the command, once decompressed
+    uint8_t data[0];   // LZ4 block
+};
+
 #pragma clang diagnostic pop
 
 } // namespace android
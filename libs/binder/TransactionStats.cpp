@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransactionStats"
+
+#include <binder/TransactionStats.h>
+
+#include <utils/String8.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <tuple>
+
+namespace android {
+
+// Enough for the interfaces and codes which a thread uses in most processes.
+// Past that, transactions are only counted as dropped.
+constexpr size_t kSlotsPerThread = 64;
+static_assert((kSlotsPerThread & (kSlotsPerThread - 1)) == 0, "slots are indexed by hash");
+
+std::atomic<bool> TransactionStats::sEnabled = false;
+
+namespace {
+
+// Only incremented by the thread which owns it, but cleared by reset() and read
+// from any thread. Atomic increments are cheap while uncontended.
+class Counter {
+public:
+    void add(uint64_t value) { mValue.fetch_add(value, std::memory_order_relaxed); }
+    void max(uint64_t value) {
+        if (value > get()) mValue.store(value, std::memory_order_relaxed);
+    }
+    uint64_t get() const { return mValue.load(std::memory_order_relaxed); }
+    void clear() { mValue.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> mValue = 0;
+};
+
+using Key = std::tuple<TransactionStats::Direction, String16, uint32_t>;
+using EntryMap = std::map<Key, TransactionStats::Entry>;
+
+void merge(const TransactionStats::Entry& from, TransactionStats::Entry* to) {
+    to->count += from.count;
+    to->dataBytes += from.dataBytes;
+    to->replyBytes += from.replyBytes;
+    to->totalLatencyNs += from.totalLatencyNs;
+    to->maxLatencyNs = std::max(to->maxLatencyNs, from.maxLatencyNs);
+    for (size_t i = 0; i < TransactionStats::kLatencyBuckets; i++) {
+        to->latencyHistogram[i] += from.latencyHistogram[i];
+    }
+}
+
+} // namespace
+
+struct TransactionStats::Slot {
+    // Set once the key below is written, after which the key never changes.
+    std::atomic<bool> used = false;
+    Direction direction;
+    String16 descriptor;
+    size_t descriptorHash;
+    uint32_t code;
+
+    Counter count;
+    Counter dataBytes;
+    Counter replyBytes;
+    Counter totalLatencyNs;
+    Counter maxLatencyNs;
+    std::array<Counter, kLatencyBuckets> latencyHistogram;
+
+    void clear() {
+        count.clear();
+        dataBytes.clear();
+        replyBytes.clear();
+        totalLatencyNs.clear();
+        maxLatencyNs.clear();
+        for (Counter& bucket : latencyHistogram) bucket.clear();
+    }
+};
+
+struct TransactionStats::Registry {
+    std::mutex mutex;
+    std::vector<ThreadStats*> threads;   // guarded by mutex
+    EntryMap retired;                    // guarded by mutex, for threads which exited
+    uint64_t retiredDropped = 0;         // guarded by mutex
+
+    static Registry& get() {
+        // never destroyed, since threads may exit after static destructors run
+        static Registry* registry = new Registry;
+        return *registry;
+    }
+
+    void collectLocked(EntryMap* entries, uint64_t* dropped);
+};
+
+// The table of a thread, which registers itself when the thread records its
+// first transaction, and retires into the registry when the thread exits.
+struct TransactionStats::ThreadStats {
+    std::array<Slot, kSlotsPerThread> slots;
+    Counter dropped;
+
+    ThreadStats() {
+        Registry& registry = Registry::get();
+        std::lock_guard<std::mutex> _l(registry.mutex);
+        registry.threads.push_back(this);
+    }
+    ~ThreadStats() {
+        Registry& registry = Registry::get();
+        std::lock_guard<std::mutex> _l(registry.mutex);
+        collect(&registry.retired, &registry.retiredDropped);
+        registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), this));
+    }
+
+    Slot* find(Direction direction, const String16& descriptor, uint32_t code) {
+        // Descriptors are keyed by their contents, since each proxy caches a
+        // copy of its own.
+        size_t descriptorHash = std::hash<std::u16string_view>{}(
+                std::u16string_view(descriptor.string(), descriptor.size()));
+        size_t hash = descriptorHash ^ code ^ (code >> 6) ^ (static_cast<size_t>(direction) << 5);
+
+        for (size_t i = 0; i < kSlotsPerThread; i++) {
+            Slot& slot = slots[(hash + i) & (kSlotsPerThread - 1)];
+            // this thread is the only one which sets 'used'
+            if (!slot.used.load(std::memory_order_relaxed)) {
+                slot.direction = direction;
+                slot.descriptor = descriptor;
+                slot.descriptorHash = descriptorHash;
+                slot.code = code;
+                slot.used.store(true, std::memory_order_release);
+                return &slot;
+            }
+            if (slot.code == code && slot.direction == direction &&
+                slot.descriptorHash == descriptorHash &&
+                // copies of a String16 share its buffer
+                (slot.descriptor.string() == descriptor.string() ||
+                 slot.descriptor == descriptor)) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    void collect(EntryMap* entries, uint64_t* outDropped) const {
+        for (const Slot& slot : slots) {
+            if (!slot.used.load(std::memory_order_acquire)) continue;
+            if (slot.count.get() == 0) continue;
+
+            Entry entry{.direction = slot.direction,
+                        .descriptor = slot.descriptor,
+                        .code = slot.code,
+                        .count = slot.count.get(),
+                        .dataBytes = slot.dataBytes.get(),
+                        .replyBytes = slot.replyBytes.get(),
+                        .totalLatencyNs = slot.totalLatencyNs.get(),
+                        .maxLatencyNs = slot.maxLatencyNs.get()};
+            for (size_t i = 0; i < kLatencyBuckets; i++) {
+                entry.latencyHistogram[i] = slot.latencyHistogram[i].get();
+            }
+
+            Key key{entry.direction, entry.descriptor, entry.code};
+            auto [it, inserted] = entries->try_emplace(key, entry);
+            if (!inserted) merge(entry, &it->second);
+        }
+        *outDropped += dropped.get();
+    }
+};
+
+void TransactionStats::Registry::collectLocked(EntryMap* entries, uint64_t* dropped) {
+    *entries = retired;
+    *dropped = retiredDropped;
+    for (const ThreadStats* thread : threads) {
+        thread->collect(entries, dropped);
+    }
+}
+
+void TransactionStats::setEnabled(bool enabled) {
+    sEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void TransactionStats::reset() {
+    Registry& registry = Registry::get();
+    std::lock_guard<std::mutex> _l(registry.mutex);
+    for (ThreadStats* thread : registry.threads) {
+        for (Slot& slot : thread->slots) slot.clear();
+        thread->dropped.clear();
+    }
+    registry.retired.clear();
+    registry.retiredDropped = 0;
+}
+
+size_t TransactionStats::latencyBucket(nsecs_t latencyNs) {
+    uint64_t latencyUs = static_cast<uint64_t>(std::max<nsecs_t>(latencyNs, 0)) / 1000;
+    if (latencyUs == 0) return 0;
+    size_t bucket = 64 - static_cast<size_t>(__builtin_clzll(latencyUs));
+    return std::min(bucket, kLatencyBuckets - 1);
+}
+
+void TransactionStats::record(Direction direction, const String16& descriptor, uint32_t code,
+                              size_t dataBytes, size_t replyBytes, nsecs_t latencyNs) {
+    static thread_local std::unique_ptr<ThreadStats> threadStats;
+    if (threadStats == nullptr) threadStats = std::make_unique<ThreadStats>();
+
+    Slot* slot = threadStats->find(direction, descriptor, code);
+    if (slot == nullptr) {
+        threadStats->dropped.add(1);
+        return;
+    }
+
+    uint64_t latency = static_cast<uint64_t>(std::max<nsecs_t>(latencyNs, 0));
+    slot->count.add(1);
+    slot->dataBytes.add(dataBytes);
+    slot->replyBytes.add(replyBytes);
+    slot->totalLatencyNs.add(latency);
+    slot->maxLatencyNs.max(latency);
+    slot->latencyHistogram[latencyBucket(latencyNs)].add(1);
+}
+
+static std::vector<TransactionStats::Entry> sortedEntries(EntryMap&& entries) {
+    std::vector<TransactionStats::Entry> ret;
+    ret.reserve(entries.size());
+    for (auto& [key, entry] : entries) ret.push_back(std::move(entry));
+    // the hot spots first
+    std::stable_sort(ret.begin(), ret.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.totalLatencyNs > rhs.totalLatencyNs;
+    });
+    return ret;
+}
+
+std::vector<TransactionStats::Entry> TransactionStats::getEntries() {
+    EntryMap entries;
+    uint64_t dropped;
+    {
+        Registry& registry = Registry::get();
+        std::lock_guard<std::mutex> _l(registry.mutex);
+        registry.collectLocked(&entries, &dropped);
+    }
+    return sortedEntries(std::move(entries));
+}
+
+std::string TransactionStats::dump() {
+    EntryMap entries;
+    uint64_t dropped;
+    {
+        Registry& registry = Registry::get();
+        std::lock_guard<std::mutex> _l(registry.mutex);
+        registry.collectLocked(&entries, &dropped);
+    }
+
+    String8 out;
+    out.appendFormat("Binder transaction stats (%s):\n", isEnabled() ? "enabled" : "disabled");
+    for (const Entry& entry : sortedEntries(std::move(entries))) {
+        out.appendFormat("  %s %s code %u: %" PRIu64 " calls, %" PRIu64 " data bytes/call, "
+                         "%" PRIu64 " reply bytes/call, latency avg %" PRIu64 "us max %" PRIu64
+                         "us\n",
+                         entry.direction == Direction::OUTGOING ? "outgoing" : "incoming",
+                         entry.descriptor.size() == 0 ? "<unknown descriptor>"
+                                                      : String8(entry.descriptor).c_str(),
+                         entry.code, entry.count, entry.dataBytes / entry.count,
+                         entry.replyBytes / entry.count,
+                         entry.totalLatencyNs / entry.count / 1000, entry.maxLatencyNs / 1000);
+
+        out.append("    latency histogram:");
+        const char* separator = " ";
+        for (size_t i = 0; i < kLatencyBuckets; i++) {
+            if (entry.latencyHistogram[i] == 0) continue;
+            if (i == kLatencyBuckets - 1) {
+                out.appendFormat("%s>=%zuus: %" PRIu64, separator, size_t(1) << (i - 1),
+                                 entry.latencyHistogram[i]);
+            } else {
+                out.appendFormat("%s<%zuus: %" PRIu64, separator, size_t(1) << i,
+                                 entry.latencyHistogram[i]);
+            }
+            separator = ", ";
+        }
+        out.append("\n");
+    }
+    if (dropped > 0) {
+        out.appendFormat("  %" PRIu64 " transactions not recorded, past %zu keys on a thread\n",
+                         dropped, kSlotsPerThread);
+    }
+    return std::string(out.c_str(), out.size());
+}
+
+} // namespace android
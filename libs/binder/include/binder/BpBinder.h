@@ -22,12 +22,15 @@
 #include <utils/Mutex.h>
 #include <utils/threads.h>
 
+#include <array>
+#include <memory>
 #include <unordered_map>
 #include <variant>
 
 // ---------------------------------------------------------------------------
 namespace android {
 
+class RpcPendingTransaction;
 class RpcSession;
 class RpcState;
 namespace internal {
@@ -61,6 +64,13 @@ public:
                                     Parcel* reply,
                                     uint32_t flags = 0) final;
 
+    /**
+     * For RPC binders only. Starts a transaction, whose reply is waited for
+     * later, see RpcSession::transactAsync.
+     */
+    std::unique_ptr<RpcPendingTransaction> transactAsync(uint32_t code, const Parcel& data,
+                                                         Parcel* reply, uint32_t flags = 0);
+
     // NOLINTNEXTLINE(google-default-arguments)
     virtual status_t    linkToDeath(const sp<DeathRecipient>& recipient,
                                     void* cookie = nullptr,
@@ -117,7 +127,22 @@ public:
             IBinder::object_cleanup_func func;
         };
 
-        KeyedVector<const void*, entry_t> mObjects;
+        struct inline_entry_t
+        {
+            const void* objectID;
+            entry_t entry;
+        };
+
+        // Most proxies carry only a handful of attached objects (e.g. one per
+        // language runtime), so they are kept in a small unsorted inline array
+        // and only spill into a hash table once that fills up.
+        static constexpr size_t kInlineObjects = 4;
+
+        const entry_t* lookup(const void* objectID) const;
+
+        size_t mInlineCount = 0;
+        std::array<inline_entry_t, kInlineObjects> mInline;
+        std::unordered_map<const void*, entry_t> mOverflow;
     };
 
     class PrivateAccessorForId {
@@ -158,6 +183,9 @@ private:
     const RpcAddress& rpcAddress() const;
     const sp<RpcSession>& rpcSession() const;
 
+    // Whether this process may make the user transaction 'code' on this binder.
+    bool isTransactionAllowed(uint32_t code, bool privateVendor);
+
     explicit BpBinder(Handle&& handle);
     BpBinder(BinderHandle&& handle, int32_t trackedUid);
     explicit BpBinder(RpcHandle&& handle);
@@ -187,6 +215,8 @@ private:
             Vector<Obituary>*   mObituaries;
             ObjectManager       mObjects;
     mutable String16            mDescriptorCache;
+    // set once mDescriptorCache is, which then never changes, so it can be read without mLock
+    mutable std::atomic<bool>   mDescriptorCached = false;
             int32_t             mTrackedUid;
 
     static Mutex                                sTrackingLock;
@@ -22,6 +22,8 @@
 #include <utils/String16.h>
 #include <utils/Vector.h>
 
+#include <string>
+
 // linux/binder.h defines this, but we don't want to include it here in order to
 // avoid exporting the kernel headers
 #ifndef B_PACK_CHARS
@@ -60,6 +62,7 @@ public:
         SYSPROPS_TRANSACTION = B_PACK_CHARS('_', 'S', 'P', 'R'),
         EXTENSION_TRANSACTION = B_PACK_CHARS('_', 'E', 'X', 'T'),
         DEBUG_PID_TRANSACTION = B_PACK_CHARS('_', 'P', 'I', 'D'),
+        TRANSACTION_STATS_TRANSACTION = B_PACK_CHARS('_', 'S', 'T', 'A'),
 
         // See android.os.IBinder.TWEET_TRANSACTION
         // Most importantly, messages can be anything not exceeding 130 UTF-8
@@ -152,6 +155,21 @@ public:
      */
     status_t                getDebugPid(pid_t* outPid);
 
+    /**
+     * Dump the TransactionStats of the process of a binder, for debugging.
+     * Returns INVALID_OPERATION if that process is not recording them, and
+     * PERMISSION_DENIED unless the caller is root, shell or system, or holds
+     * android.permission.DUMP.
+     */
+    status_t                getTransactionStats(std::string* outStats);
+
+    /**
+     * Start or stop recording the TransactionStats of the process of a binder,
+     * see TransactionStats::setEnabled. Needs the same permissions as
+     * getTransactionStats.
+     */
+    status_t                setTransactionStatsEnabled(bool enabled);
+
     // NOLINTNEXTLINE(google-default-arguments)
     virtual status_t        transact(   uint32_t code,
                                         const Parcel& data,
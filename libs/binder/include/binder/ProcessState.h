@@ -58,6 +58,24 @@ public:
             void                spawnPooledThread(bool isMain);
             
             status_t            setThreadPoolMaxThreadCount(size_t maxThreads);
+
+            struct ThreadPoolStats {
+                size_t maxThreads = 0;
+                // Pooled threads started, by startThreadPool() and on request
+                // of the driver, which asks for one when all others are busy.
+                size_t spawnedThreads = 0;
+                size_t executingThreads = 0;
+                size_t peakExecutingThreads = 0;
+                // Periods where all threads were busy, so that incoming
+                // transactions waited in the driver.
+                uint64_t starvationCount = 0;
+                int64_t totalStarvationTimeMs = 0;
+                int64_t maxStarvationTimeMs = 0;
+            };
+            // Statistics of the binder thread pool of this process so far. The
+            // driver starts threads as needed, but cannot retire them, so the pool
+            // only grows, up to the maximum.
+            ThreadPoolStats     getThreadPoolStats();
             status_t            enableOnewaySpamDetection(bool enable);
             void                giveThreadPoolName();
 
@@ -121,6 +139,12 @@ private:
             size_t              mMaxThreads;
             // Time when thread pool was emptied
             int64_t             mStarvationStartTimeMs;
+            // See ThreadPoolStats.
+            size_t              mSpawnedThreadsCount;
+            size_t              mPeakExecutingThreadsCount;
+            uint64_t            mStarvationCount;
+            int64_t             mTotalStarvationTimeMs;
+            int64_t             mMaxStarvationTimeMs;
 
     mutable Mutex               mLock;  // protects everything below.
 
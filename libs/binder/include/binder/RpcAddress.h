@@ -15,7 +15,9 @@
  */
 #pragma once
 
-#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <string>
 
 #include <utils/Errors.h>
 
@@ -32,8 +34,9 @@ struct RpcWireAddress;
  * This class represents an identifier of a binder object.
  *
  * The purpose of this class it to hide the ABI of an RpcWireAddress, and
- * potentially allow us to change the size of it in the future (RpcWireAddress
- * is PIMPL, essentially - although the type that is used here is not exposed).
+ * potentially allow us to change the size of it in the future (the type of
+ * RpcWireAddress is not exposed, although its size is, so that addresses can
+ * be stored inline rather than in a separate allocation).
  */
 class RpcAddress {
 public:
@@ -46,7 +49,8 @@ public:
     bool isZero() const;
 
     /**
-     * Create a new address which is unique
+     * Create a new address, which is random so that peers cannot guess it.
+     * This does not usually make a syscall.
      */
     static RpcAddress unique();
 
@@ -57,8 +61,16 @@ public:
     const RpcWireAddress& viewRawEmbedded() const;
 
     bool operator<(const RpcAddress& rhs) const;
+    bool operator==(const RpcAddress& rhs) const;
     std::string toString() const;
 
+    /**
+     * For keying unordered containers by address.
+     */
+    struct Hash {
+        size_t operator()(const RpcAddress& address) const;
+    };
+
     status_t writeToParcel(Parcel* parcel) const;
     status_t readFromParcel(const Parcel& parcel);
 
@@ -67,7 +79,9 @@ public:
 private:
     RpcAddress();
 
-    std::shared_ptr<RpcWireAddress> mRawAddr;
+    // Size of an RpcWireAddress, which is checked where the type is known.
+    static constexpr size_t kRawAddrSize = 32;
+    uint8_t mRawAddr[kRawAddrSize];
 };
 
 } // namespace android
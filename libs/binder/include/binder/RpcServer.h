@@ -21,6 +21,8 @@
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
 
+#include <chrono>
+#include <memory>
 #include <mutex>
 #include <thread>
 
@@ -31,6 +33,8 @@
 namespace android {
 
 class RpcSocketAddress;
+class RpcThreadPool;
+struct RpcThreadPoolCounters;
 
 /**
  * This represents a server of an interface, which may be connected to by any
@@ -103,6 +107,44 @@ public:
     void setMaxThreads(size_t threads);
     size_t getMaxThreads();
 
+    /**
+     * The calls of a multiplexed session (see
+     * RpcSession::setMultiplexedConnections) run on a pool of threads, which
+     * starts with this many threads, and keeps them when they are idle. More
+     * threads are started, up to getMaxThreads(), while calls are waiting for
+     * one, and these stop again once they have been idle for the idle timeout.
+     * By default, no thread is started upfront, and threads never stop.
+     *
+     * Sessions which are not multiplexed have one thread per connection.
+     *
+     * These must be called before adding a client session.
+     */
+    void setMinThreads(size_t threads);
+    size_t getMinThreads();
+    void setThreadIdleTimeout(std::chrono::nanoseconds timeout);
+
+    struct ThreadPoolStats {
+        // threads currently running (or waiting for) the calls of sessions
+        size_t threads = 0;
+        size_t idleThreads = 0;
+        // the most threads running at once so far
+        size_t peakThreads = 0;
+        uint64_t threadsStarted = 0;
+        // threads which stopped after the idle timeout
+        uint64_t threadsRetired = 0;
+        uint64_t calls = 0;
+        // calls which found no idle thread, when no more could be started
+        uint64_t starvedCalls = 0;
+        // how long calls waited for a thread to run them
+        uint64_t totalWaitNs = 0;
+        uint64_t maxWaitNs = 0;
+    };
+    /**
+     * Statistics of the threads which have run the calls of multiplexed
+     * sessions of this server so far.
+     */
+    ThreadPoolStats getThreadPoolStats();
+
     /**
      * The root object can be retrieved by any client, without any
      * authentication. TODO(b/183988761)
@@ -140,6 +182,8 @@ public:
     // internal use only
 
     void onSessionTerminating(const sp<RpcSession>& session);
+    // for the calls of a multiplexed session, following the policy above
+    std::shared_ptr<RpcThreadPool> makeThreadPool();
 
 private:
     friend sp<RpcServer>;
@@ -151,6 +195,9 @@ private:
     bool mAgreedExperimental = false;
     bool mStarted = false; // TODO(b/185167543): support dynamically added clients
     size_t mMaxThreads = 1;
+    size_t mMinThreads = 0;
+    std::chrono::nanoseconds mThreadIdleTimeout = std::chrono::nanoseconds::max();
+    const std::shared_ptr<RpcThreadPoolCounters> mThreadPoolCounters;
     base::unique_fd mServer; // socket we are accepting sessions on
 
     std::mutex mLock; // for below
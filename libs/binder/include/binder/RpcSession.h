@@ -21,7 +21,12 @@
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <thread>
 #include <vector>
@@ -32,10 +37,15 @@
 
 namespace android {
 
+class BpBinder;
 class Parcel;
+class RpcPendingTransaction;
 class RpcServer;
+class RpcSharedMemory;
 class RpcSocketAddress;
 class RpcState;
+class RpcThreadPool;
+struct RpcMultiplexedConnection;
 
 /**
  * This represents a session (group of connections) between a client
@@ -52,6 +62,55 @@ public:
      */
     [[nodiscard]] bool setupUnixDomainClient(const char* path);
 
+    /**
+     * Makes this session carry its calls over at most 'connections' shared
+     * connections, instead of over one connection per concurrent call. Each
+     * call is tagged with an ID, so that the calls of any number of threads
+     * may be in flight on a connection at once, and their replies interleave.
+     * The server runs the calls on up to its maximum number of threads.
+     *
+     * This must be called before setting up the session. If the server does
+     * not support it, the session falls back to one connection per call.
+     */
+    void setMultiplexedConnections(size_t connections);
+
+    /**
+     * Whether the calls of this session are multiplexed, see
+     * setMultiplexedConnections.
+     */
+    bool isMultiplexed() const { return mMultiplexed; }
+
+    /**
+     * Makes the connections of this session exchange their commands through
+     * memory shared with the server, instead of copying them through their
+     * sockets. Only Unix domain socket sessions can do this. This must be
+     * called before setting up the session. If the server does not support
+     * it, the sockets are used.
+     */
+    void setSharedMemoryTransport(bool enabled);
+
+    /**
+     * Whether all connections of this session use shared memory, see
+     * setSharedMemoryTransport.
+     */
+    bool isUsingSharedMemory();
+
+    /**
+     * Makes both sides of this session compress the transactions and replies
+     * of at least 'minBytes' bytes with LZ4 before sending them, which pays off
+     * for large payloads over sockets of limited bandwidth, such as inet and
+     * vsock ones. Zero, the default, disables it. This must be called before
+     * setting up the session. If the server does not support it, payloads are
+     * sent as they are.
+     */
+    void setCompression(size_t minBytes);
+
+    /**
+     * Whether large payloads of this session are compressed, see
+     * setCompression.
+     */
+    bool isUsingCompression();
+
     /**
      * Connects to an RPC server at the CVD & port.
      */
@@ -85,6 +144,26 @@ public:
 
     [[nodiscard]] status_t transact(const RpcAddress& address, uint32_t code, const Parcel& data,
                                     Parcel* reply, uint32_t flags);
+
+    /**
+     * Sends a transaction without waiting for its reply, so that a thread may
+     * keep any number of transactions in flight at once, pipelined on the
+     * connections of a multiplexed session (see setMultiplexedConnections).
+     * The reply is written to 'reply' by RpcPendingTransaction::wait, which may
+     * be called in any order for the transactions in flight, and 'reply' must
+     * outlive the returned object.
+     *
+     * Calls which the server makes back while running the transaction are only
+     * served while its reply is waited for. On sessions which are not
+     * multiplexed, and for oneway transactions, the transaction is made
+     * before this returns.
+     */
+    [[nodiscard]] std::unique_ptr<RpcPendingTransaction> transactAsync(const RpcAddress& address,
+                                                                       uint32_t code,
+                                                                       const Parcel& data,
+                                                                       Parcel* reply,
+                                                                       uint32_t flags);
+
     [[nodiscard]] status_t sendDecStrong(const RpcAddress& address);
 
     ~RpcSession();
@@ -108,11 +187,15 @@ public:
 
 private:
     friend PrivateAccessorForId;
+    friend RpcPendingTransaction;
     friend sp<RpcSession>;
     friend RpcServer;
+    friend RpcState;
     RpcSession();
 
     status_t readId();
+    status_t enableMultiplexing();
+    status_t enableCompression(size_t minBytes);
 
     // transfer ownership of thread
     void preJoin(std::thread thread);
@@ -121,23 +204,70 @@ private:
     void terminateLocked();
 
     struct RpcConnection : public RefBase {
+        ~RpcConnection();
+
         base::unique_fd fd;
 
         // whether this or another thread is currently using this fd to make
         // or receive transactions.
         std::optional<pid_t> exclusiveTid;
+
+        // set if the session is multiplexed, in which case any number of
+        // threads use this connection at once, and exclusiveTid is unused
+        std::unique_ptr<RpcMultiplexedConnection> multiplexed;
+
+        // set once the connection exchanges commands through shared memory
+        // instead of through the socket (which is still kept open)
+        std::unique_ptr<RpcSharedMemory> sharedMemory;
+    };
+
+    // Records that the calls this thread makes on a multiplexed session belong
+    // to the call it is running, so that they go over the same connection,
+    // with the same ID.
+    class ScopedCallContext {
+    public:
+        ScopedCallContext(const RpcSession* session, const sp<RpcConnection>& connection,
+                          uint64_t callId);
+        ~ScopedCallContext();
+        ScopedCallContext(const ScopedCallContext&) = delete;
+        ScopedCallContext& operator=(const ScopedCallContext&) = delete;
+
+        // innermost context of this thread for the session, if any
+        static const ScopedCallContext* find(const RpcSession* session);
+
+        const sp<RpcConnection>& connection() const { return mConnection; }
+        uint64_t callId() const { return mCallId; }
+
+    private:
+        const RpcSession* mSession;
+        sp<RpcConnection> mConnection;
+        uint64_t mCallId;
+        const ScopedCallContext* mPrevious;
+
+        static thread_local const ScopedCallContext* sCurrent;
     };
 
     bool setupSocketClient(const RpcSocketAddress& address);
     bool setupOneSocketClient(const RpcSocketAddress& address, int32_t sessionId);
+    // 'connection' must not be in use yet
+    status_t setupSharedMemory(const sp<RpcConnection>& connection);
     void addClientConnection(base::unique_fd fd);
+    void addClientConnection(const sp<RpcConnection>& connection);
     void setForServer(const wp<RpcServer>& server, int32_t sessionId);
     sp<RpcConnection> assignServerToThisThread(base::unique_fd fd);
     bool removeServerConnection(const sp<RpcConnection>& connection);
+    // for the server side, when the client asks for it on 'connection'
+    status_t enableMultiplexingForServer(const sp<RpcConnection>& connection);
+
+    // Runs a call read from a multiplexed server connection on the thread
+    // pool of the session, see RpcServer::setMinThreads.
+    void dispatchMultiplexedCall(std::function<void()> call);
 
     enum class ConnectionUse {
         CLIENT,
         CLIENT_ASYNC,
+        // synchronous, but the reply is waited for later, see transactAsync
+        CLIENT_PIPELINED,
         CLIENT_REFCOUNT,
     };
 
@@ -146,9 +276,12 @@ private:
     public:
         explicit ExclusiveConnection(const sp<RpcSession>& session, ConnectionUse use);
         ~ExclusiveConnection();
-        const base::unique_fd& fd() { return mConnection->fd; }
+        const sp<RpcConnection>& get() { return mConnection; }
+        // ID to send the call with, on multiplexed sessions
+        uint64_t callId() const { return mCallId; }
 
     private:
+        void findMultiplexedConnection(ConnectionUse use);
         static void findConnection(pid_t tid, sp<RpcConnection>* exclusive,
                                    sp<RpcConnection>* available,
                                    std::vector<sp<RpcConnection>>& sockets,
@@ -161,6 +294,12 @@ private:
         // thread guarantees we won't write in the middle of a message, the way
         // the wire protocol is constructed guarantees this is safe).
         bool mReentrant = false;
+
+        bool mMultiplexed = false;
+        uint64_t mCallId = 0;
+        // whether the replies to mCallId are waited for on mConnection
+        bool mWaitsForReply = false;
+        std::optional<ScopedCallContext> mCallContext;
     };
 
     // On the other side of a session, for each of mClientConnections here, there should
@@ -184,8 +323,18 @@ private:
 
     std::unique_ptr<RpcState> mState;
 
+    // set once, while setting up the session
+    std::atomic<bool> mMultiplexed = false;
+
     std::mutex mMutex; // for all below
 
+    size_t mMaxMultiplexedConnections = 0;
+    bool mUseSharedMemory = false;
+    size_t mCompressionMinBytes = 0;
+    uint64_t mNextCallId = 1;
+    // runs the calls read from multiplexed server connections
+    std::shared_ptr<RpcThreadPool> mThreadPool;
+
     std::condition_variable mAvailableConnectionCv; // for mWaitingThreads
     size_t mWaitingThreads = 0;
     // hint index into clients, ++ when sending an async transaction
@@ -201,4 +350,39 @@ private:
     bool mTerminated = false;
 };
 
+/**
+ * A transaction whose reply has yet to be read, see RpcSession::transactAsync.
+ */
+class RpcPendingTransaction {
+public:
+    /**
+     * Waits for the reply to the transaction, unless it was already read.
+     * Returns what RpcSession::transact would have for the transaction.
+     */
+    [[nodiscard]] status_t wait();
+
+    // Waits for the reply, if nobody did, since the connection cannot skip
+    // over it otherwise.
+    ~RpcPendingTransaction();
+
+    RpcPendingTransaction(const RpcPendingTransaction&) = delete;
+    RpcPendingTransaction& operator=(const RpcPendingTransaction&) = delete;
+
+private:
+    friend BpBinder;
+    friend RpcSession;
+
+    // for a transaction which is already done
+    explicit RpcPendingTransaction(status_t status);
+    RpcPendingTransaction(const sp<RpcSession>& session,
+                          std::unique_ptr<RpcSession::ExclusiveConnection> connection,
+                          Parcel* reply);
+
+    sp<RpcSession> mSession;
+    // the connection and ID of the transaction, until its reply is read
+    std::unique_ptr<RpcSession::ExclusiveConnection> mConnection;
+    Parcel* mReply = nullptr;
+    status_t mStatus = OK;
+};
+
 } // namespace android
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <utils/String16.h>
+#include <utils/Timers.h>
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace android {
+
+class BBinder;
+class BpBinder;
+
+/**
+ * Opt-in latency and size statistics of the binder transactions of this
+ * process, for each interface descriptor and transaction code, both for the
+ * calls it makes (outgoing) and the calls it serves (incoming). This covers
+ * both kernel binder and RPC binder.
+ *
+ * Transactions are recorded by the thread which makes or serves them, in a
+ * table of its own, without taking any lock, so that this can stay enabled in
+ * production. The tables of all threads are only combined when the statistics
+ * are read.
+ *
+ * Outgoing transactions are keyed by the interface descriptor of the proxy
+ * only once it is known to this process (e.g. after a call to
+ * IBinder::getInterfaceDescriptor), since looking it up would cost another
+ * transaction.
+ *
+ * The statistics of another process can be read with
+ * IBinder::getTransactionStats, or with 'dumpsys --transaction-stats', while it
+ * records them.
+ */
+class TransactionStats {
+public:
+    enum class Direction : uint8_t {
+        OUTGOING,
+        INCOMING,
+    };
+
+    /**
+     * Bucket 0 of the latency histogram counts the transactions which took
+     * under 1us, bucket i > 0 those which took [2^(i-1), 2^i) us, and the last
+     * bucket all those which took longer.
+     */
+    static constexpr size_t kLatencyBuckets = 20;
+
+    struct Entry {
+        Direction direction;
+        String16 descriptor;
+        uint32_t code;
+
+        uint64_t count = 0;
+        uint64_t dataBytes = 0;
+        uint64_t replyBytes = 0;
+        uint64_t totalLatencyNs = 0;
+        uint64_t maxLatencyNs = 0;
+        std::array<uint64_t, kLatencyBuckets> latencyHistogram = {};
+    };
+
+    /**
+     * Starts or stops recording transactions. Disabled by default. What was
+     * recorded is kept until reset(). Other processes may switch this with
+     * IBinder::setTransactionStatsEnabled, or with
+     * 'dumpsys --enable-transaction-stats'.
+     */
+    static void setEnabled(bool enabled);
+    static bool isEnabled() { return sEnabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Clears everything recorded so far.
+     */
+    static void reset();
+
+    /**
+     * Everything recorded so far, by direction, descriptor and code.
+     */
+    static std::vector<Entry> getEntries();
+
+    /**
+     * Human readable form of getEntries().
+     */
+    static std::string dump();
+
+    /**
+     * The bucket of Entry::latencyHistogram which counts a transaction which
+     * took latencyNs.
+     */
+    static size_t latencyBucket(nsecs_t latencyNs);
+
+private:
+    friend BBinder;
+    friend BpBinder;
+
+    struct Slot;
+    struct ThreadStats;
+    struct Registry;
+
+    static void record(Direction direction, const String16& descriptor, uint32_t code,
+                       size_t dataBytes, size_t replyBytes, nsecs_t latencyNs);
+
+    static std::atomic<bool> sEnabled;
+};
+
+} // namespace android
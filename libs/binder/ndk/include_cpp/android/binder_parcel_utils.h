@@ -32,6 +32,7 @@
 
 #include <optional>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace ndk {
@@ -543,14 +544,55 @@ inline binder_status_t AParcel_readStdVectorParcelableElement<ScopedFileDescript
     return status;
 }
 
+/**
+ * Whether a std::vector<T> is parcelled as an array of the backing type of the enum T, which has
+ * the same representation in memory, so that it is copied in one go rather than element by
+ * element. This is how the other backends parcel vectors of AIDL enums.
+ */
+template <typename T>
+static inline constexpr bool AParcel_isPackedEnumArray =
+        std::is_enum_v<T> && (sizeof(T) == sizeof(int8_t) || sizeof(T) == sizeof(int32_t) ||
+                              sizeof(T) == sizeof(int64_t));
+
+/**
+ * This retrieves and allocates a vector of enums to size 'length' and returns the underlying
+ * buffer, as an array of its backing type B.
+ */
+template <typename T, typename B>
+static inline bool AParcel_stdVectorEnumAllocator(void* vectorData, int32_t length, B** outBuffer) {
+    static_assert(AParcel_isPackedEnumArray<T> && sizeof(T) == sizeof(B));
+    if (length < 0) return false;
+
+    std::vector<T>* vec = static_cast<std::vector<T>*>(vectorData);
+    if (static_cast<size_t>(length) > vec->max_size()) return false;
+
+    vec->resize(static_cast<size_t>(length));
+    *outBuffer = reinterpret_cast<B*>(vec->data());
+    return true;
+}
+
 /**
  * Convenience API for writing a std::vector<P>
  */
 template <typename P>
 static inline binder_status_t AParcel_writeVector(AParcel* parcel, const std::vector<P>& vec) {
-    const void* vectorData = static_cast<const void*>(&vec);
-    return AParcel_writeParcelableArray(parcel, vectorData, static_cast<int32_t>(vec.size()),
-                                        AParcel_writeStdVectorParcelableElement<P>);
+    const int32_t length = static_cast<int32_t>(vec.size());
+    if constexpr (AParcel_isPackedEnumArray<P>) {
+        if constexpr (sizeof(P) == sizeof(int8_t)) {
+            return AParcel_writeByteArray(parcel, reinterpret_cast<const int8_t*>(vec.data()),
+                                          length);
+        } else if constexpr (sizeof(P) == sizeof(int32_t)) {
+            return AParcel_writeInt32Array(parcel, reinterpret_cast<const int32_t*>(vec.data()),
+                                           length);
+        } else {
+            return AParcel_writeInt64Array(parcel, reinterpret_cast<const int64_t*>(vec.data()),
+                                           length);
+        }
+    } else {
+        const void* vectorData = static_cast<const void*>(&vec);
+        return AParcel_writeParcelableArray(parcel, vectorData, length,
+                                            AParcel_writeStdVectorParcelableElement<P>);
+    }
 }
 
 /**
@@ -559,8 +601,22 @@ static inline binder_status_t AParcel_writeVector(AParcel* parcel, const std::ve
 template <typename P>
 static inline binder_status_t AParcel_readVector(const AParcel* parcel, std::vector<P>* vec) {
     void* vectorData = static_cast<void*>(vec);
-    return AParcel_readParcelableArray(parcel, vectorData, AParcel_stdVectorExternalAllocator<P>,
-                                       AParcel_readStdVectorParcelableElement<P>);
+    if constexpr (AParcel_isPackedEnumArray<P>) {
+        if constexpr (sizeof(P) == sizeof(int8_t)) {
+            return AParcel_readByteArray(parcel, vectorData,
+                                         AParcel_stdVectorEnumAllocator<P, int8_t>);
+        } else if constexpr (sizeof(P) == sizeof(int32_t)) {
+            return AParcel_readInt32Array(parcel, vectorData,
+                                          AParcel_stdVectorEnumAllocator<P, int32_t>);
+        } else {
+            return AParcel_readInt64Array(parcel, vectorData,
+                                          AParcel_stdVectorEnumAllocator<P, int64_t>);
+        }
+    } else {
+        return AParcel_readParcelableArray(parcel, vectorData,
+                                           AParcel_stdVectorExternalAllocator<P>,
+                                           AParcel_readStdVectorParcelableElement<P>);
+    }
 }
 
 // @START
@@ -44,6 +44,22 @@ bool AParcel_getAllowFds(const AParcel*);
  * \param parcel The parcel to clear associated data from.
  */
 void AParcel_markSensitive(const AParcel* parcel);
+
+/**
+ * Reads length bytes from the parcel without copying them, like the in-place reads of the C++
+ * Parcel. The data stays valid until the parcel is written to, reset or deleted.
+ *
+ * Available since API level 31.
+ *
+ * \param parcel the parcel to read from.
+ * \param length the number of bytes to read, which is padded to four bytes in the parcel.
+ * \param outData set to the data in the parcel, if successful.
+ *
+ * \return STATUS_OK on success, or STATUS_NOT_ENOUGH_DATA if the parcel does not hold length
+ * more bytes of data.
+ */
+binder_status_t AParcel_readInplace(const AParcel* parcel, int32_t length, const void** outData)
+        __INTRODUCED_IN(31);
 #endif
 
 __END_DECLS
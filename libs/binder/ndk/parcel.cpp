@@ -230,6 +230,16 @@ void AParcel_markSensitive(const AParcel* parcel) {
     return parcel->get()->markSensitive();
 }
 
+binder_status_t AParcel_readInplace(const AParcel* parcel, int32_t length, const void** outData) {
+    if (length < 0) return STATUS_BAD_VALUE;
+
+    const void* data = parcel->get()->readInplace(static_cast<size_t>(length));
+    if (data == nullptr) return STATUS_NOT_ENOUGH_DATA;
+
+    *outData = data;
+    return STATUS_OK;
+}
+
 binder_status_t AParcel_writeStrongBinder(AParcel* parcel, AIBinder* binder) {
     sp<IBinder> writeBinder = binder != nullptr ? binder->getBinder() : nullptr;
     return parcel->get()->writeStrongBinder(writeBinder);
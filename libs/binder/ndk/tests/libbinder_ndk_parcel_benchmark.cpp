@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/logging.h>
+#include <android/binder_auto_utils.h>
+#include <android/binder_parcel_utils.h>
+#include <benchmark/benchmark.h>
+
+#include <type_traits>
+#include <vector>
+
+// Usage: atest libbinder_ndk_parcel_benchmark
+
+enum class IntEnum : int32_t { FOO = 1, BAR = 2 };
+
+// a fixed-layout parcelable, like the touch points or sensor samples of some HALs
+struct Point {
+    int32_t x = 0;
+    int32_t y = 0;
+    float pressure = 0;
+
+    binder_status_t writeToParcel(AParcel* parcel) const {
+        if (binder_status_t status = AParcel_writeInt32(parcel, x); status != STATUS_OK) {
+            return status;
+        }
+        if (binder_status_t status = AParcel_writeInt32(parcel, y); status != STATUS_OK) {
+            return status;
+        }
+        return AParcel_writeFloat(parcel, pressure);
+    }
+    binder_status_t readFromParcel(const AParcel* parcel) {
+        if (binder_status_t status = AParcel_readInt32(parcel, &x); status != STATUS_OK) {
+            return status;
+        }
+        if (binder_status_t status = AParcel_readInt32(parcel, &y); status != STATUS_OK) {
+            return status;
+        }
+        return AParcel_readFloat(parcel, &pressure);
+    }
+};
+
+// The element by element path which vectors of enums would otherwise take through the C API, with
+// the same representation in the parcel.
+static binder_status_t writeIntEnumElement(AParcel* parcel, const void* vectorData,
+                                           size_t index) {
+    const auto* vec = static_cast<const std::vector<IntEnum>*>(vectorData);
+    return AParcel_writeInt32(parcel, static_cast<int32_t>(vec->at(index)));
+}
+static binder_status_t readIntEnumElement(const AParcel* parcel, void* vectorData, size_t index) {
+    auto* vec = static_cast<std::vector<IntEnum>*>(vectorData);
+    int32_t value;
+    binder_status_t status = AParcel_readInt32(parcel, &value);
+    vec->at(index) = static_cast<IntEnum>(value);
+    return status;
+}
+
+struct ByElement {};
+
+template <typename T>
+static void writeVector(AParcel* parcel, const std::vector<T>& vec) {
+    CHECK_EQ(STATUS_OK, ndk::AParcel_writeVector(parcel, vec));
+}
+template <typename T>
+static void readVector(const AParcel* parcel, std::vector<T>* vec) {
+    CHECK_EQ(STATUS_OK, ndk::AParcel_readVector(parcel, vec));
+}
+
+// Construct a series of args { 1 << 0, 1 << 2, ..., 1 << 12 }
+static void VectorArgs(benchmark::internal::Benchmark* b) {
+    for (int i = 0; i <= 12; i += 2) {
+        b->Args({1 << i});
+    }
+}
+
+template <typename T, typename Mode = void>
+static void BM_ParcelVector(benchmark::State& state) {
+    const size_t elements = static_cast<size_t>(state.range(0));
+
+    std::vector<T> v1(elements);
+    std::vector<T> v2;
+    ndk::ScopedAParcel parcel(AParcel_create());
+    while (state.KeepRunning()) {
+        CHECK_EQ(STATUS_OK, AParcel_setDataPosition(parcel.get(), 0));
+        if constexpr (std::is_same_v<Mode, ByElement>) {
+            CHECK_EQ(STATUS_OK,
+                     AParcel_writeParcelableArray(parcel.get(), &v1,
+                                                  static_cast<int32_t>(v1.size()),
+                                                  writeIntEnumElement));
+        } else {
+            writeVector(parcel.get(), v1);
+        }
+
+        CHECK_EQ(STATUS_OK, AParcel_setDataPosition(parcel.get(), 0));
+        if constexpr (std::is_same_v<Mode, ByElement>) {
+            CHECK_EQ(STATUS_OK,
+                     AParcel_readParcelableArray(parcel.get(), &v2,
+                                                 ndk::AParcel_stdVectorExternalAllocator<T>,
+                                                 readIntEnumElement));
+        } else {
+            readVector(parcel.get(), &v2);
+        }
+
+        benchmark::DoNotOptimize(v2.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * elements));
+}
+
+// one copy of the whole vector
+static void BM_IntEnumVector(benchmark::State& state) {
+    BM_ParcelVector<IntEnum>(state);
+}
+// a call through the C API per element, with the same result
+static void BM_IntEnumVectorByElement(benchmark::State& state) {
+    BM_ParcelVector<IntEnum, ByElement>(state);
+}
+// for reference, the primitive array which the enum vector is parcelled as
+static void BM_Int32Vector(benchmark::State& state) {
+    BM_ParcelVector<int32_t>(state);
+}
+// parcelables have a null marker per element, so they are still parcelled element by element
+static void BM_PointVector(benchmark::State& state) {
+    BM_ParcelVector<Point>(state);
+}
+
+BENCHMARK(BM_IntEnumVector)->Apply(VectorArgs);
+BENCHMARK(BM_IntEnumVectorByElement)->Apply(VectorArgs);
+BENCHMARK(BM_Int32Vector)->Apply(VectorArgs);
+BENCHMARK(BM_PointVector)->Apply(VectorArgs);
+
+BENCHMARK_MAIN();
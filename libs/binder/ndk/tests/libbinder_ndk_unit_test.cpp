@@ -667,6 +667,39 @@ TEST(NdkBinder, GetClassInterfaceDescriptor) {
     ASSERT_STREQ(IFoo::kIFooDescriptor, AIBinder_Class_getDescriptor(IFoo::kClass));
 }
 
+enum class ByteEnum : int8_t { FOO = 1, BAR = -2 };
+enum class IntEnum : int32_t { FOO = 1, BAR = 1 << 30 };
+enum class LongEnum : int64_t { FOO = 1, BAR = 1ll << 40 };
+
+// Enum vectors are copied in one go, as arrays of their backing type B.
+template <typename E, typename B>
+void expectEnumVectorIsBackingArray(const std::vector<E>& values) {
+    ndk::ScopedAParcel parcel(AParcel_create());
+    ASSERT_EQ(STATUS_OK, ndk::AParcel_writeVector(parcel.get(), values));
+
+    ASSERT_EQ(STATUS_OK, AParcel_setDataPosition(parcel.get(), 0));
+    std::vector<B> backing;
+    ASSERT_EQ(STATUS_OK, ndk::AParcel_readVector(parcel.get(), &backing));
+    ASSERT_EQ(values.size(), backing.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        EXPECT_EQ(static_cast<B>(values[i]), backing[i]) << i;
+    }
+
+    ASSERT_EQ(STATUS_OK, AParcel_setDataPosition(parcel.get(), 0));
+    std::vector<E> read;
+    ASSERT_EQ(STATUS_OK, ndk::AParcel_readVector(parcel.get(), &read));
+    EXPECT_EQ(values, read);
+}
+
+TEST(NdkBinder, EnumVectorsAreBackingArrays) {
+    expectEnumVectorIsBackingArray<ByteEnum, uint8_t>({});
+    // not a multiple of the padding
+    expectEnumVectorIsBackingArray<ByteEnum, uint8_t>(
+            {ByteEnum::FOO, ByteEnum::BAR, ByteEnum::FOO});
+    expectEnumVectorIsBackingArray<IntEnum, int32_t>({IntEnum::BAR, IntEnum::FOO});
+    expectEnumVectorIsBackingArray<LongEnum, int64_t>({LongEnum::FOO, LongEnum::BAR});
+}
+
 int main(int argc, char* argv[]) {
     ::testing::InitGoogleTest(&argc, argv);
 
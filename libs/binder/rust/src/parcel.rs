@@ -26,9 +26,11 @@ use std::convert::TryInto;
 use std::mem::ManuallyDrop;
 use std::ptr;
 
+mod borrowed;
 mod file_descriptor;
 mod parcelable;
 
+pub use self::borrowed::{BorrowedArrayElement, DeserializeBorrowed, ParcelStr};
 pub use self::file_descriptor::ParcelFileDescriptor;
 pub use self::parcelable::{
     Deserialize, DeserializeArray, DeserializeOption, Serialize, SerializeArray, SerializeOption,
@@ -219,6 +221,19 @@ impl Parcel {
         D::deserialize(self)
     }
 
+    /// Attempt to read a type that implements [`DeserializeBorrowed`] from
+    /// this `Parcel`, borrowing the data in the parcel rather than copying it.
+    ///
+    /// # Examples
+    ///
+    /// ```ignore
+    /// let name: ParcelStr = data.read_borrowed()?;
+    /// let blob: &[u8] = data.read_borrowed()?;
+    /// ```
+    pub fn read_borrowed<'a, D: DeserializeBorrowed<'a>>(&'a self) -> Result<D> {
+        D::deserialize_borrowed(self)
+    }
+
     /// Read a vector size from the `Parcel` and resize the given output vector
     /// to be correctly sized for that amount of data.
     ///
@@ -560,3 +575,48 @@ fn test_sized_write() {
         &arr,
     );
 }
+
+#[test]
+fn test_read_borrowed() {
+    use crate::binder::Interface;
+    use crate::native::Binder;
+
+    let mut service = Binder::new(()).as_binder();
+    let mut parcel = Parcel::new_for_test(&mut service).unwrap();
+    let start = parcel.get_data_position();
+
+    assert!(parcel.write("Hello, Binder!").is_ok());
+    assert!(parcel.write("").is_ok());
+    assert!(parcel.write(&None::<String>).is_ok());
+    assert!(parcel.write(&b"bytes"[..]).is_ok());
+    assert!(parcel.write(&[1i32, -2, 3][..]).is_ok());
+    assert!(parcel.write(&[0.5f32, 1.5][..]).is_ok());
+    assert!(parcel.write(&None::<Vec<u32>>).is_ok());
+    assert!(parcel.write(&Vec::<u8>::new()).is_ok());
+    unsafe {
+        assert!(parcel.set_data_position(start).is_ok());
+    }
+
+    let s: ParcelStr = parcel.read_borrowed().unwrap();
+    assert_eq!(s, "Hello, Binder!");
+    assert_eq!(s.to_utf8().unwrap(), "Hello, Binder!");
+    let s: ParcelStr = parcel.read_borrowed().unwrap();
+    assert!(s.is_empty());
+    assert_eq!(parcel.read_borrowed::<Option<ParcelStr>>(), Ok(None));
+    assert_eq!(parcel.read_borrowed::<&[u8]>().unwrap(), b"bytes");
+    assert_eq!(parcel.read_borrowed::<&[i32]>().unwrap(), [1, -2, 3]);
+    assert_eq!(parcel.read_borrowed::<&[f32]>().unwrap(), [0.5, 1.5]);
+    assert_eq!(parcel.read_borrowed::<&[u32]>(), Err(StatusCode::UNEXPECTED_NULL));
+    assert_eq!(parcel.read_borrowed::<Option<&[u8]>>(), Ok(Some(&[][..])));
+    assert_eq!(parcel.read_borrowed::<&[u8]>(), Err(StatusCode::NOT_ENOUGH_DATA));
+
+    // the borrowed reads leave the parcel where the owned reads would
+    unsafe {
+        assert!(parcel.set_data_position(start).is_ok());
+    }
+    let _: ParcelStr = parcel.read_borrowed().unwrap();
+    assert_eq!(parcel.read::<String>().unwrap(), "");
+    assert_eq!(parcel.read::<Option<String>>().unwrap(), None);
+    let _: &[u8] = parcel.read_borrowed().unwrap();
+    assert_eq!(parcel.read::<Vec<i32>>().unwrap(), [1, -2, 3]);
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+use crate::binder::AsNative;
+use crate::error::{status_result, Result, StatusCode};
+use crate::parcel::Parcel;
+use crate::sys;
+
+use std::char::{decode_utf16, DecodeUtf16};
+use std::convert::TryInto;
+use std::fmt;
+use std::iter::Copied;
+use std::mem;
+use std::ptr;
+use std::slice;
+
+/// A type which can be read from a [`Parcel`] without copying, by borrowing
+/// the data in the parcel.
+///
+/// The borrow lasts as long as the borrow of the parcel, so a service can
+/// inspect large arguments in place for the duration of a transaction, like
+/// the `readInplace` family of the C++ `Parcel`.
+pub trait DeserializeBorrowed<'a>: Sized {
+    /// Deserialize an instance borrowing from the given [`Parcel`].
+    fn deserialize_borrowed(parcel: &'a Parcel) -> Result<Self>;
+}
+
+/// Element types of arrays which are parcelled as a contiguous copy of their
+/// elements, so can be borrowed as a slice.
+///
+/// Only types with an alignment of at most four bytes are included, since that
+/// is all the alignment parcel data has. `bool` and `u16`/`i16` arrays are
+/// parcelled as an `i32` per element, so are not included either.
+///
+/// # Safety
+///
+/// Implementors must be valid for any bit pattern, and must be parcelled as
+/// a contiguous array by the corresponding `SerializeArray` implementation.
+pub unsafe trait BorrowedArrayElement: Copy {}
+
+// Safety: these are all plain old data of at most four byte alignment, and are
+// parcelled with `AParcel_write*Array`, which copies the whole array.
+unsafe impl BorrowedArrayElement for u8 {}
+unsafe impl BorrowedArrayElement for i8 {}
+unsafe impl BorrowedArrayElement for u32 {}
+unsafe impl BorrowedArrayElement for i32 {}
+unsafe impl BorrowedArrayElement for f32 {}
+
+/// Read `len` bytes of data in place, returning a pointer into the parcel.
+fn read_inplace(parcel: &Parcel, len: usize) -> Result<*const u8> {
+    let len = len.try_into().or(Err(StatusCode::BAD_VALUE))?;
+    let mut data = ptr::null();
+    unsafe {
+        // Safety: `Parcel` always contains a valid pointer to an `AParcel`,
+        // and we pass a valid out pointer, which is assigned a pointer to
+        // `len` bytes of parcel data if the call succeeds.
+        status_result(sys::AParcel_readInplace(parcel.as_native(), len, &mut data))?;
+    }
+    Ok(data.cast())
+}
+
+fn read_array<'a, T: BorrowedArrayElement>(parcel: &'a Parcel) -> Result<Option<&'a [T]>> {
+    let len: i32 = parcel.read()?;
+    if len < -1 {
+        return Err(StatusCode::BAD_VALUE);
+    }
+    if len == -1 {
+        return Ok(None);
+    }
+    if len == 0 {
+        return Ok(Some(&[]));
+    }
+
+    // usize in Rust may be 16-bit, so i32 may not fit
+    let len: usize = len.try_into().or(Err(StatusCode::BAD_VALUE))?;
+    let size = len.checked_mul(mem::size_of::<T>()).ok_or(StatusCode::BAD_VALUE)?;
+    let data = read_inplace(parcel, size)?;
+    if data as usize % mem::align_of::<T>() != 0 {
+        return Err(StatusCode::BAD_VALUE);
+    }
+    Ok(Some(unsafe {
+        // Safety: `data` points to `size` bytes of parcel data, and is
+        // suitably aligned for `T`, for which any bit pattern is valid. The
+        // data is not written to for as long as the parcel is borrowed, since
+        // writes need a mutable borrow.
+        slice::from_raw_parts(data.cast(), len)
+    }))
+}
+
+impl<'a, T: BorrowedArrayElement> DeserializeBorrowed<'a> for Option<&'a [T]> {
+    fn deserialize_borrowed(parcel: &'a Parcel) -> Result<Self> {
+        read_array(parcel)
+    }
+}
+
+impl<'a, T: BorrowedArrayElement> DeserializeBorrowed<'a> for &'a [T] {
+    fn deserialize_borrowed(parcel: &'a Parcel) -> Result<Self> {
+        read_array(parcel)?.ok_or(StatusCode::UNEXPECTED_NULL)
+    }
+}
+
+/// A string borrowed from a [`Parcel`].
+///
+/// Strings are parcelled as UTF-16, so this is a view of the UTF-16 data in the
+/// parcel, rather than a `&str`. It can be compared with a `str` and decoded
+/// without allocating, or converted to a `String` when it needs to be kept.
+#[derive(Clone, Copy, PartialEq, Eq, Hash)]
+pub struct ParcelStr<'a>(&'a [u16]);
+
+impl<'a> ParcelStr<'a> {
+    /// The UTF-16 code units of the string, without a null terminator.
+    pub fn as_utf16(&self) -> &'a [u16] {
+        self.0
+    }
+
+    /// Returns true if the string is empty.
+    pub fn is_empty(&self) -> bool {
+        self.0.is_empty()
+    }
+
+    /// Decode the characters of the string, which are errors for unpaired
+    /// surrogates.
+    pub fn chars(&self) -> DecodeUtf16<Copied<slice::Iter<'a, u16>>> {
+        decode_utf16(self.0.iter().copied())
+    }
+
+    /// Convert the string to UTF-8, failing with `BAD_VALUE` if it is not
+    /// valid UTF-16, as when reading a `String`.
+    pub fn to_utf8(&self) -> Result<String> {
+        String::from_utf16(self.0).or(Err(StatusCode::BAD_VALUE))
+    }
+}
+
+impl PartialEq<str> for ParcelStr<'_> {
+    fn eq(&self, other: &str) -> bool {
+        self.0.iter().copied().eq(other.encode_utf16())
+    }
+}
+
+impl PartialEq<&str> for ParcelStr<'_> {
+    fn eq(&self, other: &&str) -> bool {
+        *self == **other
+    }
+}
+
+impl fmt::Display for ParcelStr<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        for c in self.chars() {
+            fmt::Write::write_char(f, c.unwrap_or(char::REPLACEMENT_CHARACTER))?;
+        }
+        Ok(())
+    }
+}
+
+impl fmt::Debug for ParcelStr<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        fmt::Debug::fmt(&self.to_utf8().unwrap_or_else(|_| format!("{}", self)), f)
+    }
+}
+
+impl<'a> DeserializeBorrowed<'a> for Option<ParcelStr<'a>> {
+    fn deserialize_borrowed(parcel: &'a Parcel) -> Result<Self> {
+        // Same format as `Parcel::readString16Inplace`: the length in code
+        // units, followed by the null terminated string.
+        let len: i32 = parcel.read()?;
+        if len < -1 {
+            return Err(StatusCode::BAD_VALUE);
+        }
+        if len == -1 {
+            return Ok(None);
+        }
+
+        let len: usize = len.try_into().or(Err(StatusCode::BAD_VALUE))?;
+        let size = (len + 1).checked_mul(mem::size_of::<u16>()).ok_or(StatusCode::BAD_VALUE)?;
+        let data = read_inplace(parcel, size)?;
+        if data as usize % mem::align_of::<u16>() != 0 {
+            return Err(StatusCode::BAD_VALUE);
+        }
+        let units: &'a [u16] = unsafe {
+            // Safety: `data` points to `size` bytes of parcel data, which is
+            // suitably aligned, and is not written to while the parcel is
+            // borrowed.
+            slice::from_raw_parts(data.cast(), len + 1)
+        };
+        match units.split_last() {
+            Some((0, string)) => Ok(Some(ParcelStr(string))),
+            _ => Err(StatusCode::BAD_VALUE),
+        }
+    }
+}
+
+impl<'a> DeserializeBorrowed<'a> for ParcelStr<'a> {
+    fn deserialize_borrowed(parcel: &'a Parcel) -> Result<Self> {
+        Option::<ParcelStr<'a>>::deserialize_borrowed(parcel)?.ok_or(StatusCode::UNEXPECTED_NULL)
+    }
+}
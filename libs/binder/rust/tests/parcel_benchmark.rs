@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! Benchmarks of reading typical AIDL arguments on the service side of a
+//! transaction, copying them out of the parcel or borrowing them in place.
+
+use binder::declare_binder_interface;
+use binder::parcel::{Parcel, ParcelStr};
+use binder::{
+    Binder, BinderFeatures, IBinderInternal, Interface, SpIBinder, StatusCode, TransactionCode,
+    FIRST_CALL_TRANSACTION,
+};
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion};
+
+use std::convert::{TryFrom, TryInto};
+
+#[repr(u32)]
+#[derive(Clone, Copy)]
+enum BenchmarkTransactionCode {
+    ReadOwned = FIRST_CALL_TRANSACTION,
+    ReadBorrowed,
+}
+
+impl TryFrom<u32> for BenchmarkTransactionCode {
+    type Error = StatusCode;
+
+    fn try_from(c: u32) -> Result<Self, Self::Error> {
+        match c {
+            _ if c == BenchmarkTransactionCode::ReadOwned as u32 => {
+                Ok(BenchmarkTransactionCode::ReadOwned)
+            }
+            _ if c == BenchmarkTransactionCode::ReadBorrowed as u32 => {
+                Ok(BenchmarkTransactionCode::ReadBorrowed)
+            }
+            _ => Err(StatusCode::UNKNOWN_TRANSACTION),
+        }
+    }
+}
+
+/// Arguments of a call like those of many AIDL methods: a couple of names, a
+/// blob of bytes, and an array of ints.
+struct Payload {
+    package_name: String,
+    tag: String,
+    blob: Vec<u8>,
+    values: Vec<i32>,
+}
+
+impl Payload {
+    fn new(size: usize) -> Self {
+        Payload {
+            package_name: "com.android.example.benchmark".to_string(),
+            tag: "x".repeat(size / 16),
+            blob: vec![0x5a; size],
+            values: (0..(size / 4) as i32).collect(),
+        }
+    }
+
+    fn write(&self, data: &mut Parcel) -> binder::Result<()> {
+        data.write(&self.package_name)?;
+        data.write(&self.tag)?;
+        data.write(&self.blob)?;
+        data.write(&self.values)
+    }
+}
+
+/// Trivial interface to transact payloads with.
+pub trait IParcelBenchmark: Interface {}
+
+declare_binder_interface! {
+    IParcelBenchmark["android.os.IParcelBenchmark"] {
+        native: BnParcelBenchmark(on_transact),
+        proxy: BpParcelBenchmark,
+    }
+}
+
+impl IParcelBenchmark for BpParcelBenchmark {}
+
+impl IParcelBenchmark for Binder<BnParcelBenchmark> {}
+
+struct ParcelBenchmarkService;
+
+impl Interface for ParcelBenchmarkService {}
+
+impl IParcelBenchmark for ParcelBenchmarkService {}
+
+/// Reads the payload, and replies with a checksum of it, so that all of it is
+/// inspected either way.
+fn on_transact(
+    _service: &dyn IParcelBenchmark,
+    code: TransactionCode,
+    data: &Parcel,
+    reply: &mut Parcel,
+) -> binder::Result<()> {
+    let sum = match code.try_into()? {
+        BenchmarkTransactionCode::ReadOwned => {
+            let package_name: String = data.read()?;
+            let tag: String = data.read()?;
+            let blob: Vec<u8> = data.read()?;
+            let values: Vec<i32> = data.read()?;
+            package_name.len() + tag.len() + checksum(&blob, &values)
+        }
+        BenchmarkTransactionCode::ReadBorrowed => {
+            let package_name: ParcelStr = data.read_borrowed()?;
+            let tag: ParcelStr = data.read_borrowed()?;
+            let blob: &[u8] = data.read_borrowed()?;
+            let values: &[i32] = data.read_borrowed()?;
+            package_name.as_utf16().len() + tag.as_utf16().len() + checksum(blob, values)
+        }
+    };
+    reply.write(&(sum as i64))
+}
+
+fn checksum(blob: &[u8], values: &[i32]) -> usize {
+    blob.iter().map(|&b| b as usize).sum::<usize>()
+        + values.iter().map(|&v| v as usize).sum::<usize>()
+}
+
+fn transact(
+    service: &SpIBinder,
+    code: BenchmarkTransactionCode,
+    payload: &Payload,
+) -> binder::Result<i64> {
+    let reply = service.transact(code as TransactionCode, 0, |data| payload.write(data))?;
+    reply.read()
+}
+
+fn bench_read_payload(c: &mut Criterion) {
+    let service =
+        BnParcelBenchmark::new_binder(ParcelBenchmarkService, BinderFeatures::default())
+            .as_binder();
+
+    let mut group = c.benchmark_group("read_payload");
+    for size in [64, 1024, 16 * 1024].iter() {
+        let payload = Payload::new(*size);
+        for (name, code) in [
+            ("owned", BenchmarkTransactionCode::ReadOwned),
+            ("borrowed", BenchmarkTransactionCode::ReadBorrowed),
+        ]
+        .iter()
+        {
+            group.bench_with_input(BenchmarkId::new(*name, size), &payload, |b, payload| {
+                b.iter(|| black_box(transact(&service, *code, payload).unwrap()))
+            });
+        }
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_read_payload);
+criterion_main!(benches);
@@ -22,6 +22,7 @@
 
 #include <malloc.h>
 #include <functional>
+#include <iterator>
 #include <vector>
 
 struct DestructionAction {
@@ -168,11 +169,46 @@ TEST(BinderAllocation, SmallTransaction) {
     const auto on_malloc = OnMalloc([&](size_t bytes) {
         mallocs++;
         // Parcel should allocate a small amount by default
-        EXPECT_EQ(bytes, 128);
+        EXPECT_EQ(bytes, 256);
     });
+    // the data of the parcel may be left from earlier transactions
     manager->checkService(empty_descriptor);
 
-    EXPECT_EQ(mallocs, 1);
+    EXPECT_LE(mallocs, 1);
+}
+
+TEST(BinderAllocation, SmallTransactionsReuseParcelData) {
+    String16 empty_descriptor = String16("");
+    sp<IServiceManager> manager = defaultServiceManager();
+    manager->checkService(empty_descriptor); // keeps the data of its parcel
+
+    const auto m = ScopeDisallowMalloc();
+    for (size_t i = 0; i < 10; i++) {
+        manager->checkService(empty_descriptor);
+    }
+}
+
+TEST(BinderAllocation, SmallParcelsReuseData) {
+    {
+        // the data of both is kept for the next parcels
+        Parcel data;
+        Parcel reply;
+        data.writeInt32(0);
+        reply.writeInt32(0);
+    }
+
+    constexpr char16_t kDescriptor[] = u"android.os.IServiceManager";
+
+    const auto m = ScopeDisallowMalloc();
+    for (int32_t i = 0; i < 10; i++) {
+        Parcel data;
+        data.writeInt32(i);
+        data.writeString16(kDescriptor, std::size(kDescriptor) - 1);
+        Parcel reply;
+        reply.writeInt32(i);
+        imaginary_use = data.data();
+        imaginary_use = reply.data();
+    }
 }
 
 int main(int argc, char** argv) {
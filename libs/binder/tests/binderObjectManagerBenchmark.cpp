@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <binder/BpBinder.h>
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+// Usage: atest binderObjectManagerBenchmark
+
+using android::BpBinder;
+
+// Object IDs used by language runtimes are addresses of static tags, so use
+// addresses of distinct statics here as well.
+static char gObjectIds[16];
+
+static void ObjectCountArgs(benchmark::internal::Benchmark* b) {
+    for (int i : {1, 2, 4, 8, 16}) {
+        b->Args({i});
+    }
+}
+
+static void fill(BpBinder::ObjectManager* manager, size_t objects) {
+    for (size_t i = 0; i < objects; i++) {
+        manager->attach(&gObjectIds[i], &gObjectIds[i], nullptr, nullptr);
+    }
+}
+
+// Lookup of every attached object, the common case for proxies which already
+// have their JNI/NDK objects attached.
+static void BM_FindObject(benchmark::State& state) {
+    const size_t objects = state.range(0);
+    BpBinder::ObjectManager manager;
+    fill(&manager, objects);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < objects; i++) {
+            benchmark::DoNotOptimize(manager.find(&gObjectIds[i]));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * objects);
+}
+
+// Lookup of an ID which isn't attached, e.g. the first findObject before a
+// runtime attaches its own object.
+static void BM_FindMissingObject(benchmark::State& state) {
+    const size_t objects = state.range(0);
+    BpBinder::ObjectManager manager;
+    fill(&manager, objects);
+
+    static char missing;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(manager.find(&missing));
+    }
+}
+
+// Attach all objects to a fresh proxy and detach them again.
+static void BM_AttachDetachObjects(benchmark::State& state) {
+    const size_t objects = state.range(0);
+    BpBinder::ObjectManager manager;
+
+    while (state.KeepRunning()) {
+        fill(&manager, objects);
+        for (size_t i = 0; i < objects; i++) {
+            manager.detach(&gObjectIds[i]);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * objects);
+}
+
+// Attach all objects to a proxy which is then destroyed.
+static void BM_AttachKillObjects(benchmark::State& state) {
+    const size_t objects = state.range(0);
+
+    while (state.KeepRunning()) {
+        BpBinder::ObjectManager manager;
+        fill(&manager, objects);
+        manager.kill();
+    }
+    state.SetItemsProcessed(state.iterations() * objects);
+}
+
+BENCHMARK(BM_FindObject)->Apply(ObjectCountArgs);
+BENCHMARK(BM_FindMissingObject)->Apply(ObjectCountArgs);
+BENCHMARK(BM_AttachDetachObjects)->Apply(ObjectCountArgs);
+BENCHMARK(BM_AttachKillObjects)->Apply(ObjectCountArgs);
+
+BENCHMARK_MAIN();
@@ -17,6 +17,8 @@
 #include <binder/Parcel.h>
 #include <benchmark/benchmark.h>
 
+#include <iterator>
+
 // Usage: atest binderParcelBenchmark
 
 // For static assert(false) we need a template version to avoid early failure.
@@ -163,10 +165,38 @@ static void BM_Int64Vector(benchmark::State& state) {
     BM_ParcelVector<int64_t>(state);
 }
 
+/*
+  A parcel for each round trip, as for each transaction, with a few small
+  arguments. Their data is allocated once, and reused by the next parcels of
+  the thread.
+*/
+static void BM_SmallParcelRoundTrip(benchmark::State& state) {
+    constexpr char16_t kDescriptor[] = u"android.os.IServiceManager";
+
+    while (state.KeepRunning()) {
+        android::Parcel data;
+        data.writeString16(kDescriptor, std::size(kDescriptor) - 1);
+        data.writeInt32(42);
+        data.writeInt64(42);
+
+        data.setDataPosition(0);
+        size_t len;
+        benchmark::DoNotOptimize(data.readString16Inplace(&len));
+        benchmark::DoNotOptimize(data.readInt32());
+        benchmark::DoNotOptimize(data.readInt64());
+
+        android::Parcel reply;
+        reply.writeInt32(0);
+        benchmark::DoNotOptimize(reply.data());
+        benchmark::ClobberMemory();
+    }
+}
+
 BENCHMARK(BM_BoolVector)->Apply(VectorArgs);
 BENCHMARK(BM_ByteVector)->Apply(VectorArgs);
 BENCHMARK(BM_CharVector)->Apply(VectorArgs);
 BENCHMARK(BM_Int32Vector)->Apply(VectorArgs);
 BENCHMARK(BM_Int64Vector)->Apply(VectorArgs);
+BENCHMARK(BM_SmallParcelRoundTrip);
 
 BENCHMARK_MAIN();
@@ -18,9 +18,12 @@
 #include <android-base/logging.h>
 #include <benchmark/benchmark.h>
 #include <binder/Binder.h>
+#include <binder/BpBinder.h>
 #include <binder/RpcServer.h>
 #include <binder/RpcSession.h>
 
+#include <cstdlib>
+#include <iterator>
 #include <thread>
 
 #include <sys/types.h>
@@ -30,6 +33,8 @@ using android::BBinder;
 using android::IBinder;
 using android::interface_cast;
 using android::OK;
+using android::Parcel;
+using android::RpcPendingTransaction;
 using android::RpcServer;
 using android::RpcSession;
 using android::sp;
@@ -44,29 +49,53 @@ class MyBinderRpcBenchmark : public BnBinderRpcBenchmark {
         *out = str;
         return Status::ok();
     }
+    Status repeatBinders(const std::vector<sp<IBinder>>& binders,
+                         std::vector<sp<IBinder>>* out) override {
+        *out = binders;
+        return Status::ok();
+    }
 };
 
-static sp<RpcSession> gSession = RpcSession::make();
+// number of threads of the server, and of concurrent calls in the benchmarks below
+constexpr size_t kMaxThreads = 16;
+
+// Sessions to the same server, by whether they exchange commands through shared memory rather
+// than through their sockets, and by whether all their calls are multiplexed over a single
+// connection. The benchmarks take the former as their first argument.
+static sp<RpcSession> gSessions[2][2];
+
+static sp<RpcSession> getSession(const benchmark::State& state, bool multiplexed = false) {
+    return gSessions[state.range(0)][multiplexed];
+}
+
+// Sessions to the same server over inet loopback, by whether they compress their large payloads.
+static sp<RpcSession> gInetSessions[2];
+constexpr size_t kCompressionMinBytes = 1024;
+
+static void Transports(benchmark::internal::Benchmark* b) {
+    b->ArgName("shared_memory")->Arg(0)->Arg(1);
+}
 
 void BM_getRootObject(benchmark::State& state) {
+    sp<RpcSession> session = getSession(state);
     while (state.KeepRunning()) {
-        CHECK(gSession->getRootObject() != nullptr);
+        CHECK(session->getRootObject() != nullptr);
     }
 }
-BENCHMARK(BM_getRootObject);
+BENCHMARK(BM_getRootObject)->Apply(Transports);
 
 void BM_pingTransaction(benchmark::State& state) {
-    sp<IBinder> binder = gSession->getRootObject();
+    sp<IBinder> binder = getSession(state)->getRootObject();
     CHECK(binder != nullptr);
 
     while (state.KeepRunning()) {
         CHECK_EQ(OK, binder->pingBinder());
     }
 }
-BENCHMARK(BM_pingTransaction);
+BENCHMARK(BM_pingTransaction)->Apply(Transports);
 
 void BM_repeatString(benchmark::State& state) {
-    sp<IBinder> binder = gSession->getRootObject();
+    sp<IBinder> binder = getSession(state)->getRootObject();
     CHECK(binder != nullptr);
     sp<IBinderRpcBenchmark> iface = interface_cast<IBinderRpcBenchmark>(binder);
     CHECK(iface != nullptr);
@@ -92,10 +121,10 @@ void BM_repeatString(benchmark::State& state) {
         CHECK(ret.isOk()) << ret;
     }
 }
-BENCHMARK(BM_repeatString);
+BENCHMARK(BM_repeatString)->Apply(Transports);
 
 void BM_repeatBinder(benchmark::State& state) {
-    sp<IBinder> binder = gSession->getRootObject();
+    sp<IBinder> binder = getSession(state)->getRootObject();
     CHECK(binder != nullptr);
     sp<IBinderRpcBenchmark> iface = interface_cast<IBinderRpcBenchmark>(binder);
     CHECK(iface != nullptr);
@@ -109,7 +138,132 @@ void BM_repeatBinder(benchmark::State& state) {
         CHECK(ret.isOk()) << ret;
     }
 }
-BENCHMARK(BM_repeatBinder);
+BENCHMARK(BM_repeatBinder)->Apply(Transports);
+
+void BM_repeatBinders(benchmark::State& state) {
+    sp<IBinder> binder = getSession(state)->getRootObject();
+    CHECK(binder != nullptr);
+    sp<IBinderRpcBenchmark> iface = interface_cast<IBinderRpcBenchmark>(binder);
+    CHECK(iface != nullptr);
+
+    // Sends many binders at once, as interfaces handing out callbacks do, each of which is
+    // assigned a new address and looked up while the others are still known to the session.
+    const size_t count = static_cast<size_t>(state.range(1));
+    while (state.KeepRunning()) {
+        std::vector<sp<IBinder>> binders;
+        binders.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            binders.push_back(sp<BBinder>::make());
+        }
+
+        std::vector<sp<IBinder>> out;
+        Status ret = iface->repeatBinders(binders, &out);
+        CHECK(ret.isOk()) << ret;
+        CHECK_EQ(binders.size(), out.size());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+BENCHMARK(BM_repeatBinders)
+        ->ArgNames({"shared_memory", "count"})
+        ->Args({0, 100})
+        ->Args({0, 10000})
+        ->Args({1, 100})
+        ->Args({1, 10000});
+
+void BM_repeatStringThreads(benchmark::State& state) {
+    // Throughput of concurrent calls, each over a connection of its own, or all of them sharing
+    // one connection.
+    sp<RpcSession> session = getSession(state, state.range(1));
+    sp<IBinderRpcBenchmark> iface = interface_cast<IBinderRpcBenchmark>(session->getRootObject());
+    CHECK(iface != nullptr);
+
+    std::string str = std::string(getpagesize() * 2, 'a');
+    for (auto _ : state) {
+        std::string out;
+        Status ret = iface->repeatString(str, &out);
+        CHECK(ret.isOk()) << ret;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_repeatStringThreads)
+        ->ArgNames({"shared_memory", "multiplexed"})
+        ->Args({0, 0})
+        ->Args({0, 1})
+        ->Args({1, 0})
+        ->Args({1, 1})
+        ->ThreadRange(1, static_cast<int>(kMaxThreads))
+        ->UseRealTime();
+
+void BM_repeatStringPipelined(benchmark::State& state) {
+    // Throughput of concurrent calls which a single thread keeps in flight, to compare with as
+    // many threads making one call each above, and with calls made one after the other.
+    sp<IBinder> binder = getSession(state, true /*multiplexed*/)->getRootObject();
+    CHECK(binder != nullptr);
+    const size_t depth = static_cast<size_t>(state.range(1));
+
+    std::string str = std::string(getpagesize() * 2, 'a');
+    for (auto _ : state) {
+        std::vector<Parcel> replies(depth);
+        std::vector<std::unique_ptr<RpcPendingTransaction>> pending;
+        pending.reserve(depth);
+        for (size_t i = 0; i < depth; i++) {
+            Parcel data;
+            data.markForBinder(binder);
+            CHECK_EQ(OK, data.writeInterfaceToken(IBinderRpcBenchmark::descriptor));
+            CHECK_EQ(OK, data.writeUtf8AsUtf16(str));
+            pending.push_back(binder->remoteBinder()->transactAsync(
+                    IBinderRpcBenchmark::TRANSACTION_repeatString, data, &replies[i]));
+        }
+        for (size_t i = 0; i < depth; i++) {
+            CHECK_EQ(OK, pending[i]->wait());
+            Status ret;
+            CHECK_EQ(OK, ret.readFromParcel(replies[i]));
+            CHECK(ret.isOk()) << ret;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * depth));
+}
+BENCHMARK(BM_repeatStringPipelined)
+        ->ArgNames({"shared_memory", "depth"})
+        ->RangeMultiplier(2)
+        ->Ranges({{0, 1}, {1, static_cast<int64_t>(kMaxThreads)}})
+        ->UseRealTime();
+
+// Text-like data, which compresses about as well as typical payloads do.
+static std::string makePayload(size_t size) {
+    static const char* kWords[] = {"binder", "session", "transaction", "reply", "parcel",
+                                   "interface", "service", "status", "android", "data"};
+    std::string payload;
+    while (payload.size() < size) {
+        payload += kWords[rand() % std::size(kWords)];
+        payload += ' ';
+    }
+    payload.resize(size);
+    return payload;
+}
+
+void BM_repeatStringInet(benchmark::State& state) {
+    // Over loopback, compression only pays off once the time it saves on the wire outweighs
+    // the time it costs, so this is mostly meant to be run with the bandwidth of the loopback
+    // interface limited (e.g. with 'tc'), to compare with sockets across devices or VMs.
+    sp<IBinder> binder = gInetSessions[state.range(0)]->getRootObject();
+    CHECK(binder != nullptr);
+    sp<IBinderRpcBenchmark> iface = interface_cast<IBinderRpcBenchmark>(binder);
+    CHECK(iface != nullptr);
+
+    // written as UTF-16, so twice as large on the wire
+    std::string str = makePayload(static_cast<size_t>(state.range(1)));
+    for (auto _ : state) {
+        std::string out;
+        Status ret = iface->repeatString(str, &out);
+        CHECK(ret.isOk()) << ret;
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * str.size() * 2));
+}
+BENCHMARK(BM_repeatStringInet)
+        ->ArgNames({"compressed", "bytes"})
+        ->RangeMultiplier(4)
+        ->Ranges({{0, 1}, {256, 16384}});
 
 int main(int argc, char** argv) {
     ::benchmark::Initialize(&argc, argv);
@@ -122,16 +276,46 @@ int main(int argc, char** argv) {
         sp<RpcServer> server = RpcServer::make();
         server->setRootObject(sp<MyBinderRpcBenchmark>::make());
         server->iUnderstandThisCodeIsExperimentalAndIWillNotUseItInProduction();
+        server->setMaxThreads(kMaxThreads);
         CHECK(server->setupUnixDomainServer(addr.c_str()));
         server->join();
     }).detach();
 
-    for (size_t tries = 0; tries < 5; tries++) {
-        usleep(10000);
-        if (gSession->setupUnixDomainClient(addr.c_str())) goto success;
+    unsigned int inetPort = 0;
+    {
+        sp<RpcServer> server = RpcServer::make();
+        server->setRootObject(sp<MyBinderRpcBenchmark>::make());
+        server->iUnderstandThisCodeIsExperimentalAndIWillNotUseItInProduction();
+        server->setMaxThreads(kMaxThreads);
+        CHECK(server->setupInetServer(0, &inetPort));
+        std::thread([server]() { server->join(); }).detach();
+    }
+
+    for (bool compressed : {false, true}) {
+        sp<RpcSession> session = RpcSession::make();
+        if (compressed) session->setCompression(kCompressionMinBytes);
+        CHECK(session->setupInetClient("127.0.0.1", inetPort)) << "Could not connect.";
+        CHECK_EQ(compressed, session->isUsingCompression());
+        gInetSessions[compressed] = session;
+    }
+
+    for (bool sharedMemory : {false, true}) {
+        for (bool multiplexed : {false, true}) {
+            sp<RpcSession> session = RpcSession::make();
+            session->setSharedMemoryTransport(sharedMemory);
+            if (multiplexed) session->setMultiplexedConnections(1);
+
+            bool connected = false;
+            for (size_t tries = 0; tries < 5 && !connected; tries++) {
+                usleep(10000);
+                connected = session->setupUnixDomainClient(addr.c_str());
+            }
+            CHECK(connected) << "Could not connect.";
+            CHECK_EQ(sharedMemory, session->isUsingSharedMemory());
+            CHECK_EQ(multiplexed, session->isMultiplexed());
+            gSessions[sharedMemory][multiplexed] = session;
+        }
     }
-    LOG(FATAL) << "Could not connect.";
-success:
 
     ::benchmark::RunSpecifiedBenchmarks();
     return 0;
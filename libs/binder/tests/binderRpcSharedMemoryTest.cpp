@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <numeric>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+
+#include "../RpcSharedMemory.h"
+
+namespace android {
+
+using base::unique_fd;
+using namespace std::chrono_literals;
+
+// long enough not to be hit on a loaded device, only to not hang forever
+constexpr auto kWakeTimeout = 5s;
+
+class RpcSharedMemoryTest : public ::testing::Test {
+public:
+    void SetUp() override {
+        int sockets[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets));
+        mClientSocket.reset(sockets[0]);
+        mServerSocket.reset(sockets[1]);
+    }
+
+protected:
+    using Ring = RpcSharedMemory::Ring;
+    static constexpr uint32_t kRingSize = RpcSharedMemory::kRingSize;
+
+    static size_t memorySize() { return RpcSharedMemory::memorySize(); }
+
+    void connect() {
+        mClient = RpcSharedMemory::make();
+        ASSERT_NE(nullptr, mClient);
+        ASSERT_TRUE(mClient->send(mClientSocket));
+        mServer = RpcSharedMemory::receive(mServerSocket);
+        ASSERT_NE(nullptr, mServer);
+    }
+
+    // The ring the client writes to, and the server reads from. Either side
+    // may change it, as it is in memory shared between them.
+    Ring& clientRing() { return *mClient->mWriteRing; }
+
+    static unique_fd makeMemory(size_t size) {
+        unique_fd memFd(memfd_create("test", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+        EXPECT_NE(-1, memFd.get());
+        EXPECT_EQ(0, ftruncate(memFd.get(), static_cast<off_t>(size)));
+        EXPECT_EQ(0, fcntl(memFd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL));
+        return memFd;
+    }
+
+    static unique_fd makeEvent(int flags) {
+        unique_fd event(eventfd(0, EFD_CLOEXEC | flags));
+        EXPECT_NE(-1, event.get());
+        return event;
+    }
+
+    // Sends the fds as a (misbehaving) client would, instead of RpcSharedMemory::send().
+    void sendFds(const std::vector<unique_fd>& fds) {
+        std::vector<int> rawFds;
+        for (const unique_fd& fd : fds) rawFds.push_back(fd.get());
+        size_t fdsSize = rawFds.size() * sizeof(int);
+
+        char byte = 0;
+        iovec iov{.iov_base = &byte, .iov_len = sizeof(byte)};
+        std::vector<uint8_t> control(CMSG_SPACE(fdsSize));
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fdsSize);
+        memcpy(CMSG_DATA(cmsg), rawFds.data(), fdsSize);
+        ASSERT_EQ(static_cast<ssize_t>(sizeof(byte)), sendmsg(mClientSocket.get(), &msg, 0));
+    }
+
+    std::vector<unique_fd> makeValidFds() {
+        std::vector<unique_fd> fds;
+        fds.push_back(makeMemory(memorySize()));
+        for (size_t i = 0; i < RpcSharedMemory::kEventCount; i++) {
+            fds.push_back(makeEvent(EFD_NONBLOCK));
+        }
+        return fds;
+    }
+
+    unique_fd mClientSocket;
+    unique_fd mServerSocket;
+    std::unique_ptr<RpcSharedMemory> mClient;
+    std::unique_ptr<RpcSharedMemory> mServer;
+};
+
+TEST_F(RpcSharedMemoryTest, TransfersData) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+
+    // more than fits in the ring, so that the writer waits for the reader
+    std::vector<uint8_t> sent(3 * kRingSize + 7);
+    std::iota(sent.begin(), sent.end(), 0);
+    auto written = std::async(std::launch::async, [&] {
+        return mClient->write(mClientSocket, sent.data(), sent.size());
+    });
+
+    std::vector<uint8_t> received(sent.size());
+    EXPECT_EQ(OK, mServer->read(mServerSocket, received.data(), received.size()));
+    ASSERT_EQ(std::future_status::ready, written.wait_for(kWakeTimeout));
+    EXPECT_EQ(OK, written.get());
+    EXPECT_EQ(sent, received);
+
+    uint32_t reply = 0xdeadbeef;
+    EXPECT_EQ(OK, mServer->write(mServerSocket, &reply, sizeof(reply)));
+    uint32_t receivedReply = 0;
+    EXPECT_EQ(OK, mClient->read(mClientSocket, &receivedReply, sizeof(receivedReply)));
+    EXPECT_EQ(reply, receivedReply);
+}
+
+TEST_F(RpcSharedMemoryTest, TransfersDataAcrossWrappedPositions) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    clientRing().head = UINT32_MAX - 3;
+    clientRing().tail = UINT32_MAX - 3;
+
+    uint64_t sent = 0x0123456789abcdef;
+    EXPECT_EQ(OK, mClient->write(mClientSocket, &sent, sizeof(sent)));
+    uint64_t received = 0;
+    EXPECT_EQ(OK, mServer->read(mServerSocket, &received, sizeof(received)));
+    EXPECT_EQ(sent, received);
+    EXPECT_EQ(4u, clientRing().head);
+}
+
+TEST_F(RpcSharedMemoryTest, ReadsFullRing) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    // as large as the ring may get, so not corrupt
+    clientRing().tail = 100;
+    clientRing().head = 100 + kRingSize;
+
+    std::vector<uint8_t> received(kRingSize);
+    EXPECT_EQ(OK, mServer->read(mServerSocket, received.data(), received.size()));
+}
+
+TEST_F(RpcSharedMemoryTest, RejectsReadWithHeadTooFarAhead) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    clientRing().tail = 100;
+    clientRing().head = 100 + kRingSize + 1;
+
+    uint8_t byte;
+    EXPECT_EQ(BAD_VALUE, mServer->read(mServerSocket, &byte, sizeof(byte)));
+}
+
+TEST_F(RpcSharedMemoryTest, RejectsReadWithHeadBehindTail) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    clientRing().tail = 100;
+    clientRing().head = 99;
+
+    uint8_t byte;
+    EXPECT_EQ(BAD_VALUE, mServer->read(mServerSocket, &byte, sizeof(byte)));
+}
+
+TEST_F(RpcSharedMemoryTest, RejectsWriteWithTailAheadOfHead) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    clientRing().head = 100;
+    clientRing().tail = 101;
+
+    uint8_t byte = 0;
+    EXPECT_EQ(BAD_VALUE, mClient->write(mClientSocket, &byte, sizeof(byte)));
+}
+
+TEST_F(RpcSharedMemoryTest, RejectsWriteWithTailTooFarBehind) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    clientRing().head = UINT32_MAX;
+    clientRing().tail = UINT32_MAX - kRingSize - 1;
+
+    uint8_t byte = 0;
+    EXPECT_EQ(BAD_VALUE, mClient->write(mClientSocket, &byte, sizeof(byte)));
+}
+
+TEST_F(RpcSharedMemoryTest, WakesReaderWhenPeerCloses) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    auto read = std::async(std::launch::async, [&] {
+        uint8_t byte;
+        return mServer->read(mServerSocket, &byte, sizeof(byte));
+    });
+
+    mClient = nullptr;
+    ASSERT_EQ(std::future_status::ready, read.wait_for(kWakeTimeout));
+    EXPECT_EQ(DEAD_OBJECT, read.get());
+}
+
+TEST_F(RpcSharedMemoryTest, WakesReaderWhenPeerDies) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    auto read = std::async(std::launch::async, [&] {
+        uint8_t byte;
+        return mServer->read(mServerSocket, &byte, sizeof(byte));
+    });
+
+    // as when the client process dies, without marking the rings closed
+    mClientSocket.reset();
+    ASSERT_EQ(std::future_status::ready, read.wait_for(kWakeTimeout));
+    EXPECT_EQ(DEAD_OBJECT, read.get());
+}
+
+TEST_F(RpcSharedMemoryTest, WakesWriterWhenPeerDies) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    auto written = std::async(std::launch::async, [&] {
+        std::vector<uint8_t> data(2 * kRingSize);
+        return mClient->write(mClientSocket, data.data(), data.size());
+    });
+
+    mServerSocket.reset();
+    ASSERT_EQ(std::future_status::ready, written.wait_for(kWakeTimeout));
+    EXPECT_EQ(DEAD_OBJECT, written.get());
+}
+
+TEST_F(RpcSharedMemoryTest, ReadsDataWrittenBeforePeerDies) {
+    ASSERT_NO_FATAL_FAILURE(connect());
+    uint32_t sent = 42;
+    EXPECT_EQ(OK, mClient->write(mClientSocket, &sent, sizeof(sent)));
+    mClientSocket.reset();
+
+    uint32_t received = 0;
+    EXPECT_EQ(OK, mServer->read(mServerSocket, &received, sizeof(received)));
+    EXPECT_EQ(sent, received);
+    EXPECT_EQ(DEAD_OBJECT, mServer->read(mServerSocket, &received, sizeof(received)));
+}
+
+TEST_F(RpcSharedMemoryTest, ReceivesValidFds) {
+    ASSERT_NO_FATAL_FAILURE(sendFds(makeValidFds()));
+    EXPECT_NE(nullptr, RpcSharedMemory::receive(mServerSocket));
+}
+
+TEST_F(RpcSharedMemoryTest, RejectsMemoryOfWrongSize) {
+    std::vector<unique_fd> fds = makeValidFds();
+    fds[0] = makeMemory(memorySize() / 2);
+    ASSERT_NO_FATAL_FAILURE(sendFds(fds));
+    EXPECT_EQ(nullptr, RpcSharedMemory::receive(mServerSocket));
+}
+
+TEST_F(RpcSharedMemoryTest, RejectsMissingEvents) {
+    std::vector<unique_fd> fds = makeValidFds();
+    fds.pop_back();
+    ASSERT_NO_FATAL_FAILURE(sendFds(fds));
+    EXPECT_EQ(nullptr, RpcSharedMemory::receive(mServerSocket));
+}
+
+TEST_F(RpcSharedMemoryTest, RejectsBlockingEvents) {
+    std::vector<unique_fd> fds = makeValidFds();
+    fds[1] = makeEvent(0);
+    ASSERT_NO_FATAL_FAILURE(sendFds(fds));
+    EXPECT_EQ(nullptr, RpcSharedMemory::receive(mServerSocket));
+}
+
+TEST_F(RpcSharedMemoryTest, RejectsEventsWhichAreNotEventFds) {
+    std::vector<unique_fd> fds = makeValidFds();
+    fds[2] = makeMemory(memorySize());
+    ASSERT_EQ(0, fcntl(fds[2].get(), F_SETFL, O_NONBLOCK));
+    ASSERT_NO_FATAL_FAILURE(sendFds(fds));
+    EXPECT_EQ(nullptr, RpcSharedMemory::receive(mServerSocket));
+}
+
+} // namespace android
@@ -25,8 +25,10 @@
 #include <binder/BpBinder.h>
 #include <binder/IServiceManager.h>
 #include <binder/ProcessState.h>
+#include <binder/RpcAddress.h>
 #include <binder/RpcServer.h>
 #include <binder/RpcSession.h>
+#include <binder/TransactionStats.h>
 #include <gtest/gtest.h>
 
 #include <chrono>
@@ -35,6 +37,7 @@
 #include <thread>
 
 #include <sys/prctl.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "../RpcState.h"   // for debugging
@@ -62,6 +65,63 @@ TEST(BinderRpc, SetExternalServer) {
     ASSERT_EQ(sinkFd, retrieved.get());
 }
 
+TEST(BinderRpc, UniqueAddressesAfterFork) {
+    // as a server forked after this process sent binders
+    (void)RpcAddress::unique();
+
+    base::unique_fd readEnd, writeEnd;
+    ASSERT_TRUE(base::Pipe(&readEnd, &writeEnd));
+    pid_t pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+        readEnd.reset();
+        CHECK(base::WriteStringToFd(RpcAddress::unique().toString(), writeEnd));
+        _exit(0);
+    }
+    writeEnd.reset();
+
+    std::string childAddress;
+    ASSERT_TRUE(base::ReadFdToString(readEnd, &childAddress));
+    EXPECT_EQ(pid, TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0)));
+    EXPECT_NE(RpcAddress::unique().toString(), childAddress);
+}
+
+// Like proxies of the same interface, each has a copy of the descriptor of its own.
+class DescriptorCopyBinder : public BBinder {
+public:
+    static inline const char* kDescriptor = "android.binder.test.DescriptorCopy";
+    const String16& getInterfaceDescriptor() const override { return mDescriptor; }
+
+private:
+    const String16 mDescriptor{kDescriptor};
+};
+
+TEST(BinderRpc, TransactionStatsKeyedByDescriptorContents) {
+    // more than the keys a thread can record
+    constexpr size_t kBinders = 200;
+
+    TransactionStats::reset();
+    TransactionStats::setEnabled(true);
+    std::vector<sp<IBinder>> binders;
+    for (size_t i = 0; i < kBinders; i++) {
+        binders.push_back(sp<DescriptorCopyBinder>::make());
+        Parcel data;
+        Parcel reply;
+        EXPECT_EQ(OK, binders.back()->transact(IBinder::PING_TRANSACTION, data, &reply));
+    }
+    TransactionStats::setEnabled(false);
+
+    size_t found = 0;
+    for (const auto& entry : TransactionStats::getEntries()) {
+        if (entry.descriptor != String16(DescriptorCopyBinder::kDescriptor)) continue;
+        found++;
+        EXPECT_EQ(TransactionStats::Direction::INCOMING, entry.direction);
+        EXPECT_EQ(static_cast<uint32_t>(IBinder::PING_TRANSACTION), entry.code);
+        EXPECT_EQ(kBinders, entry.count);
+    }
+    EXPECT_EQ(1u, found);
+}
+
 using android::binder::Status;
 
 #define EXPECT_OK(status)                 \
@@ -115,6 +175,21 @@ public:
         }
         return Status::ok();
     }
+    Status getThreadPoolStats(RpcThreadPoolStats* out) override {
+        sp<RpcServer> spServer = server.promote();
+        if (spServer == nullptr) {
+            return Status::fromExceptionCode(Status::EX_NULL_POINTER);
+        }
+        RpcServer::ThreadPoolStats stats = spServer->getThreadPoolStats();
+        out->threads = static_cast<int64_t>(stats.threads);
+        out->idleThreads = static_cast<int64_t>(stats.idleThreads);
+        out->peakThreads = static_cast<int64_t>(stats.peakThreads);
+        out->threadsStarted = static_cast<int64_t>(stats.threadsStarted);
+        out->threadsRetired = static_cast<int64_t>(stats.threadsRetired);
+        out->calls = static_cast<int64_t>(stats.calls);
+        out->starvedCalls = static_cast<int64_t>(stats.starvedCalls);
+        return Status::ok();
+    }
     Status pingMe(const sp<IBinder>& binder, int32_t* out) override {
         if (binder == nullptr) {
             std::cout << "Received null binder!" << std::endl;
@@ -301,6 +376,8 @@ struct BinderRpcTestProcessSession {
 
 enum class SocketType {
     UNIX,
+    // Unix domain socket, with commands exchanged through shared memory
+    UNIX_SHARED_MEMORY,
     VSOCK,
     INET,
 };
@@ -308,6 +385,8 @@ static inline std::string PrintSocketType(const testing::TestParamInfo<SocketTyp
     switch (info.param) {
         case SocketType::UNIX:
             return "unix_domain_socket";
+        case SocketType::UNIX_SHARED_MEMORY:
+            return "unix_domain_socket_shared_memory";
         case SocketType::VSOCK:
             return "vm_socket";
         case SocketType::INET:
@@ -320,10 +399,13 @@ static inline std::string PrintSocketType(const testing::TestParamInfo<SocketTyp
 class BinderRpc : public ::testing::TestWithParam<SocketType> {
 public:
     // This creates a new process serving an interface on a certain number of
-    // threads.
+    // threads. If multiplexedConnections is set, the calls of each session are
+    // multiplexed over that many connections, and if compressionMinBytes is
+    // set, their payloads of that size are compressed.
     ProcessSession createRpcTestSocketServerProcess(
             size_t numThreads, size_t numSessions,
-            const std::function<void(const sp<RpcServer>&)>& configure) {
+            const std::function<void(const sp<RpcServer>&)>& configure,
+            size_t multiplexedConnections = 0, size_t compressionMinBytes = 0) {
         CHECK_GE(numSessions, 1) << "Must have at least one session to a server";
 
         SocketType socketType = GetParam();
@@ -344,6 +426,7 @@ public:
 
                     switch (socketType) {
                         case SocketType::UNIX:
+                        case SocketType::UNIX_SHARED_MEMORY:
                             CHECK(server->setupUnixDomainServer(addr.c_str())) << addr;
                             break;
                         case SocketType::VSOCK:
@@ -375,10 +458,23 @@ public:
 
         for (size_t i = 0; i < numSessions; i++) {
             sp<RpcSession> session = RpcSession::make();
+            if (multiplexedConnections > 0) {
+                session->setMultiplexedConnections(multiplexedConnections);
+            }
+            if (compressionMinBytes > 0) {
+                session->setCompression(compressionMinBytes);
+            }
             switch (socketType) {
                 case SocketType::UNIX:
                     if (session->setupUnixDomainClient(addr.c_str())) goto success;
                     break;
+                case SocketType::UNIX_SHARED_MEMORY:
+                    session->setSharedMemoryTransport(true);
+                    if (session->setupUnixDomainClient(addr.c_str())) {
+                        CHECK(session->isUsingSharedMemory());
+                        goto success;
+                    }
+                    break;
                 case SocketType::VSOCK:
                     if (session->setupVsockClient(VMADDR_CID_LOCAL, vsockPort)) goto success;
                     break;
@@ -395,8 +491,9 @@ public:
         return ret;
     }
 
-    BinderRpcTestProcessSession createRpcTestSocketServerProcess(size_t numThreads,
-                                                                 size_t numSessions = 1) {
+    BinderRpcTestProcessSession createRpcTestSocketServerProcess(
+            size_t numThreads, size_t numSessions = 1, size_t multiplexedConnections = 0,
+            size_t compressionMinBytes = 0) {
         BinderRpcTestProcessSession ret{
                 .proc = createRpcTestSocketServerProcess(numThreads, numSessions,
                                                          [&](const sp<RpcServer>& server) {
@@ -404,7 +501,9 @@ public:
                                                                      new MyBinderRpcTest;
                                                              server->setRootObject(service);
                                                              service->server = server;
-                                                         }),
+                                                         },
+                                                         multiplexedConnections,
+                                                         compressionMinBytes),
         };
 
         ret.rootBinder = ret.proc.sessions.at(0).root;
@@ -435,6 +534,71 @@ TEST_P(BinderRpc, GetInterfaceDescriptor) {
     EXPECT_EQ(IBinderRpcTest::descriptor, proc.rootBinder->getInterfaceDescriptor());
 }
 
+TEST_P(BinderRpc, TransactionStats) {
+    auto proc = createRpcTestSocketServerProcess(1, 1, [](const sp<RpcServer>& server) {
+        TransactionStats::setEnabled(true);
+        sp<MyBinderRpcTest> service = new MyBinderRpcTest;
+        server->setRootObject(service);
+        service->server = server;
+    });
+    sp<IBinder> root = proc.sessions.at(0).root;
+    sp<IBinderRpcTest> iface = interface_cast<IBinderRpcTest>(root);
+
+    // outgoing transactions are only keyed by the descriptor once it is known
+    EXPECT_EQ(IBinderRpcTest::descriptor, root->getInterfaceDescriptor());
+
+    constexpr size_t kCalls = 10;
+    TransactionStats::reset();
+    TransactionStats::setEnabled(true);
+    for (size_t i = 0; i < kCalls; i++) {
+        std::string doubled;
+        EXPECT_OK(iface->doubleString("foo", &doubled));
+    }
+    TransactionStats::setEnabled(false);
+
+    constexpr uint32_t kCode = BnBinderRpcTest::TRANSACTION_doubleString;
+    size_t found = 0;
+    for (const auto& entry : TransactionStats::getEntries()) {
+        if (entry.direction != TransactionStats::Direction::OUTGOING || entry.code != kCode) {
+            continue;
+        }
+        found++;
+        EXPECT_EQ(IBinderRpcTest::descriptor, entry.descriptor);
+        EXPECT_EQ(kCalls, entry.count);
+        EXPECT_GT(entry.dataBytes, 0u);
+        EXPECT_GT(entry.replyBytes, 0u);
+        EXPECT_GT(entry.totalLatencyNs, 0u);
+        EXPECT_GE(entry.totalLatencyNs, entry.maxLatencyNs);
+
+        uint64_t histogramCount = 0;
+        for (uint64_t bucket : entry.latencyHistogram) histogramCount += bucket;
+        EXPECT_EQ(kCalls, histogramCount);
+    }
+    EXPECT_EQ(1u, found);
+
+    // the server records the calls it serves, and dumps them on request
+    std::string remoteStats;
+    ASSERT_EQ(OK, root->getTransactionStats(&remoteStats));
+    std::string incoming = std::string("incoming ") + String8(IBinderRpcTest::descriptor).c_str() +
+            " code " + std::to_string(kCode) + ": " + std::to_string(kCalls) + " calls";
+    EXPECT_NE(std::string::npos, remoteStats.find(incoming)) << remoteStats;
+}
+
+TEST_P(BinderRpc, TransactionStatsEnabledRemotely) {
+    auto proc = createRpcTestSocketServerProcess(1);
+    std::string remoteStats;
+    EXPECT_EQ(INVALID_OPERATION, proc.rootBinder->getTransactionStats(&remoteStats));
+    EXPECT_EQ("", remoteStats);
+
+    ASSERT_EQ(OK, proc.rootBinder->setTransactionStatsEnabled(true));
+    ASSERT_EQ(OK, proc.rootBinder->getTransactionStats(&remoteStats));
+    EXPECT_NE(std::string::npos, remoteStats.find("Binder transaction stats (enabled)"))
+            << remoteStats;
+
+    ASSERT_EQ(OK, proc.rootBinder->setTransactionStatsEnabled(false));
+    EXPECT_EQ(INVALID_OPERATION, proc.rootBinder->getTransactionStats(&remoteStats));
+}
+
 TEST_P(BinderRpc, MultipleSessions) {
     auto proc = createRpcTestSocketServerProcess(1 /*threads*/, 5 /*sessions*/);
     for (auto session : proc.proc.sessions) {
@@ -491,6 +655,30 @@ TEST_P(BinderRpc, SendAndGetResultBackBig) {
     EXPECT_EQ(single + single, doubled);
 }
 
+TEST_P(BinderRpc, SendAndGetResultBackCompressed) {
+    auto proc = createRpcTestSocketServerProcess(1, 1 /*sessions*/, 0 /*connections*/,
+                                                 256 /*compressionMinBytes*/);
+    EXPECT_TRUE(proc.proc.sessions.at(0).session->isUsingCompression());
+
+    // below the threshold
+    std::string doubled;
+    EXPECT_OK(proc.rootIface->doubleString("cool ", &doubled));
+    EXPECT_EQ("cool cool ", doubled);
+
+    // compresses well
+    std::string single = std::string(10000, 'a');
+    EXPECT_OK(proc.rootIface->doubleString(single, &doubled));
+    EXPECT_EQ(single + single, doubled);
+
+    // hardly compresses, if at all
+    std::string noise;
+    for (size_t i = 0; i < 10000; i++) {
+        noise += static_cast<char>('!' + rand() % 94);
+    }
+    EXPECT_OK(proc.rootIface->doubleString(noise, &doubled));
+    EXPECT_EQ(noise + noise, doubled);
+}
+
 TEST_P(BinderRpc, CallMeBack) {
     auto proc = createRpcTestSocketServerProcess(1);
 
@@ -807,6 +995,179 @@ TEST_P(BinderRpc, ThreadingStressTest) {
     for (auto& t : threads) t.join();
 }
 
+TEST_P(BinderRpc, MultiplexedThreadPoolOverSaturated) {
+    constexpr size_t kNumThreads = 10;
+    constexpr size_t kNumCalls = kNumThreads + 3;
+    constexpr size_t kSleepMs = 500;
+
+    // all calls share one connection, and still run in parallel on the server
+    auto proc = createRpcTestSocketServerProcess(kNumThreads, 1 /*sessions*/, 1 /*connections*/);
+    EXPECT_TRUE(proc.proc.sessions.at(0).session->isMultiplexed());
+
+    size_t epochMsBefore = epochMillis();
+
+    std::vector<std::thread> ts;
+    for (size_t i = 0; i < kNumCalls; i++) {
+        ts.push_back(std::thread([&] { proc.rootIface->sleepMs(kSleepMs); }));
+    }
+
+    for (auto& t : ts) t.join();
+
+    size_t epochMsAfter = epochMillis();
+
+    EXPECT_GE(epochMsAfter, epochMsBefore + 2 * kSleepMs);
+
+    // Potential flake, but make sure calls are handled in parallel.
+    EXPECT_LE(epochMsAfter, epochMsBefore + 3 * kSleepMs);
+}
+
+TEST_P(BinderRpc, MultiplexedThreadPoolGrowsAndShrinks) {
+    // int64_t, like the stats in AIDL
+    constexpr int64_t kMinThreads = 2;
+    constexpr int64_t kMaxThreads = 5;
+    constexpr int64_t kNumCalls = kMaxThreads + 3;
+    constexpr int32_t kSleepMs = 200;
+    constexpr std::chrono::milliseconds kIdleTimeout(100);
+
+    auto proc = createRpcTestSocketServerProcess(
+            kMaxThreads, 1 /*sessions*/,
+            [&](const sp<RpcServer>& server) {
+                server->setMinThreads(kMinThreads);
+                server->setThreadIdleTimeout(kIdleTimeout);
+                sp<MyBinderRpcTest> service = new MyBinderRpcTest;
+                server->setRootObject(service);
+                service->server = server;
+            },
+            1 /*connections*/);
+    sp<IBinderRpcTest> iface = interface_cast<IBinderRpcTest>(proc.sessions.at(0).root);
+
+    // the minimum is started with the session, and kept
+    RpcThreadPoolStats stats;
+    EXPECT_OK(iface->getThreadPoolStats(&stats));
+    EXPECT_EQ(kMinThreads, stats.threads);
+    EXPECT_EQ(0, stats.threadsRetired);
+
+    // threads are started while calls wait for one, up to the maximum
+    std::vector<std::thread> ts;
+    for (int64_t i = 0; i < kNumCalls; i++) {
+        ts.push_back(std::thread([&] { EXPECT_OK(iface->sleepMs(kSleepMs)); }));
+    }
+    for (auto& t : ts) t.join();
+
+    EXPECT_OK(iface->getThreadPoolStats(&stats));
+    EXPECT_EQ(kMaxThreads, stats.peakThreads);
+    EXPECT_EQ(kMaxThreads, stats.threadsStarted);
+    EXPECT_GE(stats.starvedCalls, kNumCalls - kMaxThreads);
+
+    // and stop again once idle, down to the minimum
+    std::this_thread::sleep_for(kIdleTimeout * 5);
+    EXPECT_OK(iface->getThreadPoolStats(&stats));
+    EXPECT_EQ(kMinThreads, stats.threads);
+    EXPECT_EQ(kMinThreads - 1, stats.idleThreads); // one runs this call
+    EXPECT_EQ(kMaxThreads - kMinThreads, stats.threadsRetired);
+}
+
+TEST_P(BinderRpc, MultiplexedNestedTransactions) {
+    auto proc = createRpcTestSocketServerProcess(1, 1 /*sessions*/, 1 /*connections*/);
+
+    auto nastyNester = sp<MyBinderRpcTest>::make();
+    EXPECT_OK(proc.rootIface->nestMe(nastyNester, 10));
+
+    wp<IBinder> weak = nastyNester;
+    nastyNester = nullptr;
+    EXPECT_EQ(nullptr, weak.promote());
+}
+
+TEST_P(BinderRpc, MultiplexedThreadingStressTest) {
+    constexpr size_t kNumClientThreads = 10;
+    constexpr size_t kNumServerThreads = 10;
+    constexpr size_t kNumCalls = 100;
+
+    auto proc = createRpcTestSocketServerProcess(kNumServerThreads, 1 /*sessions*/,
+                                                 2 /*connections*/);
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kNumClientThreads; i++) {
+        threads.push_back(std::thread([&] {
+            for (size_t j = 0; j < kNumCalls; j++) {
+                sp<IBinder> out;
+                EXPECT_OK(proc.rootIface->repeatBinder(proc.rootBinder, &out));
+                EXPECT_EQ(proc.rootBinder, out);
+            }
+        }));
+    }
+
+    for (auto& t : threads) t.join();
+}
+
+static std::unique_ptr<RpcPendingTransaction> startDoubleString(const sp<IBinder>& binder,
+                                                                const std::string& str,
+                                                                Parcel* reply) {
+    Parcel data;
+    data.markForBinder(binder);
+    CHECK_EQ(OK, data.writeInterfaceToken(IBinderRpcTest::descriptor));
+    CHECK_EQ(OK, data.writeUtf8AsUtf16(str));
+    return binder->remoteBinder()->transactAsync(IBinderRpcTest::TRANSACTION_doubleString, data,
+                                                 reply);
+}
+
+TEST_P(BinderRpc, PipelinedTransactions) {
+    constexpr size_t kNumCalls = 100;
+
+    // pipelined on a multiplexed session, and one after the other otherwise
+    for (size_t connections : {0, 1}) {
+        auto proc = createRpcTestSocketServerProcess(1, 1 /*sessions*/, connections);
+
+        std::vector<Parcel> replies(kNumCalls);
+        std::vector<std::unique_ptr<RpcPendingTransaction>> pending;
+        for (size_t i = 0; i < kNumCalls; i++) {
+            pending.push_back(startDoubleString(proc.rootBinder, std::to_string(i), &replies[i]));
+        }
+
+        // replies are read in any order
+        for (size_t i = kNumCalls; i-- > 0;) {
+            ASSERT_EQ(OK, pending[i]->wait());
+
+            binder::Status status;
+            ASSERT_EQ(OK, status.readFromParcel(replies[i]));
+            EXPECT_OK(status);
+            std::string doubled;
+            ASSERT_EQ(OK, replies[i].readUtf8FromUtf16(&doubled));
+            EXPECT_EQ(std::to_string(i) + std::to_string(i), doubled);
+        }
+    }
+}
+
+TEST_P(BinderRpc, PipelinedTransactionsRunInParallel) {
+    constexpr size_t kNumCalls = 10;
+    constexpr int32_t kSleepMs = 500;
+
+    // one thread keeps all calls in flight on one connection
+    auto proc = createRpcTestSocketServerProcess(kNumCalls, 1 /*sessions*/, 1 /*connections*/);
+
+    size_t epochMsBefore = epochMillis();
+
+    std::vector<Parcel> replies(kNumCalls);
+    std::vector<std::unique_ptr<RpcPendingTransaction>> pending;
+    for (size_t i = 0; i < kNumCalls; i++) {
+        Parcel data;
+        data.markForBinder(proc.rootBinder);
+        ASSERT_EQ(OK, data.writeInterfaceToken(IBinderRpcTest::descriptor));
+        ASSERT_EQ(OK, data.writeInt32(kSleepMs));
+        pending.push_back(
+                proc.rootBinder->remoteBinder()->transactAsync(IBinderRpcTest::TRANSACTION_sleepMs,
+                                                               data, &replies[i]));
+    }
+    for (auto& p : pending) EXPECT_EQ(OK, p->wait());
+
+    size_t epochMsAfter = epochMillis();
+
+    EXPECT_GE(epochMsAfter, epochMsBefore + kSleepMs);
+
+    // Potential flake, but make sure calls are handled in parallel.
+    EXPECT_LE(epochMsAfter, epochMsBefore + 2 * kSleepMs);
+}
+
 TEST_P(BinderRpc, OnewayStressTest) {
     constexpr size_t kNumClientThreads = 10;
     constexpr size_t kNumServerThreads = 10;
@@ -934,6 +1295,7 @@ TEST_P(BinderRpc, Fds) {
 INSTANTIATE_TEST_CASE_P(PerSocket, BinderRpc,
                         ::testing::ValuesIn({
                                 SocketType::UNIX,
+                                SocketType::UNIX_SHARED_MEMORY,
 // TODO(b/185269356): working on host
 #ifdef __BIONIC__
                                 SocketType::VSOCK,
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ftl/small_hash_map.h>
+#include <gtest/gtest.h>
+
+#include <cctype>
+#include <string>
+#include <unordered_map>
+
+namespace android::test {
+
+using ftl::SmallHashMap;
+
+// Keep in sync with example usage in header file.
+TEST(SmallHashMap, Example) {
+  ftl::SmallHashMap<int, std::string, 2> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_FALSE(map.dynamic());
+
+  map = ftl::init::map<int, std::string>(123, "abc")(-1);
+  EXPECT_EQ(map.size(), 2u);
+  EXPECT_FALSE(map.dynamic());
+
+  EXPECT_TRUE(map.try_emplace(42, 3u, '?').second);
+  EXPECT_TRUE(map.dynamic());
+
+  EXPECT_TRUE(map.contains(123));
+  EXPECT_EQ(map.find(42, [](const std::string& s) { return s.size(); }), 3u);
+
+  const auto opt = map.find(-1);
+  ASSERT_TRUE(opt);
+
+  std::string& ref = *opt;
+  EXPECT_TRUE(ref.empty());
+  ref = "xyz";
+
+  EXPECT_TRUE(map.erase(123));
+  EXPECT_FALSE(map.contains(123));
+  EXPECT_EQ(map.size(), 2u);
+}
+
+TEST(SmallHashMap, Construct) {
+  {
+    // Default constructor.
+    SmallHashMap<int, std::string, 2> map;
+
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.dynamic());
+  }
+  {
+    // In-place constructor with implicit size.
+    SmallHashMap map = ftl::init::map<int, std::string>(123, "abc")(-1)(42, 3u, '?');
+
+    static_assert(std::is_same_v<decltype(map), SmallHashMap<int, std::string, 3>>);
+    EXPECT_EQ(map.size(), 3u);
+    EXPECT_EQ(map.max_size(), 3u);
+    EXPECT_FALSE(map.dynamic());
+
+    EXPECT_EQ(map, SmallHashMap(ftl::init::map(-1, "\0\0\0")(42, "???")(123, "abc")));
+  }
+}
+
+TEST(SmallHashMap, Find) {
+  {
+    // Constant reference.
+    const SmallHashMap map = ftl::init::map('a', 'A')('b', 'B')('c', 'C');
+
+    const auto opt = map.find('b');
+    EXPECT_EQ(opt, 'B');
+
+    const char d = 'D';
+    const auto ref = map.find('d').value_or(std::cref(d));
+    EXPECT_EQ(ref.get(), 'D');
+  }
+  {
+    // Mutable unary operation.
+    SmallHashMap map = ftl::init::map('a', 'x')('b', 'y')('c', 'z');
+    EXPECT_TRUE(map.find('c', [](char& c) { c = std::toupper(c); }));
+
+    EXPECT_EQ(map, SmallHashMap(ftl::init::map('c', 'Z')('b', 'y')('a', 'x')));
+  }
+}
+
+TEST(SmallHashMap, TryEmplace) {
+  SmallHashMap<int, std::string, 2> map;
+
+  const auto [it, ok] = map.try_emplace(1, "one");
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(it->first, 1);
+  EXPECT_EQ(it->second, "one");
+
+  // Existing mappings are not replaced.
+  EXPECT_FALSE(map.try_emplace(1, "uno").second);
+  EXPECT_EQ(map.find(1)->get(), "one");
+
+  EXPECT_TRUE(map.try_emplace(2, "two").second);
+  EXPECT_FALSE(map.dynamic());
+
+  // Spill to the hashed representation.
+  EXPECT_TRUE(map.try_emplace(3, "three").second);
+  EXPECT_TRUE(map.dynamic());
+  EXPECT_EQ(map.size(), 3u);
+
+  EXPECT_EQ(map.find(1)->get(), "one");
+  EXPECT_EQ(map.find(2)->get(), "two");
+  EXPECT_EQ(map.find(3)->get(), "three");
+  EXPECT_FALSE(map.contains(4));
+
+  EXPECT_FALSE(map.try_emplace(3, "tres").second);
+}
+
+TEST(SmallHashMap, Erase) {
+  {
+    // Static storage.
+    SmallHashMap map = ftl::init::map(1, '1')(2, '2')(3, '3');
+    EXPECT_TRUE(map.erase(1));
+    EXPECT_FALSE(map.erase(1));
+    EXPECT_EQ(map, SmallHashMap(ftl::init::map(2, '2')(3, '3')));
+  }
+  {
+    // Dynamic storage.
+    SmallHashMap<int, char, 1> map;
+    for (int i = 0; i < 10; i++) {
+      EXPECT_TRUE(map.try_emplace(i, static_cast<char>('0' + i)).second);
+    }
+    EXPECT_TRUE(map.dynamic());
+
+    EXPECT_TRUE(map.erase(0));
+    EXPECT_TRUE(map.erase(5));
+    EXPECT_FALSE(map.erase(5));
+    EXPECT_EQ(map.size(), 8u);
+
+    for (int i = 0; i < 10; i++) {
+      if (i == 0 || i == 5) {
+        EXPECT_FALSE(map.contains(i));
+      } else {
+        EXPECT_EQ(map.find(i), static_cast<char>('0' + i));
+      }
+    }
+  }
+}
+
+// Unlike std::hash for integers, the probe sequences of these keys always collide.
+struct CollidingHash {
+  std::size_t operator()(int key) const { return static_cast<std::size_t>(key & 1); }
+};
+
+TEST(SmallHashMap, Collisions) {
+  SmallHashMap<int, int, 2, CollidingHash> map;
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(map.try_emplace(i, -i).second);
+  }
+
+  for (int i = 0; i < 100; i += 3) {
+    EXPECT_TRUE(map.erase(i));
+  }
+
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(map.contains(i), i % 3 != 0) << i;
+  }
+}
+
+TEST(SmallHashMap, MatchesUnorderedMap) {
+  SmallHashMap<unsigned, unsigned, 4> map;
+  std::unordered_map<unsigned, unsigned> reference;
+
+  // Interleave insertions and erasures of pseudo-random keys, growing and shrinking the table.
+  unsigned seed = 12345;
+  const auto next = [&seed] { return seed = seed * 1103515245 + 12345; };
+
+  for (int i = 0; i < 5000; i++) {
+    const unsigned key = (next() >> 16) % 512;
+    if (next() % 3 == 0) {
+      EXPECT_EQ(map.erase(key), reference.erase(key) == 1);
+    } else {
+      const unsigned value = next();
+      EXPECT_EQ(map.try_emplace(key, value).second, reference.try_emplace(key, value).second);
+    }
+  }
+
+  ASSERT_EQ(map.size(), reference.size());
+  for (const auto& [key, value] : reference) {
+    EXPECT_EQ(map.find(key), value);
+  }
+}
+
+}  // namespace android::test
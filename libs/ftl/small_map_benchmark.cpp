@@ -0,0 +1,130 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <ftl/small_hash_map.h>
+#include <ftl/small_map.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// Usage: atest ftl_benchmark
+
+namespace android::test {
+namespace {
+
+// Static capacity of the ftl maps, so that all but the smallest size spill to dynamic storage.
+constexpr std::size_t kCapacity = 8;
+
+// Layer IDs are sequential but sparse, and looked up in no particular order.
+std::vector<std::int32_t> make_keys(std::size_t count) {
+  std::vector<std::int32_t> keys(count);
+  for (std::size_t i = 0; i < count; i++) {
+    keys[i] = static_cast<std::int32_t>(i * 7 + 1);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::default_random_engine(count));
+  return keys;
+}
+
+template <typename Map>
+void insert(Map& map, std::int32_t key) {
+  map.try_emplace(key, key);
+}
+
+template <typename Map>
+bool contains(const Map& map, std::int32_t key) {
+  if constexpr (std::is_same_v<Map, std::unordered_map<std::int32_t, std::int32_t>>) {
+    return map.find(key) != map.end();
+  } else {
+    return map.contains(key);
+  }
+}
+
+// Looks up every key of a map of the given size.
+template <typename Map>
+void BM_Find(benchmark::State& state) {
+  const auto keys = make_keys(static_cast<std::size_t>(state.range(0)));
+
+  Map map;
+  for (const auto key : keys) insert(map, key);
+
+  auto lookups = keys;
+  std::shuffle(lookups.begin(), lookups.end(), std::default_random_engine(0));
+
+  for (auto _ : state) {
+    for (const auto key : lookups) {
+      benchmark::DoNotOptimize(contains(map, key));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(lookups.size()));
+}
+
+// Looks up keys missing from a map of the given size.
+template <typename Map>
+void BM_FindMissing(benchmark::State& state) {
+  const auto keys = make_keys(static_cast<std::size_t>(state.range(0)));
+
+  Map map;
+  for (const auto key : keys) insert(map, key);
+
+  for (auto _ : state) {
+    for (const auto key : keys) {
+      benchmark::DoNotOptimize(contains(map, key + 1));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(keys.size()));
+}
+
+// Builds a map of the given size, then erases all of its keys.
+template <typename Map>
+void BM_InsertErase(benchmark::State& state) {
+  const auto keys = make_keys(static_cast<std::size_t>(state.range(0)));
+
+  for (auto _ : state) {
+    Map map;
+    for (const auto key : keys) insert(map, key);
+    for (const auto key : keys) benchmark::DoNotOptimize(map.erase(key));
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(keys.size()));
+}
+
+using SmallMap = ftl::SmallMap<std::int32_t, std::int32_t, kCapacity>;
+using SmallHashMap = ftl::SmallHashMap<std::int32_t, std::int32_t, kCapacity>;
+using UnorderedMap = std::unordered_map<std::int32_t, std::int32_t>;
+
+void Sizes(benchmark::internal::Benchmark* b) {
+  for (const int size : {4, 16, 64, 256}) b->Arg(size);
+}
+
+BENCHMARK_TEMPLATE(BM_Find, SmallMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_Find, SmallHashMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_Find, UnorderedMap)->Apply(Sizes);
+
+BENCHMARK_TEMPLATE(BM_FindMissing, SmallMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindMissing, SmallHashMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_FindMissing, UnorderedMap)->Apply(Sizes);
+
+BENCHMARK_TEMPLATE(BM_InsertErase, SmallMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_InsertErase, SmallHashMap)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_InsertErase, UnorderedMap)->Apply(Sizes);
+
+}  // namespace
+}  // namespace android::test
+
+BENCHMARK_MAIN();
@@ -45,6 +45,14 @@ TEST(SmallMap, Example) {
   ref = "xyz";
 
   EXPECT_EQ(map, SmallMap(ftl::init::map(-1, "xyz")(42, "???")(123, "abc")));
+
+  EXPECT_TRUE(map.try_emplace(7, "seven").second);
+  EXPECT_FALSE(map.try_emplace(7, "sept").second);
+  EXPECT_TRUE(map.dynamic());
+
+  EXPECT_TRUE(map.erase(-1));
+  EXPECT_FALSE(map.erase(-1));
+  EXPECT_EQ(map.size(), 3u);
 }
 
 TEST(SmallMap, Construct) {
@@ -128,4 +136,39 @@ TEST(SmallMap, Find) {
   }
 }
 
+TEST(SmallMap, TryEmplace) {
+  SmallMap map = ftl::init::map(1, 'a')(2, 'b');
+
+  const auto [it, ok] = map.try_emplace(3, 'c');
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(it->first, 3);
+  EXPECT_EQ(it->second, 'c');
+  EXPECT_TRUE(map.dynamic());
+
+  EXPECT_FALSE(map.try_emplace(1, 'z').second);
+  EXPECT_EQ(map.find(1), 'a');
+
+  EXPECT_EQ(map, SmallMap(ftl::init::map(3, 'c')(2, 'b')(1, 'a')));
+}
+
+TEST(SmallMap, Erase) {
+  {
+    // Static storage.
+    SmallMap map = ftl::init::map(1, '1')(2, '2')(3, '3');
+    EXPECT_TRUE(map.erase(1));
+    EXPECT_FALSE(map.erase(1));
+    EXPECT_EQ(map, SmallMap(ftl::init::map(2, '2')(3, '3')));
+  }
+  {
+    // Dynamic storage.
+    SmallMap map = ftl::init::map(1, '1')(2, '2');
+    EXPECT_TRUE(map.try_emplace(3, '3').second);
+    EXPECT_TRUE(map.dynamic());
+
+    EXPECT_TRUE(map.erase(1));
+    EXPECT_FALSE(map.erase(4));
+    EXPECT_EQ(map, SmallMap(ftl::init::map(2, '2')(3, '3')));
+  }
+}
+
 }  // namespace android::test
@@ -719,11 +719,13 @@ status_t SurfaceComposerClient::Transaction::writeToParcel(Parcel* parcel) const
 }
 
 SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::merge(Transaction&& other) {
-    for (auto const& [handle, composerState] : other.mComposerStates) {
-        if (mComposerStates.count(handle) == 0) {
-            mComposerStates[handle] = composerState;
-        } else {
-            mComposerStates[handle].state.merge(composerState.state);
+    // Grow the map once, rather than rehashing as the states of other are added. The states of
+    // layers which this transaction does not touch yet are moved over.
+    mComposerStates.reserve(mComposerStates.size() + other.mComposerStates.size());
+    for (auto& [handle, composerState] : other.mComposerStates) {
+        const auto [it, inserted] = mComposerStates.try_emplace(handle, std::move(composerState));
+        if (!inserted) {
+            it->second.state.merge(composerState.state);
         }
     }
 
@@ -736,26 +738,34 @@ SurfaceComposerClient::Transaction& SurfaceComposerClient::Transaction::merge(Tr
         }
     }
 
-    for (const auto& [listener, callbackInfo] : other.mListenerCallbacks) {
-        auto& [callbackIds, surfaceControls] = callbackInfo;
-        mListenerCallbacks[listener].callbackIds.insert(std::make_move_iterator(
-                                                                callbackIds.begin()),
-                                                        std::make_move_iterator(callbackIds.end()));
-
-        mListenerCallbacks[listener].surfaceControls.insert(surfaceControls.begin(),
-                                                            surfaceControls.end());
+    if (!other.mListenerCallbacks.empty()) {
+        const auto currentProcessListener = TransactionCompletedListener::getIInstance();
+        for (auto& [listener, callbackInfo] : other.mListenerCallbacks) {
+            auto& [callbackIds, surfaceControls] = callbackInfo;
+            auto& listenerCallbackInfo = mListenerCallbacks[listener];
+            listenerCallbackInfo.callbackIds.insert(std::make_move_iterator(callbackIds.begin()),
+                                                   std::make_move_iterator(callbackIds.end()));
+            if (listener == currentProcessListener) {
+                listenerCallbackInfo.surfaceControls
+                        .insert(std::make_move_iterator(surfaceControls.begin()),
+                                std::make_move_iterator(surfaceControls.end()));
+                continue;
+            }
 
-        auto& currentProcessCallbackInfo =
-                mListenerCallbacks[TransactionCompletedListener::getIInstance()];
-        currentProcessCallbackInfo.surfaceControls
-                .insert(std::make_move_iterator(surfaceControls.begin()),
-                        std::make_move_iterator(surfaceControls.end()));
+            listenerCallbackInfo.surfaceControls.insert(surfaceControls.begin(),
+                                                        surfaceControls.end());
+            mListenerCallbacks[currentProcessListener].surfaceControls.insert(
+                    std::make_move_iterator(surfaceControls.begin()),
+                    std::make_move_iterator(surfaceControls.end()));
+        }
 
-        // register all surface controls for all callbackIds for this listener that is merging
+        // Register all surface controls for all callbackIds of the listeners that were merged.
+        // The sets only grow while merging, so registering once covers every listener.
+        const auto& currentProcessCallbackInfo = mListenerCallbacks[currentProcessListener];
+        const auto listenerInstance = TransactionCompletedListener::getInstance();
         for (const auto& surfaceControl : currentProcessCallbackInfo.surfaceControls) {
-            TransactionCompletedListener::getInstance()
-                    ->addSurfaceControlToCallbacks(surfaceControl,
-                                                   currentProcessCallbackInfo.callbackIds);
+            listenerInstance->addSurfaceControlToCallbacks(surfaceControl,
+                                                           currentProcessCallbackInfo.callbackIds);
         }
     }
 
@@ -974,17 +984,14 @@ void SurfaceComposerClient::Transaction::setEarlyWakeupEnd() {
 layer_state_t* SurfaceComposerClient::Transaction::getLayerState(const sp<SurfaceControl>& sc) {
     auto handle = sc->getLayerStateHandle();
 
-    if (mComposerStates.count(handle) == 0) {
-        // we don't have it, add an initialized layer_state to our list
-        ComposerState s;
-
-        s.state.surface = handle;
-        s.state.layerId = sc->getLayerId();
-
-        mComposerStates[handle] = s;
+    const auto [it, inserted] = mComposerStates.try_emplace(handle);
+    if (inserted) {
+        // we didn't have it, initialize the layer_state we added to our list
+        it->second.state.surface = handle;
+        it->second.state.layerId = sc->getLayerId();
     }
 
-    return &(mComposerStates[handle].state);
+    return &(it->second.state);
 }
 
 void SurfaceComposerClient::Transaction::registerSurfaceControlForCallback(
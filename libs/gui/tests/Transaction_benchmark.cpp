@@ -0,0 +1,87 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <binder/Binder.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+
+#include <vector>
+
+namespace android {
+namespace {
+
+constexpr size_t kTransactionCount = 50;
+constexpr size_t kLayersPerTransaction = 10;
+// Consecutive transactions touch half of the same layers, as when a window is animated by several
+// transactions which are merged before being applied.
+constexpr size_t kLayerStride = kLayersPerTransaction / 2;
+constexpr size_t kLayerCount = kTransactionCount * kLayerStride + kLayersPerTransaction;
+
+std::vector<sp<SurfaceControl>> createSurfaceControls() {
+    std::vector<sp<SurfaceControl>> surfaceControls;
+    surfaceControls.reserve(kLayerCount);
+    for (size_t i = 0; i < kLayerCount; i++) {
+        // The transactions are never applied, so the layers need not exist.
+        surfaceControls.push_back(new SurfaceControl(nullptr, new BBinder(), nullptr,
+                                                     static_cast<int32_t>(i) + 1));
+    }
+    return surfaceControls;
+}
+
+std::vector<SurfaceComposerClient::Transaction> createTransactions(
+        const std::vector<sp<SurfaceControl>>& surfaceControls) {
+    std::vector<SurfaceComposerClient::Transaction> transactions(kTransactionCount);
+    for (size_t i = 0; i < kTransactionCount; i++) {
+        for (size_t j = 0; j < kLayersPerTransaction; j++) {
+            const auto& sc = surfaceControls[i * kLayerStride + j];
+            const float offset = static_cast<float>(i);
+            transactions[i]
+                    .setPosition(sc, offset, offset)
+                    .setAlpha(sc, 0.5f)
+                    .setCrop(sc, Rect(0, 0, 100, 100))
+                    .setLayer(sc, static_cast<int32_t>(j));
+        }
+    }
+    return transactions;
+}
+
+void BM_MergeTransactions(benchmark::State& state) {
+    const auto surfaceControls = createSurfaceControls();
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto transactions = createTransactions(surfaceControls);
+        state.ResumeTiming();
+
+        SurfaceComposerClient::Transaction merged;
+        for (auto& transaction : transactions) {
+            merged.merge(std::move(transaction));
+        }
+        benchmark::DoNotOptimize(merged);
+
+        state.PauseTiming();
+        merged.clear();
+        transactions.clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * kTransactionCount));
+}
+BENCHMARK(BM_MergeTransactions);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -26,6 +26,7 @@
 #include <stdexcept>
 
 #include <math/quat.h>
+#include <math/TMatSimd.h>
 #include <math/TVecHelpers.h>
 
 #include  <utils/String8.h>
@@ -231,15 +232,85 @@ CONSTEXPR MATRIX PURE fastInverse3(const MATRIX& x) {
  * make sure the matrix is not singular.
  */
 template <typename MATRIX>
-inline constexpr MATRIX PURE inverse(const MATRIX& matrix) {
+inline constexpr MATRIX PURE inverseGeneric(const MATRIX& matrix) {
     static_assert(MATRIX::NUM_ROWS == MATRIX::NUM_COLS, "only square matrices can be inverted");
     return (MATRIX::NUM_ROWS == 2) ? fastInverse2<MATRIX>(matrix) :
           ((MATRIX::NUM_ROWS == 3) ? fastInverse3<MATRIX>(matrix) :
                     gaussJordanInverse<MATRIX>(matrix));
 }
 
+template <typename MATRIX>
+inline MATRIX inverseSimd(const MATRIX& matrix, std::false_type) {
+    return inverseGeneric(matrix);
+}
+
+#if defined(MATH_SIMD_KERNELS)
+template <typename MATRIX>
+inline MATRIX inverseSimd(const MATRIX& matrix, std::true_type) {
+    if (MATRIX::NUM_ROWS != 3) {
+        return inverseGeneric(matrix);
+    }
+    MATRIX inverted(MATRIX::NO_INIT);
+    simd::inverse33(&inverted[0][0], &matrix[0][0]);
+    return inverted;
+}
+#endif
+
+/**
+ * Same as inverseGeneric(), but float matrices use the SIMD kernel at runtime.
+ */
+template <typename MATRIX>
+inline CONSTEXPR MATRIX PURE inverse(const MATRIX& matrix) {
+    typedef simd::HasKernel<MATRIX::NUM_ROWS, typename MATRIX::value_type> has_kernel;
+    if (has_kernel::value && simd::isRuntime()) {
+        return inverseSimd(matrix, has_kernel());
+    }
+    return inverseGeneric(matrix);
+}
+
+// matrix * column-vector, accumulated in VECTOR_R
+template <typename VECTOR_R, typename MATRIX, typename VECTOR>
+CONSTEXPR VECTOR_R PURE multiplyVectorGeneric(const MATRIX& lhs, const VECTOR& rhs) {
+    // Result is initialized to zero.
+    VECTOR_R result;
+    for (size_t col = 0; col < MATRIX::NUM_COLS; ++col) {
+        result += lhs[col] * rhs[col];
+    }
+    return result;
+}
+
+template <typename VECTOR_R, typename MATRIX, typename VECTOR>
+inline VECTOR_R multiplyVectorSimd(const MATRIX& lhs, const VECTOR& rhs, std::false_type) {
+    return multiplyVectorGeneric<VECTOR_R>(lhs, rhs);
+}
+
+#if defined(MATH_SIMD_KERNELS)
+template <typename VECTOR_R, typename MATRIX, typename VECTOR>
+inline VECTOR_R multiplyVectorSimd(const MATRIX& lhs, const VECTOR& rhs, std::true_type) {
+    if (MATRIX::NUM_ROWS != 4) {
+        return multiplyVectorGeneric<VECTOR_R>(lhs, rhs);
+    }
+    VECTOR_R result(VECTOR_R::NO_INIT);
+    simd::multiply4(&result[0], &lhs[0][0], &rhs[0]);
+    return result;
+}
+#endif
+
+/**
+ * Same as multiplyVectorGeneric(), but float 4x4 matrices use the SIMD kernel at runtime.
+ */
+template <typename VECTOR_R, typename MATRIX, typename VECTOR>
+CONSTEXPR VECTOR_R PURE multiplyVector(const MATRIX& lhs, const VECTOR& rhs) {
+    typedef simd::HasKernel<MATRIX::NUM_ROWS, typename VECTOR_R::value_type,
+            typename MATRIX::value_type, typename VECTOR::value_type> has_kernel;
+    if (has_kernel::value && simd::isRuntime()) {
+        return multiplyVectorSimd<VECTOR_R>(lhs, rhs, has_kernel());
+    }
+    return multiplyVectorGeneric<VECTOR_R>(lhs, rhs);
+}
+
 template<typename MATRIX_R, typename MATRIX_A, typename MATRIX_B>
-CONSTEXPR MATRIX_R PURE multiply(const MATRIX_A& lhs, const MATRIX_B& rhs) {
+CONSTEXPR MATRIX_R PURE multiplyGeneric(const MATRIX_A& lhs, const MATRIX_B& rhs) {
     // pre-requisite:
     //  lhs : D columns, R rows
     //  rhs : C columns, D rows
@@ -254,11 +325,42 @@ CONSTEXPR MATRIX_R PURE multiply(const MATRIX_A& lhs, const MATRIX_B& rhs) {
 
     MATRIX_R res(MATRIX_R::NO_INIT);
     for (size_t col = 0; col < MATRIX_R::NUM_COLS; ++col) {
-        res[col] = lhs * rhs[col];
+        // same as lhs * rhs[col], but always through the generic path
+        res[col] = multiplyVectorGeneric<decltype(lhs * rhs[col])>(lhs, rhs[col]);
     }
     return res;
 }
 
+template<typename MATRIX_R, typename MATRIX_A, typename MATRIX_B>
+inline MATRIX_R multiplySimd(const MATRIX_A& lhs, const MATRIX_B& rhs, std::false_type) {
+    return multiplyGeneric<MATRIX_R>(lhs, rhs);
+}
+
+#if defined(MATH_SIMD_KERNELS)
+template<typename MATRIX_R, typename MATRIX_A, typename MATRIX_B>
+inline MATRIX_R multiplySimd(const MATRIX_A& lhs, const MATRIX_B& rhs, std::true_type) {
+    if (MATRIX_R::NUM_ROWS != 4 || MATRIX_R::NUM_COLS != 4 || MATRIX_A::NUM_COLS != 4) {
+        return multiplyGeneric<MATRIX_R>(lhs, rhs);
+    }
+    MATRIX_R res(MATRIX_R::NO_INIT);
+    simd::multiply44(&res[0][0], &lhs[0][0], &rhs[0][0]);
+    return res;
+}
+#endif
+
+/**
+ * Same as multiplyGeneric(), but float 4x4 matrices use the SIMD kernel at runtime.
+ */
+template<typename MATRIX_R, typename MATRIX_A, typename MATRIX_B>
+CONSTEXPR MATRIX_R PURE multiply(const MATRIX_A& lhs, const MATRIX_B& rhs) {
+    typedef simd::HasKernel<MATRIX_R::NUM_ROWS, typename MATRIX_R::value_type,
+            typename MATRIX_A::value_type, typename MATRIX_B::value_type> has_kernel;
+    if (has_kernel::value && simd::isRuntime()) {
+        return multiplySimd<MATRIX_R>(lhs, rhs, has_kernel());
+    }
+    return multiplyGeneric<MATRIX_R>(lhs, rhs);
+}
+
 // transpose. this handles matrices of matrices
 template <typename MATRIX>
 CONSTEXPR MATRIX PURE transpose(const MATRIX& m) {
@@ -642,3 +744,4 @@ public:
 
 #undef PURE
 #undef CONSTEXPR
+#undef MATH_SIMD_KERNELS
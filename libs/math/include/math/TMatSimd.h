@@ -0,0 +1,224 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <type_traits>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MATH_SIMD_NEON
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#define MATH_SIMD_SSE
+#include <xmmintrin.h>
+#endif
+
+// Whether the simd:: kernels below exist. Left defined for TMatHelpers.h, which undefines it.
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+#define MATH_SIMD_KERNELS
+#endif
+
+// The SIMD kernels can't be evaluated at compile time, so they are only used when the compiler
+// lets us tell constant evaluation apart from runtime evaluation.
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define MATH_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#endif
+
+namespace android {
+namespace details {
+// -------------------------------------------------------------------------------------
+
+/*
+ * No user serviceable parts here.
+ *
+ * Don't use this file directly, instead include ui/mat*.h
+ */
+
+namespace matrix {
+namespace simd {
+
+#if defined(MATH_SIMD_KERNELS) && defined(MATH_IS_CONSTANT_EVALUATED)
+static constexpr bool kEnabled = true;
+#else
+static constexpr bool kEnabled = false;
+#endif
+
+template <typename... T>
+struct AllFloat : std::true_type {};
+
+template <typename T, typename... R>
+struct AllFloat<T, R...> : std::integral_constant<bool,
+        std::is_same<T, float>::value && AllFloat<R...>::value> {};
+
+/*
+ * Whether an operation on matrices of size NxN and the given value types has a SIMD kernel.
+ * Only float is vectorized; other types always use the generic templates.
+ */
+template <size_t N, typename... T>
+using HasKernel = std::integral_constant<bool,
+        kEnabled && (N == 3 || N == 4) && AllFloat<T...>::value>;
+
+/*
+ * Returns true when called from runtime code, false during constant evaluation.
+ */
+inline constexpr bool isRuntime() {
+#if defined(MATH_IS_CONSTANT_EVALUATED)
+    return !MATH_IS_CONSTANT_EVALUATED();
+#else
+    return false;
+#endif
+}
+
+#if defined(MATH_SIMD_KERNELS)
+
+/*
+ * The kernels below operate on column-major arrays of floats and produce results which are
+ * bit-identical to the generic templates: products and sums are evaluated in the same order,
+ * without fused multiply-add, and divisions are not replaced by reciprocals.
+ */
+
+#if defined(MATH_SIMD_NEON)
+typedef float32x4_t float4_t;
+
+inline float4_t load4(const float* p) { return vld1q_f32(p); }
+inline void store4(float* p, float4_t v) { vst1q_f32(p, v); }
+
+// (x, y, z) is kept as (x, y, z, x) so that rotations of the lanes stay within the vector.
+inline float4_t load3(const float* p) {
+    const float v[4] = { p[0], p[1], p[2], p[0] };
+    return vld1q_f32(v);
+}
+inline float4_t yzx(float4_t v) { return vextq_f32(v, v, 1); }
+inline float4_t zxy(float4_t v) { return vextq_f32(v, v, 2); }
+
+inline float4_t mul(float4_t a, float4_t b) { return vmulq_f32(a, b); }
+inline float4_t sub(float4_t a, float4_t b) { return vsubq_f32(a, b); }
+inline float lane0(float4_t v) { return vgetq_lane_f32(v, 0); }
+
+#if defined(__aarch64__)
+inline float4_t div(float4_t v, float s) { return vdivq_f32(v, vdupq_n_f32(s)); }
+#else
+// ARMv7 NEON has no vector division, and reciprocal estimates wouldn't be exact.
+inline float4_t div(float4_t v, float s) {
+    float f[4];
+    vst1q_f32(f, v);
+    for (size_t i = 0; i < 4; ++i) {
+        f[i] /= s;
+    }
+    return vld1q_f32(f);
+}
+#endif
+
+// acc + v * s, not fused: vmlaq_n_f32 may be turned into a fused FMLA by the compiler.
+inline float4_t mulAdd(float4_t acc, float4_t v, float s) {
+    return vaddq_f32(acc, vmulq_f32(v, vdupq_n_f32(s)));
+}
+inline float4_t zero() { return vdupq_n_f32(0); }
+#else
+typedef __m128 float4_t;
+
+inline float4_t load4(const float* p) { return _mm_loadu_ps(p); }
+inline void store4(float* p, float4_t v) { _mm_storeu_ps(p, v); }
+
+// (x, y, z) is kept as (x, y, z, x) so that rotations of the lanes stay within the vector.
+inline float4_t load3(const float* p) { return _mm_setr_ps(p[0], p[1], p[2], p[0]); }
+inline float4_t yzx(float4_t v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 2, 1)); }
+inline float4_t zxy(float4_t v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 1, 0, 2)); }
+
+inline float4_t mul(float4_t a, float4_t b) { return _mm_mul_ps(a, b); }
+inline float4_t sub(float4_t a, float4_t b) { return _mm_sub_ps(a, b); }
+inline float4_t div(float4_t v, float s) { return _mm_div_ps(v, _mm_set1_ps(s)); }
+inline float lane0(float4_t v) { return _mm_cvtss_f32(v); }
+
+// acc + v * s, not fused
+inline float4_t mulAdd(float4_t acc, float4_t v, float s) {
+    return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(s)));
+}
+inline float4_t zero() { return _mm_setzero_ps(); }
+#endif
+
+// mat4 * vec4, with the matrix columns already loaded
+inline float4_t transform4(float4_t c0, float4_t c1, float4_t c2, float4_t c3, const float* v) {
+    float4_t result = zero();
+    result = mulAdd(result, c0, v[0]);
+    result = mulAdd(result, c1, v[1]);
+    result = mulAdd(result, c2, v[2]);
+    result = mulAdd(result, c3, v[3]);
+    return result;
+}
+
+// out = m * v, m is a column-major 4x4 matrix
+inline void multiply4(float* out, const float* m, const float* v) {
+    store4(out, transform4(load4(m), load4(m + 4), load4(m + 8), load4(m + 12), v));
+}
+
+// out = lhs * rhs, all column-major 4x4 matrices. out must not alias lhs or rhs.
+inline void multiply44(float* out, const float* lhs, const float* rhs) {
+    const float4_t c0 = load4(lhs);
+    const float4_t c1 = load4(lhs + 4);
+    const float4_t c2 = load4(lhs + 8);
+    const float4_t c3 = load4(lhs + 12);
+    store4(out,      transform4(c0, c1, c2, c3, rhs));
+    store4(out + 4,  transform4(c0, c1, c2, c3, rhs + 4));
+    store4(out + 8,  transform4(c0, c1, c2, c3, rhs + 8));
+    store4(out + 12, transform4(c0, c1, c2, c3, rhs + 12));
+}
+
+// a x b, for vectors loaded with load3()
+inline float4_t cross3(float4_t a, float4_t b) {
+    return sub(mul(yzx(a), zxy(b)), mul(zxy(a), yzx(b)));
+}
+
+// out = inverse(m), both column-major 3x3 matrices. See matrix::fastInverse3().
+inline void inverse33(float* out, const float* m) {
+    const float4_t c0 = load3(m);
+    const float4_t c1 = load3(m + 3);
+    const float4_t c2 = load3(m + 6);
+
+    // The rows of the adjugate are the cross products of the columns.
+    const float4_t r0 = cross3(c1, c2);
+    const float4_t r1 = cross3(c2, c0);
+    const float4_t r2 = cross3(c0, c1);
+
+    const float det = m[0] * lane0(r0) + m[3] * lane0(r1) + m[6] * lane0(r2);
+    float rows[3][4];
+    store4(rows[0], div(r0, det));
+    store4(rows[1], div(r1, det));
+    store4(rows[2], div(r2, det));
+
+    for (size_t col = 0; col < 3; ++col) {
+        for (size_t row = 0; row < 3; ++row) {
+            out[col * 3 + row] = rows[row][col];
+        }
+    }
+}
+
+#endif  // MATH_SIMD_KERNELS
+
+}  // namespace simd
+}  // namespace matrix
+
+// -------------------------------------------------------------------------------------
+}  // namespace details
+}  // namespace android
+
+#undef MATH_SIMD_NEON
+#undef MATH_SIMD_SSE
+#undef MATH_IS_CONSTANT_EVALUATED
@@ -522,12 +522,7 @@ CONSTEXPR TMat44<T> TMat44<T>::lookAt(const TVec3<A>& eye, const TVec3<B>& cente
 // matrix * column-vector, result is a vector of the same type than the input vector
 template <typename T, typename U>
 CONSTEXPR typename TMat44<T>::col_type PURE operator *(const TMat44<T>& lhs, const TVec4<U>& rhs) {
-    // Result is initialized to zero.
-    typename TMat44<T>::col_type result;
-    for (size_t col = 0; col < TMat44<T>::NUM_COLS; ++col) {
-        result += lhs[col] * rhs[col];
-    }
-    return result;
+    return matrix::multiplyVector<typename TMat44<T>::col_type>(lhs, rhs);
 }
 
 // mat44 * vec3, result is vec3( mat44 * {vec3, 1} )
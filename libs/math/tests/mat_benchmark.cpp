@@ -0,0 +1,111 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <math/mat3.h>
+#include <math/mat4.h>
+
+#include <random>
+
+// Usage: atest mat_benchmark
+//
+// Compares the float mat4/mat3 operators, which use the SIMD kernels when available, with the
+// generic templates they are specialized from.
+
+namespace android {
+namespace {
+
+using details::matrix::inverseGeneric;
+using details::matrix::multiplyGeneric;
+using details::matrix::multiplyVectorGeneric;
+
+template <typename MATRIX>
+MATRIX randomMatrix(std::default_random_engine& generator) {
+    std::uniform_real_distribution<float> distribution(-10.0, 10.0);
+    MATRIX m;
+    for (size_t col = 0; col < MATRIX::NUM_COLS; ++col) {
+        for (size_t row = 0; row < MATRIX::NUM_ROWS; ++row) {
+            m[col][row] = distribution(generator);
+        }
+    }
+    return m;
+}
+
+void BM_Mat4Multiply(benchmark::State& state) {
+    std::default_random_engine generator(1);
+    mat4 lhs = randomMatrix<mat4>(generator);
+    const mat4 rhs = randomMatrix<mat4>(generator);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lhs = lhs * rhs);
+    }
+}
+BENCHMARK(BM_Mat4Multiply);
+
+void BM_Mat4MultiplyGeneric(benchmark::State& state) {
+    std::default_random_engine generator(1);
+    mat4 lhs = randomMatrix<mat4>(generator);
+    const mat4 rhs = randomMatrix<mat4>(generator);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lhs = multiplyGeneric<mat4>(lhs, rhs));
+    }
+}
+BENCHMARK(BM_Mat4MultiplyGeneric);
+
+void BM_Mat4Transform(benchmark::State& state) {
+    std::default_random_engine generator(1);
+    const mat4 m = randomMatrix<mat4>(generator);
+    vec4 v(1, 2, 3, 4);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v = m * v);
+    }
+}
+BENCHMARK(BM_Mat4Transform);
+
+void BM_Mat4TransformGeneric(benchmark::State& state) {
+    std::default_random_engine generator(1);
+    const mat4 m = randomMatrix<mat4>(generator);
+    vec4 v(1, 2, 3, 4);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v = multiplyVectorGeneric<vec4>(m, v));
+    }
+}
+BENCHMARK(BM_Mat4TransformGeneric);
+
+void BM_Mat3Inverse(benchmark::State& state) {
+    std::default_random_engine generator(1);
+    const mat3 m = randomMatrix<mat3>(generator);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(inverse(m));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Mat3Inverse);
+
+void BM_Mat3InverseGeneric(benchmark::State& state) {
+    std::default_random_engine generator(1);
+    const mat3 m = randomMatrix<mat3>(generator);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(inverseGeneric(m));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Mat3InverseGeneric);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -163,6 +163,30 @@ TEST_F(MatTest, ElementAccess) {
     EXPECT_FLOAT_EQ(m(3, 2), 100);
 }
 
+TEST_F(MatTest, SimdMatchesGeneric) {
+    std::default_random_engine generator(171717);
+    std::uniform_real_distribution<float> distribution(-10.0, 10.0);
+    auto next = std::bind(distribution, generator);
+
+    for (size_t i = 0; i < 100; ++i) {
+        mat4 m0, m1;
+        vec4 v;
+        for (size_t c = 0; c < 4; ++c) {
+            m0[c] = vec4(next(), next(), next(), next());
+            m1[c] = vec4(next(), next(), next(), next());
+        }
+        v = vec4(next(), next(), next(), next());
+
+        // the SIMD kernels must be bit-exact with the generic templates
+        EXPECT_EQ(details::matrix::multiplyGeneric<mat4>(m0, m1), m0 * m1);
+        EXPECT_EQ(details::matrix::multiplyVectorGeneric<vec4>(m0, v), m0 * v);
+
+        mat4 m2(m0);
+        m2 *= m1;
+        EXPECT_EQ(m0 * m1, m2);
+    }
+}
+
 //------------------------------------------------------------------------------
 // MAT 3
 //------------------------------------------------------------------------------
@@ -270,6 +294,22 @@ TEST_F(Mat3Test, MiscOps) {
     EXPECT_EQ(m1, m1*identity);
 }
 
+TEST_F(Mat3Test, SimdMatchesGeneric) {
+    std::default_random_engine generator(171717);
+    std::uniform_real_distribution<float> distribution(-10.0, 10.0);
+    auto next = std::bind(distribution, generator);
+
+    for (size_t i = 0; i < 100; ++i) {
+        mat3 m;
+        for (size_t c = 0; c < 3; ++c) {
+            m[c] = vec3(next(), next(), next());
+        }
+
+        // the SIMD kernels must be bit-exact with the generic templates
+        EXPECT_EQ(details::matrix::inverseGeneric(m), inverse(m));
+    }
+}
+
 //------------------------------------------------------------------------------
 // MAT 2
 //------------------------------------------------------------------------------
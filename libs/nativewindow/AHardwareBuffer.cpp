@@ -150,9 +150,6 @@ int AHardwareBuffer_lockAndGetInfo(AHardwareBuffer* buffer, uint64_t usage,
 
 int AHardwareBuffer_lock(AHardwareBuffer* buffer, uint64_t usage,
                          int32_t fence, const ARect* rect, void** outVirtualAddress) {
-    int32_t bytesPerPixel;
-    int32_t bytesPerStride;
-
     if (!buffer) return BAD_VALUE;
 
     if (usage & ~(AHARDWAREBUFFER_USAGE_CPU_READ_MASK |
@@ -177,7 +174,8 @@ int AHardwareBuffer_lock(AHardwareBuffer* buffer, uint64_t usage,
     } else {
         bounds.set(Rect(rect->left, rect->top, rect->right, rect->bottom));
     }
-    return gbuffer->lockAsync(usage, usage, bounds, outVirtualAddress, fence, &bytesPerPixel, &bytesPerStride);
+    // Don't ask for bytes per pixel or stride, which cost a metadata query on some mappers.
+    return gbuffer->lockAsync(usage, usage, bounds, outVirtualAddress, fence);
 }
 
 int AHardwareBuffer_lockPlanes(AHardwareBuffer* buffer, uint64_t usage,
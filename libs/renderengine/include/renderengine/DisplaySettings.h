@@ -63,13 +63,19 @@ struct DisplaySettings {
 
     // SDR white point, -1f if unknown
     float sdrWhitePointNits = -1.f;
+
+    // Region of the output buffer that needs to be redrawn, in physical display space. The
+    // contents of the buffer outside of it are assumed to be up to date already. If empty, then
+    // the whole buffer is redrawn. RenderEngine may redraw more than this region.
+    Region damageRegion;
 };
 
 static inline bool operator==(const DisplaySettings& lhs, const DisplaySettings& rhs) {
     return lhs.physicalDisplay == rhs.physicalDisplay && lhs.clip == rhs.clip &&
             lhs.maxLuminance == rhs.maxLuminance && lhs.outputDataspace == rhs.outputDataspace &&
             lhs.colorTransform == rhs.colorTransform &&
-            lhs.clearRegion.hasSameRects(rhs.clearRegion) && lhs.orientation == rhs.orientation;
+            lhs.clearRegion.hasSameRects(rhs.clearRegion) && lhs.orientation == rhs.orientation &&
+            lhs.damageRegion.hasSameRects(rhs.damageRegion);
 }
 
 // Defining PrintTo helps with Google Tests.
@@ -86,6 +92,8 @@ static inline void PrintTo(const DisplaySettings& settings, ::std::ostream* os)
     *os << "\n    .clearRegion = ";
     PrintTo(settings.clearRegion, os);
     *os << "\n    .orientation = " << settings.orientation;
+    *os << "\n    .damageRegion = ";
+    PrintTo(settings.damageRegion, os);
     *os << "\n}";
 }
 
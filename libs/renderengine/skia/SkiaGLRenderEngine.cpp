@@ -34,6 +34,7 @@
 #include <SkRegion.h>
 #include <SkShadowUtils.h>
 #include <SkSurface.h>
+#include <android-base/scopeguard.h>
 #include <android-base/stringprintf.h>
 #include <gl/GrGLInterface.h>
 #include <gui/TraceUtils.h>
@@ -747,6 +748,17 @@ status_t SkiaGLRenderEngine::drawLayers(const DisplaySettings& display,
 
     validateOutputBufferUsage(buffer->getBuffer());
 
+    // Draw in the context which can access the output buffer. Screenshots are not drawn in step
+    // with composition, so they may find the context that composition last selected. Swap back
+    // afterwards so that cached values of isProtected in SurfaceFlinger are up-to-date.
+    const bool inProtected = mInProtectedContext;
+    useProtectedContext(buffer->getBuffer()->getUsage() & GRALLOC_USAGE_PROTECTED);
+    const auto restoreContext = base::make_scope_guard([&] {
+        if (inProtected != mInProtectedContext) {
+            useProtectedContext(inProtected);
+        }
+    });
+
     auto grContext = getActiveGrContext();
     auto& cache = mTextureCache;
 
@@ -817,6 +829,17 @@ status_t SkiaGLRenderEngine::drawLayers(const DisplaySettings& display,
     }
 
     AutoSaveRestore surfaceAutoSaveRestore(canvas);
+    // Only redraw the damaged part of the buffer, unless the layers are composed offscreen first,
+    // since the blit of the offscreen buffer replaces the entire destination.
+    if (!display.damageRegion.isEmpty() && blurCompositionLayer == nullptr) {
+        ATRACE_NAME("DamageRegion");
+        SkRegion damageRegion;
+        for (const Rect& rect : display.damageRegion) {
+            damageRegion.op(SkIRect::MakeLTRB(rect.left, rect.top, rect.right, rect.bottom),
+                            SkRegion::kUnion_Op);
+        }
+        canvas->clipRegion(damageRegion);
+    }
     // Clear the entire canvas with a transparent black to prevent ghost images.
     canvas->clear(SK_ColorTRANSPARENT);
     initCanvas(canvas, display);
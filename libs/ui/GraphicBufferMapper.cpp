@@ -71,6 +71,10 @@ GraphicBufferMapper::GraphicBufferMapper() {
     LOG_ALWAYS_FATAL("gralloc-mapper is missing");
 }
 
+GraphicBufferMapper::GraphicBufferMapper(std::unique_ptr<const GrallocMapper> mapper,
+                                         Version mapperVersion)
+      : mMapper(std::move(mapper)), mMapperVersion(mapperVersion) {}
+
 void GraphicBufferMapper::dumpBuffer(buffer_handle_t bufferHandle, std::string& result,
                                      bool less) const {
     result.append(mMapper->dumpBuffer(bufferHandle, less));
@@ -104,6 +108,13 @@ status_t GraphicBufferMapper::importBuffer(buffer_handle_t rawHandle,
         return static_cast<status_t>(error);
     }
 
+    {
+        // The handle may be the reused address of a buffer which was not released through
+        // freeBuffer, so start it with no plane layouts cached.
+        std::lock_guard<std::mutex> lock(mPlaneLayoutsMutex);
+        mPlaneLayouts.insert_or_assign(bufferHandle, std::nullopt);
+    }
+
     *outHandle = bufferHandle;
 
     return NO_ERROR;
@@ -119,6 +130,10 @@ status_t GraphicBufferMapper::freeBuffer(buffer_handle_t handle)
 {
     ATRACE_CALL();
 
+    {
+        std::lock_guard<std::mutex> lock(mPlaneLayoutsMutex);
+        mPlaneLayouts.erase(handle);
+    }
     mMapper->freeBuffer(handle);
 
     return NO_ERROR;
@@ -162,10 +177,31 @@ status_t GraphicBufferMapper::lockAsync(buffer_handle_t handle, uint64_t produce
 
     const uint64_t usage = static_cast<uint64_t>(
             android_convertGralloc1To0Usage(producerUsage, consumerUsage));
+    if ((outBytesPerPixel || outBytesPerStride) &&
+        getCachedBytesPerPixelAndStride(handle, outBytesPerPixel, outBytesPerStride)) {
+        outBytesPerPixel = nullptr;
+        outBytesPerStride = nullptr;
+    }
     return mMapper->lock(handle, usage, bounds, fenceFd, vaddr, outBytesPerPixel,
                          outBytesPerStride);
 }
 
+bool GraphicBufferMapper::getCachedBytesPerPixelAndStride(buffer_handle_t handle,
+                                                          int32_t* outBytesPerPixel,
+                                                          int32_t* outBytesPerStride) {
+    // Mappers before 4.0 return these from lock itself.
+    if (mMapperVersion != Version::GRALLOC_4) {
+        return false;
+    }
+
+    std::vector<ui::PlaneLayout> planeLayouts;
+    if (getPlaneLayouts(handle, &planeLayouts) != NO_ERROR) {
+        return false;
+    }
+    Gralloc4Mapper::getBytesPerPixelAndStride(planeLayouts, outBytesPerPixel, outBytesPerStride);
+    return true;
+}
+
 status_t GraphicBufferMapper::lockAsyncYCbCr(buffer_handle_t handle,
         uint32_t usage, const Rect& bounds, android_ycbcr *ycbcr, int fenceFd)
 {
@@ -273,7 +309,33 @@ status_t GraphicBufferMapper::getChromaSiting(buffer_handle_t bufferHandle,
 
 status_t GraphicBufferMapper::getPlaneLayouts(buffer_handle_t bufferHandle,
                                               std::vector<ui::PlaneLayout>* outPlaneLayouts) {
-    return mMapper->getPlaneLayouts(bufferHandle, outPlaneLayouts);
+    if (!outPlaneLayouts) {
+        return BAD_VALUE;
+    }
+
+    // Only buffers imported through importBuffer are cached, as only their lifetime is known.
+    {
+        std::lock_guard<std::mutex> lock(mPlaneLayoutsMutex);
+        const auto it = mPlaneLayouts.find(bufferHandle);
+        if (it == mPlaneLayouts.end()) {
+            return mMapper->getPlaneLayouts(bufferHandle, outPlaneLayouts);
+        }
+        if (it->second) {
+            *outPlaneLayouts = *it->second;
+            return NO_ERROR;
+        }
+    }
+
+    // Query gralloc without holding the lock, so that locks of other buffers aren't blocked.
+    status_t error = mMapper->getPlaneLayouts(bufferHandle, outPlaneLayouts);
+    if (error == NO_ERROR) {
+        std::lock_guard<std::mutex> lock(mPlaneLayoutsMutex);
+        // The buffer may have been freed in the meantime.
+        if (const auto it = mPlaneLayouts.find(bufferHandle); it != mPlaneLayouts.end()) {
+            it->second = *outPlaneLayouts;
+        }
+    }
+    return error;
 }
 
 status_t GraphicBufferMapper::getDataspace(buffer_handle_t bufferHandle,
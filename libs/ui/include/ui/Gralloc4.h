@@ -62,6 +62,11 @@ public:
     status_t lock(buffer_handle_t bufferHandle, uint64_t usage, const Rect& bounds,
                   int acquireFence, android_ycbcr* ycbcr) const override;
 
+    // Derives the bytes per pixel and bytes per stride reported by lock from the plane layouts of
+    // a buffer. Either is -1 if it isn't uniform across planes. Null outputs are ignored.
+    static void getBytesPerPixelAndStride(const std::vector<ui::PlaneLayout>& planeLayouts,
+                                          int32_t* outBytesPerPixel, int32_t* outBytesPerStride);
+
     int unlock(buffer_handle_t bufferHandle) const override;
 
     status_t isSupported(uint32_t width, uint32_t height, PixelFormat format, uint32_t layerCount,
@@ -21,6 +21,10 @@
 #include <sys/types.h>
 
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 #include <ui/GraphicTypes.h>
 #include <ui/PixelFormat.h>
@@ -118,6 +122,8 @@ public:
             buffer_handle_t bufferHandle,
             aidl::android::hardware::graphics::common::ExtendableType* outChromaSiting);
     status_t getChromaSiting(buffer_handle_t bufferHandle, ui::ChromaSiting* outChromaSiting);
+    // Plane layouts are immutable for the lifetime of a buffer, so they are queried from gralloc
+    // once per buffer imported with importBuffer and cached until freeBuffer.
     status_t getPlaneLayouts(buffer_handle_t bufferHandle,
                              std::vector<ui::PlaneLayout>* outPlaneLayouts);
     status_t getDataspace(buffer_handle_t bufferHandle, ui::Dataspace* outDataspace);
@@ -175,14 +181,28 @@ public:
 
     Version getMapperVersion() const { return mMapperVersion; }
 
-private:
+protected:
     friend class Singleton<GraphicBufferMapper>;
 
     GraphicBufferMapper();
 
+    // For tests and benchmarks which inject a fake mapper.
+    GraphicBufferMapper(std::unique_ptr<const GrallocMapper> mapper, Version mapperVersion);
+
     std::unique_ptr<const GrallocMapper> mMapper;
 
     Version mMapperVersion;
+
+private:
+    // Fills in the bytes per pixel and stride from the cached plane layouts, so that CPU locks
+    // don't fetch and decode the plane layout metadata on every call. Returns false if the plane
+    // layouts are not available from this mapper.
+    bool getCachedBytesPerPixelAndStride(buffer_handle_t bufferHandle, int32_t* outBytesPerPixel,
+                                         int32_t* outBytesPerStride);
+
+    // Keyed by the handles of imported buffers, with no value until the plane layouts are queried.
+    std::mutex mPlaneLayoutsMutex;
+    std::unordered_map<buffer_handle_t, std::optional<std::vector<ui::PlaneLayout>>> mPlaneLayouts;
 };
 
 // ---------------------------------------------------------------------------
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <cutils/native_handle.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include "mock/FakeGrallocMapper.h"
+
+// Usage: atest GraphicBufferMapper_benchmark
+//
+// Measures the CPU lock/unlock cycle of an app reading back a buffer every frame, against a fake
+// mapper, so that only the overhead of GraphicBufferMapper and the metadata decoding is timed.
+
+namespace android {
+namespace {
+
+constexpr uint32_t kWidth = 1920;
+constexpr uint32_t kHeight = 1080;
+
+std::vector<ui::PlaneLayout> planeLayouts(size_t planeCount) {
+    std::vector<ui::PlaneLayout> layouts(planeCount);
+    int64_t offset = 0;
+    for (auto& layout : layouts) {
+        layout.offsetInBytes = offset;
+        layout.sampleIncrementInBits = 8;
+        layout.strideInBytes = kWidth;
+        layout.widthInSamples = kWidth;
+        layout.heightInSamples = kHeight;
+        layout.totalSizeInBytes = kWidth * kHeight;
+        layout.horizontalSubsampling = 1;
+        layout.verticalSubsampling = 1;
+        offset += layout.totalSizeInBytes;
+    }
+    return layouts;
+}
+
+class BenchmarkGraphicBufferMapper : public GraphicBufferMapper {
+public:
+    BenchmarkGraphicBufferMapper(size_t planeCount, Version version)
+          : GraphicBufferMapper(std::make_unique<const fake::FakeGrallocMapper>(
+                                        planeLayouts(planeCount)),
+                                version) {}
+
+    buffer_handle_t importBuffer(native_handle_t* rawHandle) {
+        buffer_handle_t handle = nullptr;
+        GraphicBufferMapper::importBuffer(rawHandle, kWidth, kHeight, 1, HAL_PIXEL_FORMAT_Y8,
+                                          GRALLOC_USAGE_SW_READ_OFTEN, kWidth, &handle);
+        return handle;
+    }
+};
+
+// Lock with the bytes per pixel and stride, as AHardwareBuffer_lockAndGetInfo does.
+void lockAndGetInfo(benchmark::State& state, GraphicBufferMapper::Version version) {
+    BenchmarkGraphicBufferMapper mapper(state.range(0), version);
+    native_handle_t* rawHandle = native_handle_create(0, 0);
+    buffer_handle_t handle = mapper.importBuffer(rawHandle);
+
+    for (auto _ : state) {
+        void* data;
+        int32_t bytesPerPixel;
+        int32_t bytesPerStride;
+        mapper.lock(handle, GRALLOC_USAGE_SW_READ_OFTEN, Rect(kWidth, kHeight), &data,
+                    &bytesPerPixel, &bytesPerStride);
+        benchmark::DoNotOptimize(data);
+        mapper.unlock(handle);
+    }
+
+    mapper.freeBuffer(handle);
+    native_handle_delete(rawHandle);
+}
+
+// Gralloc 3 reports the values from lock, i.e. the plane layouts are decoded on every lock.
+void BM_LockAndGetInfo_Uncached(benchmark::State& state) {
+    lockAndGetInfo(state, GraphicBufferMapper::Version::GRALLOC_3);
+}
+BENCHMARK(BM_LockAndGetInfo_Uncached)->Arg(1)->Arg(3);
+
+void BM_LockAndGetInfo_Cached(benchmark::State& state) {
+    lockAndGetInfo(state, GraphicBufferMapper::Version::GRALLOC_4);
+}
+BENCHMARK(BM_LockAndGetInfo_Cached)->Arg(1)->Arg(3);
+
+// Lock without the bytes per pixel and stride, as AHardwareBuffer_lock does.
+void BM_Lock(benchmark::State& state) {
+    BenchmarkGraphicBufferMapper mapper(1, GraphicBufferMapper::Version::GRALLOC_4);
+    native_handle_t* rawHandle = native_handle_create(0, 0);
+    buffer_handle_t handle = mapper.importBuffer(rawHandle);
+
+    for (auto _ : state) {
+        void* data;
+        mapper.lock(handle, GRALLOC_USAGE_SW_READ_OFTEN, Rect(kWidth, kHeight), &data);
+        benchmark::DoNotOptimize(data);
+        mapper.unlock(handle);
+    }
+
+    mapper.freeBuffer(handle);
+    native_handle_delete(rawHandle);
+}
+BENCHMARK(BM_Lock);
+
+} // namespace
+} // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicBufferMapperTest"
+
+#include <cutils/native_handle.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include <gtest/gtest.h>
+
+#include "mock/FakeGrallocMapper.h"
+
+namespace android {
+
+namespace {
+
+constexpr uint32_t kTestWidth = 64;
+constexpr uint32_t kTestHeight = 32;
+
+std::vector<ui::PlaneLayout> rgbaPlaneLayouts() {
+    ui::PlaneLayout planeLayout;
+    planeLayout.offsetInBytes = 0;
+    planeLayout.sampleIncrementInBits = 32;
+    planeLayout.strideInBytes = kTestWidth * 4;
+    planeLayout.widthInSamples = kTestWidth;
+    planeLayout.heightInSamples = kTestHeight;
+    planeLayout.totalSizeInBytes = kTestWidth * kTestHeight * 4;
+    planeLayout.horizontalSubsampling = 1;
+    planeLayout.verticalSubsampling = 1;
+    return {planeLayout};
+}
+
+} // namespace
+
+class TestableGraphicBufferMapper : public GraphicBufferMapper {
+public:
+    TestableGraphicBufferMapper(std::unique_ptr<const GrallocMapper> mapper, Version version)
+          : GraphicBufferMapper(std::move(mapper), version) {}
+
+    const fake::FakeGrallocMapper& getFakeMapper() const {
+        return static_cast<const fake::FakeGrallocMapper&>(*mMapper);
+    }
+};
+
+class GraphicBufferMapperTest : public testing::TestWithParam<GraphicBufferMapper::Version> {
+public:
+    GraphicBufferMapperTest()
+          : mMapper(std::make_unique<const fake::FakeGrallocMapper>(rgbaPlaneLayouts()),
+                    GetParam()),
+            mRawHandle(native_handle_create(0, 0)) {}
+
+    ~GraphicBufferMapperTest() override { native_handle_delete(mRawHandle); }
+
+    void SetUp() override { ASSERT_EQ(NO_ERROR, importBuffer(&mHandle)); }
+
+protected:
+    status_t importBuffer(buffer_handle_t* outHandle) {
+        return mMapper.importBuffer(mRawHandle, kTestWidth, kTestHeight, 1,
+                                    HAL_PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_SW_READ_OFTEN,
+                                    kTestWidth, outHandle);
+    }
+
+    TestableGraphicBufferMapper mMapper;
+    native_handle_t* const mRawHandle;
+    buffer_handle_t mHandle = nullptr;
+};
+
+TEST_P(GraphicBufferMapperTest, LockReportsBytesPerPixelAndStride) {
+    void* data = nullptr;
+    int32_t bytesPerPixel = 0;
+    int32_t bytesPerStride = 0;
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(NO_ERROR,
+                  mMapper.lock(mHandle, GRALLOC_USAGE_SW_READ_OFTEN,
+                               Rect(kTestWidth, kTestHeight), &data, &bytesPerPixel,
+                               &bytesPerStride));
+        EXPECT_NE(nullptr, data);
+        EXPECT_EQ(4, bytesPerPixel);
+        EXPECT_EQ(static_cast<int32_t>(kTestWidth * 4), bytesPerStride);
+        ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    }
+
+    if (GetParam() == GraphicBufferMapper::Version::GRALLOC_4) {
+        // Fetched once, then served from the cache.
+        EXPECT_EQ(1u, mMapper.getFakeMapper().getPlaneLayoutsCount());
+    } else {
+        // Older mappers report the values from lock itself.
+        EXPECT_EQ(3u, mMapper.getFakeMapper().getPlaneLayoutsCount());
+    }
+}
+
+TEST_P(GraphicBufferMapperTest, LockWithoutBytesPerPixelSkipsPlaneLayouts) {
+    void* data = nullptr;
+    ASSERT_EQ(NO_ERROR,
+              mMapper.lock(mHandle, GRALLOC_USAGE_SW_READ_OFTEN, Rect(kTestWidth, kTestHeight),
+                           &data));
+    ASSERT_EQ(NO_ERROR, mMapper.unlock(mHandle));
+    EXPECT_EQ(0u, mMapper.getFakeMapper().getPlaneLayoutsCount());
+}
+
+TEST_P(GraphicBufferMapperTest, FreeBufferInvalidatesPlaneLayouts) {
+    std::vector<ui::PlaneLayout> planeLayouts;
+    ASSERT_EQ(NO_ERROR, mMapper.getPlaneLayouts(mHandle, &planeLayouts));
+    ASSERT_EQ(NO_ERROR, mMapper.getPlaneLayouts(mHandle, &planeLayouts));
+    EXPECT_EQ(1u, mMapper.getFakeMapper().getPlaneLayoutsCount());
+    EXPECT_EQ(0u, mMapper.getFakeMapper().getBufferIdCount());
+    EXPECT_EQ(rgbaPlaneLayouts(), planeLayouts);
+
+    // The handle may be reused for another buffer once freed.
+    ASSERT_EQ(NO_ERROR, mMapper.freeBuffer(mHandle));
+    EXPECT_EQ(1u, mMapper.getFakeMapper().getFreeBufferCount());
+
+    ASSERT_EQ(NO_ERROR, importBuffer(&mHandle));
+    ASSERT_EQ(NO_ERROR, mMapper.getPlaneLayouts(mHandle, &planeLayouts));
+    EXPECT_EQ(2u, mMapper.getFakeMapper().getPlaneLayoutsCount());
+}
+
+TEST_P(GraphicBufferMapperTest, ReusedHandleInvalidatesPlaneLayouts) {
+    std::vector<ui::PlaneLayout> planeLayouts;
+    ASSERT_EQ(NO_ERROR, mMapper.getPlaneLayouts(mHandle, &planeLayouts));
+    EXPECT_EQ(1u, mMapper.getFakeMapper().getPlaneLayoutsCount());
+
+    // The handle now refers to another buffer, which was imported without the previous one
+    // going through freeBuffer.
+    buffer_handle_t reusedHandle;
+    ASSERT_EQ(NO_ERROR, importBuffer(&reusedHandle));
+    ASSERT_EQ(mHandle, reusedHandle);
+    ASSERT_EQ(NO_ERROR, mMapper.getPlaneLayouts(reusedHandle, &planeLayouts));
+    ASSERT_EQ(NO_ERROR, mMapper.getPlaneLayouts(reusedHandle, &planeLayouts));
+    EXPECT_EQ(2u, mMapper.getFakeMapper().getPlaneLayoutsCount());
+}
+
+TEST_P(GraphicBufferMapperTest, NotImportedHandleIsNotCached) {
+    native_handle_t* handle = native_handle_create(0, 0);
+    std::vector<ui::PlaneLayout> planeLayouts;
+    ASSERT_EQ(NO_ERROR, mMapper.getPlaneLayouts(handle, &planeLayouts));
+    ASSERT_EQ(NO_ERROR, mMapper.getPlaneLayouts(handle, &planeLayouts));
+    EXPECT_EQ(2u, mMapper.getFakeMapper().getPlaneLayoutsCount());
+    native_handle_delete(handle);
+}
+
+INSTANTIATE_TEST_SUITE_P(Mappers, GraphicBufferMapperTest,
+                         testing::Values(GraphicBufferMapper::Version::GRALLOC_3,
+                                         GraphicBufferMapper::Version::GRALLOC_4));
+
+} // namespace android
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeGrallocMapper.h"
+
+#include <algorithm>
+
+namespace android::fake {
+
+FakeGrallocMapper::FakeGrallocMapper(std::vector<ui::PlaneLayout> planeLayouts) {
+    gralloc4::encodePlaneLayouts(planeLayouts, &mEncodedPlaneLayouts);
+
+    size_t size = 0;
+    for (const auto& planeLayout : planeLayouts) {
+        size = std::max(size, static_cast<size_t>(planeLayout.offsetInBytes +
+                                                  planeLayout.totalSizeInBytes));
+    }
+    mData.resize(size);
+}
+
+FakeGrallocMapper::~FakeGrallocMapper() = default;
+
+status_t FakeGrallocMapper::lock(buffer_handle_t bufferHandle, uint64_t /*usage*/,
+                                 const Rect& /*bounds*/, int /*acquireFence*/, void** outData,
+                                 int32_t* outBytesPerPixel, int32_t* outBytesPerStride) const {
+    // Like Gralloc4Mapper, derive the values from the plane layouts when asked for them.
+    if (outBytesPerPixel || outBytesPerStride) {
+        std::vector<ui::PlaneLayout> planeLayouts;
+        if (getPlaneLayouts(bufferHandle, &planeLayouts) == NO_ERROR && !planeLayouts.empty()) {
+            if (outBytesPerPixel) {
+                *outBytesPerPixel = planeLayouts.front().sampleIncrementInBits / 8;
+            }
+            if (outBytesPerStride) {
+                *outBytesPerStride = planeLayouts.front().strideInBytes;
+            }
+        }
+    }
+    *outData = mData.data();
+    return NO_ERROR;
+}
+
+status_t FakeGrallocMapper::getPlaneLayouts(buffer_handle_t /*bufferHandle*/,
+                                            std::vector<ui::PlaneLayout>* outPlaneLayouts) const {
+    mGetPlaneLayoutsCount++;
+    return gralloc4::decodePlaneLayouts(mEncodedPlaneLayouts, outPlaneLayouts);
+}
+
+} // namespace android::fake
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <ui/Gralloc.h>
+
+#include <atomic>
+#include <vector>
+
+namespace android::fake {
+
+// A GrallocMapper backed by a single CPU allocation, which counts the calls that the
+// GraphicBufferMapper caches are meant to avoid. Plane layouts are round-tripped through the
+// gralloc4 metadata encoding, like a real IMapper@4.0 get(PlaneLayouts) call.
+class FakeGrallocMapper : public GrallocMapper {
+public:
+    explicit FakeGrallocMapper(std::vector<ui::PlaneLayout> planeLayouts);
+    ~FakeGrallocMapper() override;
+
+    bool isLoaded() const override { return true; }
+
+    status_t createDescriptor(void*, void*) const override { return INVALID_OPERATION; }
+    // Hands back the raw handle, which stays owned by the caller.
+    status_t importBuffer(const hardware::hidl_handle& rawHandle,
+                          buffer_handle_t* outBufferHandle) const override {
+        *outBufferHandle = rawHandle.getNativeHandle();
+        return NO_ERROR;
+    }
+    void freeBuffer(buffer_handle_t) const override { mFreeBufferCount++; }
+    status_t validateBufferSize(buffer_handle_t, uint32_t, uint32_t, android::PixelFormat,
+                                uint32_t, uint64_t, uint32_t) const override {
+        return NO_ERROR;
+    }
+    void getTransportSize(buffer_handle_t, uint32_t*, uint32_t*) const override {}
+
+    status_t lock(buffer_handle_t bufferHandle, uint64_t usage, const Rect& bounds,
+                  int acquireFence, void** outData, int32_t* outBytesPerPixel,
+                  int32_t* outBytesPerStride) const override;
+    status_t lock(buffer_handle_t, uint64_t, const Rect&, int, android_ycbcr*) const override {
+        return INVALID_OPERATION;
+    }
+    int unlock(buffer_handle_t) const override { return -1; }
+
+    status_t getBufferId(buffer_handle_t, uint64_t* outBufferId) const override {
+        mGetBufferIdCount++;
+        *outBufferId = 1;
+        return NO_ERROR;
+    }
+    status_t getPlaneLayouts(buffer_handle_t bufferHandle,
+                             std::vector<ui::PlaneLayout>* outPlaneLayouts) const override;
+
+    size_t getPlaneLayoutsCount() const { return mGetPlaneLayoutsCount; }
+    size_t getBufferIdCount() const { return mGetBufferIdCount; }
+    size_t getFreeBufferCount() const { return mFreeBufferCount; }
+
+private:
+    hardware::hidl_vec<uint8_t> mEncodedPlaneLayouts;
+    mutable std::vector<uint8_t> mData;
+
+    mutable std::atomic<size_t> mGetPlaneLayoutsCount = 0;
+    mutable std::atomic<size_t> mGetBufferIdCount = 0;
+    mutable std::atomic<size_t> mFreeBufferCount = 0;
+};
+
+} // namespace android::fake
@@ -27,9 +27,9 @@ namespace android {
 namespace frameworks {
 namespace stats {
 
-StatsHal::StatsHal() {}
+namespace {
 
-ndk::ScopedAStatus StatsHal::reportVendorAtom(const VendorAtom& vendorAtom) {
+ndk::ScopedAStatus validateVendorAtom(const VendorAtom& vendorAtom) {
     std::string reverseDomainName = (std::string) vendorAtom.reverseDomainName;
     if (vendorAtom.atomId < 100000 || vendorAtom.atomId >= 200000) {
         ALOGE("Atom ID %ld is not a valid vendor atom ID", (long) vendorAtom.atomId);
@@ -41,6 +41,10 @@ ndk::ScopedAStatus StatsHal::reportVendorAtom(const VendorAtom& vendorAtom) {
         return ndk::ScopedAStatus::fromServiceSpecificErrorWithMessage(
             -1, "Vendor atom reverse domain name is too long");
     }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus writeVendorAtom(EventWriter writer, const VendorAtom& vendorAtom) {
     AStatsEvent* event = AStatsEvent_obtain();
     AStatsEvent_setAtomId(event, vendorAtom.atomId);
     AStatsEvent_writeString(event, vendorAtom.reverseDomainName.c_str());
@@ -65,7 +69,7 @@ ndk::ScopedAStatus StatsHal::reportVendorAtom(const VendorAtom& vendorAtom) {
         }
     }
     AStatsEvent_build(event);
-    const int ret = AStatsEvent_write(event);
+    const int ret = writer(event);
     AStatsEvent_release(event);
 
     return ret <= 0 ?
@@ -73,6 +77,47 @@ ndk::ScopedAStatus StatsHal::reportVendorAtom(const VendorAtom& vendorAtom) {
             ndk::ScopedAStatus::ok();
 }
 
+}  // namespace
+
+StatsBatchHal::StatsBatchHal(EventWriter writer) : mWriter(writer) {}
+
+ndk::ScopedAStatus StatsBatchHal::reportVendorAtoms(const std::vector<VendorAtom>& vendorAtoms) {
+    for (const auto& vendorAtom : vendorAtoms) {
+        ndk::ScopedAStatus status = validateVendorAtom(vendorAtom);
+        if (!status.isOk()) {
+            return status;
+        }
+    }
+
+    ndk::ScopedAStatus result = ndk::ScopedAStatus::ok();
+    for (const auto& vendorAtom : vendorAtoms) {
+        ndk::ScopedAStatus status = writeVendorAtom(mWriter, vendorAtom);
+        if (!status.isOk() && result.isOk()) {
+            result = std::move(status);
+        }
+    }
+    return result;
+}
+
+StatsHal::StatsHal() : StatsHal(AStatsEvent_write) {}
+
+StatsHal::StatsHal(EventWriter writer)
+      : mWriter(writer), mBatchHal(ndk::SharedRefBase::make<StatsBatchHal>(writer)) {}
+
+ndk::ScopedAStatus StatsHal::reportVendorAtom(const VendorAtom& vendorAtom) {
+    ndk::ScopedAStatus status = validateVendorAtom(vendorAtom);
+    if (!status.isOk()) {
+        return status;
+    }
+    return writeVendorAtom(mWriter, vendorAtom);
+}
+
+ndk::SpAIBinder StatsHal::createBinder() {
+    ndk::SpAIBinder binder = BnStats::createBinder();
+    AIBinder_setExtension(binder.get(), mBatchHal->asBinder().get());
+    return binder;
+}
+
 }  // namespace stats
 }  // namespace frameworks
 }  // namespace android
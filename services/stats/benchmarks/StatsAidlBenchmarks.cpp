@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StatsAidlBenchmarks"
+
+#include <android/binder_ibinder_platform.h>
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <android/binder_stability.h>
+#include <benchmark/benchmark.h>
+#include <log/log.h>
+#include <stats/StatsAidl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using aidl::android::frameworks::stats::IStats;
+using aidl::android::frameworks::stats::StatsHal;
+using aidl::android::frameworks::stats::VendorAtom;
+using aidl::android::frameworks::stats::VendorAtomValue;
+using aidl::android::frameworks::stats::batch::IStatsBatch;
+
+// Usage: atest libstatshidl_benchmarks
+//
+// Compares reporting vendor atoms one binder call at a time with reporting them in batches, from
+// this process to a StatsHal served by a child process.
+
+static const char* kServiceName = "libstatshidl_benchmarks";
+
+// Stand-in for the statsd socket: a datagram socket pair drained by a reader thread, so that the
+// benchmarks pay for a socket write per event without needing statsd.
+class FakeStatsdSocket {
+public:
+    FakeStatsdSocket() {
+        if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, mFds) != 0) {
+            LOG_ALWAYS_FATAL("socketpair failed: %s", strerror(errno));
+        }
+        mReader = std::thread([fd = mFds[1]] {
+            char buffer[4096];
+            while (recv(fd, buffer, sizeof(buffer), 0) > 0) {
+            }
+        });
+    }
+
+    ~FakeStatsdSocket() {
+        shutdown(mFds[0], SHUT_RDWR);
+        shutdown(mFds[1], SHUT_RDWR);
+        mReader.join();
+        close(mFds[0]);
+        close(mFds[1]);
+    }
+
+    // The size of a serialized vendor atom with a few values.
+    static constexpr size_t kEventSize = 96;
+
+    static int write(AStatsEvent* /*event*/) {
+        static const char payload[kEventSize] = {};
+        return send(sInstance->mFds[0], payload, sizeof(payload), 0);
+    }
+
+    static FakeStatsdSocket* sInstance;
+
+private:
+    int mFds[2];
+    std::thread mReader;
+};
+
+FakeStatsdSocket* FakeStatsdSocket::sInstance = nullptr;
+
+// Serves a StatsHal which writes to a FakeStatsdSocket, until the parent process dies.
+static int statsHalService() {
+    FakeStatsdSocket socket;
+    FakeStatsdSocket::sInstance = &socket;
+    auto hal = ndk::SharedRefBase::make<StatsHal>(&FakeStatsdSocket::write);
+
+    // StatsHal and its extension are VINTF stable, but not declared in the VINTF manifest under
+    // this name.
+    ndk::SpAIBinder binder = hal->asBinder();
+    ndk::SpAIBinder extension;
+    AIBinder_getExtension(binder.get(), extension.getR());
+    AIBinder_forceDowngradeToLocalStability(binder.get());
+    AIBinder_forceDowngradeToLocalStability(extension.get());
+
+    if (AServiceManager_addService(binder.get(), kServiceName) != EX_NONE) {
+        LOG_ALWAYS_FATAL("Could not register %s", kServiceName);
+    }
+    ABinderProcess_joinThreadPool();
+    return 1;  // should not return
+}
+
+static std::shared_ptr<IStats> sStats;
+static std::shared_ptr<IStatsBatch> sStatsBatch;
+
+static VendorAtom makeAtom(int32_t i) {
+    VendorAtom atom;
+    atom.reverseDomainName = "com.example.vendor";
+    atom.atomId = 100001;
+    atom.values.push_back(VendorAtomValue::make<VendorAtomValue::intValue>(i));
+    atom.values.push_back(VendorAtomValue::make<VendorAtomValue::longValue>(i * 1000LL));
+    atom.values.push_back(VendorAtomValue::make<VendorAtomValue::floatValue>(i * 0.5f));
+    return atom;
+}
+
+static void BatchSizeArgs(benchmark::internal::Benchmark* b) {
+    for (int i : {1, 8, 64}) {
+        b->Args({i});
+    }
+}
+
+// One reportVendorAtom call per atom.
+static void BM_ReportVendorAtom(benchmark::State& state) {
+    std::vector<VendorAtom> atoms;
+    for (int32_t i = 0; i < state.range(0); i++) {
+        atoms.push_back(makeAtom(i));
+    }
+
+    for (auto _ : state) {
+        for (const auto& atom : atoms) {
+            if (!sStats->reportVendorAtom(atom).isOk()) {
+                state.SkipWithError("reportVendorAtom failed");
+                return;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * atoms.size());
+}
+BENCHMARK(BM_ReportVendorAtom)->Apply(BatchSizeArgs);
+
+// One reportVendorAtoms call per batch.
+static void BM_ReportVendorAtoms(benchmark::State& state) {
+    std::vector<VendorAtom> atoms;
+    for (int32_t i = 0; i < state.range(0); i++) {
+        atoms.push_back(makeAtom(i));
+    }
+
+    for (auto _ : state) {
+        if (!sStatsBatch->reportVendorAtoms(atoms).isOk()) {
+            state.SkipWithError("reportVendorAtoms failed");
+            return;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * atoms.size());
+}
+BENCHMARK(BM_ReportVendorAtoms)->Apply(BatchSizeArgs);
+
+int main(int argc, char** argv) {
+    if (fork() == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGHUP);
+        return statsHalService();
+    }
+
+    ndk::SpAIBinder binder(AServiceManager_waitForService(kServiceName));
+    sStats = IStats::fromBinder(binder);
+    ndk::SpAIBinder extension;
+    AIBinder_getExtension(binder.get(), extension.getR());
+    sStatsBatch = IStatsBatch::fromBinder(extension);
+    if (!sStats || !sStatsBatch) {
+        LOG_ALWAYS_FATAL("Could not get %s", kServiceName);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -15,21 +15,61 @@
  */
 
 #include <aidl/android/frameworks/stats/BnStats.h>
+#include <aidl/android/frameworks/stats/batch/BnStatsBatch.h>
+
+#include <memory>
+#include <vector>
+
+struct AStatsEvent;
 
 namespace aidl {
 namespace android {
 namespace frameworks {
 namespace stats {
 
+/**
+ * Writes a built event to statsd, and returns the number of bytes written or a negative errno.
+ */
+using EventWriter = int (*)(AStatsEvent* event);
+
+class StatsBatchHal : public batch::BnStatsBatch {
+public:
+    explicit StatsBatchHal(EventWriter writer);
+
+    /**
+     * Binder call to get a batch of vendor atoms.
+     */
+    ndk::ScopedAStatus reportVendorAtoms(const std::vector<VendorAtom>& in_vendorAtoms) override;
+
+private:
+    const EventWriter mWriter;
+};
+
 class StatsHal : public BnStats {
 public:
     StatsHal();
 
+    /**
+     * Writes events with the given writer instead of AStatsEvent_write, e.g. to a stand-in for the
+     * statsd socket.
+     */
+    explicit StatsHal(EventWriter writer);
+
     /**
      * Binder call to get vendor atom.
      */
     virtual ndk::ScopedAStatus reportVendorAtom(
         const VendorAtom& in_vendorAtom) override;
+
+protected:
+    /**
+     * Attaches a StatsBatchHal as the extension of the binder, before it can be shared.
+     */
+    ndk::SpAIBinder createBinder() override;
+
+private:
+    const EventWriter mWriter;
+    const std::shared_ptr<StatsBatchHal> mBatchHal;
 };
 
 }  // namespace stats
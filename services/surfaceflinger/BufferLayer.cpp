@@ -49,6 +49,7 @@
 #include <cstdlib>
 #include <mutex>
 #include <sstream>
+#include <utility>
 
 #include "Colorizer.h"
 #include "DisplayDevice.h"
@@ -531,6 +532,11 @@ bool BufferLayer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t latchTime,
 
     BufferInfo oldBufferInfo = mBufferInfo;
 
+    if (!canReplaceCapturedBuffer()) {
+        ATRACE_NAME("!canReplaceCapturedBuffer()");
+        return false;
+    }
+
     status_t err = updateTexImage(recomputeVisibleRegions, latchTime, expectedPresentTime);
     if (err != NO_ERROR) {
         return false;
@@ -747,6 +753,18 @@ void BufferLayer::latchAndReleaseBuffer() {
     releasePendingBuffer(systemTime());
 }
 
+bool BufferLayer::onCaptureDrawn() {
+    releaseDrawnCaptureFences();
+    return std::exchange(mLatchHeldForCaptures, false);
+}
+
+bool BufferLayer::canReplaceCapturedBuffer() {
+    // The consumer releases the current buffer as soon as it is replaced, so rather than waiting
+    // for the screen captures sampling it, the new buffer is latched once they are drawn.
+    mLatchHeldForCaptures = releaseDrawnCaptureFences();
+    return !mLatchHeldForCaptures;
+}
+
 PixelFormat BufferLayer::getPixelFormat() const {
     return mBufferInfo.mPixelFormat;
 }
@@ -101,6 +101,8 @@ public:
     // Should only be called on the main thread.
     void latchAndReleaseBuffer() override;
 
+    bool onCaptureDrawn() override;
+
     bool getTransformToDisplayInverse() const override;
 
     Rect getBufferCrop() const override;
@@ -187,6 +189,10 @@ protected:
     std::atomic<bool> mSidebandStreamChanged{false};
 
 private:
+    // Called before the current buffer is replaced, while screen captures may still sample it.
+    // Returns whether it may be replaced now, rather than once the captures are drawn.
+    virtual bool canReplaceCapturedBuffer();
+
     virtual bool fenceHasSignaled() const = 0;
     virtual bool framePresentTimeIsCurrent(nsecs_t expectedPresentTime) const = 0;
     virtual uint64_t getFrameNumber(nsecs_t expectedPresentTime) const = 0;
@@ -203,6 +209,10 @@ private:
     virtual status_t updateActiveBuffer() = 0;
     virtual status_t updateFrameNumber(nsecs_t latchTime) = 0;
 
+    // Whether a new buffer is held back until the screen captures sampling the current one are
+    // drawn.
+    bool mLatchHeldForCaptures = false;
+
     // We generate InputWindowHandles for all non-cursor buffered layers regardless of whether they
     // have an InputChannel. This is to enable the InputDispatcher to do PID based occlusion
     // detection.
@@ -26,6 +26,7 @@
 
 #include "BufferStateLayer.h"
 
+#include <algorithm>
 #include <limits>
 
 #include <FrameTimeline/FrameTimeline.h>
@@ -73,6 +74,11 @@ BufferStateLayer::~BufferStateLayer() {
                                   mFlinger->getMaxAcquiredBufferCountForCurrentRefreshRate(
                                           mOwnerUid));
     }
+    for (const HeldRelease& release : mHeldReleases) {
+        if (release.listener != nullptr) {
+            sendHeldRelease(release);
+        }
+    }
 }
 
 status_t BufferStateLayer::addReleaseFence(const sp<CallbackHandle>& ch,
@@ -177,6 +183,92 @@ void BufferStateLayer::onLayerDisplayed(const sp<Fence>& releaseFence) {
     }
 }
 
+bool BufferStateLayer::canReplaceCapturedBuffer() {
+    // Buffers are only released once the transaction callbacks of their replacements are sent, so
+    // screen captures still sampling the current buffer hold back its release instead of the latch.
+    releaseDrawnCaptureFences();
+    return true;
+}
+
+bool BufferStateLayer::onCaptureDrawn() {
+    auto it = mHeldReleases.begin();
+    while (it != mHeldReleases.end()) {
+        if (mergeDrawnCaptureFences(*it) || it->listener == nullptr) {
+            ++it;
+            continue;
+        }
+        sendHeldRelease(*it);
+        it = mHeldReleases.erase(it);
+    }
+    return BufferLayer::onCaptureDrawn();
+}
+
+void BufferStateLayer::holdReleaseForCaptures(const sp<CallbackHandle>& ch) {
+    const auto it = std::find_if(mHeldReleases.begin(), mHeldReleases.end(),
+                                 [&](const HeldRelease& release) {
+                                     return release.listener == nullptr &&
+                                             release.callbackId == ch->previousReleaseCallbackId;
+                                 });
+    if (it == mHeldReleases.end()) {
+        return;
+    }
+
+    if (!mergeDrawnCaptureFences(*it) || mDrawingState.releaseBufferListener == nullptr) {
+        if (it->releaseFence != nullptr && it->releaseFence->isValid() &&
+            addReleaseFence(ch, it->releaseFence) != OK) {
+            ALOGE("Failed to add screen capture release fence for layer %s", mName.c_str());
+        }
+        mHeldReleases.erase(it);
+        return;
+    }
+
+    it->releaseFence = mergeReleaseFences(it->releaseFence, ch->previousReleaseFence);
+    it->listener = mDrawingState.releaseBufferListener;
+    ch->previousReleaseCallbackId = ReleaseCallbackId::INVALID_ID;
+    ch->previousReleaseFence = nullptr;
+}
+
+bool BufferStateLayer::mergeDrawnCaptureFences(HeldRelease& release) const {
+    auto it = release.captureFences.begin();
+    while (it != release.captureFences.end()) {
+        if (it->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        release.releaseFence = mergeReleaseFences(release.releaseFence, it->get());
+        it = release.captureFences.erase(it);
+    }
+    return !release.captureFences.empty();
+}
+
+sp<Fence> BufferStateLayer::mergeReleaseFences(const sp<Fence>& fence,
+                                               const sp<Fence>& other) const {
+    if (fence == nullptr || !fence->isValid()) {
+        return other;
+    }
+    if (other == nullptr || !other->isValid()) {
+        return fence;
+    }
+    char fenceName[32] = {};
+    snprintf(fenceName, 32, "%.28s", mName.c_str());
+    sp<Fence> mergedFence = Fence::merge(fenceName, fence, other);
+    if (!mergedFence->isValid()) {
+        ALOGE("failed to merge release fences, layer: %s", mName.c_str());
+        // as in addReleaseFence(), hope that the fences signal in order
+        return other;
+    }
+    return mergedFence;
+}
+
+void BufferStateLayer::sendHeldRelease(const HeldRelease& release) {
+    release.listener->onReleaseBuffer(release.callbackId,
+                                      release.releaseFence ? release.releaseFence
+                                                           : Fence::NO_FENCE,
+                                      mTransformHint,
+                                      mFlinger->getMaxAcquiredBufferCountForCurrentRefreshRate(
+                                              mOwnerUid));
+}
+
 void BufferStateLayer::onSurfaceFrameCreated(
         const std::shared_ptr<frametimeline::SurfaceFrame>& surfaceFrame) {
     while (mPendingJankClassifications.size() >= kPendingClassificationMaxSurfaceFrames) {
@@ -204,9 +296,16 @@ void BufferStateLayer::releasePendingBuffer(nsecs_t dequeueReadyTime) {
         if (handle->releasePreviousBuffer &&
             mDrawingState.releaseBufferEndpoint == handle->listener) {
             handle->previousReleaseCallbackId = mPreviousReleaseCallbackId;
+            holdReleaseForCaptures(handle);
             break;
         }
     }
+    // Releases which were not taken over from a callback handle are sent some other way, or never.
+    mHeldReleases.erase(std::remove_if(mHeldReleases.begin(), mHeldReleases.end(),
+                                       [](const HeldRelease& release) {
+                                           return release.listener == nullptr;
+                                       }),
+                        mHeldReleases.end());
 
     std::vector<JankData> jankData;
     jankData.reserve(mPendingJankClassifications.size());
@@ -801,6 +900,10 @@ status_t BufferStateLayer::updateActiveBuffer() {
     }
 
     mPreviousReleaseCallbackId = {getCurrentBufferId(), mBufferInfo.mFrameNumber};
+    if (!mPendingCaptureFences.empty()) {
+        mHeldReleases.push_back({mPreviousReleaseCallbackId, std::move(mPendingCaptureFences)});
+        mPendingCaptureFences.clear();
+    }
     mBufferInfo.mBuffer = s.buffer;
     mBufferInfo.mFence = s.acquireFence;
     mBufferInfo.mFrameNumber = s.frameNumber;
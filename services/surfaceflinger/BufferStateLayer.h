@@ -24,7 +24,9 @@
 #include <system/window.h>
 #include <utils/String8.h>
 
+#include <future>
 #include <stack>
+#include <vector>
 
 namespace android {
 
@@ -41,6 +43,7 @@ public:
 
     void onLayerDisplayed(const sp<Fence>& releaseFence) override;
     void releasePendingBuffer(nsecs_t dequeueReadyTime) override;
+    bool onCaptureDrawn() override;
 
     void finalizeFrameEventHistory(const std::shared_ptr<FenceTime>& glDoneFence,
                                    const CompositorTiming& compositorTiming) override;
@@ -112,6 +115,7 @@ protected:
 
 private:
     friend class SlotGenerationTest;
+    friend class LayerCaptureReleaseTest;
     friend class TransactionFrameTracerTest;
     friend class TransactionSurfaceFrameTest;
 
@@ -122,6 +126,26 @@ private:
 
     status_t addReleaseFence(const sp<CallbackHandle>& ch, const sp<Fence>& releaseFence);
 
+    // The release of a replaced buffer, which is held back until the screen captures sampling it
+    // are drawn, and then sent with their release fences merged into its own.
+    struct HeldRelease {
+        ReleaseCallbackId callbackId;
+        std::vector<std::shared_future<sp<Fence>>> captureFences;
+        sp<Fence> releaseFence;
+        // Set once the release is taken over from the transaction callback which would send it.
+        sp<ITransactionCompletedListener> listener;
+    };
+
+    bool canReplaceCapturedBuffer() override;
+    // Takes the release of the previous buffer over from the callback handle if screen captures
+    // still sample that buffer, or merges the release fences of the drawn ones into it.
+    void holdReleaseForCaptures(const sp<CallbackHandle>& ch);
+    // Merges the release fences of the drawn screen captures into the held release, and returns
+    // whether any of them are still being drawn.
+    bool mergeDrawnCaptureFences(HeldRelease& release) const;
+    sp<Fence> mergeReleaseFences(const sp<Fence>& fence, const sp<Fence>& other) const;
+    void sendHeldRelease(const HeldRelease& release);
+
     uint64_t getFrameNumber(nsecs_t expectedPresentTime) const override;
 
     bool latchSidebandStream(bool& recomputeVisibleRegions) override;
@@ -145,6 +169,7 @@ private:
 
     sp<Fence> mPreviousReleaseFence;
     ReleaseCallbackId mPreviousReleaseCallbackId = ReleaseCallbackId::INVALID_ID;
+    std::vector<HeldRelease> mHeldReleases;
     uint64_t mPreviousReleasedFrameNumber = 0;
 
     bool mReleasePreviousBuffer = false;
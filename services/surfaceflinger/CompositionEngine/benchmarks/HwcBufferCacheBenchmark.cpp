@@ -0,0 +1,81 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <compositionengine/impl/HwcBufferCache.h>
+#include <ui/GraphicBuffer.h>
+
+#include <array>
+#include <vector>
+
+namespace android::compositionengine {
+namespace {
+
+using impl::HwcBufferCache;
+
+constexpr size_t kLayerCount = 30;
+constexpr size_t kOutputCount = 3;
+constexpr size_t kBufferCount = 3;
+
+struct TestLayer {
+    TestLayer() {
+        for (auto& buffer : buffers) {
+            buffer = new GraphicBuffer(100, 100, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                                       GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE,
+                                       "benchmark");
+        }
+    }
+
+    std::array<sp<GraphicBuffer>, kBufferCount> buffers;
+    // The buffer cache of the layer on each output mirroring it.
+    std::array<HwcBufferCache, kOutputCount> caches;
+};
+
+// Looks up the buffer of every layer on every output once per iteration, as when writing the
+// layer state to HWC. With state.range(0) set, every layer latches the next buffer of its triple
+// buffered queue each frame, so that each lookup misses, and otherwise the layers are static.
+void BM_GetHwcBuffer(benchmark::State& state) {
+    const bool updateBuffers = state.range(0) != 0;
+    std::vector<TestLayer> layers(kLayerCount);
+
+    size_t frame = 0;
+    size_t sentBufferCount = 0;
+    for (auto _ : state) {
+        const size_t slot = updateBuffers ? frame % kBufferCount : 0;
+        for (auto& layer : layers) {
+            const sp<GraphicBuffer>& buffer = layer.buffers[slot];
+            for (auto& cache : layer.caches) {
+                uint32_t hwcSlot = 0;
+                sp<GraphicBuffer> hwcBuffer;
+                cache.getHwcBuffer(static_cast<int>(slot), buffer, &hwcSlot, &hwcBuffer);
+                if (hwcBuffer) {
+                    sentBufferCount++;
+                }
+                benchmark::DoNotOptimize(hwcSlot);
+            }
+        }
+        frame++;
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(frame * kLayerCount * kOutputCount));
+    state.counters["SentBuffers"] = benchmark::Counter(static_cast<double>(sentBufferCount) /
+                                                       static_cast<double>(frame));
+}
+BENCHMARK(BM_GetHwcBuffer)->Arg(0)->Arg(1);
+
+} // namespace
+} // namespace android::compositionengine
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <compositionengine/impl/OutputCompositionState.h>
+#include <compositionengine/impl/planner/Flattener.h>
+#include <compositionengine/impl/planner/LayerState.h>
+#include <compositionengine/impl/planner/Predictor.h>
+#include <compositionengine/mock/LayerFE.h>
+#include <compositionengine/mock/OutputLayer.h>
+#include <gmock/gmock.h>
+#include <renderengine/mock/RenderEngine.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android::compositionengine {
+namespace {
+
+using namespace std::chrono_literals;
+using impl::planner::Flattener;
+using impl::planner::LayerState;
+using impl::planner::NonBufferHash;
+using impl::planner::Plan;
+using impl::planner::Predictor;
+
+using testing::NiceMock;
+using testing::Return;
+using testing::ReturnRef;
+
+constexpr auto kFramePeriod = 16667us;
+
+sp<GraphicBuffer> makeBuffer() {
+    return new GraphicBuffer(100, 100, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                             GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE, "benchmark");
+}
+
+struct TestLayer {
+    TestLayer(int32_t id) : name("layer" + std::to_string(id)) {
+        outputLayerCompositionState.displayFrame = Rect(0, id * 10, 100, id * 10 + 10);
+        outputLayerCompositionState.visibleRegion =
+                Region(outputLayerCompositionState.displayFrame);
+        layerFECompositionState.buffer = makeBuffer();
+
+        ON_CALL(*layerFE, getSequence).WillByDefault(Return(id));
+        ON_CALL(*layerFE, getDebugName).WillByDefault(Return(name.c_str()));
+        ON_CALL(*layerFE, getCompositionState).WillByDefault(Return(&layerFECompositionState));
+        ON_CALL(*layerFE, prepareClientCompositionList)
+                .WillByDefault(Return(std::vector<LayerFE::LayerSettings>{{}}));
+        ON_CALL(outputLayer, getLayerFE).WillByDefault(ReturnRef(*layerFE));
+        ON_CALL(outputLayer, getState).WillByDefault(ReturnRef(outputLayerCompositionState));
+        ON_CALL(outputLayer, editState).WillByDefault(ReturnRef(outputLayerCompositionState));
+
+        layerState = std::make_unique<LayerState>(&outputLayer);
+        layerState->incrementFramesSinceBufferUpdate();
+    }
+
+    // Mirrors the bookkeeping of Planner::plan.
+    void update() {
+        if (layerState->update(&outputLayer).test(impl::planner::LayerStateField::Buffer)) {
+            layerState->resetFramesSinceBufferUpdate();
+        } else {
+            layerState->incrementFramesSinceBufferUpdate();
+        }
+        outputLayerCompositionState.overrideInfo = {};
+    }
+
+    const std::string name;
+    NiceMock<mock::OutputLayer> outputLayer;
+    impl::OutputLayerCompositionState outputLayerCompositionState;
+    sp<NiceMock<mock::LayerFE>> layerFE = sp<NiceMock<mock::LayerFE>>::make();
+    LayerFECompositionState layerFECompositionState;
+    std::unique_ptr<LayerState> layerState;
+};
+
+// Composes a stack of static layers below a blinking cursor at 60 Hz, while the geometry switches
+// between two layouts every 750ms, e.g. as the keyboard is shown and hidden. Each iteration runs
+// 10 seconds worth of frames through the Flattener and RenderEngine mock, with history-based
+// prediction disabled or enabled, and reports the fraction of frames that composed the static
+// layers from a cached set.
+void BM_FlattenBlinkingCursor(benchmark::State& state) {
+    constexpr size_t kLayerCount = 8;
+    constexpr size_t kFrameCount = 600;
+    constexpr size_t kCursorPeriodFrames = 30;
+    constexpr size_t kGeometryPeriodFrames = 45;
+
+    const bool enablePrediction = state.range(0) != 0;
+
+    NiceMock<renderengine::mock::RenderEngine> renderEngine;
+    Predictor predictor;
+    Flattener flattener(renderEngine,
+                        Flattener::Tunables{
+                                .mActiveLayerTimeout =
+                                        Flattener::Tunables::kDefaultActiveLayerTimeout,
+                                .mRenderScheduling = std::nullopt,
+                                .mEnableHolePunch = true,
+                                .mPrediction = enablePrediction
+                                        ? std::make_optional(Flattener::Tunables::Prediction{
+                                                  .activeLayerTimeout = Flattener::Tunables::
+                                                          Prediction::kDefaultActiveLayerTimeout,
+                                          })
+                                        : std::nullopt,
+                        },
+                        &predictor);
+    flattener.setDisplaySize({100, static_cast<int32_t>(kLayerCount * 10)});
+
+    impl::OutputCompositionState outputState;
+    outputState.dataspace = ui::Dataspace::SRGB;
+    outputState.framebufferSpace = ProjectionSpace(ui::Size(100, 100), Rect(100, 100));
+    outputState.layerStackSpace = outputState.framebufferSpace;
+
+    std::vector<std::unique_ptr<TestLayer>> testLayers;
+    std::vector<const LayerState*> layers;
+    for (size_t i = 0; i < kLayerCount; i++) {
+        testLayers.emplace_back(std::make_unique<TestLayer>(static_cast<int32_t>(i)));
+        layers.push_back(testLayers.back()->layerState.get());
+    }
+    TestLayer& cursor = *testLayers.back();
+    const sp<GraphicBuffer> cursorBuffers[] = {makeBuffer(), makeBuffer()};
+
+    const NonBufferHash hash = getNonBufferHash(layers);
+    auto time = std::chrono::steady_clock::now();
+    size_t frame = 0;
+    size_t flattenedFrames = 0;
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < kFrameCount; i++, frame++) {
+            if (frame % kCursorPeriodFrames == 0) {
+                cursor.layerFECompositionState.buffer =
+                        cursorBuffers[(frame / kCursorPeriodFrames) % 2];
+            }
+            for (auto& layer : testLayers) {
+                layer->update();
+            }
+
+            // Stand in for the hash of the other layout, which only differs elsewhere.
+            const bool otherLayout = (frame / kGeometryPeriodFrames) % 2 != 0;
+            const NonBufferHash layoutHash = otherLayout ? hash + 1 : hash;
+            const NonBufferHash flattenedHash = flattener.flattenLayers(layers, layoutHash, time);
+            flattener.renderCachedSets(outputState, std::nullopt);
+
+            // Report the cached set, if any, as composed by the device, as the Planner would.
+            Plan plan;
+            if (flattenedHash != layoutHash) {
+                plan.addLayerType(hal::Composition::DEVICE);
+            }
+            predictor.recordResult(std::nullopt, flattenedHash, layers, false, plan);
+
+            if (testLayers.front()->outputLayerCompositionState.overrideInfo.buffer) {
+                flattenedFrames++;
+            }
+            time += kFramePeriod;
+        }
+    }
+
+    state.counters["FlattenedFrames"] =
+            benchmark::Counter(static_cast<double>(flattenedFrames) / static_cast<double>(frame));
+}
+BENCHMARK(BM_FlattenBlinkingCursor)->Arg(0)->Arg(1);
+
+} // namespace
+} // namespace android::compositionengine
+
+BENCHMARK_MAIN();
@@ -171,6 +171,13 @@ public:
     // Enables (or disables) layer caching texture pool on this output
     virtual void setLayerCachingTexturePoolEnabled(bool) = 0;
 
+    // Releases the layer caching textures on this output that are not in use
+    virtual void trimLayerCachingTexturePool() = 0;
+
+    // Enables (or disables) partial redraws of the client target on this output, which only
+    // repaint what changed since the dequeued buffer was last drawn
+    virtual void setClientTargetDamageEnabled(bool) = 0;
+
     // Sets the projection state to use
     virtual void setProjection(ui::Rotation orientation, const Rect& layerStackSpaceRect,
                                const Rect& orientedDisplaySpaceRect) = 0;
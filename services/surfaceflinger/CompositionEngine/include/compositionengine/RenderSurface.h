@@ -86,6 +86,10 @@ public:
     virtual std::shared_ptr<renderengine::ExternalTexture> dequeueBuffer(
             base::unique_fd* bufferFence) = 0;
 
+    // Returns the age of the last dequeued buffer, i.e. the number of frames since its contents
+    // were queued, or 0 if its contents are undefined.
+    virtual int getBufferAge() const = 0;
+
     // Queues the drawn buffer for consumption by HWC. readyFence is the fence
     // which will fire when the buffer is ready for consumption.
     virtual void queueBuffer(base::unique_fd readyFence) = 0;
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <compositionengine/LayerFE.h>
+#include <renderengine/DisplaySettings.h>
+#include <ui/Rect.h>
+#include <ui/Region.h>
+#include <ui/Transform.h>
+
+namespace android {
+
+namespace compositionengine::impl {
+
+// Tracks what changed in the client target from frame to frame, so that client composition only
+// needs to redraw the parts of a reused buffer that are out of date.
+//
+// The damage of a frame is found by diffing its client composition request against the request of
+// the previous frame. A layer which only latched a new buffer damages its own bounds, while any
+// other change to the request damages the whole client target. The damage of the last few queued
+// frames is kept, so that a buffer dequeued with an age of N frames is repaired by redrawing the
+// union of the damage of the frames queued since, as well as of the current frame.
+class ClientTargetDamageHistory {
+public:
+    // Oldest buffer age for which the damage is tracked, which covers triple buffering with room
+    // to spare.
+    static constexpr size_t kMaxBufferAge = 4;
+
+    // Computes the damage of the frame being composed, and returns the region of the buffer which
+    // needs to be redrawn, in framebuffer space, given its ID and age. An empty region means the
+    // whole buffer must be redrawn. layerStackToFramebuffer maps the geometry of the layers to
+    // the buffer, whose bounds are given by framebufferBounds.
+    Region computeDamage(uint64_t bufferId, int bufferAge,
+                         const renderengine::DisplaySettings& display, bool isProtected,
+                         const std::vector<LayerFE::LayerSettings>& layers,
+                         const ui::Transform& layerStackToFramebuffer,
+                         const Rect& framebufferBounds);
+
+    // Records that the buffer was queued, along with whether its contents were drawn up to date,
+    // i.e. whether the last request was rendered into it successfully.
+    void onBufferQueued(uint64_t bufferId, bool drawn);
+
+    // Records a frame whose client target buffer was queued again without being redrawn, since it
+    // already held the contents of the request. The request still counts as the last one, so that
+    // what changed since the previous frame is redrawn into the other buffers.
+    void onBufferReused(uint64_t bufferId, const renderengine::DisplaySettings& display,
+                        bool isProtected, const std::vector<LayerFE::LayerSettings>& layers,
+                        const ui::Transform& layerStackToFramebuffer,
+                        const Rect& framebufferBounds);
+
+    // Returns the number of pixels redrawn, as well as the number of pixels of the buffers into
+    // which client composition was done, for testing and debugging.
+    uint64_t getDrawnPixelCount() const { return mDrawnPixelCount; }
+    uint64_t getBufferPixelCount() const { return mBufferPixelCount; }
+
+    void dump(std::string& out) const;
+
+private:
+    struct Frame {
+        uint64_t bufferId;
+        // The region which changed from the previous frame to this one.
+        Region damage;
+        // Whether the contents of the buffer were drawn for this frame.
+        bool drawn;
+    };
+
+    struct Request {
+        renderengine::DisplaySettings display;
+        bool isProtected;
+        // Snapshot of the layer settings, without strong references to the layer buffers.
+        std::vector<LayerFE::LayerSettings> layers;
+    };
+
+    // Returns the region which changed since the last request, or std::nullopt if the whole client
+    // target changed.
+    std::optional<Region> diff(const renderengine::DisplaySettings& display, bool isProtected,
+                               const std::vector<LayerFE::LayerSettings>& layers,
+                               const ui::Transform& layerStackToFramebuffer) const;
+
+    // Adds the damage of the request since the last one to the pending damage, and makes it the
+    // last request.
+    void recordRequest(const renderengine::DisplaySettings& display, bool isProtected,
+                       const std::vector<LayerFE::LayerSettings>& layers,
+                       const ui::Transform& layerStackToFramebuffer,
+                       const Rect& framebufferBounds);
+
+    // Returns the region of the buffer which is out of date, or std::nullopt if its contents are
+    // unknown.
+    std::optional<Region> getBufferDamage(uint64_t bufferId, int bufferAge) const;
+
+    std::optional<Request> mLastRequest;
+
+    // Damage of the frames since the last queued one.
+    Region mPendingDamage;
+
+    // Queued frames, the most recent one first.
+    std::deque<Frame> mFrames;
+
+    uint64_t mDrawnPixelCount = 0;
+    uint64_t mBufferPixelCount = 0;
+};
+
+} // namespace compositionengine::impl
+} // namespace android
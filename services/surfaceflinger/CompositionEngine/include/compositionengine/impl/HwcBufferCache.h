@@ -61,11 +61,12 @@ public:
     static const constexpr size_t FLATTENER_CACHING_SLOT = BufferQueue::NUM_BUFFER_SLOTS;
 
 private:
-    // an array where the index corresponds to a slot and the value corresponds to a (counter,
-    // buffer) pair. "counter" is a unique value that indicates the last time this slot was updated
-    // or used and allows us to keep track of the least-recently used buffer.
+    // an array where the index corresponds to a slot and the value is the ID of the buffer last
+    // sent to HWC in that slot, or 0 if none was. Buffer IDs are unique within the process, so
+    // comparing them is enough to find out whether HWC has a buffer cached, without keeping a
+    // reference to it.
     static const constexpr size_t kMaxLayerBufferCount = BufferQueue::NUM_BUFFER_SLOTS + 1;
-    wp<GraphicBuffer> mBuffers[kMaxLayerBufferCount];
+    uint64_t mBufferIds[kMaxLayerBufferCount] = {};
     uint32_t mNextSlot = 0;
     bool mReduceSlotsForWideVideo = false;
 };
@@ -101,6 +101,8 @@ public:
         mBlurLayer = nullptr;
         mHolePunchLayer = nullptr;
         mSkipCount = 0;
+        mRenderStartTime = 0;
+        mRenderLatency = std::chrono::nanoseconds::zero();
 
         mLayers.insert(mLayers.end(), other.mLayers.cbegin(), other.mLayers.cend());
         Region boundingRegion;
@@ -117,6 +119,14 @@ public:
     void render(renderengine::RenderEngine& re, TexturePool& texturePool,
                 const OutputCompositionState& outputState);
 
+    // Records the time from the start of render() until the draw fence signaled, once it has.
+    // RenderEngine has no GPU timer queries, so this is an upper bound of the GPU time which also
+    // covers the CPU submission and the time spent queued behind other GPU work.
+    void updateRenderLatency();
+
+    // Returns the latency recorded by updateRenderLatency(), or zero if it is unknown.
+    std::chrono::nanoseconds getRenderLatency() const { return mRenderLatency; }
+
     void dump(std::string& result) const;
 
     // Whether this represents a single layer with a buffer and rounded corners.
@@ -169,6 +179,8 @@ private:
     ProjectionSpace mOutputSpace;
     ui::Dataspace mOutputDataspace;
     ui::Transform::RotationFlags mOrientation = ui::Transform::ROT_0;
+    nsecs_t mRenderStartTime = 0;
+    std::chrono::nanoseconds mRenderLatency = std::chrono::nanoseconds::zero();
 
     static const bool sDebugHighlighLayers;
 };
@@ -22,6 +22,8 @@
 
 #include <chrono>
 #include <numeric>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace android {
@@ -70,6 +72,20 @@ public:
             const size_t maxDeferRenderAttempts;
         };
 
+        // Tunables that are specific to flattening runs which are predicted to become inactive
+        struct Prediction {
+            static const constexpr std::chrono::milliseconds kDefaultActiveLayerTimeout = 50ms;
+
+            // Threshold that replaces mActiveLayerTimeout for building the cached set of a run
+            // which was flattened before with the same geometry, and whose flattened layer stack
+            // the Predictor has seen composed without client composition. Going back to that
+            // geometry, e.g. returning to the launcher, makes it likely that the same run settles
+            // again, so its cached set is rendered ahead of time, while the display is otherwise
+            // idle. It is only swapped in once its layers have been inactive for
+            // mActiveLayerTimeout, as it would have been without prediction.
+            const std::chrono::milliseconds activeLayerTimeout;
+        };
+
         static const constexpr std::chrono::milliseconds kDefaultActiveLayerTimeout = 150ms;
 
         static const constexpr bool kDefaultEnableHolePunch = true;
@@ -85,9 +101,17 @@ public:
 
         // True if the hole punching feature should be enabled.
         const bool mEnableHolePunch;
+
+        // Toggles for flattening layers ahead of mActiveLayerTimeout based on past cached sets.
+        // See: Prediction
+        const std::optional<Prediction> mPrediction;
     };
 
-    Flattener(renderengine::RenderEngine& renderEngine, const Tunables& tunables);
+    // The predictor, if any, must outlive the Flattener. Prediction is disabled without one.
+    Flattener(renderengine::RenderEngine& renderEngine, const Tunables& tunables,
+              const Predictor* predictor = nullptr);
+
+    bool isPredictionEnabled() const { return mTunables.mPrediction.has_value(); }
 
     void setDisplaySize(ui::Size size) {
         mDisplaySize = size;
@@ -101,8 +125,14 @@ public:
     void renderCachedSets(const OutputCompositionState& outputState,
                           std::optional<std::chrono::steady_clock::time_point> renderDeadline);
 
+    // Reports the layers which were composed by the client in the frame that was last flattened,
+    // which is how the client composition avoided by cached sets is accounted for.
+    void recordClientComposition(const std::unordered_set<LayerId>& clientComposedLayers);
+
     void setTexturePoolEnabled(bool enabled) { mTexturePool.setEnabled(enabled); }
 
+    void trimTexturePool() { mTexturePool.trim(); }
+
     void dump(std::string& result) const;
     void dumpLayers(std::string& result) const;
 
@@ -115,6 +145,24 @@ private:
 
     NonBufferHash computeLayersHash() const;
 
+    // True if the cached set has not been updated for long enough to be part of a new run.
+    bool isInactive(const CachedSet&, std::chrono::steady_clock::time_point now) const;
+
+    // True if all layers of the cached set were part of a cached set which was used before, with
+    // the current geometry, and the Predictor did not see the flattened layer stack which had
+    // that cached set composed by the client.
+    bool isPredictedStable(const CachedSet&) const;
+
+    // Remembers the layers of a cached set that was rendered and swapped in with the current
+    // geometry, and accounts for its render duration.
+    void recordUsedCachedSet(CachedSet&);
+
+    // Remembers the hash of a flattened layer stack for the current geometry, for looking up
+    // how the Predictor saw it composed.
+    void recordFlattenedHash(NonBufferHash);
+
+    size_t getLayerHistoryKey(const CachedSet::Layer&) const;
+
     bool mergeWithCachedSets(const std::vector<const LayerState*>& layers,
                              std::chrono::steady_clock::time_point now);
 
@@ -207,6 +255,12 @@ protected:
     std::optional<CachedSet> mNewCachedSet;
 
 private:
+    const Predictor* const mPredictor;
+
+    // Earliest time at which mNewCachedSet may be swapped in. Later than the time it was built
+    // for a predicted cached set, which is rendered ahead of time.
+    std::chrono::steady_clock::time_point mNewCachedSetSwapInTime;
+
     ui::Size mDisplaySize;
 
     NonBufferHash mCurrentGeometry;
@@ -214,6 +268,16 @@ private:
 
     std::vector<CachedSet> mLayers;
 
+    // Keys of layers that were part of a used cached set, combined with the geometry at the time,
+    // and the last flattened hash seen for each such geometry. Cleared once full, since stale
+    // geometries are not worth tracking.
+    static constexpr size_t kMaxLayerHistorySize = 1024;
+    std::unordered_set<size_t> mLayerHistory;
+    std::unordered_map<NonBufferHash, NonBufferHash> mFlattenedHashHistory;
+
+    // Layers which were composed by the client the last time they were not part of a cached set.
+    std::unordered_set<LayerId> mClientComposedLayers;
+
     // Statistics
     size_t mUnflattenedDisplayCost = 0;
     size_t mFlattenedDisplayCost = 0;
@@ -221,6 +285,14 @@ private:
     std::unordered_map<size_t, size_t> mFinalLayerCounts;
     size_t mCachedSetCreationCount = 0;
     size_t mCachedSetCreationCost = 0;
+    size_t mPredictedCachedSetCount = 0;
+    size_t mUsedCachedSetCount = 0;
+    std::chrono::nanoseconds mCachedSetRenderLatency = std::chrono::nanoseconds::zero();
+    // Frames in which a cached set was composed by the device, while its layers were composed by
+    // the client before they were flattened, and the render latency of the cached set summed over
+    // these frames, as an estimate of the client composition that was avoided.
+    size_t mClientCompositionAvoidedFrames = 0;
+    std::chrono::nanoseconds mClientCompositionAvoidedLatency = std::chrono::nanoseconds::zero();
     std::unordered_map<size_t, size_t> mInvalidatedCachedSetAges;
 };
 
@@ -69,6 +69,9 @@ public:
 
     void setTexturePoolEnabled(bool enabled) { mFlattener.setTexturePoolEnabled(enabled); }
 
+    // Releases the textures which are pooled for cached sets, but not in use.
+    void trimTexturePool() { mFlattener.trimTexturePool(); }
+
     void dump(const Vector<String16>& args, std::string&);
 
 private:
@@ -18,6 +18,8 @@
 
 #include <compositionengine/impl/planner/LayerState.h>
 
+#include <algorithm>
+
 namespace android::compositionengine::impl::planner {
 
 class LayerStack {
@@ -113,6 +115,10 @@ public:
         mLayerTypes.emplace_back(type);
     }
 
+    bool hasLayerType(hardware::graphics::composer::hal::Composition type) const {
+        return std::find(mLayerTypes.cbegin(), mLayerTypes.cend(), type) != mLayerTypes.cend();
+    }
+
     friend std::string to_string(const Plan& plan);
 
     friend bool operator==(const Plan& lhs, const Plan& rhs) {
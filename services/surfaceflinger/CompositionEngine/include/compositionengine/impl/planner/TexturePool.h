@@ -23,16 +23,19 @@
 
 #include <renderengine/ExternalTexture.h>
 #include <chrono>
+#include <deque>
+#include <vector>
 #include "android-base/macros.h"
 
 namespace android::compositionengine::impl::planner {
-
-// A pool of textures that only manages textures of a single size.
-// While it is possible to define a texture pool supporting variable-sized textures to save on
-// memory, it is a simpler implementation to only manage screen-sized textures. The texture pool is
-// unbounded - there are a minimum number of textures preallocated. Under heavy system load, new
-// textures may be allocated, but only a maximum number of retained once those textures are no
-// longer necessary.
+using namespace std::chrono_literals;
+
+// A pool of textures, which are screen-sized unless another size is requested.
+// The texture pool is unbounded - under heavy system load, new textures may be allocated, but only
+// as many are retained as recently needed. For each size, the pool tracks the peak number of
+// textures that were borrowed at once over the last two churn windows, and retains enough textures
+// to serve that peak again, up to a maximum. Once the churn dies down, e.g. after a window
+// animation, the pool shrinks back to a minimum number of screen-sized textures.
 class TexturePool {
 public:
     // RAII class helping with managing textures from the texture pool
@@ -77,7 +80,18 @@ public:
     // If the pool is currently starved of textures, then a new texture is generated.
     // When the AutoTexture object is destroyed, the scratch texture is automatically returned
     // to the pool.
-    std::shared_ptr<AutoTexture> borrowTexture();
+    std::shared_ptr<AutoTexture> borrowTexture() { return borrowTexture(mSize); }
+
+    // Borrows a texture of the given size from the pool.
+    std::shared_ptr<AutoTexture> borrowTexture(ui::Size size);
+
+    // Starts a new churn window if the current one has elapsed, and releases the textures that
+    // are no longer needed to serve the demand of the last two windows.
+    void updateChurn(std::chrono::steady_clock::time_point now);
+
+    // Releases all textures held by the pool, e.g. under memory pressure. The pool grows again
+    // with subsequent demand.
+    void trim();
 
     // Enables or disables the pool. When the pool is disabled, no buffers will
     // be held by the pool. This is useful when the active display changes.
@@ -87,8 +101,11 @@ public:
 
 protected:
     // Proteted visibility so that they can be used for testing
-    const static constexpr size_t kMinPoolSize = 3;
+    // Number of screen-sized textures retained when there is no churn
+    const static constexpr size_t kMinPoolSize = 1;
+    // Maximum number of textures retained for each size
     const static constexpr size_t kMaxPoolSize = 4;
+    const static constexpr std::chrono::milliseconds kChurnWindow = 1000ms;
 
     struct Entry {
         std::shared_ptr<renderengine::ExternalTexture> texture;
@@ -97,15 +114,38 @@ protected:
 
     std::deque<Entry> mPool;
 
+    // Number of borrows served from the pool, and the number that allocated a new texture
+    size_t mHitCount = 0;
+    size_t mMissCount = 0;
+
 private:
-    std::shared_ptr<renderengine::ExternalTexture> genTexture();
+    // Demand for textures of a given size
+    struct Demand {
+        ui::Size size;
+        size_t borrowed = 0;
+        size_t peak = 0;
+        size_t previousPeak = 0;
+    };
+
+    std::shared_ptr<renderengine::ExternalTexture> genTexture(ui::Size size);
     // Returns a previously borrowed texture to the pool.
     void returnTexture(std::shared_ptr<renderengine::ExternalTexture>&& texture,
                        const sp<Fence>& fence);
     void allocatePool();
+
+    Demand* findDemand(ui::Size size);
+    // Returns the number of textures of the given size to retain, in addition to the borrowed ones.
+    size_t getTargetPoolSize(const Demand&) const;
+    size_t getPoolSize(ui::Size size) const;
+
     renderengine::RenderEngine& mRenderEngine;
     ui::Size mSize;
     bool mEnabled;
+
+    std::vector<Demand> mDemands;
+    std::chrono::steady_clock::time_point mChurnWindowStart;
+    // Set by trim(), until the next borrow, so that the minimum pool size is not retained.
+    bool mTrimmed = false;
 };
 
 } // namespace android::compositionengine::impl::planner
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+
+#include <android-base/stringprintf.h>
+#include <compositionengine/impl/ClientTargetDamageHistory.h>
+#include <math/mat4.h>
+#include <renderengine/LayerSettings.h>
+
+namespace android::compositionengine::impl {
+
+namespace {
+
+LayerFE::LayerSettings getLayerSettingsSnapshot(const LayerFE::LayerSettings& settings) {
+    LayerFE::LayerSettings snapshot = settings;
+    snapshot.source.buffer.buffer = nullptr;
+    snapshot.source.buffer.fence = nullptr;
+    return snapshot;
+}
+
+bool equalIgnoringBuffer(const LayerFE::LayerSettings& settings,
+                         const LayerFE::LayerSettings& snapshot) {
+    renderengine::LayerSettings other = settings;
+    other.source.buffer.buffer = nullptr;
+    other.source.buffer.fence = nullptr;
+    return other == static_cast<const renderengine::LayerSettings&>(snapshot);
+}
+
+bool hasBufferChanged(const LayerFE::LayerSettings& settings,
+                      const LayerFE::LayerSettings& snapshot) {
+    // Buffers which are not identified by a latched frame, e.g. the buffers of cached sets, may
+    // be redrawn in place, so they are assumed to change every frame.
+    if (settings.source.buffer.buffer && (settings.bufferId == 0 || settings.frameNumber == 0)) {
+        return true;
+    }
+    return settings.bufferId != snapshot.bufferId || settings.frameNumber != snapshot.frameNumber;
+}
+
+bool hasBlur(const renderengine::LayerSettings& settings) {
+    return settings.backgroundBlurRadius > 0 || !settings.blurRegions.empty();
+}
+
+// Returns the bounds of the layer in framebuffer space, padded by a pixel to account for filtering.
+Rect getFramebufferBounds(const renderengine::LayerSettings& settings,
+                          const ui::Transform& layerStackToFramebuffer) {
+    const FloatRect& bounds = settings.geometry.boundaries;
+    const mat4& transform = settings.geometry.positionTransform;
+
+    float left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY;
+    for (const vec2& corner : {vec2(bounds.left, bounds.top), vec2(bounds.right, bounds.top),
+                               vec2(bounds.left, bounds.bottom),
+                               vec2(bounds.right, bounds.bottom)}) {
+        const vec4 position = transform * vec4(corner.x, corner.y, 0.f, 1.f);
+        left = std::min(left, position.x);
+        top = std::min(top, position.y);
+        right = std::max(right, position.x);
+        bottom = std::max(bottom, position.y);
+    }
+
+    const Rect layerStackBounds(static_cast<int32_t>(std::floor(left)),
+                                static_cast<int32_t>(std::floor(top)),
+                                static_cast<int32_t>(std::ceil(right)),
+                                static_cast<int32_t>(std::ceil(bottom)));
+    const Rect framebufferBounds =
+            layerStackToFramebuffer.transform(layerStackBounds, /*roundOutwards=*/true);
+    return Rect(framebufferBounds.left - 1, framebufferBounds.top - 1, framebufferBounds.right + 1,
+                framebufferBounds.bottom + 1);
+}
+
+uint64_t getArea(const Region& region) {
+    uint64_t area = 0;
+    for (const Rect& rect : region) {
+        area += static_cast<uint64_t>(rect.getWidth()) * static_cast<uint64_t>(rect.getHeight());
+    }
+    return area;
+}
+
+} // namespace
+
+Region ClientTargetDamageHistory::computeDamage(uint64_t bufferId, int bufferAge,
+                                                const renderengine::DisplaySettings& display,
+                                                bool isProtected,
+                                                const std::vector<LayerFE::LayerSettings>& layers,
+                                                const ui::Transform& layerStackToFramebuffer,
+                                                const Rect& framebufferBounds) {
+    recordRequest(display, isProtected, layers, layerStackToFramebuffer, framebufferBounds);
+
+    // Redraw the whole buffer if its contents are unknown, or if it is entirely out of date
+    // anyway. An empty damage region also means a full redraw to RenderEngine, so a buffer which
+    // is already up to date is redrawn as well, which is rare since the frame would not change.
+    const Region fullDamage(framebufferBounds);
+    Region damage = getBufferDamage(bufferId, bufferAge).value_or(fullDamage);
+    damage.andSelf(framebufferBounds);
+    if (damage.isEmpty() || fullDamage.subtract(damage).isEmpty()) {
+        damage.clear();
+    }
+
+    const uint64_t bufferPixelCount = getArea(fullDamage);
+    mBufferPixelCount += bufferPixelCount;
+    mDrawnPixelCount += damage.isEmpty() ? bufferPixelCount : getArea(damage);
+    return damage;
+}
+
+void ClientTargetDamageHistory::onBufferQueued(uint64_t bufferId, bool drawn) {
+    mFrames.push_front({bufferId, std::move(mPendingDamage), drawn});
+    mPendingDamage.clear();
+    if (mFrames.size() > kMaxBufferAge) {
+        mFrames.pop_back();
+    }
+}
+
+void ClientTargetDamageHistory::onBufferReused(uint64_t bufferId,
+                                               const renderengine::DisplaySettings& display,
+                                               bool isProtected,
+                                               const std::vector<LayerFE::LayerSettings>& layers,
+                                               const ui::Transform& layerStackToFramebuffer,
+                                               const Rect& framebufferBounds) {
+    recordRequest(display, isProtected, layers, layerStackToFramebuffer, framebufferBounds);
+    onBufferQueued(bufferId, true);
+}
+
+void ClientTargetDamageHistory::dump(std::string& out) const {
+    base::StringAppendF(&out,
+                        "   Client target damage: %zu frames tracked, drawn %" PRIu64
+                        " of %" PRIu64 " pixels (%.2f%%)\n",
+                        mFrames.size(), mDrawnPixelCount, mBufferPixelCount,
+                        mBufferPixelCount ? 100.f * static_cast<float>(mDrawnPixelCount) /
+                                        static_cast<float>(mBufferPixelCount)
+                                          : 0.f);
+}
+
+std::optional<Region> ClientTargetDamageHistory::diff(
+        const renderengine::DisplaySettings& display, bool isProtected,
+        const std::vector<LayerFE::LayerSettings>& layers,
+        const ui::Transform& layerStackToFramebuffer) const {
+    if (!mLastRequest) {
+        return std::nullopt;
+    }
+
+    // DisplaySettings::operator== leaves out the SDR white point.
+    renderengine::DisplaySettings other = display;
+    other.damageRegion.clear();
+    if (!(other == mLastRequest->display) ||
+        other.sdrWhitePointNits != mLastRequest->display.sdrWhitePointNits ||
+        isProtected != mLastRequest->isProtected || layers.size() != mLastRequest->layers.size()) {
+        return std::nullopt;
+    }
+
+    Region damage;
+    for (size_t i = 0; i < layers.size(); i++) {
+        const LayerFE::LayerSettings& settings = layers[i];
+        const LayerFE::LayerSettings& snapshot = mLastRequest->layers[i];
+
+        // Blurs sample what is underneath them, so a change under a blurred layer would spread.
+        if (hasBlur(settings) || !equalIgnoringBuffer(settings, snapshot)) {
+            return std::nullopt;
+        }
+
+        if (hasBufferChanged(settings, snapshot)) {
+            damage.orSelf(getFramebufferBounds(settings, layerStackToFramebuffer));
+        }
+    }
+    return damage;
+}
+
+void ClientTargetDamageHistory::recordRequest(const renderengine::DisplaySettings& display,
+                                              bool isProtected,
+                                              const std::vector<LayerFE::LayerSettings>& layers,
+                                              const ui::Transform& layerStackToFramebuffer,
+                                              const Rect& framebufferBounds) {
+    if (const auto damage = diff(display, isProtected, layers, layerStackToFramebuffer)) {
+        mPendingDamage.orSelf(damage->intersect(framebufferBounds));
+    } else {
+        mPendingDamage = Region(framebufferBounds);
+    }
+
+    Request& request = mLastRequest.emplace();
+    request.display = display;
+    request.display.damageRegion.clear();
+    request.isProtected = isProtected;
+    request.layers.reserve(layers.size());
+    std::transform(layers.begin(), layers.end(), std::back_inserter(request.layers),
+                   getLayerSettingsSnapshot);
+}
+
+std::optional<Region> ClientTargetDamageHistory::getBufferDamage(uint64_t bufferId,
+                                                                 int bufferAge) const {
+    if (bufferAge <= 0 || static_cast<size_t>(bufferAge) > mFrames.size()) {
+        return std::nullopt;
+    }
+
+    // The buffer must hold the contents of the frame it was queued for.
+    const Frame& bufferFrame = mFrames[static_cast<size_t>(bufferAge) - 1];
+    if (bufferFrame.bufferId != bufferId || !bufferFrame.drawn) {
+        return std::nullopt;
+    }
+
+    Region damage = mPendingDamage;
+    for (size_t i = 0; i + 1 < static_cast<size_t>(bufferAge); i++) {
+        damage.orSelf(mFrames[i].damage);
+    }
+    return damage;
+}
+
+} // namespace android::compositionengine::impl
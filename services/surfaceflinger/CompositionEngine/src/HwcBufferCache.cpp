@@ -35,13 +35,22 @@ constexpr int MAX_NUM_SLOTS_FOR_WIDE_VIDEOS = 4;
 
 namespace android::compositionengine::impl {
 
-HwcBufferCache::HwcBufferCache() {
-    std::fill(std::begin(mBuffers), std::end(mBuffers), wp<GraphicBuffer>(nullptr));
-    char value[PROPERTY_VALUE_MAX];
-    property_get("vendor.display.reduce_slots_for_wide_video", value, "1");
-    mReduceSlotsForWideVideo = atoi(value);
+namespace {
+
+// The HwcBufferCache of every layer on every output reads this, so it is only read once.
+bool shouldReduceSlotsForWideVideo() {
+    static const bool reduceSlotsForWideVideo = [] {
+        char value[PROPERTY_VALUE_MAX];
+        property_get("vendor.display.reduce_slots_for_wide_video", value, "1");
+        return atoi(value) != 0;
+    }();
+    return reduceSlotsForWideVideo;
 }
 
+} // namespace
+
+HwcBufferCache::HwcBufferCache() : mReduceSlotsForWideVideo(shouldReduceSlotsForWideVideo()) {}
+
 //TODO: Move to common location
 static bool formatIsYuv(const PixelFormat format) {
     switch (format) {
@@ -82,11 +91,11 @@ static bool formatIsYuv(const PixelFormat format) {
 void HwcBufferCache::getHwcBuffer(int slot, const sp<GraphicBuffer>& buffer, uint32_t* outSlot,
                                   sp<GraphicBuffer>* outBuffer) {
     // default is 0
-    wp<GraphicBuffer> weakCopy(buffer);
+    const uint64_t bufferId = buffer ? buffer->getId() : 0;
     uint32_t width = 0;
     uint32_t height = 0;
     PixelFormat format = PIXEL_FORMAT_NONE;
-    if (buffer) {
+    if (buffer && mReduceSlotsForWideVideo) {
         width = buffer->getWidth();
         height = buffer->getHeight();
         format = buffer->getPixelFormat();
@@ -111,15 +120,15 @@ void HwcBufferCache::getHwcBuffer(int slot, const sp<GraphicBuffer>& buffer, uin
         *outSlot = static_cast<uint32_t>(slot);
     }
 
-    auto& currentBuffer = mBuffers[*outSlot];
-    if (currentBuffer == weakCopy) {
+    auto& currentBufferId = mBufferIds[*outSlot];
+    if (currentBufferId == bufferId) {
         // already cached in HWC, skip sending the buffer
         *outBuffer = nullptr;
     } else {
         *outBuffer = buffer;
 
         // update cache
-        currentBuffer = buffer;
+        currentBufferId = bufferId;
     }
 }
 
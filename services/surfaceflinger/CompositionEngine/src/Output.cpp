@@ -157,6 +157,20 @@ void Output::setLayerCachingTexturePoolEnabled(bool enabled) {
     }
 }
 
+void Output::trimLayerCachingTexturePool() {
+    if (mPlanner) {
+        mPlanner->trimTexturePool();
+    }
+}
+
+void Output::setClientTargetDamageEnabled(bool enabled) {
+    if (enabled == (mClientTargetDamageHistory != nullptr)) {
+        return;
+    }
+
+    mClientTargetDamageHistory = enabled ? std::make_unique<ClientTargetDamageHistory>() : nullptr;
+}
+
 void Output::setProjection(ui::Rotation orientation, const Rect& layerStackSpaceRect,
                            const Rect& orientedDisplaySpaceRect) {
     auto& outputState = editState();
@@ -315,6 +329,10 @@ void Output::dumpBase(std::string& out) const {
         out.append("    No render surface!\n");
     }
 
+    if (mClientTargetDamageHistory) {
+        mClientTargetDamageHistory->dump(out);
+    }
+
     android::base::StringAppendF(&out, "\n   %zu Layers\n", getOutputLayerCount());
     for (const auto* outputLayer : getOutputLayersOrderedByZ()) {
         if (!outputLayer) {
@@ -1124,6 +1142,10 @@ std::optional<base::unique_fd> Output::composeSurfaces(
 
     base::unique_fd readyFence;
     if (!hasClientComposition) {
+        if (tex && mClientTargetDamageHistory) {
+            // The flipped client target is queued without being drawn.
+            mClientTargetDamageHistory->onBufferQueued(tex->getBuffer()->getId(), false);
+        }
         setExpensiveRenderingExpected(false);
         return readyFence;
     }
@@ -1168,6 +1190,13 @@ std::optional<base::unique_fd> Output::composeSurfaces(
                                                    clientCompositionDisplay,
                                                    clientCompositionLayers)) {
             outputCompositionState.reusedClientComposition = true;
+            if (mClientTargetDamageHistory) {
+                mClientTargetDamageHistory->onBufferReused(
+                        tex->getBuffer()->getId(), clientCompositionDisplay,
+                        supportsProtectedContent, clientCompositionLayers,
+                        outputState.layerStackSpace.getTransform(outputState.framebufferSpace),
+                        outputState.framebufferSpace.bounds);
+            }
             setExpensiveRenderingExpected(false);
             return readyFence;
         }
@@ -1175,6 +1204,15 @@ std::optional<base::unique_fd> Output::composeSurfaces(
                                             clientCompositionLayers);
     }
 
+    // Only redraw what changed since the dequeued buffer was last drawn, if it is known.
+    if (mClientTargetDamageHistory) {
+        clientCompositionDisplay.damageRegion = mClientTargetDamageHistory->computeDamage(
+                tex->getBuffer()->getId(), mRenderSurface->getBufferAge(), clientCompositionDisplay,
+                supportsProtectedContent, clientCompositionLayers,
+                outputState.layerStackSpace.getTransform(outputState.framebufferSpace),
+                outputState.framebufferSpace.bounds);
+    }
+
     // We boost GPU frequency here because there will be color spaces conversion
     // or complex GPU shaders and it's expensive. We boost the GPU frequency so that
     // GPU composition can finish in time. We must reset GPU frequency afterwards,
@@ -1212,6 +1250,10 @@ std::optional<base::unique_fd> Output::composeSurfaces(
         mClientCompositionRequestCache->remove(tex->getBuffer()->getId());
     }
 
+    if (mClientTargetDamageHistory) {
+        mClientTargetDamageHistory->onBufferQueued(tex->getBuffer()->getId(), status == NO_ERROR);
+    }
+
     auto& timeStats = getCompositionEngine().getTimeStats();
     if (readyFence.get() < 0) {
         timeStats.recordRenderEngineDuration(renderEngineStart, systemTime());
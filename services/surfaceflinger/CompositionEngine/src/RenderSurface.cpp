@@ -205,6 +205,17 @@ std::shared_ptr<renderengine::ExternalTexture> RenderSurface::dequeueBuffer(
     return mTexture;
 }
 
+int RenderSurface::getBufferAge() const {
+    int age = 0;
+    if (status_t result = mNativeWindow->query(mNativeWindow.get(), NATIVE_WINDOW_BUFFER_AGE, &age);
+        result != NO_ERROR) {
+        ALOGV("Failed to query buffer age for display [%s]: %d", mDisplay.getName().c_str(),
+              result);
+        return 0;
+    }
+    return age;
+}
+
 void RenderSurface::queueBuffer(base::unique_fd readyFence) {
     auto& state = mDisplay.getState();
 
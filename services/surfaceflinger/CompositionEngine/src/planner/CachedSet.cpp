@@ -137,6 +137,19 @@ bool CachedSet::hasReadyBuffer() const {
     return mTexture && mDrawFence->getStatus() == Fence::Status::Signaled;
 }
 
+void CachedSet::updateRenderLatency() {
+    if (!mDrawFence || mRenderStartTime == 0) {
+        return;
+    }
+
+    const nsecs_t signalTime = mDrawFence->getSignalTime();
+    if (signalTime == Fence::SIGNAL_TIME_INVALID || signalTime == Fence::SIGNAL_TIME_PENDING) {
+        return;
+    }
+
+    mRenderLatency = std::chrono::nanoseconds(std::max<nsecs_t>(signalTime - mRenderStartTime, 0));
+}
+
 std::vector<CachedSet> CachedSet::decompose() const {
     std::vector<CachedSet> layers;
 
@@ -274,6 +287,7 @@ void CachedSet::render(renderengine::RenderEngine& renderEngine, TexturePool& te
         bufferFence.reset(texture->getReadyFence()->dup());
     }
 
+    const nsecs_t renderStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
     base::unique_fd drawFence;
     status_t result =
             renderEngine.drawLayers(displaySettings, layerSettingsPointers, texture->get(), false,
@@ -288,6 +302,8 @@ void CachedSet::render(renderengine::RenderEngine& renderEngine, TexturePool& te
         mOutputDataspace = outputDataspace;
         mOrientation = orientation;
         mSkipCount = 0;
+        mRenderStartTime = renderStartTime;
+        mRenderLatency = std::chrono::nanoseconds::zero();
     } else {
         mTexture.reset();
     }
@@ -22,6 +22,7 @@
 #include <android-base/properties.h>
 #include <compositionengine/impl/planner/Flattener.h>
 #include <compositionengine/impl/planner/LayerState.h>
+#include <compositionengine/impl/planner/Predictor.h>
 
 #include <gui/TraceUtils.h>
 
@@ -60,12 +61,18 @@ bool isSameStack(const std::vector<const LayerState*>& incomingLayers,
 
 } // namespace
 
-Flattener::Flattener(renderengine::RenderEngine& renderEngine, const Tunables& tunables)
-      : mRenderEngine(renderEngine), mTunables(tunables), mTexturePool(mRenderEngine) {}
+Flattener::Flattener(renderengine::RenderEngine& renderEngine, const Tunables& tunables,
+                     const Predictor* predictor)
+      : mRenderEngine(renderEngine),
+        mTunables(tunables),
+        mTexturePool(mRenderEngine),
+        mPredictor(predictor) {}
 
 NonBufferHash Flattener::flattenLayers(const std::vector<const LayerState*>& layers,
                                        NonBufferHash hash, time_point now) {
     ATRACE_CALL();
+    mTexturePool.updateChurn(now);
+
     const size_t unflattenedDisplayCost = calculateDisplayCost(layers);
     mUnflattenedDisplayCost += unflattenedDisplayCost;
 
@@ -91,7 +98,11 @@ NonBufferHash Flattener::flattenLayers(const std::vector<const LayerState*>& lay
 
     if (alreadyHadCachedSets) {
         buildCachedSets(now);
-        hash = computeLayersHash();
+        const NonBufferHash flattenedHash = computeLayersHash();
+        if (flattenedHash != hash) {
+            recordFlattenedHash(flattenedHash);
+        }
+        hash = flattenedHash;
     }
 
     return hash;
@@ -123,8 +134,10 @@ void Flattener::renderCachedSets(
             estimatedRenderFinish > *renderDeadline) {
             mNewCachedSet->incrementSkipCount();
 
+            // A predicted cached set is rendered ahead of time, so it is never worth a late frame.
             if (mNewCachedSet->getSkipCount() <=
-                mTunables.mRenderScheduling->maxDeferRenderAttempts) {
+                        mTunables.mRenderScheduling->maxDeferRenderAttempts ||
+                now < mNewCachedSetSwapInTime) {
                 ATRACE_FORMAT("DeadlinePassed: exceeded deadline by: %d us",
                               std::chrono::duration_cast<std::chrono::microseconds>(
                                       estimatedRenderFinish - *renderDeadline)
@@ -187,6 +200,25 @@ void Flattener::dump(std::string& result) const {
     base::StringAppendF(&result, "\n    Cached sets created: %zd\n", mCachedSetCreationCount);
     base::StringAppendF(&result, "    Cost: %.2f\n",
                         static_cast<float>(mCachedSetCreationCost) / displayArea);
+    base::StringAppendF(&result, "    Predicted: %zd\n", mPredictedCachedSetCount);
+    base::StringAppendF(&result, "    Used: %zd\n", mUsedCachedSetCount);
+
+    base::StringAppendF(&result, "    Client composition avoided: %zd frames\n",
+                        mClientCompositionAvoidedFrames);
+
+    const auto toMs = [](std::chrono::nanoseconds duration) {
+        return std::chrono::duration<float, std::milli>(duration).count();
+    };
+    // Latencies from the start of rendering until the draw fence signals, which include CPU and
+    // GPU queueing time, so these are not GPU durations. Rendering a cached set draws the same
+    // layers as client composition would, so its latency also stands in for the latter.
+    result.append("\n    Render latency, submit to draw fence (in ms):\n");
+    base::StringAppendF(&result, "      Rendering cached sets:       %.2f\n",
+                        toMs(mCachedSetRenderLatency));
+    base::StringAppendF(&result, "      Client composition avoided:  %.2f\n",
+                        toMs(mClientCompositionAvoidedLatency));
+    base::StringAppendF(&result, "      Estimated saving:            %.2f\n",
+                        toMs(mClientCompositionAvoidedLatency) - toMs(mCachedSetRenderLatency));
 
     const auto lastUpdate =
             std::chrono::duration_cast<std::chrono::milliseconds>(now - mLastGeometryUpdate);
@@ -238,6 +270,7 @@ void Flattener::resetActivities(NonBufferHash hash, time_point now) {
     }
 
     mLayers.clear();
+    mClientComposedLayers.clear();
 
     if (mNewCachedSet) {
         ++mInvalidatedCachedSetAges[mNewCachedSet->getAge()];
@@ -245,6 +278,101 @@ void Flattener::resetActivities(NonBufferHash hash, time_point now) {
     }
 }
 
+bool Flattener::isInactive(const CachedSet& cachedSet, time_point now) const {
+    const auto timeout = mTunables.mPrediction && isPredictedStable(cachedSet)
+            ? mTunables.mPrediction->activeLayerTimeout
+            : mTunables.mActiveLayerTimeout;
+    return now - cachedSet.getLastUpdate() > timeout;
+}
+
+bool Flattener::isPredictedStable(const CachedSet& cachedSet) const {
+    if (!mPredictor || mLayerHistory.empty()) {
+        return false;
+    }
+
+    const auto& layers = cachedSet.getConstituentLayers();
+    if (!std::all_of(layers.cbegin(), layers.cend(), [this](const CachedSet::Layer& layer) {
+            return mLayerHistory.count(getLayerHistoryKey(layer)) > 0;
+        })) {
+        return false;
+    }
+
+    // A cached set only saves composition work if the device composes it, so follow the plan the
+    // Predictor recorded for the layer stack which was flattened with this geometry before.
+    const auto flattenedHash = mFlattenedHashHistory.find(mCurrentGeometry);
+    if (flattenedHash == mFlattenedHashHistory.end()) {
+        return false;
+    }
+
+    const auto predictedPlan = mPredictor->getPredictedPlan({}, flattenedHash->second);
+    return predictedPlan && !predictedPlan->plan.hasLayerType(hal::Composition::CLIENT);
+}
+
+void Flattener::recordUsedCachedSet(CachedSet& cachedSet) {
+    ++mUsedCachedSetCount;
+
+    // The draw fence has signaled by the time the cached set is swapped in.
+    cachedSet.updateRenderLatency();
+    mCachedSetRenderLatency += cachedSet.getRenderLatency();
+
+    if (!mTunables.mPrediction) {
+        return;
+    }
+
+    if (mLayerHistory.size() + cachedSet.getLayerCount() > kMaxLayerHistorySize) {
+        mLayerHistory.clear();
+        mFlattenedHashHistory.clear();
+    }
+    for (const CachedSet::Layer& layer : cachedSet.getConstituentLayers()) {
+        mLayerHistory.insert(getLayerHistoryKey(layer));
+    }
+}
+
+void Flattener::recordFlattenedHash(NonBufferHash flattenedHash) {
+    if (!mTunables.mPrediction) {
+        return;
+    }
+
+    if (mFlattenedHashHistory.size() >= kMaxLayerHistorySize) {
+        mLayerHistory.clear();
+        mFlattenedHashHistory.clear();
+    }
+    mFlattenedHashHistory[mCurrentGeometry] = flattenedHash;
+}
+
+void Flattener::recordClientComposition(const std::unordered_set<LayerId>& clientComposedLayers) {
+    const auto isClientComposed = [&](const CachedSet::Layer& layer) {
+        return clientComposedLayers.count(layer.getState()->getId()) > 0;
+    };
+    const auto wasClientComposed = [&](const CachedSet::Layer& layer) {
+        return mClientComposedLayers.count(layer.getState()->getId()) > 0;
+    };
+
+    for (const CachedSet& cachedSet : mLayers) {
+        const auto& layers = cachedSet.getConstituentLayers();
+        if (cachedSet.getLayerCount() == 1) {
+            if (isClientComposed(layers.front())) {
+                mClientComposedLayers.insert(layers.front().getState()->getId());
+            } else {
+                mClientComposedLayers.erase(layers.front().getState()->getId());
+            }
+            continue;
+        }
+
+        if (std::none_of(layers.cbegin(), layers.cend(), isClientComposed) &&
+            std::any_of(layers.cbegin(), layers.cend(), wasClientComposed)) {
+            ++mClientCompositionAvoidedFrames;
+            mClientCompositionAvoidedLatency += cachedSet.getRenderLatency();
+        }
+    }
+}
+
+size_t Flattener::getLayerHistoryKey(const CachedSet::Layer& layer) const {
+    size_t key = mCurrentGeometry;
+    android::hashCombineSingle(key, layer.getState()->getId());
+    return key;
+}
+
 NonBufferHash Flattener::computeLayersHash() const{
     size_t hash = 0;
     for (const auto& layer : mLayers) {
@@ -301,7 +429,7 @@ bool Flattener::mergeWithCachedSets(const std::vector<const LayerState*>& layers
                 ALOGV("[%s] Dropping new cached set", __func__);
                 ++mInvalidatedCachedSetAges[0];
                 mNewCachedSet = std::nullopt;
-            } else if (mNewCachedSet->hasReadyBuffer()) {
+            } else if (mNewCachedSet->hasReadyBuffer() && now >= mNewCachedSetSwapInTime) {
                 ALOGV("[%s] Found ready buffer", __func__);
                 size_t skipCount = mNewCachedSet->getLayerCount();
                 while (skipCount != 0) {
@@ -334,6 +462,7 @@ bool Flattener::mergeWithCachedSets(const std::vector<const LayerState*>& layers
                     skipCount -= layerCount;
                 }
                 priorBlurLayer = mNewCachedSet->getBlurLayer();
+                recordUsedCachedSet(*mNewCachedSet);
                 merged.emplace_back(std::move(*mNewCachedSet));
                 mNewCachedSet = std::nullopt;
                 continue;
@@ -409,8 +538,7 @@ std::vector<Flattener::Run> Flattener::findCandidateRuns(time_point now) const {
     bool runHasFirstLayer = false;
 
     for (auto currentSet = mLayers.cbegin(); currentSet != mLayers.cend(); ++currentSet) {
-        const bool layerIsInactive =
-                now - currentSet->getLastUpdate() > mTunables.mActiveLayerTimeout;
+        const bool layerIsInactive = isInactive(*currentSet, now);
         const bool layerHasBlur = currentSet->hasBlurBehind();
 
         if (layerIsInactive && (firstLayer || runHasFirstLayer || !layerHasBlur) &&
@@ -501,13 +629,22 @@ void Flattener::buildCachedSets(time_point now) {
         return;
     }
 
+    // The run is predicted if any of its sets would not have been inactive without history. Its
+    // cached set is then held back until they would have been.
+    const auto getSwapInTime = [&](const CachedSet& cachedSet) {
+        return cachedSet.getLastUpdate() + mTunables.mActiveLayerTimeout;
+    };
+
     mNewCachedSet.emplace(*bestRun->getStart());
     mNewCachedSet->setLastUpdate(now);
     auto currentSet = bestRun->getStart();
+    mNewCachedSetSwapInTime = getSwapInTime(*currentSet);
     while (mNewCachedSet->getLayerCount() < bestRun->getLayerLength()) {
         ++currentSet;
         mNewCachedSet->append(*currentSet);
+        mNewCachedSetSwapInTime = std::max(mNewCachedSetSwapInTime, getSwapInTime(*currentSet));
     }
+    const bool isPredicted = mNewCachedSetSwapInTime > now;
 
     if (bestRun->getBlurringLayer()) {
         mNewCachedSet->addBackgroundBlurLayer(*bestRun->getBlurringLayer());
@@ -526,6 +663,9 @@ void Flattener::buildCachedSets(time_point now) {
 
     ++mCachedSetCreationCount;
     mCachedSetCreationCost += mNewCachedSet->getCreationCost();
+    if (isPredicted) {
+        ++mPredictedCachedSetCount;
+    }
 
     // note the compiler should strip the follow no-op statements when ALOGV is off
     const auto dumper = [&] {
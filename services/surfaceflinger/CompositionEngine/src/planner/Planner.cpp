@@ -53,6 +53,21 @@ std::optional<Flattener::Tunables::RenderScheduling> buildRenderSchedulingTunabl
             });
 }
 
+std::optional<Flattener::Tunables::Prediction> buildPredictionTunables() {
+    if (!base::GetBoolProperty(std::string("debug.sf.enable_cached_set_prediction"), false)) {
+        return std::nullopt;
+    }
+
+    const auto activeLayerTimeout = std::chrono::milliseconds(
+            base::GetIntProperty<int32_t>(std::string("debug.sf.cached_set_predicted_timeout_ms"),
+                                          Flattener::Tunables::Prediction::
+                                                  kDefaultActiveLayerTimeout.count()));
+
+    return std::make_optional<Flattener::Tunables::Prediction>(Flattener::Tunables::Prediction{
+            .activeLayerTimeout = activeLayerTimeout,
+    });
+}
+
 Flattener::Tunables buildFlattenerTuneables() {
     const auto activeLayerTimeout = std::chrono::milliseconds(
             base::GetIntProperty<int32_t>(std::string(
@@ -65,16 +80,18 @@ Flattener::Tunables buildFlattenerTuneables() {
             .mActiveLayerTimeout = activeLayerTimeout,
             .mRenderScheduling = buildRenderSchedulingTunables(),
             .mEnableHolePunch = enableHolePunch,
+            .mPrediction = buildPredictionTunables(),
     };
 }
 
 } // namespace
 
 Planner::Planner(renderengine::RenderEngine& renderEngine)
-      : mFlattener(renderEngine,
-                   buildFlattenerTuneables()) {
+      : mFlattener(renderEngine, buildFlattenerTuneables(), &mPredictor) {
+    // The Flattener predicts cached sets from the plans which the Predictor records.
     mPredictorEnabled =
-            base::GetBoolProperty(std::string("debug.sf.enable_planner_prediction"), false);
+            base::GetBoolProperty(std::string("debug.sf.enable_planner_prediction"), false) ||
+            mFlattener.isPredictionEnabled();
 }
 
 void Planner::setDisplaySize(ui::Size size) {
@@ -166,6 +183,14 @@ void Planner::plan(
 void Planner::reportFinalPlan(
         compositionengine::Output::OutputLayersEnumerator<compositionengine::Output>&& layers) {
     ATRACE_CALL();
+    std::unordered_set<LayerId> clientComposedLayers;
+    for (auto layer : layers) {
+        if (layer->getState().forceClientComposition || layer->requiresClientComposition()) {
+            clientComposedLayers.insert(layer->getLayerFE().getSequence());
+        }
+    }
+    mFlattener.recordClientComposition(clientComposedLayers);
+
     if (!mPredictorEnabled) {
         return;
     }
@@ -22,14 +22,26 @@
 #include <compositionengine/impl/planner/TexturePool.h>
 #include <utils/Log.h>
 
+#include <algorithm>
+
 namespace android::compositionengine::impl::planner {
 
+namespace {
+
+ui::Size getTextureSize(const renderengine::ExternalTexture& texture) {
+    return texture.getBuffer()->getBounds().getSize();
+}
+
+} // namespace
+
 void TexturePool::allocatePool() {
     mPool.clear();
+    mDemands.clear();
     if (mEnabled && mSize.isValid()) {
+        mDemands.push_back({.size = mSize});
         mPool.resize(kMinPoolSize);
         std::generate_n(mPool.begin(), kMinPoolSize, [&]() {
-            return Entry{genTexture(), nullptr};
+            return Entry{genTexture(mSize), nullptr};
         });
     }
 }
@@ -42,13 +54,29 @@ void TexturePool::setDisplaySize(ui::Size size) {
     allocatePool();
 }
 
-std::shared_ptr<TexturePool::AutoTexture> TexturePool::borrowTexture() {
-    if (mPool.empty()) {
-        return std::make_shared<AutoTexture>(*this, genTexture(), nullptr);
+std::shared_ptr<TexturePool::AutoTexture> TexturePool::borrowTexture(ui::Size size) {
+    mTrimmed = false;
+
+    Demand* demand = findDemand(size);
+    if (!demand && mEnabled) {
+        demand = &mDemands.emplace_back(Demand{.size = size});
+    }
+    if (demand) {
+        demand->borrowed++;
+        demand->peak = std::max(demand->peak, demand->borrowed);
     }
 
-    const auto entry = mPool.front();
-    mPool.pop_front();
+    const auto pooled = std::find_if(mPool.begin(), mPool.end(), [size](const Entry& entry) {
+        return getTextureSize(*entry.texture) == size;
+    });
+    if (pooled == mPool.end()) {
+        mMissCount++;
+        return std::make_shared<AutoTexture>(*this, genTexture(size), nullptr);
+    }
+
+    mHitCount++;
+    const auto entry = *pooled;
+    mPool.erase(pooled);
     return std::make_shared<AutoTexture>(*this, entry.texture, entry.fence);
 }
 
@@ -60,30 +88,97 @@ void TexturePool::returnTexture(std::shared_ptr<renderengine::ExternalTexture>&&
     }
 
     // Or the texture on the floor if the pool is no longer tracking textures of the same size.
-    if (static_cast<int32_t>(texture->getBuffer()->getWidth()) != mSize.getWidth() ||
-        static_cast<int32_t>(texture->getBuffer()->getHeight()) != mSize.getHeight()) {
-        ALOGV("Deallocating texture from Planner's pool - display size changed (previous: (%dx%d), "
-              "current: (%dx%d))",
-              texture->getBuffer()->getWidth(), texture->getBuffer()->getHeight(), mSize.getWidth(),
-              mSize.getHeight());
+    const ui::Size size = getTextureSize(*texture);
+    Demand* demand = findDemand(size);
+    if (!demand) {
+        ALOGV("Deallocating texture from Planner's pool - size no longer tracked (previous: "
+              "(%dx%d), current: (%dx%d))",
+              size.getWidth(), size.getHeight(), mSize.getWidth(), mSize.getHeight());
         return;
     }
 
-    // Also ensure the pool does not grow beyond a maximum size.
-    if (mPool.size() == kMaxPoolSize) {
-        ALOGD("Deallocating texture from Planner's pool - max size [%" PRIu64 "] reached",
-              static_cast<uint64_t>(kMaxPoolSize));
+    if (demand->borrowed > 0) {
+        demand->borrowed--;
+    }
+
+    // Also ensure the pool does not grow beyond what the recent demand needs.
+    if (const size_t targetSize = getTargetPoolSize(*demand); getPoolSize(size) >= targetSize) {
+        ALOGV("Deallocating texture from Planner's pool - target size [%zu] reached", targetSize);
         return;
     }
 
     mPool.push_back({std::move(texture), fence});
 }
 
-std::shared_ptr<renderengine::ExternalTexture> TexturePool::genTexture() {
-    LOG_ALWAYS_FATAL_IF(!mSize.isValid(), "Attempted to generate texture with invalid size");
+void TexturePool::updateChurn(std::chrono::steady_clock::time_point now) {
+    if (now - mChurnWindowStart < kChurnWindow) {
+        return;
+    }
+    mChurnWindowStart = now;
+
+    for (Demand& demand : mDemands) {
+        demand.previousPeak = demand.peak;
+        demand.peak = demand.borrowed;
+
+        // Release the least recently returned textures beyond the target size.
+        const size_t targetSize = getTargetPoolSize(demand);
+        size_t poolSize = getPoolSize(demand.size);
+        for (auto entry = mPool.begin(); entry != mPool.end() && poolSize > targetSize;) {
+            if (getTextureSize(*entry->texture) == demand.size) {
+                ALOGV("Deallocating texture from Planner's pool - churn dropped");
+                entry = mPool.erase(entry);
+                poolSize--;
+            } else {
+                ++entry;
+            }
+        }
+    }
+
+    // Stop tracking sizes other than the display size once they are no longer used.
+    mDemands.erase(std::remove_if(mDemands.begin(), mDemands.end(),
+                                  [this](const Demand& demand) {
+                                      return demand.size != mSize && demand.borrowed == 0 &&
+                                              demand.previousPeak == 0;
+                                  }),
+                   mDemands.end());
+}
+
+void TexturePool::trim() {
+    ALOGV("Trimming Planner's pool of %zu textures", mPool.size());
+    mPool.clear();
+    mTrimmed = true;
+
+    // Forget the demand, so that the textures in use are released once returned.
+    for (Demand& demand : mDemands) {
+        demand.peak = 0;
+        demand.previousPeak = 0;
+    }
+}
+
+TexturePool::Demand* TexturePool::findDemand(ui::Size size) {
+    const auto demand = std::find_if(mDemands.begin(), mDemands.end(),
+                                     [size](const Demand& demand) { return demand.size == size; });
+    return demand != mDemands.end() ? &*demand : nullptr;
+}
+
+size_t TexturePool::getTargetPoolSize(const Demand& demand) const {
+    const size_t peak = std::max(demand.peak, demand.previousPeak);
+    const size_t minSize = demand.size == mSize && !mTrimmed ? kMinPoolSize : 0;
+    return std::clamp(peak > demand.borrowed ? peak - demand.borrowed : 0, minSize, kMaxPoolSize);
+}
+
+size_t TexturePool::getPoolSize(ui::Size size) const {
+    return static_cast<size_t>(
+            std::count_if(mPool.cbegin(), mPool.cend(), [size](const Entry& entry) {
+                return getTextureSize(*entry.texture) == size;
+            }));
+}
+
+std::shared_ptr<renderengine::ExternalTexture> TexturePool::genTexture(ui::Size size) {
+    LOG_ALWAYS_FATAL_IF(!size.isValid(), "Attempted to generate texture with invalid size");
     return std::make_shared<
             renderengine::ExternalTexture>(sp<GraphicBuffer>::
-                                                   make(mSize.getWidth(), mSize.getHeight(),
+                                                   make(size.getWidth(), size.getHeight(),
                                                         HAL_PIXEL_FORMAT_RGBA_8888, 1,
                                                         GraphicBuffer::USAGE_HW_RENDER |
                                                                 GraphicBuffer::USAGE_HW_COMPOSER |
@@ -103,6 +198,20 @@ void TexturePool::dump(std::string& out) const {
     base::StringAppendF(&out,
                         "TexturePool (%s) has %zu buffers of size [%" PRId32 ", %" PRId32 "]\n",
                         mEnabled ? "enabled" : "disabled", mPool.size(), mSize.width, mSize.height);
+    for (const Demand& demand : mDemands) {
+        base::StringAppendF(&out,
+                            "  [%" PRId32 ", %" PRId32 "]: %zu pooled, %zu borrowed, peak %zu, "
+                            "target %zu\n",
+                            demand.size.width, demand.size.height, getPoolSize(demand.size),
+                            demand.borrowed, std::max(demand.peak, demand.previousPeak),
+                            getTargetPoolSize(demand));
+    }
+    const size_t borrowCount = mHitCount + mMissCount;
+    base::StringAppendF(&out, "  Hits: %zu, misses: %zu (%.2f%% hit rate)\n", mHitCount,
+                        mMissCount,
+                        borrowCount ? 100.f * static_cast<float>(mHitCount) /
+                                        static_cast<float>(borrowCount)
+                                    : 0.f);
 }
 
 } // namespace android::compositionengine::impl::planner
\ No newline at end of file
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <compositionengine/impl/ClientTargetDamageHistory.h>
+#include <gtest/gtest.h>
+
+#include <iterator>
+
+#include "RegionMatcher.h"
+
+namespace android::compositionengine {
+namespace {
+
+using impl::ClientTargetDamageHistory;
+
+const Rect kFramebufferBounds(1080, 2340);
+const Rect kCursorBounds(100, 200, 110, 240);
+const Rect kIconBounds(500, 1000, 600, 1100);
+// The bounds of the layers, padded by a pixel for filtering.
+const Rect kCursorDamage(99, 199, 111, 241);
+const Rect kIconDamage(499, 999, 601, 1101);
+
+constexpr uint64_t kBufferIds[] = {1001, 1002, 1003};
+
+class ClientTargetDamageHistoryTest : public testing::Test {
+public:
+    ClientTargetDamageHistoryTest() {
+        mWindow.geometry.boundaries = kFramebufferBounds.toFloatRect();
+        mWindow.bufferId = 1;
+        mWindow.frameNumber = 1;
+
+        mCursor.geometry.boundaries = kCursorBounds.toFloatRect();
+        mCursor.bufferId = 2;
+        mCursor.frameNumber = 1;
+
+        mIcon.geometry.boundaries = kIconBounds.toFloatRect();
+        mIcon.bufferId = 3;
+        mIcon.frameNumber = 1;
+    }
+
+    // Composes a frame into the next buffer of a triple buffered queue, and returns the region to
+    // redraw.
+    Region composeFrame() {
+        const size_t index = mFrameCount % std::size(kBufferIds);
+        const int bufferAge = mFrameCount < std::size(kBufferIds) ? 0 : 3;
+        mFrameCount++;
+        return composeFrame(kBufferIds[index], bufferAge);
+    }
+
+    Region composeFrame(uint64_t bufferId, int bufferAge, bool drawn = true) {
+        const Region damage =
+                mHistory.computeDamage(bufferId, bufferAge, mDisplay, false,
+                                       {mWindow, mIcon, mCursor}, ui::Transform(),
+                                       kFramebufferBounds);
+        mHistory.onBufferQueued(bufferId, drawn);
+        return damage;
+    }
+
+    void blinkCursor() { mCursor.frameNumber++; }
+
+    renderengine::DisplaySettings mDisplay;
+    LayerFE::LayerSettings mWindow;
+    LayerFE::LayerSettings mCursor;
+    LayerFE::LayerSettings mIcon;
+    ClientTargetDamageHistory mHistory;
+    size_t mFrameCount = 0;
+};
+
+TEST_F(ClientTargetDamageHistoryTest, redrawsEverythingWithoutHistory) {
+    for (size_t i = 0; i < std::size(kBufferIds); i++) {
+        blinkCursor();
+        EXPECT_THAT(composeFrame(), RegionEq(Region()));
+    }
+    EXPECT_EQ(mHistory.getBufferPixelCount(), mHistory.getDrawnPixelCount());
+}
+
+TEST_F(ClientTargetDamageHistoryTest, onlyRedrawsBlinkingCursor) {
+    for (size_t i = 0; i < std::size(kBufferIds); i++) {
+        composeFrame();
+    }
+
+    const uint64_t warmupPixelCount = mHistory.getDrawnPixelCount();
+    constexpr size_t kBlinkCount = 60;
+    for (size_t i = 0; i < kBlinkCount; i++) {
+        blinkCursor();
+        EXPECT_THAT(composeFrame(), RegionEq(Region(kCursorDamage)));
+    }
+
+    const uint64_t cursorPixelCount =
+            static_cast<uint64_t>(kCursorDamage.getWidth() * kCursorDamage.getHeight());
+    const uint64_t framebufferPixelCount =
+            static_cast<uint64_t>(kFramebufferBounds.getWidth() * kFramebufferBounds.getHeight());
+    EXPECT_EQ(kBlinkCount * cursorPixelCount, mHistory.getDrawnPixelCount() - warmupPixelCount);
+    EXPECT_EQ((kBlinkCount + std::size(kBufferIds)) * framebufferPixelCount,
+              mHistory.getBufferPixelCount());
+}
+
+TEST_F(ClientTargetDamageHistoryTest, redrawsDamageOfFramesQueuedSinceBuffer) {
+    composeFrame(kBufferIds[0], 0);
+
+    // The icon changes, and then the cursor, so the first buffer misses both changes.
+    mIcon.frameNumber++;
+    composeFrame(kBufferIds[1], 0);
+    blinkCursor();
+    EXPECT_THAT(composeFrame(kBufferIds[0], 2),
+                RegionEq(Region(kIconDamage).merge(kCursorDamage)));
+
+    // Only the cursor changed since the second buffer was drawn.
+    EXPECT_THAT(composeFrame(kBufferIds[1], 2), RegionEq(Region(kCursorDamage)));
+}
+
+TEST_F(ClientTargetDamageHistoryTest, redrawsDamageOfReusedBuffer) {
+    composeFrame(kBufferIds[0], 0);
+    blinkCursor();
+    composeFrame(kBufferIds[1], 0);
+
+    // The cursor blinks back, so the first buffer is queued again as it was drawn.
+    mCursor.frameNumber--;
+    mHistory.onBufferReused(kBufferIds[0], mDisplay, false, {mWindow, mIcon, mCursor},
+                            ui::Transform(), kFramebufferBounds);
+
+    // The first buffer misses the icon, and the second one misses the icon as well as the cursor
+    // which blinked back while the first buffer was reused.
+    mIcon.frameNumber++;
+    EXPECT_THAT(composeFrame(kBufferIds[1], 2),
+                RegionEq(Region(kIconDamage).merge(kCursorDamage)));
+    EXPECT_THAT(composeFrame(kBufferIds[0], 2), RegionEq(Region(kIconDamage)));
+}
+
+TEST_F(ClientTargetDamageHistoryTest, redrawsEverythingForUnknownBuffer) {
+    composeFrame(kBufferIds[0], 0);
+    blinkCursor();
+    EXPECT_THAT(composeFrame(kBufferIds[0], 1), RegionEq(Region(kCursorDamage)));
+
+    blinkCursor();
+    EXPECT_THAT(composeFrame(kBufferIds[1], 1), RegionEq(Region()));
+
+    // Older than the tracked frames.
+    blinkCursor();
+    EXPECT_THAT(composeFrame(kBufferIds[0],
+                             static_cast<int>(ClientTargetDamageHistory::kMaxBufferAge) + 1),
+                RegionEq(Region()));
+}
+
+TEST_F(ClientTargetDamageHistoryTest, redrawsEverythingIfBufferWasNotDrawn) {
+    composeFrame(kBufferIds[0], 0, /*drawn=*/false);
+    blinkCursor();
+    EXPECT_THAT(composeFrame(kBufferIds[0], 1), RegionEq(Region()));
+    blinkCursor();
+    EXPECT_THAT(composeFrame(kBufferIds[0], 1), RegionEq(Region(kCursorDamage)));
+}
+
+TEST_F(ClientTargetDamageHistoryTest, redrawsEverythingIfRequestChanges) {
+    composeFrame(kBufferIds[0], 0);
+
+    mCursor.alpha = 0.5f;
+    EXPECT_THAT(composeFrame(kBufferIds[0], 1), RegionEq(Region()));
+
+    mDisplay.sdrWhitePointNits = 200.f;
+    EXPECT_THAT(composeFrame(kBufferIds[0], 1), RegionEq(Region()));
+
+    mWindow.backgroundBlurRadius = 10;
+    EXPECT_THAT(composeFrame(kBufferIds[0], 1), RegionEq(Region()));
+}
+
+} // namespace
+} // namespace android::compositionengine
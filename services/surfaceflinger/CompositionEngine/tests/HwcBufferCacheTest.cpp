@@ -82,5 +82,24 @@ TEST_F(HwcBufferCacheTest, cacheMapsNegativeSlotToZero) {
     testSlot(-123, 0);
 }
 
+TEST_F(HwcBufferCacheTest, cacheDoesNotKeepBuffersAlive) {
+    uint32_t outSlot;
+    sp<GraphicBuffer> outBuffer;
+    mCache.getHwcBuffer(0, mBuffer1, &outSlot, &outBuffer);
+    EXPECT_EQ(mBuffer1, outBuffer);
+
+    // Once the cached buffer is freed, a buffer allocated in its place is sent to HWC, even if it
+    // reuses the same memory.
+    wp<GraphicBuffer> weakBuffer = mBuffer1;
+    outBuffer.clear();
+    mBuffer1.clear();
+    EXPECT_EQ(nullptr, weakBuffer.promote());
+
+    sp<GraphicBuffer> buffer = new GraphicBuffer(1, 1, HAL_PIXEL_FORMAT_RGBA_8888, 1, 0);
+    mCache.getHwcBuffer(0, buffer, &outSlot, &outBuffer);
+    EXPECT_EQ(0u, outSlot);
+    EXPECT_EQ(buffer, outBuffer);
+}
+
 } // namespace
 } // namespace android::compositionengine
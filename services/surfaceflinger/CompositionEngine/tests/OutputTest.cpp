@@ -47,6 +47,7 @@ using testing::DoAll;
 using testing::ElementsAre;
 using testing::ElementsAreArray;
 using testing::Eq;
+using testing::Field;
 using testing::InSequence;
 using testing::Invoke;
 using testing::IsEmpty;
@@ -3335,6 +3336,135 @@ TEST_F(OutputComposeSurfacesTest, clientCompositionIfRequestChanges) {
     EXPECT_FALSE(mOutput.mState.reusedClientComposition);
 }
 
+TEST_F(OutputComposeSurfacesTest, onlyRedrawsDamageOfReusedBuffer) {
+    LayerFE::LayerSettings r1;
+    LayerFE::LayerSettings r2;
+
+    r1.geometry.boundaries = FloatRect{0, 0, 10, 10};
+    r1.bufferId = 1;
+    r1.frameNumber = 1;
+    r2.geometry.boundaries = FloatRect{5, 6, 7, 8};
+    r2.bufferId = 2;
+    r2.frameNumber = 1;
+    LayerFE::LayerSettings r2Blink = r2;
+    r2Blink.frameNumber = 2;
+
+    mOutput.setClientTargetDamageEnabled(true);
+    mOutput.mState.framebufferSpace.bounds = Rect(2000, 2000);
+
+    EXPECT_CALL(mOutput, getSkipColorTransform()).WillRepeatedly(Return(false));
+    EXPECT_CALL(*mDisplayColorProfile, hasWideColorGamut()).WillRepeatedly(Return(true));
+    EXPECT_CALL(mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mRenderEngine, isProtected()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mOutput, generateClientCompositionRequests(_, _, kDefaultOutputDataspace))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r1, r2}))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{r1, r2Blink}));
+    EXPECT_CALL(mOutput, appendRegionFlashRequests(RegionEq(kDebugRegion), _))
+            .WillRepeatedly(Return());
+
+    EXPECT_CALL(*mRenderSurface, dequeueBuffer(_)).WillRepeatedly(Return(mOutputBuffer));
+    EXPECT_CALL(*mRenderSurface, getBufferAge()).WillOnce(Return(0)).WillOnce(Return(1));
+
+    // The second frame only redraws the bounds of the layer with a new buffer, translated from
+    // the layer stack to the framebuffer, and padded by a pixel.
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damageRegion, RegionEq(Region())),
+                           ElementsAre(Pointee(r1), Pointee(r2)), _, false, _, _))
+            .WillOnce(Return(NO_ERROR));
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damageRegion,
+                                 RegionEq(Region(Rect{12, 13, 16, 17}))),
+                           ElementsAre(Pointee(r1), Pointee(r2Blink)), _, false, _, _))
+            .WillOnce(Return(NO_ERROR));
+
+    verify().execute().expectAFenceWasReturned();
+    verify().execute().expectAFenceWasReturned();
+}
+
+TEST_F(OutputComposeSurfacesTest, redrawsDamageAcrossReusedBuffer) {
+    LayerFE::LayerSettings window;
+    LayerFE::LayerSettings cursor;
+
+    window.geometry.boundaries = FloatRect{0, 0, 10, 10};
+    window.bufferId = 1;
+    window.frameNumber = 1;
+    cursor.geometry.boundaries = FloatRect{50, 60, 70, 80};
+    cursor.bufferId = 2;
+    cursor.frameNumber = 1;
+    LayerFE::LayerSettings nextWindow = window;
+    nextWindow.frameNumber = 2;
+    LayerFE::LayerSettings blinkedCursor = cursor;
+    blinkedCursor.frameNumber = 2;
+
+    mOutput.cacheClientCompositionRequests(3);
+    mOutput.setClientTargetDamageEnabled(true);
+    mOutput.mState.framebufferSpace.bounds = Rect(2000, 2000);
+
+    EXPECT_CALL(mOutput, getSkipColorTransform()).WillRepeatedly(Return(false));
+    EXPECT_CALL(*mDisplayColorProfile, hasWideColorGamut()).WillRepeatedly(Return(true));
+    EXPECT_CALL(mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mRenderEngine, isProtected()).WillRepeatedly(Return(false));
+    EXPECT_CALL(mOutput, generateClientCompositionRequests(_, _, kDefaultOutputDataspace))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{window, cursor}))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{window, blinkedCursor}))
+            .WillOnce(Return(std::vector<LayerFE::LayerSettings>{window, cursor}))
+            .WillRepeatedly(Return(std::vector<LayerFE::LayerSettings>{nextWindow, blinkedCursor}));
+    EXPECT_CALL(mOutput, appendRegionFlashRequests(RegionEq(kDebugRegion), _))
+            .WillRepeatedly(Return());
+
+    // Double buffering, where the third frame finds the first buffer already drawn.
+    const auto otherOutputBuffer = std::make_shared<
+            renderengine::ExternalTexture>(new GraphicBuffer(), mRenderEngine,
+                                           renderengine::ExternalTexture::Usage::READABLE |
+                                                   renderengine::ExternalTexture::Usage::WRITEABLE);
+    EXPECT_CALL(*mRenderSurface, dequeueBuffer(_))
+            .WillOnce(Return(mOutputBuffer))
+            .WillOnce(Return(otherOutputBuffer))
+            .WillOnce(Return(mOutputBuffer))
+            .WillOnce(Return(otherOutputBuffer))
+            .WillOnce(Return(mOutputBuffer));
+    EXPECT_CALL(*mRenderSurface, getBufferAge())
+            .WillOnce(Return(0))
+            .WillOnce(Return(0))
+            .WillRepeatedly(Return(2));
+    EXPECT_CALL(mOutput, setExpensiveRenderingExpected(false));
+
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damageRegion, RegionEq(Region())),
+                           ElementsAre(Pointee(window), Pointee(cursor)), _, false, _, _))
+            .WillOnce(Return(NO_ERROR));
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damageRegion, RegionEq(Region())),
+                           ElementsAre(Pointee(window), Pointee(blinkedCursor)), _, false, _, _))
+            .WillOnce(Return(NO_ERROR));
+
+    // Besides the window, the cursor is out of date in both buffers: the second buffer was drawn
+    // with the cursor blinked, and the first one was reused with the cursor as it was before.
+    Region damage(Rect{7, 7, 19, 19});
+    damage.orSelf(Rect{57, 67, 79, 89});
+    EXPECT_CALL(mRenderEngine,
+                drawLayers(Field(&renderengine::DisplaySettings::damageRegion, RegionEq(damage)),
+                           ElementsAre(Pointee(nextWindow), Pointee(blinkedCursor)), _, false, _,
+                           _))
+            .Times(2)
+            .WillRepeatedly(Return(NO_ERROR));
+
+    verify().execute().expectAFenceWasReturned();
+    EXPECT_FALSE(mOutput.mState.reusedClientComposition);
+
+    verify().execute().expectAFenceWasReturned();
+    EXPECT_FALSE(mOutput.mState.reusedClientComposition);
+
+    verify().execute().expectAFenceWasReturned();
+    EXPECT_TRUE(mOutput.mState.reusedClientComposition);
+
+    verify().execute().expectAFenceWasReturned();
+    EXPECT_FALSE(mOutput.mState.reusedClientComposition);
+
+    verify().execute().expectAFenceWasReturned();
+    EXPECT_FALSE(mOutput.mState.reusedClientComposition);
+}
+
 struct OutputComposeSurfacesTest_UsesExpectedDisplaySettings : public OutputComposeSurfacesTest {
     OutputComposeSurfacesTest_UsesExpectedDisplaySettings() {
         EXPECT_CALL(mRenderEngine, supportsProtectedContent()).WillRepeatedly(Return(false));
@@ -245,6 +245,24 @@ TEST_F(RenderSurfaceTest, dequeueBufferObtainsABuffer) {
     EXPECT_EQ(buffer.get(), mSurface.mutableTextureForTest()->getBuffer().get());
 }
 
+/*
+ * RenderSurface::getBufferAge()
+ */
+
+TEST_F(RenderSurfaceTest, getBufferAgeQueriesTheNativeWindow) {
+    EXPECT_CALL(*mNativeWindow, query(NATIVE_WINDOW_BUFFER_AGE, _))
+            .WillOnce(DoAll(SetArgPointee<1>(2), Return(NO_ERROR)));
+
+    EXPECT_EQ(2, mSurface.getBufferAge());
+}
+
+TEST_F(RenderSurfaceTest, getBufferAgeReturnsZeroOnError) {
+    EXPECT_CALL(*mNativeWindow, query(NATIVE_WINDOW_BUFFER_AGE, _))
+            .WillOnce(DoAll(SetArgPointee<1>(2), Return(INVALID_OPERATION)));
+
+    EXPECT_EQ(0, mSurface.getBufferAge());
+}
+
 /*
  * RenderSurface::queueBuffer()
  */
@@ -18,6 +18,7 @@
 #include <compositionengine/impl/planner/CachedSet.h>
 #include <compositionengine/impl/planner/Flattener.h>
 #include <compositionengine/impl/planner/LayerState.h>
+#include <compositionengine/impl/planner/Predictor.h>
 #include <compositionengine/mock/LayerFE.h>
 #include <compositionengine/mock/OutputLayer.h>
 #include <gtest/gtest.h>
@@ -32,6 +33,8 @@ using impl::planner::CachedSet;
 using impl::planner::Flattener;
 using impl::planner::LayerState;
 using impl::planner::NonBufferHash;
+using impl::planner::Plan;
+using impl::planner::Predictor;
 
 using testing::_;
 using testing::ByMove;
@@ -47,8 +50,9 @@ namespace {
 
 class TestableFlattener : public Flattener {
 public:
-    TestableFlattener(renderengine::RenderEngine& renderEngine, const Tunables& tunables)
-          : Flattener(renderEngine, tunables) {}
+    TestableFlattener(renderengine::RenderEngine& renderEngine, const Tunables& tunables,
+                      const Predictor* predictor)
+          : Flattener(renderEngine, tunables, predictor) {}
     const std::optional<CachedSet>& getNewCachedSetForTesting() const { return mNewCachedSet; }
 };
 
@@ -59,18 +63,20 @@ public:
                     .mActiveLayerTimeout = 100ms,
                     .mRenderScheduling = std::nullopt,
                     .mEnableHolePunch = true,
+                    .mPrediction = std::nullopt,
             }) {}
     void SetUp() override;
 
 protected:
     FlattenerTest(const Flattener::Tunables& tunables)
-          : mFlattener(std::make_unique<TestableFlattener>(mRenderEngine, tunables)) {}
+          : mFlattener(std::make_unique<TestableFlattener>(mRenderEngine, tunables, &mPredictor)) {}
     void initializeOverrideBuffer(const std::vector<const LayerState*>& layers);
     void initializeFlattener(const std::vector<const LayerState*>& layers);
     void expectAllLayersFlattened(const std::vector<const LayerState*>& layers);
 
     // mRenderEngine is held as a reference in mFlattener, so explicitly destroy mFlattener first.
     renderengine::mock::RenderEngine mRenderEngine;
+    Predictor mPredictor;
     std::unique_ptr<TestableFlattener> mFlattener;
 
     const std::chrono::steady_clock::time_point kStartTime = std::chrono::steady_clock::now();
@@ -906,7 +912,8 @@ public:
                                                                          kCachedSetRenderDuration,
                                                                  .maxDeferRenderAttempts =
                                                                          kMaxDeferRenderAttempts},
-                                        .mEnableHolePunch = true}) {}
+                                        .mEnableHolePunch = true,
+                                        .mPrediction = std::nullopt}) {}
 };
 
 TEST_F(FlattenerRenderSchedulingTest, flattenLayers_renderCachedSets_defersUpToMaxAttempts) {
@@ -1087,5 +1094,162 @@ TEST_F(FlattenerTest, flattenLayers_skipsHDR2) {
     EXPECT_EQ(nullptr, overrideBuffer3);
 }
 
+class FlattenerPredictionTest : public FlattenerTest {
+public:
+    FlattenerPredictionTest()
+          : FlattenerTest(Flattener::Tunables{
+                    .mActiveLayerTimeout = 100ms,
+                    .mRenderScheduling = std::nullopt,
+                    .mEnableHolePunch = true,
+                    .mPrediction =
+                            Flattener::Tunables::Prediction{
+                                    .activeLayerTimeout = 50ms,
+                            },
+            }) {}
+
+protected:
+    // Flattens another frame of the layers, which are expected to be flattened into a cached set
+    // already, and reports how the cached set was composed, as the Planner does.
+    void reportComposition(const std::vector<const LayerState*>& layers,
+                           hal::Composition composition) {
+        initializeOverrideBuffer(layers);
+        const NonBufferHash flattenedHash =
+                mFlattener->flattenLayers(layers, getNonBufferHash(layers), mTime);
+        EXPECT_NE(getNonBufferHash(layers), flattenedHash);
+        mFlattener->renderCachedSets(mOutputState, std::nullopt);
+
+        Plan plan;
+        plan.addLayerType(composition);
+        mPredictor.recordResult(std::nullopt, flattenedHash, layers, false, plan);
+
+        std::unordered_set<impl::planner::LayerId> clientComposedLayers;
+        if (composition == hal::Composition::CLIENT) {
+            for (const LayerState* layer : layers) {
+                clientComposedLayers.insert(layer->getId());
+            }
+        }
+        mFlattener->recordClientComposition(clientComposedLayers);
+    }
+};
+
+TEST_F(FlattenerPredictionTest, flattenLayers_withoutHistory_waitsForActiveLayerTimeout) {
+    auto& layerState1 = mTestLayers[0]->layerState;
+    auto& layerState2 = mTestLayers[1]->layerState;
+
+    const std::vector<const LayerState*> layers = {
+            layerState1.get(),
+            layerState2.get(),
+    };
+
+    initializeFlattener(layers);
+
+    // Inactive for longer than the predicted timeout, but not the regular one.
+    mTime += 60ms;
+
+    EXPECT_CALL(mRenderEngine, drawLayers(_, _, _, _, _, _)).Times(0);
+    initializeOverrideBuffer(layers);
+    EXPECT_EQ(getNonBufferHash(layers),
+              mFlattener->flattenLayers(layers, getNonBufferHash(layers), mTime));
+    mFlattener->renderCachedSets(mOutputState, std::nullopt);
+    EXPECT_FALSE(mFlattener->getNewCachedSetForTesting());
+}
+
+TEST_F(FlattenerPredictionTest, flattenLayers_withHistory_preRendersAfterPredictedTimeout) {
+    auto& layerState1 = mTestLayers[0]->layerState;
+    auto& layerState2 = mTestLayers[1]->layerState;
+
+    const std::vector<const LayerState*> layers = {
+            layerState1.get(),
+            layerState2.get(),
+    };
+
+    initializeFlattener(layers);
+
+    // Flatten the layers once with the regular timeout, and have the device compose the cached set.
+    mTime += 200ms;
+    expectAllLayersFlattened(layers);
+    reportComposition(layers, hal::Composition::DEVICE);
+
+    // Switch to another geometry, and come back to the initial one.
+    mFlattener->flattenLayers(layers, getNonBufferHash(layers) + 1, mTime);
+    initializeFlattener(layers);
+
+    // The same layers are now expected to settle, so their cached set is rendered ahead of the
+    // regular timeout...
+    mTime += 60ms;
+    EXPECT_CALL(mRenderEngine, drawLayers(_, _, _, _, _, _)).WillOnce(Return(NO_ERROR));
+    initializeOverrideBuffer(layers);
+    EXPECT_EQ(getNonBufferHash(layers),
+              mFlattener->flattenLayers(layers, getNonBufferHash(layers), mTime));
+    mFlattener->renderCachedSets(mOutputState, std::nullopt);
+    EXPECT_TRUE(mFlattener->getNewCachedSetForTesting());
+    EXPECT_EQ(nullptr, layerState1->getOutputLayer()->getState().overrideInfo.buffer);
+
+    // ...but only swapped in after it, without rendering again.
+    mTime += 50ms;
+    initializeOverrideBuffer(layers);
+    EXPECT_NE(getNonBufferHash(layers),
+              mFlattener->flattenLayers(layers, getNonBufferHash(layers), mTime));
+    mFlattener->renderCachedSets(mOutputState, std::nullopt);
+    EXPECT_NE(nullptr, layerState1->getOutputLayer()->getState().overrideInfo.buffer);
+
+    std::string dump;
+    mFlattener->dump(dump);
+    EXPECT_NE(std::string::npos, dump.find("Predicted: 1\n"));
+    EXPECT_NE(std::string::npos, dump.find("Used: 2\n"));
+}
+
+TEST_F(FlattenerPredictionTest, flattenLayers_withClientComposition_waitsForActiveLayerTimeout) {
+    auto& layerState1 = mTestLayers[0]->layerState;
+    auto& layerState2 = mTestLayers[1]->layerState;
+
+    const std::vector<const LayerState*> layers = {
+            layerState1.get(),
+            layerState2.get(),
+    };
+
+    initializeFlattener(layers);
+
+    // The cached set was used before, but did not save any client composition.
+    mTime += 200ms;
+    expectAllLayersFlattened(layers);
+    reportComposition(layers, hal::Composition::CLIENT);
+
+    mFlattener->flattenLayers(layers, getNonBufferHash(layers) + 1, mTime);
+    initializeFlattener(layers);
+
+    mTime += 60ms;
+    EXPECT_CALL(mRenderEngine, drawLayers(_, _, _, _, _, _)).Times(0);
+    initializeOverrideBuffer(layers);
+    EXPECT_EQ(getNonBufferHash(layers),
+              mFlattener->flattenLayers(layers, getNonBufferHash(layers), mTime));
+    mFlattener->renderCachedSets(mOutputState, std::nullopt);
+    EXPECT_FALSE(mFlattener->getNewCachedSetForTesting());
+}
+
+TEST_F(FlattenerPredictionTest, recordClientComposition_countsClientCompositionAvoided) {
+    auto& layerState1 = mTestLayers[0]->layerState;
+    auto& layerState2 = mTestLayers[1]->layerState;
+
+    const std::vector<const LayerState*> layers = {
+            layerState1.get(),
+            layerState2.get(),
+    };
+
+    initializeFlattener(layers);
+    mFlattener->recordClientComposition({layerState1->getId(), layerState2->getId()});
+
+    mTime += 200ms;
+    expectAllLayersFlattened(layers);
+    reportComposition(layers, hal::Composition::DEVICE);
+    reportComposition(layers, hal::Composition::DEVICE);
+    // The client composing the cached set itself does not avoid anything.
+    reportComposition(layers, hal::Composition::CLIENT);
+
+    std::string dump;
+    mFlattener->dump(dump);
+    EXPECT_NE(std::string::npos, dump.find("Client composition avoided: 2 frames\n"));
+}
+
 } // namespace
 } // namespace android::compositionengine
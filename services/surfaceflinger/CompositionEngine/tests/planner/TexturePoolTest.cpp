@@ -27,6 +27,7 @@ namespace {
 
 const ui::Size kDisplaySize(1, 1);
 const ui::Size kDisplaySizeTwo(2, 2);
+const ui::Size kTextureSize(1, 2);
 
 class TestableTexturePool : public TexturePool {
 public:
@@ -35,6 +36,9 @@ public:
     size_t getMinPoolSize() const { return kMinPoolSize; }
     size_t getMaxPoolSize() const { return kMaxPoolSize; }
     size_t getPoolSize() const { return mPool.size(); }
+    size_t getHitCount() const { return mHitCount; }
+    size_t getMissCount() const { return mMissCount; }
+    std::chrono::milliseconds getChurnWindow() const { return kChurnWindow; }
 };
 
 struct TexturePoolTest : public testing::Test {
@@ -170,5 +174,103 @@ TEST_F(TexturePoolTest, reallocatesWhenReEnabled) {
     EXPECT_EQ(mTexturePool.getPoolSize(), mTexturePool.getMinPoolSize());
 }
 
+TEST_F(TexturePoolTest, reusesTexturesAcrossFlattenUnflattenCycles) {
+    // Two cached sets are created and invalidated over and over, e.g. by a blinking cursor.
+    for (size_t i = 0; i < 10; i++) {
+        auto first = mTexturePool.borrowTexture();
+        auto second = mTexturePool.borrowTexture();
+    }
+
+    // Only the first cycle allocates beyond the preallocated pool.
+    EXPECT_EQ(19u, mTexturePool.getHitCount());
+    EXPECT_EQ(1u, mTexturePool.getMissCount());
+    EXPECT_EQ(2u, mTexturePool.getPoolSize());
+
+    std::string dump;
+    mTexturePool.dump(dump);
+    EXPECT_NE(std::string::npos, dump.find("Hits: 19, misses: 1"));
+}
+
+TEST_F(TexturePoolTest, retainsPeakDemandUntilChurnStops) {
+    const auto start = std::chrono::steady_clock::now();
+    mTexturePool.updateChurn(start);
+
+    // A window animation invalidates and recreates several cached sets at once.
+    {
+        std::vector<std::shared_ptr<TexturePool::AutoTexture>> textures;
+        for (size_t i = 0; i < mTexturePool.getMaxPoolSize(); i++) {
+            textures.emplace_back(mTexturePool.borrowTexture());
+        }
+    }
+    EXPECT_EQ(mTexturePool.getMaxPoolSize(), mTexturePool.getPoolSize());
+
+    // The peak is retained for the current and next churn window.
+    mTexturePool.updateChurn(start + mTexturePool.getChurnWindow() / 2);
+    EXPECT_EQ(mTexturePool.getMaxPoolSize(), mTexturePool.getPoolSize());
+    mTexturePool.updateChurn(start + mTexturePool.getChurnWindow());
+    EXPECT_EQ(mTexturePool.getMaxPoolSize(), mTexturePool.getPoolSize());
+
+    // The same burst again is served from the pool.
+    {
+        std::vector<std::shared_ptr<TexturePool::AutoTexture>> textures;
+        for (size_t i = 0; i < mTexturePool.getMaxPoolSize(); i++) {
+            textures.emplace_back(mTexturePool.borrowTexture());
+        }
+    }
+    EXPECT_EQ(mTexturePool.getMaxPoolSize() - 1, mTexturePool.getMissCount());
+
+    // Once idle for two churn windows, the pool shrinks back to its minimum size.
+    mTexturePool.updateChurn(start + 2 * mTexturePool.getChurnWindow());
+    EXPECT_EQ(mTexturePool.getMaxPoolSize(), mTexturePool.getPoolSize());
+    mTexturePool.updateChurn(start + 3 * mTexturePool.getChurnWindow());
+    EXPECT_EQ(mTexturePool.getMinPoolSize(), mTexturePool.getPoolSize());
+}
+
+TEST_F(TexturePoolTest, trimReleasesTextures) {
+    auto texture = mTexturePool.borrowTexture();
+    {
+        auto other = mTexturePool.borrowTexture();
+    }
+    EXPECT_EQ(1u, mTexturePool.getPoolSize());
+
+    mTexturePool.trim();
+    EXPECT_EQ(0u, mTexturePool.getPoolSize());
+
+    // Textures in use are released when returned.
+    texture.reset();
+    EXPECT_EQ(0u, mTexturePool.getPoolSize());
+
+    // The pool grows again with subsequent demand.
+    texture = mTexturePool.borrowTexture();
+    EXPECT_EQ(2u, mTexturePool.getMissCount());
+    texture.reset();
+    EXPECT_EQ(mTexturePool.getMinPoolSize(), mTexturePool.getPoolSize());
+}
+
+TEST_F(TexturePoolTest, poolsTexturesOfOtherSizes) {
+    const auto start = std::chrono::steady_clock::now();
+    mTexturePool.updateChurn(start);
+
+    uint64_t bufferId;
+    {
+        auto texture = mTexturePool.borrowTexture(kTextureSize);
+        EXPECT_EQ(kTextureSize, texture->get()->getBuffer()->getBounds().getSize());
+        bufferId = texture->get()->getBuffer()->getId();
+    }
+    EXPECT_EQ(1u, mTexturePool.getMissCount());
+    EXPECT_EQ(mTexturePool.getMinPoolSize() + 1, mTexturePool.getPoolSize());
+
+    {
+        auto texture = mTexturePool.borrowTexture(kTextureSize);
+        EXPECT_EQ(bufferId, texture->get()->getBuffer()->getId());
+    }
+    EXPECT_EQ(1u, mTexturePool.getMissCount());
+
+    // Unlike screen-sized textures, textures of other sizes are not retained when unused.
+    mTexturePool.updateChurn(start + mTexturePool.getChurnWindow());
+    mTexturePool.updateChurn(start + 2 * mTexturePool.getChurnWindow());
+    EXPECT_EQ(mTexturePool.getMinPoolSize(), mTexturePool.getPoolSize());
+}
+
 } // namespace
 } // namespace android::compositionengine::impl::planner
@@ -23,6 +23,8 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+
 #include <android-base/stringprintf.h>
 #include <android/log.h>
 
@@ -33,238 +35,253 @@
 
 namespace android {
 
-FrameTracker::FrameTracker() :
-        mOffset(0),
-        mNumFences(0),
-        mDisplayPeriod(0) {
-    resetFrameCountersLocked();
+FrameTracker::FrameTracker() {
+    // The record of the first frame is being written.
+    mFrameRecords[0].sequence.store(1, std::memory_order_relaxed);
 }
 
 void FrameTracker::setDesiredPresentTime(nsecs_t presentTime) {
-    Mutex::Autolock lock(mMutex);
-    mFrameRecords[mOffset].desiredPresentTime = presentTime;
+    FrameRecord& record = mFrameRecords[getPublishedFrameCount() % NUM_FRAME_RECORDS];
+    record.desiredPresentTime.store(presentTime, std::memory_order_relaxed);
 }
 
 void FrameTracker::setFrameReadyTime(nsecs_t readyTime) {
-    Mutex::Autolock lock(mMutex);
-    mFrameRecords[mOffset].frameReadyTime = readyTime;
+    FrameRecord& record = mFrameRecords[getPublishedFrameCount() % NUM_FRAME_RECORDS];
+    record.frameReadyTime.store(readyTime, std::memory_order_relaxed);
 }
 
 void FrameTracker::setFrameReadyFence(
         std::shared_ptr<FenceTime>&& readyFence) {
-    Mutex::Autolock lock(mMutex);
-    mFrameRecords[mOffset].frameReadyFence = std::move(readyFence);
-    mNumFences++;
+    FrameRecord& record = mFrameRecords[getPublishedFrameCount() % NUM_FRAME_RECORDS];
+    std::atomic_store(&record.frameReadyFence, std::move(readyFence));
 }
 
 void FrameTracker::setActualPresentTime(nsecs_t presentTime) {
-    Mutex::Autolock lock(mMutex);
-    mFrameRecords[mOffset].actualPresentTime = presentTime;
+    FrameRecord& record = mFrameRecords[getPublishedFrameCount() % NUM_FRAME_RECORDS];
+    record.actualPresentTime.store(presentTime, std::memory_order_relaxed);
 }
 
 void FrameTracker::setActualPresentFence(const std::shared_ptr<FenceTime>& readyFence) {
-    Mutex::Autolock lock(mMutex);
-    mFrameRecords[mOffset].actualPresentFence = readyFence;
-    mNumFences++;
+    FrameRecord& record = mFrameRecords[getPublishedFrameCount() % NUM_FRAME_RECORDS];
+    std::atomic_store(&record.actualPresentFence, readyFence);
+    mHasPresentFence = readyFence != nullptr;
 }
 
 void FrameTracker::setDisplayRefreshPeriod(nsecs_t displayPeriod) {
-    Mutex::Autolock lock(mMutex);
-    mDisplayPeriod = displayPeriod;
+    mDisplayPeriod.store(displayPeriod, std::memory_order_relaxed);
 }
 
 void FrameTracker::advanceFrame() {
-    Mutex::Autolock lock(mMutex);
-
-    // Update the statistic to include the frame we just finished.
-    updateStatsLocked(mOffset);
-
-    // Advance to the next frame.
-    mOffset = (mOffset+1) % NUM_FRAME_RECORDS;
-    mFrameRecords[mOffset].desiredPresentTime = INT64_MAX;
-    mFrameRecords[mOffset].frameReadyTime = INT64_MAX;
-    mFrameRecords[mOffset].actualPresentTime = INT64_MAX;
-
-    if (mFrameRecords[mOffset].frameReadyFence != nullptr) {
-        // We're clobbering an unsignaled fence, so we need to decrement the
-        // fence count.
-        mFrameRecords[mOffset].frameReadyFence = nullptr;
-        mNumFences--;
-    }
-
-    if (mFrameRecords[mOffset].actualPresentFence != nullptr) {
-        // We're clobbering an unsignaled fence, so we need to decrement the
-        // fence count.
-        mFrameRecords[mOffset].actualPresentFence = nullptr;
-        mNumFences--;
+    const uint64_t frameNumber = getPublishedFrameCount();
+    FrameRecord& record = mFrameRecords[frameNumber % NUM_FRAME_RECORDS];
+
+    // Update the statistic to include the frame we just finished, unless its
+    // present time is resolved from a fence by the readers.
+    const nsecs_t presentTime = mHasPresentFence
+            ? INT64_MAX
+            : record.actualPresentTime.load(std::memory_order_relaxed);
+    if (isPresentTimeValid(mPrevPresentTime) && isPresentTimeValid(presentTime)) {
+        countFrame(mPrevPresentTime, presentTime);
     }
+    mPrevPresentTime = presentTime;
+    mHasPresentFence = false;
+
+    // Publish the frame we just finished.
+    const uint32_t sequence = record.sequence.load(std::memory_order_relaxed);
+    record.sequence.store(sequence + 1, std::memory_order_release);
+    mFrameNumber.store(frameNumber + 1, std::memory_order_release);
+
+    // Advance to the next frame. Its record is marked as being written before
+    // it is modified, so that readers of the frame it held discard their copy.
+    FrameRecord& next = mFrameRecords[(frameNumber + 1) % NUM_FRAME_RECORDS];
+    next.sequence.store(next.sequence.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    next.frameNumber.store(frameNumber + 1, std::memory_order_relaxed);
+    next.desiredPresentTime.store(INT64_MAX, std::memory_order_relaxed);
+    next.frameReadyTime.store(INT64_MAX, std::memory_order_relaxed);
+    next.actualPresentTime.store(INT64_MAX, std::memory_order_relaxed);
+    std::atomic_store(&next.frameReadyFence, std::shared_ptr<FenceTime>());
+    std::atomic_store(&next.actualPresentFence, std::shared_ptr<FenceTime>());
 }
 
-nsecs_t FrameTracker::getPreviousGfxInfo() {
-    Mutex::Autolock lock(mMutex);
-    size_t previous = -1;
-    if (mOffset > 0) {
-        previous = (mOffset-1) % NUM_FRAME_RECORDS;
-    } else if (mOffset == 0) {
-        previous = NUM_FRAME_RECORDS - 1;
-    }
-    if (previous >= 0) {
-        nsecs_t desiredPresentTime = mFrameRecords[previous].desiredPresentTime;
-        const std::shared_ptr<FenceTime>& rfence = mFrameRecords[previous].frameReadyFence;
-        if (rfence != nullptr) {
-            nsecs_t frameReadyTime = rfence->getSignalTime();
-            if (desiredPresentTime != INT64_MAX && frameReadyTime != INT64_MAX) {
-                return (frameReadyTime - desiredPresentTime);
-            }
-        }
+nsecs_t FrameTracker::getPreviousGfxInfo() const {
+    const uint64_t frameCount = getPublishedFrameCount();
+    Frame frame;
+    if (frameCount > 0 && readFrame(frameCount - 1, &frame) &&
+        frame.desiredPresentTime != INT64_MAX && frame.frameReadyTime != INT64_MAX) {
+        return frame.frameReadyTime - frame.desiredPresentTime;
     }
     return INT64_MAX;
 }
 
 void FrameTracker::clearStats() {
-    Mutex::Autolock lock(mMutex);
-    for (size_t i = 0; i < NUM_FRAME_RECORDS; i++) {
-        mFrameRecords[i].desiredPresentTime = 0;
-        mFrameRecords[i].frameReadyTime = 0;
-        mFrameRecords[i].actualPresentTime = 0;
-        mFrameRecords[i].frameReadyFence.reset();
-        mFrameRecords[i].actualPresentFence.reset();
+    // The records are left to be overwritten by the writer, and only hidden
+    // from the readers.
+    const uint64_t frameCount = getPublishedFrameCount();
+    uint64_t clearedFrameNumber = mClearedFrameNumber.load(std::memory_order_relaxed);
+    while (clearedFrameNumber < frameCount &&
+           !mClearedFrameNumber.compare_exchange_weak(clearedFrameNumber, frameCount,
+                                                      std::memory_order_relaxed)) {
     }
-    mNumFences = 0;
-    mFrameRecords[mOffset].desiredPresentTime = INT64_MAX;
-    mFrameRecords[mOffset].frameReadyTime = INT64_MAX;
-    mFrameRecords[mOffset].actualPresentTime = INT64_MAX;
 }
 
 void FrameTracker::getStats(FrameStats* outStats) const {
-    Mutex::Autolock lock(mMutex);
-    processFencesLocked();
-
-    outStats->refreshPeriodNano = mDisplayPeriod;
+    {
+        Mutex::Autolock lock(mReaderMutex);
+        updateStatsLocked();
+    }
 
-    const size_t offset = mOffset;
-    for (size_t i = 1; i < NUM_FRAME_RECORDS; i++) {
-        const size_t index = (offset + i) % NUM_FRAME_RECORDS;
+    outStats->refreshPeriodNano = mDisplayPeriod.load(std::memory_order_relaxed);
 
+    const uint64_t frameCount = getPublishedFrameCount();
+    for (uint64_t i = NUM_FRAME_RECORDS - 1; i > 0; i--) {
         // Skip frame records with no data (if buffer not yet full).
-        if (mFrameRecords[index].desiredPresentTime == 0) {
+        Frame frame;
+        if (frameCount < i || !readFrame(frameCount - i, &frame) ||
+            frame.desiredPresentTime == 0) {
             continue;
         }
 
-        nsecs_t desiredPresentTimeNano = mFrameRecords[index].desiredPresentTime;
-        outStats->desiredPresentTimesNano.push_back(desiredPresentTimeNano);
+        outStats->desiredPresentTimesNano.push_back(frame.desiredPresentTime);
+        outStats->actualPresentTimesNano.push_back(frame.actualPresentTime);
+        outStats->frameReadyTimesNano.push_back(frame.frameReadyTime);
+    }
+}
 
-        nsecs_t actualPresentTimeNano = mFrameRecords[index].actualPresentTime;
-        outStats->actualPresentTimesNano.push_back(actualPresentTimeNano);
+void FrameTracker::logAndResetStats(const std::string_view& name) {
+    {
+        Mutex::Autolock lock(mReaderMutex);
+        updateStatsLocked();
+    }
 
-        nsecs_t frameReadyTimeNano = mFrameRecords[index].frameReadyTime;
-        outStats->frameReadyTimesNano.push_back(frameReadyTimeNano);
+    int32_t numFrames[NUM_FRAME_BUCKETS];
+    bool hasFrames = false;
+    for (int i = 0; i < NUM_FRAME_BUCKETS; i++) {
+        numFrames[i] = mNumFrames[i].exchange(0, std::memory_order_relaxed);
+        hasFrames |= numFrames[i] > 0;
+    }
+    if (hasFrames) {
+        EventLog::logFrameDurations(name, numFrames, NUM_FRAME_BUCKETS);
     }
 }
 
-void FrameTracker::logAndResetStats(const std::string_view& name) {
-    Mutex::Autolock lock(mMutex);
-    logStatsLocked(name);
-    resetFrameCountersLocked();
+bool FrameTracker::readFrame(uint64_t frameNumber, Frame* outFrame) const {
+    if (frameNumber < mClearedFrameNumber.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    const FrameRecord& record = mFrameRecords[frameNumber % NUM_FRAME_RECORDS];
+    const uint32_t sequence = record.sequence.load(std::memory_order_acquire);
+    if (sequence % 2 != 0 || record.frameNumber.load(std::memory_order_relaxed) != frameNumber) {
+        return false;
+    }
+
+    Frame frame;
+    frame.desiredPresentTime = record.desiredPresentTime.load(std::memory_order_relaxed);
+    frame.frameReadyTime = record.frameReadyTime.load(std::memory_order_relaxed);
+    frame.actualPresentTime = record.actualPresentTime.load(std::memory_order_relaxed);
+    const auto readyFence = std::atomic_load(&record.frameReadyFence);
+    const auto presentFence = std::atomic_load(&record.actualPresentFence);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record.sequence.load(std::memory_order_relaxed) != sequence) {
+        return false;
+    }
+
+    // The fences of a published frame are never replaced, so they can be
+    // resolved outside of the sequence.
+    if (readyFence != nullptr) {
+        frame.frameReadyTime = readyFence->getSignalTime();
+    }
+    if (presentFence != nullptr) {
+        frame.actualPresentTime = presentFence->getSignalTime();
+        frame.hasPresentFence = true;
+    }
+    *outFrame = frame;
+    return true;
 }
 
-void FrameTracker::processFencesLocked() const {
-    FrameRecord* records = const_cast<FrameRecord*>(mFrameRecords);
-    int& numFences = const_cast<int&>(mNumFences);
-
-    for (int i = 1; i < NUM_FRAME_RECORDS && numFences > 0; i++) {
-        size_t idx = (mOffset+NUM_FRAME_RECORDS-i) % NUM_FRAME_RECORDS;
-        bool updated = false;
-
-        const std::shared_ptr<FenceTime>& rfence = records[idx].frameReadyFence;
-        if (rfence != nullptr) {
-            records[idx].frameReadyTime = rfence->getSignalTime();
-            if (records[idx].frameReadyTime < INT64_MAX) {
-                records[idx].frameReadyFence = nullptr;
-                numFences--;
-                updated = true;
-            }
+uint64_t FrameTracker::getPublishedFrameCount() const {
+    return mFrameNumber.load(std::memory_order_acquire);
+}
+
+void FrameTracker::updateStatsLocked() const {
+    const uint64_t frameCount = getPublishedFrameCount();
+    const uint64_t oldestFrame =
+            frameCount > NUM_FRAME_RECORDS - 1 ? frameCount - (NUM_FRAME_RECORDS - 1) : 0;
+
+    uint64_t frameNumber = std::max(mNextStatsFrame, oldestFrame + 1);
+    for (; frameNumber < frameCount; frameNumber++) {
+        Frame prevFrame;
+        Frame frame;
+        if (!readFrame(frameNumber - 1, &prevFrame) || !readFrame(frameNumber, &frame)) {
+            continue;
         }
 
-        const std::shared_ptr<FenceTime>& pfence =
-                records[idx].actualPresentFence;
-        if (pfence != nullptr) {
-            records[idx].actualPresentTime = pfence->getSignalTime();
-            if (records[idx].actualPresentTime < INT64_MAX) {
-                records[idx].actualPresentFence = nullptr;
-                numFences--;
-                updated = true;
-            }
+        // Frames whose present times are both timestamps are counted by the
+        // writer.
+        if (!prevFrame.hasPresentFence && !frame.hasPresentFence) {
+            continue;
         }
 
-        if (updated) {
-            updateStatsLocked(idx);
+        // Stop at the first present fence which has not signaled yet, so that
+        // the frame is counted once it does.
+        if ((prevFrame.hasPresentFence && prevFrame.actualPresentTime == INT64_MAX) ||
+            (frame.hasPresentFence && frame.actualPresentTime == INT64_MAX)) {
+            break;
         }
-    }
-}
 
-void FrameTracker::updateStatsLocked(size_t newFrameIdx) const {
-    int* numFrames = const_cast<int*>(mNumFrames);
-
-    if (mDisplayPeriod > 0 && isFrameValidLocked(newFrameIdx)) {
-        size_t prevFrameIdx = (newFrameIdx+NUM_FRAME_RECORDS-1) %
-                NUM_FRAME_RECORDS;
-
-        if (isFrameValidLocked(prevFrameIdx)) {
-            nsecs_t newPresentTime =
-                    mFrameRecords[newFrameIdx].actualPresentTime;
-            nsecs_t prevPresentTime =
-                    mFrameRecords[prevFrameIdx].actualPresentTime;
-
-            nsecs_t duration = newPresentTime - prevPresentTime;
-            int numPeriods = int((duration + mDisplayPeriod/2) /
-                    mDisplayPeriod);
-
-            for (int i = 0; i < NUM_FRAME_BUCKETS-1; i++) {
-                int nextBucket = 1 << (i+1);
-                if (numPeriods < nextBucket) {
-                    numFrames[i]++;
-                    return;
-                }
-            }
-
-            // The last duration bucket is a catch-all.
-            numFrames[NUM_FRAME_BUCKETS-1]++;
+        if (isPresentTimeValid(prevFrame.actualPresentTime) &&
+            isPresentTimeValid(frame.actualPresentTime)) {
+            countFrame(prevFrame.actualPresentTime, frame.actualPresentTime);
         }
     }
+    mNextStatsFrame = frameNumber;
 }
 
-void FrameTracker::resetFrameCountersLocked() {
-    for (int i = 0; i < NUM_FRAME_BUCKETS; i++) {
-        mNumFrames[i] = 0;
+void FrameTracker::countFrame(nsecs_t prevPresentTime, nsecs_t presentTime) const {
+    const nsecs_t displayPeriod = mDisplayPeriod.load(std::memory_order_relaxed);
+    if (displayPeriod <= 0) {
+        return;
     }
-}
 
-void FrameTracker::logStatsLocked(const std::string_view& name) const {
-    for (int i = 0; i < NUM_FRAME_BUCKETS; i++) {
-        if (mNumFrames[i] > 0) {
-            EventLog::logFrameDurations(name, mNumFrames, NUM_FRAME_BUCKETS);
+    nsecs_t duration = presentTime - prevPresentTime;
+    int numPeriods = int((duration + displayPeriod/2) / displayPeriod);
+
+    for (int i = 0; i < NUM_FRAME_BUCKETS-1; i++) {
+        int nextBucket = 1 << (i+1);
+        if (numPeriods < nextBucket) {
+            mNumFrames[i].fetch_add(1, std::memory_order_relaxed);
             return;
         }
     }
+
+    // The last duration bucket is a catch-all.
+    mNumFrames[NUM_FRAME_BUCKETS-1].fetch_add(1, std::memory_order_relaxed);
 }
 
-bool FrameTracker::isFrameValidLocked(size_t idx) const {
-    return mFrameRecords[idx].actualPresentTime > 0 &&
-            mFrameRecords[idx].actualPresentTime < INT64_MAX;
+bool FrameTracker::isPresentTimeValid(nsecs_t presentTime) {
+    return presentTime > 0 && presentTime < INT64_MAX;
 }
 
 void FrameTracker::dumpStats(std::string& result) const {
-    Mutex::Autolock lock(mMutex);
-    processFencesLocked();
+    {
+        Mutex::Autolock lock(mReaderMutex);
+        updateStatsLocked();
+    }
 
-    const size_t o = mOffset;
-    for (size_t i = 1; i < NUM_FRAME_RECORDS; i++) {
-        const size_t index = (o+i) % NUM_FRAME_RECORDS;
+    const uint64_t frameCount = getPublishedFrameCount();
+    for (uint64_t i = NUM_FRAME_RECORDS - 1; i > 0; i--) {
+        // Frames which were cleared, or not recorded yet, are dumped as zeros.
+        Frame frame;
+        if (frameCount >= i) {
+            readFrame(frameCount - i, &frame);
+        }
         base::StringAppendF(&result, "%" PRId64 "\t%" PRId64 "\t%" PRId64 "\n",
-                            mFrameRecords[index].desiredPresentTime,
-                            mFrameRecords[index].actualPresentTime,
-                            mFrameRecords[index].frameReadyTime);
+                            frame.desiredPresentTime, frame.actualPresentTime,
+                            frame.frameReadyTime);
     }
     result.append("\n");
 }
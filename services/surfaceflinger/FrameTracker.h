@@ -21,19 +21,27 @@
 #include <utils/RefBase.h>
 #include <utils/Timers.h>
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string_view>
 
 namespace android {
 
 // FrameTracker tracks information about the most recently rendered frames. It
-// uses a circular buffer of frame records, and is *NOT* thread-safe -
-// mutexing must be done at a higher level if multi-threaded access is
-// possible.
+// uses a circular buffer of frame records.
+//
+// The frame records are written by a single thread, i.e. the setters and
+// advanceFrame must not be called concurrently, and are read without locking
+// by any number of threads. Each record is guarded by a sequence counter, so
+// that a reader discards a record that the writer overwrote while it was being
+// read, instead of blocking the writer.
 //
 // Some of the time values tracked may be set either as a specific timestamp
 // or a fence.  When a non-nullptr fence is set for a given time value, the
-// signal time of that fence is used instead of the timestamp.
+// signal time of that fence is used instead of the timestamp. Fences are only
+// resolved by the readers, so that recording a frame never polls a fence.
 class FrameTracker {
 
 public:
@@ -70,13 +78,14 @@ public:
 
     // setDisplayRefreshPeriod sets the display refresh period in nanoseconds.
     // This is used to compute frame presentation duration statistics relative
-    // to this period.
+    // to this period. It may be called from any thread.
     void setDisplayRefreshPeriod(nsecs_t displayPeriod);
 
     // advanceFrame advances the frame tracker to the next frame.
     void advanceFrame();
 
-    // clearStats clears the tracked frame stats.
+    // clearStats clears the tracked frame stats. It may be called from any
+    // thread, and only hides the frames recorded so far from the readers.
     void clearStats();
 
     // getStats gets the tracked frame stats.
@@ -90,74 +99,92 @@ public:
     void dumpStats(std::string& result) const;
 
     //get previous frame gfx info.
-    nsecs_t getPreviousGfxInfo();
+    nsecs_t getPreviousGfxInfo() const;
 
 private:
     struct FrameRecord {
-        FrameRecord() :
-            desiredPresentTime(0),
-            frameReadyTime(0),
-            actualPresentTime(0) {}
-        nsecs_t desiredPresentTime;
-        nsecs_t frameReadyTime;
-        nsecs_t actualPresentTime;
+        // sequence is odd while the record is being written, and changes
+        // every time the record is reused for a new frame.
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<uint64_t> frameNumber{0};
+        std::atomic<nsecs_t> desiredPresentTime{0};
+        std::atomic<nsecs_t> frameReadyTime{0};
+        std::atomic<nsecs_t> actualPresentTime{0};
+        // The fences are accessed with std::atomic_load and std::atomic_store.
         std::shared_ptr<FenceTime> frameReadyFence;
         std::shared_ptr<FenceTime> actualPresentFence;
     };
 
-    // processFences iterates over all the frame records that have a fence set
-    // and replaces that fence with a timestamp if the fence has signaled.  If
-    // the fence is not signaled the record's displayTime is set to INT64_MAX.
-    //
-    // This method is const because although it modifies the frame records it
-    // does so in such a way that the information represented should not
-    // change.  This allows it to be called from the dump method.
-    void processFencesLocked() const;
+    // A copy of a frame record, with its fences resolved.
+    struct Frame {
+        nsecs_t desiredPresentTime = 0;
+        nsecs_t frameReadyTime = 0;
+        nsecs_t actualPresentTime = 0;
+        bool hasPresentFence = false;
+    };
+
+    // readFrame copies the record of the given frame, and resolves the times
+    // of its signaled fences. The time of an unsignaled fence is INT64_MAX.
+    // Returns false if the frame was cleared, or if its record is being
+    // overwritten.
+    bool readFrame(uint64_t frameNumber, Frame* outFrame) const;
 
-    // updateStatsLocked updates the running statistics that are gathered
-    // about the frame times.
-    void updateStatsLocked(size_t newFrameIdx) const;
+    // getPublishedFrameCount returns the number of frames advanced past, i.e.
+    // the frame number of the current frame.
+    uint64_t getPublishedFrameCount() const;
 
-    // resetFrameCounteresLocked sets all elements of the mNumFrames array to
-    // 0.
-    void resetFrameCountersLocked();
+    // updateStatsLocked updates the running statistics with the frames whose
+    // present time has become known since the last update. Frames whose
+    // present time is a timestamp, as well as the previous frame's, are
+    // counted by the writer in advanceFrame instead.
+    void updateStatsLocked() const;
 
-    // logStatsLocked dumps the current statistics to the binary event log.
-    void logStatsLocked(const std::string_view& name) const;
+    // countFrame adds the duration between the present times of two
+    // consecutive frames to the running statistics.
+    void countFrame(nsecs_t prevPresentTime, nsecs_t presentTime) const;
 
-    // isFrameValidLocked returns true if the data for the given frame index is
-    // valid and has all arrived (i.e. there are no oustanding fences).
-    bool isFrameValidLocked(size_t idx) const;
+    // isPresentTimeValid returns true if the present time of a frame has
+    // arrived (i.e. there is no outstanding fence).
+    static bool isPresentTimeValid(nsecs_t presentTime);
 
     // mFrameRecords is the circular buffer storing the tracked data for each
     // frame.
     FrameRecord mFrameRecords[NUM_FRAME_RECORDS];
 
-    // mOffset is the offset into mFrameRecords of the current frame.
-    size_t mOffset;
+    // mFrameNumber is the number of the current frame, whose record is
+    // mFrameRecords[mFrameNumber % NUM_FRAME_RECORDS]. The frames before it
+    // are published to the readers.
+    std::atomic<uint64_t> mFrameNumber{0};
 
-    // mNumFences is the total number of fences set in the frame records.  It
-    // is incremented each time a fence is added and decremented each time a
-    // signaled fence is removed in processFences or if advanceFrame clobbers
-    // a fence.
-    //
-    // The number of fences is tracked so that the run time of processFences
-    // doesn't grow with NUM_FRAME_RECORDS.
-    int mNumFences;
+    // mClearedFrameNumber is the number of the first frame that was not
+    // cleared by clearStats.
+    std::atomic<uint64_t> mClearedFrameNumber{0};
+
+    // mHasPresentFence is whether a present fence was set for the current
+    // frame, and mPrevPresentTime is the present time of the previous frame
+    // if it was set as a timestamp, or INT64_MAX otherwise. They are only
+    // used by the writer.
+    bool mHasPresentFence = false;
+    nsecs_t mPrevPresentTime = INT64_MAX;
 
     // mNumFrames keeps a count of the number of frames with a duration in a
     // particular range of vsync periods.  Element n of the array stores the
     // number of frames with duration in the half-inclusive range
     // [2^n, 2^(n+1)).  The last element of the array contains the count for
     // all frames with duration greater than 2^(NUM_FRAME_BUCKETS-1).
-    int32_t mNumFrames[NUM_FRAME_BUCKETS];
+    mutable std::atomic<int32_t> mNumFrames[NUM_FRAME_BUCKETS]{};
 
     // mDisplayPeriod is the display refresh period of the display for which
     // this FrameTracker is gathering information.
-    nsecs_t mDisplayPeriod;
+    std::atomic<nsecs_t> mDisplayPeriod{0};
+
+    // mReaderMutex serializes the readers which resolve fences into the
+    // running statistics. The writer never takes it.
+    mutable Mutex mReaderMutex;
 
-    // mMutex is used to protect access to all member variables.
-    mutable Mutex mMutex;
+    // mNextStatsFrame is the number of the first frame which the readers have
+    // not considered for the running statistics yet.
+    mutable uint64_t mNextStatsFrame = 1;
 };
 
 } // namespace android
@@ -211,6 +211,30 @@ LayerCreationArgs::LayerCreationArgs(SurfaceFlinger* flinger, sp<Client> client,
  */
 void Layer::onLayerDisplayed(const sp<Fence>& /*releaseFence*/) {}
 
+void Layer::addPendingCaptureFence(std::shared_future<sp<Fence>> fence) {
+    mPendingCaptureFences.push_back(std::move(fence));
+}
+
+bool Layer::onCaptureDrawn() {
+    releaseDrawnCaptureFences();
+    return false;
+}
+
+bool Layer::releaseDrawnCaptureFences() {
+    auto it = mPendingCaptureFences.begin();
+    while (it != mPendingCaptureFences.end()) {
+        if (it->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        if (const sp<Fence>& fence = it->get(); fence->isValid()) {
+            onLayerDisplayed(fence);
+        }
+        it = mPendingCaptureFences.erase(it);
+    }
+    return !mPendingCaptureFences.empty();
+}
+
 void Layer::removeRelativeZ(const std::vector<Layer*>& layersInTree) {
     if (mDrawingState.zOrderRelativeOf == nullptr) {
         return;
@@ -2152,10 +2176,12 @@ void Layer::writeToProtoCommonState(LayerProto* layerInfo, LayerVector::StateSet
         layerInfo->set_name(getName().c_str());
         layerInfo->set_type(getType());
 
+        layerInfo->mutable_children()->Reserve(static_cast<int>(children.size()));
         for (const auto& child : children) {
             layerInfo->add_children(child->sequence);
         }
 
+        layerInfo->mutable_relatives()->Reserve(static_cast<int>(state.zOrderRelatives.size()));
         for (const wp<Layer>& weakRelative : state.zOrderRelatives) {
             sp<Layer> strongRelative = weakRelative.promote();
             if (strongRelative != nullptr) {
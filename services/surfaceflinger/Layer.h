@@ -40,6 +40,7 @@
 
 #include <chrono>
 #include <cstdint>
+#include <future>
 #include <list>
 #include <optional>
 #include <vector>
@@ -638,6 +639,13 @@ public:
     void onLayerDisplayed(const sp<Fence>& releaseFence) override;
     const char* getDebugName() const override;
 
+    // Screen captures drawn off the main thread sample the current buffer, which must not be
+    // released before they are drawn, so their release fences are held on to until then.
+    void addPendingCaptureFence(std::shared_future<sp<Fence>>);
+    // Called on the main thread once a screen capture drawn off it is drawn. Returns whether a
+    // buffer was held back until then, so that a frame must be scheduled to latch it.
+    virtual bool onCaptureDrawn();
+
     bool setShadowRadius(float shadowRadius);
 
     // Before color management is introduced, contents on Android have to be
@@ -915,6 +923,7 @@ protected:
     // For unit tests
     friend class TestableSurfaceFlinger;
     friend class FpsReporterTest;
+    friend class LayerCaptureReleaseTest;
     friend class RefreshRateSelectionTest;
     friend class SetFrameRateTest;
     friend class TransactionFrameTracerTest;
@@ -1049,6 +1058,13 @@ protected:
 
     mutable bool mDrawingStateModified = false;
 
+    // Passes the release fences of the pending screen captures which are drawn to
+    // onLayerDisplayed, and returns whether any of them are still being drawn.
+    bool releaseDrawnCaptureFences();
+
+    // Release fences of the screen captures which are being drawn off the main thread.
+    std::vector<std::shared_future<sp<Fence>>> mPendingCaptureFences;
+
 private:
     virtual void setTransformHint(ui::Transform::RotationFlags) {}
 
@@ -57,9 +57,9 @@ void LayerProtoHelper::writeToProto(const Region& region,
     Region::const_iterator const tail = region.end();
     // Use a lambda do avoid writing the object header when the object is empty
     RegionProto* regionProto = getRegionProto();
+    regionProto->mutable_rect()->Reserve(static_cast<int>(tail - head));
     while (head != tail) {
-        std::function<RectProto*()> getProtoRect = [&]() { return regionProto->add_rect(); };
-        writeToProto(*head, getProtoRect);
+        writeToProto(*head, [&]() { return regionProto->add_rect(); });
         head++;
     }
 }
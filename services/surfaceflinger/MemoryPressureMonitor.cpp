@@ -0,0 +1,99 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "MemoryPressureMonitor.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <log/log.h>
+#include <psi/psi.h>
+#include <utils/Trace.h>
+
+namespace android {
+
+std::unique_ptr<MemoryPressureMonitor> MemoryPressureMonitor::create(
+        std::chrono::microseconds stall, std::chrono::microseconds window, Callback&& callback) {
+    base::unique_fd psiFd(init_psi_monitor(PSI_SOME, static_cast<int>(stall.count()),
+                                           static_cast<int>(window.count())));
+    if (psiFd.get() < 0) {
+        ALOGW("Memory pressure is not monitored, PSI is unavailable");
+        return nullptr;
+    }
+
+    base::unique_fd stopFd(eventfd(0, EFD_CLOEXEC));
+    if (stopFd.get() < 0) {
+        ALOGE("Failed to create eventfd: %s", strerror(errno));
+        return nullptr;
+    }
+
+    return std::make_unique<MemoryPressureMonitor>(std::move(psiFd), std::move(stopFd),
+                                                   std::move(callback));
+}
+
+MemoryPressureMonitor::MemoryPressureMonitor(base::unique_fd psiFd, base::unique_fd stopFd,
+                                             Callback&& callback)
+      : mPsiFd(std::move(psiFd)), mStopFd(std::move(stopFd)), mCallback(std::move(callback)) {
+    mThread = std::thread([this]() { threadMain(); });
+    pthread_setname_np(mThread.native_handle(), "MemoryPressure");
+}
+
+MemoryPressureMonitor::~MemoryPressureMonitor() {
+    const uint64_t stop = 1;
+    if (write(mStopFd.get(), &stop, sizeof(stop)) != sizeof(stop)) {
+        ALOGE("Failed to stop the memory pressure monitor: %s", strerror(errno));
+    }
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void MemoryPressureMonitor::threadMain() {
+    pollfd fds[] = {
+            {.fd = mPsiFd.get(), .events = POLLPRI},
+            {.fd = mStopFd.get(), .events = POLLIN},
+    };
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            ALOGE("Stopped monitoring memory pressure: %s", strerror(errno));
+            return;
+        }
+
+        if (fds[1].revents) {
+            return;
+        }
+        if (fds[0].revents & POLLERR) {
+            // the PSI trigger is gone, e.g. the cgroup was removed
+            ALOGE("Stopped monitoring memory pressure: PSI trigger failed");
+            return;
+        }
+        if (fds[0].revents & POLLPRI) {
+            ATRACE_NAME("MemoryPressureMonitor::callback");
+            mCallback();
+        }
+    }
+}
+
+} // namespace android
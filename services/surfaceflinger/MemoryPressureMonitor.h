@@ -0,0 +1,60 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace android {
+
+// Calls back when the kernel reports memory pressure through PSI (/proc/pressure/memory), so that
+// SurfaceFlinger can drop the memory it only holds on to as a cache, such as the textures pooled
+// for cached sets. The callback runs on the monitor's own thread, at most once per window.
+class MemoryPressureMonitor {
+public:
+    using Callback = std::function<void()>;
+
+    // Reports pressure once tasks have been stalled on memory for more than 'stall' within
+    // 'window'. Returns nullptr if PSI is unavailable.
+    static std::unique_ptr<MemoryPressureMonitor> create(std::chrono::microseconds stall,
+                                                         std::chrono::microseconds window,
+                                                         Callback&&);
+
+    ~MemoryPressureMonitor();
+
+    MemoryPressureMonitor(const MemoryPressureMonitor&) = delete;
+    MemoryPressureMonitor& operator=(const MemoryPressureMonitor&) = delete;
+
+    // Use create().
+    MemoryPressureMonitor(base::unique_fd psiFd, base::unique_fd stopFd, Callback&&);
+
+private:
+    void threadMain();
+
+    const base::unique_fd mPsiFd;
+    // Written to stop the thread.
+    const base::unique_fd mStopFd;
+    const Callback mCallback;
+
+    std::thread mThread;
+};
+
+} // namespace android
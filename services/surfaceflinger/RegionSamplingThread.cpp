@@ -104,7 +104,9 @@ RegionSamplingThread::RegionSamplingThread(SurfaceFlinger& flinger, const Timing
                 "RegSampIdle",
                 std::chrono::duration_cast<std::chrono::milliseconds>(
                         mTunables.mSamplingTimerTimeout),
-                [] {}, [this] { checkForStaleLuma(); }),
+                [] {}, [this] { checkForStaleLuma(); }, std::make_unique<scheduler::SteadyClock>(),
+                // checkForStaleLuma only posts to the main thread, so the timer can share a thread
+                scheduler::OneShotTimerService::getInstance()),
         mLastSampleTime(0ns) {
     mThread = std::thread([this]() { threadMain(); });
     pthread_setname_np(mThread.native_handle(), "RegionSampling");
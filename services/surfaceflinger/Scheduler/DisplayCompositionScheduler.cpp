@@ -0,0 +1,83 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "DisplayCompositionScheduler"
+
+#include "DisplayCompositionScheduler.h"
+
+#include <android-base/stringprintf.h>
+
+#include <cinttypes>
+
+namespace android::scheduler {
+
+bool DisplayCompositionScheduler::isDue(PhysicalDisplayId displayId, nsecs_t vsyncPeriod,
+                                        nsecs_t framePeriod, nsecs_t expectedPresentTime) const {
+    const auto it = mDisplays.find(displayId);
+    if (it == mDisplays.end() || vsyncPeriod <= framePeriod) {
+        return true;
+    }
+
+    // Allow half a frame of slack, so that jitter in the predicted present times does not push
+    // the composition of the display to the frame after its vsync.
+    return expectedPresentTime + framePeriod / 2 >= it->second.nextPresentTime;
+}
+
+void DisplayCompositionScheduler::onComposed(PhysicalDisplayId displayId, nsecs_t vsyncPeriod,
+                                             nsecs_t expectedPresentTime) {
+    DisplayState& state = mDisplays[displayId];
+    if (expectedPresentTime >= state.nextPresentTime + vsyncPeriod / 2) {
+        // The display was idle, or its vsync period changed, so follow the current frame.
+        state.nextPresentTime = expectedPresentTime + vsyncPeriod;
+    } else if (expectedPresentTime + vsyncPeriod / 2 >= state.nextPresentTime) {
+        // Keep to the vsync of the display, instead of to the frame nearest to it, so that the
+        // error does not accumulate when the refresh rates are not multiples of each other.
+        state.nextPresentTime += vsyncPeriod;
+    }
+    state.composedCount++;
+}
+
+void DisplayCompositionScheduler::onSkipped(PhysicalDisplayId displayId) {
+    mDisplays[displayId].skippedCount++;
+}
+
+void DisplayCompositionScheduler::onDisplayRemoved(PhysicalDisplayId displayId) {
+    mDisplays.erase(displayId);
+}
+
+size_t DisplayCompositionScheduler::getComposedCount(PhysicalDisplayId displayId) const {
+    const auto it = mDisplays.find(displayId);
+    return it == mDisplays.end() ? 0 : it->second.composedCount;
+}
+
+size_t DisplayCompositionScheduler::getSkippedCount(PhysicalDisplayId displayId) const {
+    const auto it = mDisplays.find(displayId);
+    return it == mDisplays.end() ? 0 : it->second.skippedCount;
+}
+
+void DisplayCompositionScheduler::dump(std::string& result) const {
+    result.append("Display composition scheduling:\n");
+    for (const auto& [displayId, state] : mDisplays) {
+        base::StringAppendF(&result,
+                            "  Display %s: composed %zu frames, skipped %zu frames, next present "
+                            "at %" PRId64 "\n",
+                            to_string(displayId).c_str(), state.composedCount, state.skippedCount,
+                            state.nextPresentTime);
+    }
+}
+
+} // namespace android::scheduler
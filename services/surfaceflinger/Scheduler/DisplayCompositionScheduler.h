@@ -0,0 +1,67 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+#include <ui/DisplayId.h>
+#include <utils/Timers.h>
+
+namespace android::scheduler {
+
+// Schedules the composition of each display at its own refresh rate.
+//
+// The frames of SurfaceFlinger follow the vsync of the primary display, so a display whose refresh
+// rate is lower, e.g. a 60 Hz external display next to a 120 Hz internal panel, would otherwise be
+// composed on every frame, only for its presents to queue up behind its own vsync. Instead, such a
+// display is composed on the frames which present on one of its vsyncs, and skipped in between.
+// Transactions are still committed on every frame, for all displays.
+class DisplayCompositionScheduler {
+public:
+    // Returns whether the display should be composed on the frame which presents at
+    // expectedPresentTime, given the vsync period of the display and the period of the frames.
+    bool isDue(PhysicalDisplayId, nsecs_t vsyncPeriod, nsecs_t framePeriod,
+               nsecs_t expectedPresentTime) const;
+
+    // Records that the display was composed on the frame which presents at expectedPresentTime,
+    // so that it is next due on its following vsync.
+    void onComposed(PhysicalDisplayId, nsecs_t vsyncPeriod, nsecs_t expectedPresentTime);
+
+    // Records that the display was skipped on a frame, since it was not due.
+    void onSkipped(PhysicalDisplayId);
+
+    void onDisplayRemoved(PhysicalDisplayId);
+
+    size_t getComposedCount(PhysicalDisplayId) const;
+    size_t getSkippedCount(PhysicalDisplayId) const;
+
+    void dump(std::string& result) const;
+
+private:
+    struct DisplayState {
+        // Earliest present time at which the display is due again.
+        nsecs_t nextPresentTime = 0;
+        size_t composedCount = 0;
+        size_t skippedCount = 0;
+    };
+
+    std::unordered_map<PhysicalDisplayId, DisplayState> mDisplays;
+};
+
+} // namespace android::scheduler
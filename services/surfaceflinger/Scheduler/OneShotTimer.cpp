@@ -16,33 +16,17 @@
 
 #include "OneShotTimer.h"
 #include <utils/Log.h>
-#include <utils/Timers.h>
-#include <chrono>
 #include <sstream>
-#include <thread>
-
-namespace {
-using namespace std::chrono_literals;
-
-constexpr int64_t kNsToSeconds = std::chrono::duration_cast<std::chrono::nanoseconds>(1s).count();
-
-// The syscall interface uses a pair of integers for the timestamp. The first
-// (tv_sec) is the whole count of seconds. The second (tv_nsec) is the
-// nanosecond part of the count. This function takes care of translation.
-void calculateTimeoutTime(std::chrono::nanoseconds timestamp, timespec* spec) {
-    const nsecs_t timeout = systemTime(CLOCK_MONOTONIC) + timestamp.count();
-    spec->tv_sec = static_cast<__kernel_time_t>(timeout / kNsToSeconds);
-    spec->tv_nsec = timeout % kNsToSeconds;
-}
-} // namespace
 
 namespace android {
 namespace scheduler {
 
 OneShotTimer::OneShotTimer(std::string name, const Interval& interval,
                            const ResetCallback& resetCallback,
-                           const TimeoutCallback& timeoutCallback, std::unique_ptr<Clock> clock)
+                           const TimeoutCallback& timeoutCallback, std::unique_ptr<Clock> clock,
+                           std::shared_ptr<OneShotTimerService> service)
       : mClock(std::move(clock)),
+        mService(service ? std::move(service) : std::make_shared<OneShotTimerService>(name)),
         mName(std::move(name)),
         mInterval(interval),
         mResetCallback(resetCallback),
@@ -55,112 +39,22 @@ OneShotTimer::~OneShotTimer() {
 }
 
 void OneShotTimer::start() {
-    int result = sem_init(&mSemaphore, 0, 0);
-    LOG_ALWAYS_FATAL_IF(result, "sem_init failed");
-
-    if (!mThread.joinable()) {
-        // Only create thread if it has not been created.
-        mThread = std::thread(&OneShotTimer::loop, this);
+    if (mId == 0) {
+        // Only add the timer if it has not been added.
+        mId = mService->add(mName, mInterval, *mClock, mResetCallback, mTimeoutCallback);
     }
 }
 
 void OneShotTimer::stop() {
-    mStopTriggered = true;
-    int result = sem_post(&mSemaphore);
-    LOG_ALWAYS_FATAL_IF(result, "sem_post failed");
-
-    if (mThread.joinable()) {
-        mThread.join();
-        result = sem_destroy(&mSemaphore);
-        LOG_ALWAYS_FATAL_IF(result, "sem_destroy failed");
-    }
-}
-
-void OneShotTimer::loop() {
-    if (pthread_setname_np(pthread_self(), mName.c_str())) {
-        ALOGW("Failed to set thread name on dispatch thread");
-    }
-
-    TimerState state = TimerState::RESET;
-    while (true) {
-        bool triggerReset = false;
-        bool triggerTimeout = false;
-
-        state = checkForResetAndStop(state);
-        if (state == TimerState::STOPPED) {
-            break;
-        }
-
-        if (state == TimerState::IDLE) {
-            int result = sem_wait(&mSemaphore);
-            if (result && errno != EINTR) {
-                std::stringstream ss;
-                ss << "sem_wait failed (" << errno << ")";
-                LOG_ALWAYS_FATAL("%s", ss.str().c_str());
-            }
-            continue;
-        }
-
-        if (state == TimerState::RESET) {
-            triggerReset = true;
-        }
-
-        if (triggerReset && mResetCallback) {
-            mResetCallback();
-        }
-
-        state = checkForResetAndStop(state);
-        if (state == TimerState::STOPPED) {
-            break;
-        }
-
-        auto triggerTime = mClock->now() + mInterval;
-        state = TimerState::WAITING;
-        while (state == TimerState::WAITING) {
-            constexpr auto zero = std::chrono::steady_clock::duration::zero();
-            // Wait for mInterval time for semaphore signal.
-            struct timespec ts;
-            calculateTimeoutTime(std::chrono::nanoseconds(mInterval), &ts);
-            int result = sem_clockwait(&mSemaphore, CLOCK_MONOTONIC, &ts);
-            if (result && errno != ETIMEDOUT && errno != EINTR) {
-                std::stringstream ss;
-                ss << "sem_clockwait failed (" << errno << ")";
-                LOG_ALWAYS_FATAL("%s", ss.str().c_str());
-            }
-
-            state = checkForResetAndStop(state);
-            if (state == TimerState::RESET) {
-                triggerTime = mClock->now() + mInterval;
-                state = TimerState::WAITING;
-            } else if (state == TimerState::WAITING && (triggerTime - mClock->now()) <= zero) {
-                triggerTimeout = true;
-                state = TimerState::IDLE;
-            }
-        }
-
-        if (triggerTimeout && mTimeoutCallback) {
-            mTimeoutCallback();
-        }
-    }
-}
-
-OneShotTimer::TimerState OneShotTimer::checkForResetAndStop(TimerState state) {
-    // Stop takes precedence of the reset.
-    if (mStopTriggered.exchange(false)) {
-        return TimerState::STOPPED;
-    }
-    // If the state was stopped, the thread was joined, and we cannot reset
-    // the timer anymore.
-    if (state != TimerState::STOPPED && mResetTriggered.exchange(false)) {
-        return TimerState::RESET;
+    if (const auto id = mId.exchange(0)) {
+        mService->remove(id);
     }
-    return state;
 }
 
 void OneShotTimer::reset() {
-    mResetTriggered = true;
-    int result = sem_post(&mSemaphore);
-    LOG_ALWAYS_FATAL_IF(result, "sem_post failed");
+    if (const auto id = mId.load()) {
+        mService->reset(id);
+    }
 }
 
 std::string OneShotTimer::dump() const {
@@ -16,20 +16,24 @@
 
 #pragma once
 
-#include <semaphore.h>
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
-#include <thread>
-#include "../Clock.h"
+#include <functional>
+#include <memory>
+#include <string>
 
-#include <android-base/thread_annotations.h>
+#include "../Clock.h"
+#include "OneShotTimerService.h"
 
 namespace android {
 namespace scheduler {
 
 /*
  * Class that sets off a timer for a given interval, and fires a callback when the
- * interval expires.
+ * interval expires. The timer is run by a OneShotTimerService, so resetting a timer that hasn't
+ * expired is cheap enough to do on every input event or frame. Each timer has a service thread of
+ * its own, since callbacks may block, unless it shares one, e.g. OneShotTimerService::getInstance()
+ * for timers whose callbacks do not block.
  */
 class OneShotTimer {
 public:
@@ -39,7 +43,8 @@ public:
 
     OneShotTimer(std::string name, const Interval& interval, const ResetCallback& resetCallback,
                  const TimeoutCallback& timeoutCallback,
-                 std::unique_ptr<Clock> clock = std::make_unique<SteadyClock>());
+                 std::unique_ptr<Clock> clock = std::make_unique<SteadyClock>(),
+                 std::shared_ptr<OneShotTimerService> service = nullptr);
     ~OneShotTimer();
 
     // Initializes and turns on the idle timer.
@@ -52,39 +57,11 @@ public:
     std::string dump() const;
 
 private:
-    // Enum to track in what state is the timer.
-    enum class TimerState {
-        // The internal timer thread has been destroyed, and no state is
-        // tracked.
-        // Possible state transitions: RESET
-        STOPPED = 0,
-        // An external thread has just reset this timer.
-        // If there is a reset callback, then that callback is fired.
-        // Possible state transitions: STOPPED, WAITING
-        RESET = 1,
-        // This timer is waiting for the timeout interval to expire.
-        // Possible state transaitions: STOPPED, RESET, IDLE
-        WAITING = 2,
-        // The timeout interval has expired, so we are sleeping now.
-        // Possible state transaitions: STOPPED, RESET
-        IDLE = 3
-    };
-
-    // Function that loops until the condition for stopping is met.
-    void loop();
-
-    // Checks whether mResetTriggered and mStopTriggered were set and updates
-    // mState if so.
-    TimerState checkForResetAndStop(TimerState state);
-
-    // Thread waiting for timer to expire.
-    std::thread mThread;
-
     // Clock object for the timer. Mocked in unit tests.
     std::unique_ptr<Clock> mClock;
 
-    // Semaphore to keep mThread synchronized.
-    sem_t mSemaphore;
+    // Service running the timer, dedicated to it unless injected.
+    const std::shared_ptr<OneShotTimerService> mService;
 
     // Timer's name.
     std::string mName;
@@ -98,11 +75,9 @@ private:
     // Callback that happens when timer expires.
     const TimeoutCallback mTimeoutCallback;
 
-    // After removing lock guarding mState, the state can be now accessed at
-    // any time. Keep a bool if the reset or stop were requested, and occasionally
-    // check in the main loop if they were.
-    std::atomic<bool> mResetTriggered = false;
-    std::atomic<bool> mStopTriggered = false;
+    // The timer in mService while started, or zero. Resets may race with start and stop, in which
+    // case the service ignores the reset of a removed timer.
+    std::atomic<OneShotTimerService::TimerId> mId = 0;
 };
 
 } // namespace scheduler
@@ -0,0 +1,268 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "OneShotTimerService"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "OneShotTimerService.h"
+
+#include <log/log.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utils/Trace.h>
+
+namespace android {
+namespace scheduler {
+
+namespace {
+
+enum DispatchType : uint32_t { TIMER, WAKE, MAX_DISPATCH_TYPE };
+
+constexpr int64_t kNsPerSecond = std::chrono::nanoseconds(std::chrono::seconds(1)).count();
+
+} // namespace
+
+OneShotTimerService::OneShotTimerService(std::string threadName)
+      : mThreadName(std::move(threadName)) {
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    LOG_ALWAYS_FATAL_IF(mTimerFd < 0, "timerfd_create failed: %s", strerror(errno));
+    mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    LOG_ALWAYS_FATAL_IF(mEventFd < 0, "eventfd failed: %s", strerror(errno));
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    LOG_ALWAYS_FATAL_IF(mEpollFd < 0, "epoll_create1 failed: %s", strerror(errno));
+
+    epoll_event timerEvent = {.events = EPOLLIN, .data = {.u32 = DispatchType::TIMER}};
+    LOG_ALWAYS_FATAL_IF(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mTimerFd, &timerEvent),
+                        "Error adding timer fd to epoll: %s", strerror(errno));
+    epoll_event wakeEvent = {.events = EPOLLIN, .data = {.u32 = DispatchType::WAKE}};
+    LOG_ALWAYS_FATAL_IF(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mEventFd, &wakeEvent),
+                        "Error adding event fd to epoll: %s", strerror(errno));
+
+    mThread = std::thread(&OneShotTimerService::threadMain, this);
+}
+
+OneShotTimerService::~OneShotTimerService() {
+    {
+        std::lock_guard lock(mMutex);
+        ALOGW_IF(!mTimers.empty(), "Destroying service with %zu timers", mTimers.size());
+        mStopping = true;
+    }
+    wake();
+    mThread.join();
+
+    close(mEpollFd);
+    close(mEventFd);
+    close(mTimerFd);
+}
+
+std::shared_ptr<OneShotTimerService> OneShotTimerService::getInstance() {
+    static std::mutex sMutex;
+    static std::weak_ptr<OneShotTimerService> sInstance;
+
+    std::lock_guard lock(sMutex);
+    auto service = sInstance.lock();
+    if (!service) {
+        service = std::make_shared<OneShotTimerService>();
+        sInstance = service;
+    }
+    return service;
+}
+
+OneShotTimerService::TimerId OneShotTimerService::add(std::string name, Interval interval,
+                                                      const Clock& clock, Callback resetCallback,
+                                                      Callback timeoutCallback) {
+    TimerId id;
+    {
+        std::lock_guard lock(mMutex);
+        id = mNextId++;
+        mTimers.emplace(id,
+                        Timer{.name = std::move(name),
+                              .interval = interval,
+                              .clock = clock,
+                              .resetCallback = std::move(resetCallback),
+                              .timeoutCallback = std::move(timeoutCallback),
+                              .state = TimerState::Reset,
+                              .deadline = {},
+                              .removed = false});
+    }
+    wake();
+    return id;
+}
+
+void OneShotTimerService::reset(TimerId id) {
+    {
+        std::lock_guard lock(mMutex);
+        const auto it = mTimers.find(id);
+        if (it == mTimers.end()) return;
+
+        Timer& timer = it->second;
+        switch (timer.state) {
+            case TimerState::Reset:
+                return;
+            case TimerState::Waiting:
+                // The common case, which the service thread picks up when the timerfd fires for
+                // the previous deadline.
+                timer.deadline = timer.clock.now() + timer.interval;
+                return;
+            case TimerState::Idle:
+                timer.state = TimerState::Reset;
+                break;
+        }
+    }
+    wake();
+}
+
+void OneShotTimerService::remove(TimerId id) {
+    std::unique_lock lock(mMutex);
+    const auto it = mTimers.find(id);
+    if (it == mTimers.end()) return;
+
+    if (mDispatchingId == id) {
+        if (std::this_thread::get_id() == mThread.get_id()) {
+            // Called from a callback of this timer, so defer until it returns.
+            it->second.removed = true;
+            return;
+        }
+        mCondition.wait(lock, [&]() REQUIRES(mMutex) { return mDispatchingId != id; });
+    }
+
+    mTimers.erase(id);
+}
+
+uint64_t OneShotTimerService::getWakeupCount() const {
+    std::lock_guard lock(mMutex);
+    return mWakeupCount;
+}
+
+void OneShotTimerService::wake() {
+    const uint64_t value = 1;
+    if (write(mEventFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        ALOGE("Failed to wake up service thread: %s", strerror(errno));
+    }
+}
+
+void OneShotTimerService::threadMain() {
+    // Thread names are limited to 15 characters.
+    if (pthread_setname_np(pthread_self(), mThreadName.substr(0, 15).c_str())) {
+        ALOGW("Failed to set thread name on timer thread");
+    }
+
+    while (true) {
+        epoll_event events[DispatchType::MAX_DISPATCH_TYPE];
+        const int nfds = epoll_wait(mEpollFd, events, DispatchType::MAX_DISPATCH_TYPE, -1);
+        if (nfds < 0) {
+            LOG_ALWAYS_FATAL_IF(errno != EINTR, "epoll_wait failed: %s", strerror(errno));
+            continue;
+        }
+
+        for (int i = 0; i < nfds; i++) {
+            uint64_t ignored;
+            const int fd = events[i].data.u32 == DispatchType::TIMER ? mTimerFd : mEventFd;
+            read(fd, &ignored, sizeof(ignored));
+        }
+
+        std::unique_lock lock(mMutex);
+        if (mStopping) return;
+
+        mWakeupCount++;
+        dispatch(lock);
+    }
+}
+
+void OneShotTimerService::dispatch(std::unique_lock<std::mutex>& lock) {
+    while (const auto next = nextCallback()) {
+        const auto [id, callback] = *next;
+        mDispatchingId = id;
+
+        // The timer is not erased while its callback runs, so its members stay valid.
+        const char* name = mTimers.at(id).name.c_str();
+
+        lock.unlock();
+        {
+            ATRACE_NAME(name);
+            (*callback)();
+        }
+        lock.lock();
+
+        mDispatchingId.reset();
+        if (mTimers.at(id).removed) {
+            mTimers.erase(id);
+        }
+        mCondition.notify_all();
+    }
+
+    rearm();
+}
+
+std::optional<std::pair<OneShotTimerService::TimerId, const OneShotTimerService::Callback*>>
+OneShotTimerService::nextCallback() {
+    for (auto& [id, timer] : mTimers) {
+        switch (timer.state) {
+            case TimerState::Reset:
+                timer.state = TimerState::Waiting;
+                timer.deadline = timer.clock.now() + timer.interval;
+                if (timer.resetCallback) {
+                    return std::make_pair(id, &timer.resetCallback);
+                }
+                break;
+            case TimerState::Waiting:
+                if (timer.clock.now() >= timer.deadline) {
+                    timer.state = TimerState::Idle;
+                    if (timer.timeoutCallback) {
+                        return std::make_pair(id, &timer.timeoutCallback);
+                    }
+                }
+                break;
+            case TimerState::Idle:
+                break;
+        }
+    }
+    return std::nullopt;
+}
+
+void OneShotTimerService::rearm() {
+    std::optional<TimePoint> wakeTime;
+    const TimePoint now = std::chrono::steady_clock::now();
+    for (const auto& [id, timer] : mTimers) {
+        if (timer.state != TimerState::Waiting) continue;
+
+        // Timers may use a fake clock, so translate the time left into the steady clock.
+        const TimePoint time = now + (timer.deadline - timer.clock.now());
+        if (!wakeTime || time < *wakeTime) {
+            wakeTime = time;
+        }
+    }
+
+    // Disarm the timerfd if no timer is waiting.
+    const int64_t ns = wakeTime
+            ? std::chrono::duration_cast<std::chrono::nanoseconds>(wakeTime->time_since_epoch())
+                      .count()
+            : 0;
+    const itimerspec spec = {
+            .it_interval = {.tv_sec = 0, .tv_nsec = 0},
+            .it_value = {.tv_sec = static_cast<time_t>(ns / kNsPerSecond),
+                         .tv_nsec = static_cast<long>(ns % kNsPerSecond)},
+    };
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr)) {
+        ALOGW("Failed to set timerfd: %s", strerror(errno));
+    }
+}
+
+} // namespace scheduler
+} // namespace android
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <android-base/thread_annotations.h>
+
+#include "../Clock.h"
+
+namespace android {
+namespace scheduler {
+
+/*
+ * Runs the timers of all OneShotTimers on a single thread, which waits on a timerfd armed for the
+ * earliest deadline.
+ *
+ * Resetting a timer that is already waiting only moves its deadline forward, without rearming the
+ * timerfd or waking up the thread. When the timerfd fires for a deadline that has since moved, the
+ * thread rearms it for the new one. A timer reset at a high rate thus costs at most one wakeup per
+ * interval, rather than one per reset. Only a reset that brings a timer out of idle wakes up the
+ * thread, in order to run the reset callback.
+ *
+ * Callbacks run on the service thread, one at a time, so a callback which blocks delays the
+ * timers of every other callback. Timers whose callbacks may block, e.g. on the main thread of
+ * SurfaceFlinger, need a service of their own.
+ */
+class OneShotTimerService {
+public:
+    using Interval = std::chrono::milliseconds;
+    using Callback = std::function<void()>;
+    using TimerId = uint64_t;
+
+    explicit OneShotTimerService(std::string threadName = "OneShotTimers");
+    ~OneShotTimerService();
+
+    // Returns the service shared by the timers of the process whose callbacks do not block, which
+    // is created on first use and destroyed with the last timer holding a reference to it.
+    static std::shared_ptr<OneShotTimerService> getInstance();
+
+    // Starts a timer, whose reset callback is run as soon as possible, and returns its nonzero ID.
+    // The clock must outlive the timer, i.e. until remove() returns.
+    TimerId add(std::string name, Interval interval, const Clock& clock,
+                Callback resetCallback, Callback timeoutCallback) EXCLUDES(mMutex);
+
+    // Pushes the deadline of the timer back by a full interval. If the timer had expired, then its
+    // reset callback is run. Does nothing if the timer was removed.
+    void reset(TimerId) EXCLUDES(mMutex);
+
+    // Stops the timer. Once this returns, none of its callbacks are running or will run, unless
+    // called from one of the callbacks of the timer itself.
+    void remove(TimerId) EXCLUDES(mMutex);
+
+    // Returns the number of times the service thread woke up, for benchmarks.
+    uint64_t getWakeupCount() const EXCLUDES(mMutex);
+
+private:
+    enum class TimerState {
+        // The reset callback is pending, after which the timer waits for its deadline.
+        Reset,
+        // The timer is waiting for its deadline.
+        Waiting,
+        // The deadline has passed, and the timeout callback was run or is pending.
+        Idle,
+    };
+
+    struct Timer {
+        std::string name;
+        Interval interval;
+        const Clock& clock;
+        Callback resetCallback;
+        Callback timeoutCallback;
+
+        TimerState state = TimerState::Reset;
+        std::chrono::steady_clock::time_point deadline;
+
+        // Set by remove() while one of the callbacks of the timer is running on the service
+        // thread, so that the timer is erased once it returns.
+        bool removed = false;
+    };
+
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    void threadMain();
+    void wake();
+
+    // Updates the timers, and runs their callbacks one at a time with the lock released.
+    void dispatch(std::unique_lock<std::mutex>& lock) REQUIRES(mMutex);
+
+    // Returns the next pending callback and the ID of its timer, and updates the timer state.
+    std::optional<std::pair<TimerId, const Callback*>> nextCallback() REQUIRES(mMutex);
+
+    // Arms the timerfd for the earliest deadline of a waiting timer, in terms of the steady clock.
+    void rearm() REQUIRES(mMutex);
+
+    const std::string mThreadName;
+
+    int mTimerFd = -1;
+    int mEventFd = -1;
+    int mEpollFd = -1;
+
+    std::thread mThread;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+
+    std::unordered_map<TimerId, Timer> mTimers GUARDED_BY(mMutex);
+    TimerId mNextId GUARDED_BY(mMutex) = 1;
+
+    // The timer whose callback is running on the service thread, if any.
+    std::optional<TimerId> mDispatchingId GUARDED_BY(mMutex);
+
+    bool mStopping GUARDED_BY(mMutex) = false;
+    uint64_t mWakeupCount GUARDED_BY(mMutex) = 0;
+};
+
+} // namespace scheduler
+} // namespace android
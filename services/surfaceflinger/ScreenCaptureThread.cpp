@@ -0,0 +1,71 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include "ScreenCaptureThread.h"
+
+#include <pthread.h>
+#include <utils/Trace.h>
+
+namespace android {
+
+ScreenCaptureThread::ScreenCaptureThread() {
+    mThread = std::thread([this]() { threadMain(); });
+    pthread_setname_np(mThread.native_handle(), "ScreenCapture");
+}
+
+ScreenCaptureThread::~ScreenCaptureThread() {
+    {
+        std::lock_guard lock(mMutex);
+        mRunning = false;
+        mCondition.notify_one();
+    }
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void ScreenCaptureThread::post(Work&& work) {
+    std::lock_guard lock(mMutex);
+    mWork.push_back(std::move(work));
+    mCondition.notify_one();
+}
+
+// NO_THREAD_SAFETY_ANALYSIS is because std::unique_lock presently lacks thread safety annotations.
+void ScreenCaptureThread::threadMain() NO_THREAD_SAFETY_ANALYSIS {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [this]() REQUIRES(mMutex) { return !mWork.empty() || !mRunning; });
+        if (mWork.empty()) {
+            return;
+        }
+
+        Work work = std::move(mWork.front());
+        mWork.pop_front();
+        lock.unlock();
+        {
+            ATRACE_NAME("ScreenCaptureThread::work");
+            work();
+            // Release what the work holds on to before taking the lock again.
+            work = nullptr;
+        }
+        lock.lock();
+    }
+}
+
+} // namespace android
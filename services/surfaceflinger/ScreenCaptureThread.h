@@ -0,0 +1,57 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/thread_annotations.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace android {
+
+// Draws screen captures off the main thread. The main thread snapshots the composition state of
+// the captured layers, and posts the RenderEngine work on the snapshot to this thread, so that
+// screenshots for recents or screen recording do not take frame time from the main thread.
+//
+// The work runs in the order it was posted. Pending work still runs when the thread is destroyed,
+// so that every capture listener is called back.
+class ScreenCaptureThread {
+public:
+    ScreenCaptureThread();
+    ~ScreenCaptureThread();
+
+    ScreenCaptureThread(const ScreenCaptureThread&) = delete;
+    ScreenCaptureThread& operator=(const ScreenCaptureThread&) = delete;
+
+    using Work = std::function<void()>;
+    void post(Work&&) EXCLUDES(mMutex);
+
+private:
+    void threadMain();
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::deque<Work> mWork GUARDED_BY(mMutex);
+    bool mRunning GUARDED_BY(mMutex) = true;
+
+    std::thread mThread;
+};
+
+} // namespace android
@@ -124,10 +124,12 @@
 #include "LayerProtoHelper.h"
 #include "LayerRenderArea.h"
 #include "LayerVector.h"
+#include "MemoryPressureMonitor.h"
 #include "MonitoredProducer.h"
 #include "NativeWindowSurface.h"
 #include "RefreshRateOverlay.h"
 #include "RegionSamplingThread.h"
+#include "ScreenCaptureThread.h"
 #include "Scheduler/DispSyncSource.h"
 #include "Scheduler/EventThread.h"
 #include "Scheduler/LayerHistory.h"
@@ -617,6 +619,9 @@ SurfaceFlinger::SurfaceFlinger(Factory& factory) : SurfaceFlinger(factory, SkipI
         return base::GetBoolProperty(std::string("debug.sf.enable_layer_caching"), enable);
     }();
 
+    mClientTargetDamageEnabled =
+            base::GetBoolProperty(std::string("debug.sf.enable_client_target_damage"), true);
+
     useContextPriority = use_context_priority(true);
 
     using Values = SurfaceFlingerProperties::primary_display_orientation_values;
@@ -773,6 +778,9 @@ SurfaceFlinger::SurfaceFlinger(Factory& factory) : SurfaceFlinger(factory, SkipI
 #endif
 
     enableLatchUnsignaled = base::GetBoolProperty("debug.sf.latch_unsignaled"s, false);
+
+    mPerDisplayFrameScheduling =
+            base::GetBoolProperty("debug.sf.per_display_frame_scheduling"s, false);
 }
 
 SurfaceFlinger::~SurfaceFlinger() {
@@ -1111,6 +1119,26 @@ void SurfaceFlinger::init() {
     mMaxRenderTargetSize =
             std::min(getRenderEngine().getMaxTextureSize(), getRenderEngine().getMaxViewportDims());
 
+    // Screen captures can only be drawn off the main thread if RenderEngine serializes the calls
+    // from different threads, and selects the context for the output buffer by itself.
+    if (getRenderEngine().getRenderEngineType() ==
+                renderengine::RenderEngine::RenderEngineType::SKIA_GL_THREADED &&
+        base::GetBoolProperty("debug.sf.async_screen_capture"s, true)) {
+        mScreenCaptureThread = std::make_unique<ScreenCaptureThread>();
+    }
+
+    // The textures pooled for cached sets are only a cache, so let them go when memory runs low
+    // rather than waiting for the displays to power off. The thresholds match the medium
+    // pressure level of lmkd.
+    mMemoryPressureMonitor = MemoryPressureMonitor::create(70ms, 1s, [this] {
+        static_cast<void>(schedule([this]() MAIN_THREAD {
+            ATRACE_NAME("trimLayerCachingTexturePools");
+            for (const auto& [_, display] : ON_MAIN_THREAD(mDisplays)) {
+                display->getCompositionDisplay()->trimLayerCachingTexturePool();
+            }
+        }));
+    });
+
     // Set SF main policy after initializing RenderEngine which has its own policy.
     if (!SetTaskProfiles(0, {"SFMainPolicy"})) {
         ALOGW("Failed to set main task profile");
@@ -2549,6 +2577,67 @@ void SurfaceFlinger::updateFrameScheduler() NO_THREAD_SAFETY_ANALYSIS {
     }
 }
 
+void SurfaceFlinger::updateDeferredDisplays() {
+    mDeferredDisplays.clear();
+    mDeferredLayerStacks.clear();
+    if (!mPerDisplayFrameScheduling) {
+        return;
+    }
+
+    const nsecs_t framePeriod = mScheduler->getDisplayStatInfo(systemTime()).vsyncPeriod;
+    std::vector<ui::LayerStack> dueLayerStacks;
+    for (const auto& [_, display] : ON_MAIN_THREAD(mDisplays)) {
+        // The frames follow the vsync of the primary display, and virtual displays have none.
+        const auto& mode = display->getActiveMode();
+        if (display->isPrimary() || display->isVirtual() || !display->isPoweredOn() || !mode ||
+            mDisplayCompositionScheduler.isDue(display->getPhysicalId(), mode->getVsyncPeriod(),
+                                               framePeriod, mExpectedPresentTime)) {
+            dueLayerStacks.push_back(display->getLayerStack());
+            continue;
+        }
+        mDeferredDisplays.insert(display->getPhysicalId());
+        mDeferredLayerStacks.push_back(display->getLayerStack());
+    }
+
+    // Layer stacks mirrored onto a display which is due are latched right away.
+    mDeferredLayerStacks.erase(std::remove_if(mDeferredLayerStacks.begin(),
+                                              mDeferredLayerStacks.end(),
+                                              [&](ui::LayerStack layerStack) {
+                                                  return std::find(dueLayerStacks.begin(),
+                                                                   dueLayerStacks.end(),
+                                                                   layerStack) !=
+                                                          dueLayerStacks.end();
+                                              }),
+                               mDeferredLayerStacks.end());
+}
+
+void SurfaceFlinger::addOutputsToCompose(compositionengine::CompositionRefreshArgs& refreshArgs) {
+    const auto& displays = ON_MAIN_THREAD(mDisplays);
+    // Changes which are applied to the outputs as they are composed must reach every display.
+    const bool composeDeferredDisplays = mVisibleRegionsDirty || mGeometryInvalid ||
+            mRepaintEverything || mDrawingState.colorMatrixChanged;
+    refreshArgs.outputs.reserve(displays.size());
+    for (const auto& [_, display] : displays) {
+        if (!display->isVirtual()) {
+            const auto displayId = display->getPhysicalId();
+            if (!composeDeferredDisplays && mDeferredDisplays.count(displayId)) {
+                mDisplayCompositionScheduler.onSkipped(displayId);
+                continue;
+            }
+            if (const auto& mode = display->getActiveMode()) {
+                mDisplayCompositionScheduler.onComposed(displayId, mode->getVsyncPeriod(),
+                                                        mExpectedPresentTime);
+            }
+        }
+        refreshArgs.outputs.push_back(display->getCompositionDisplay());
+    }
+}
+
+bool SurfaceFlinger::isLayerStackDeferred(ui::LayerStack layerStack) const {
+    return std::find(mDeferredLayerStacks.begin(), mDeferredLayerStacks.end(), layerStack) !=
+            mDeferredLayerStacks.end();
+}
+
 void SurfaceFlinger::syncToDisplayHardware() NO_THREAD_SAFETY_ANALYSIS {
     ATRACE_CALL();
 
@@ -2607,6 +2696,7 @@ void SurfaceFlinger::onMessageInvalidate(int64_t vsyncId, nsecs_t expectedVSyncT
     mScheduledPresentTime = expectedVSyncTime;
     updateFrameScheduler();
     syncToDisplayHardware();
+    updateDeferredDisplays();
 
     const auto vsyncIn = [&] {
         if (!ATRACE_ENABLED()) return 0.f;
@@ -2790,11 +2880,7 @@ void SurfaceFlinger::onMessageRefresh() {
     mRefreshPending = false;
 
     compositionengine::CompositionRefreshArgs refreshArgs;
-    const auto& displays = ON_MAIN_THREAD(mDisplays);
-    refreshArgs.outputs.reserve(displays.size());
-    for (const auto& [_, display] : displays) {
-        refreshArgs.outputs.push_back(display->getCompositionDisplay());
-    }
+    addOutputsToCompose(refreshArgs);
     mDrawingState.traverseInZOrder([&refreshArgs](Layer* layer) {
         if (auto layerFE = layer->getCompositionEngineLayerFE())
             refreshArgs.layers.push_back(layerFE);
@@ -3792,6 +3878,7 @@ void SurfaceFlinger::processDisplayAdded(const wp<IBinder>& displayToken,
     builder.setDisplayExtnIntf(mDisplayExtnIntf);
     auto compositionDisplay = getCompositionEngine().createDisplay(builder.build());
     compositionDisplay->setLayerCachingEnabled(mLayerCachingEnabled);
+    compositionDisplay->setClientTargetDamageEnabled(mClientTargetDamageEnabled);
 
     sp<compositionengine::DisplaySurface> displaySurface;
     sp<IGraphicBufferProducer> producer;
@@ -3894,6 +3981,7 @@ void SurfaceFlinger::processDisplayRemoved(const wp<IBinder>& displayToken) {
             releaseVirtualDisplay(display->getVirtualId());
         } else {
             dispatchDisplayHotplugEvent(display->getPhysicalId(), false);
+            mDisplayCompositionScheduler.onDisplayRemoved(display->getPhysicalId());
         }
         destroySmomoInstance(display);
     }
@@ -4422,6 +4510,7 @@ bool SurfaceFlinger::handlePageFlip() {
     bool visibleRegions = false;
     bool frameQueued = false;
     bool newDataLatched = false;
+    bool deferredFrameQueued = false;
     std::set<uint32_t> layerStackIds;
     uint32_t layerStackId = 0;
 
@@ -4446,7 +4535,11 @@ bool SurfaceFlinger::handlePageFlip() {
 
          if (layer->hasReadyFrame()) {
             frameQueued = true;
-            if (layer->shouldPresentNow(expectedPresentTime)) {
+            if (isLayerStackDeferred(layer->getLayerStack())) {
+                ATRACE_NAME("layer display deferred");
+                deferredFrameQueued = true;
+                layer->useEmptyDamage();
+            } else if (layer->shouldPresentNow(expectedPresentTime)) {
                 mLayersWithQueuedFrames.emplace(layer);
                 if (wakeUpPresentationDisplays) {
                     layerStackId = layer->getLayerStack();
@@ -4495,7 +4588,9 @@ bool SurfaceFlinger::handlePageFlip() {
     // If we will need to wake up at some time in the future to deal with a
     // queued frame that shouldn't be displayed during this vsync period, wake
     // up during the next vsync period to check again.
-    if (frameQueued && (mLayersWithQueuedFrames.empty() || !newDataLatched)) {
+    // Frames of displays which are not due are latched on the frame of their next vsync.
+    if (deferredFrameQueued ||
+        (frameQueued && (mLayersWithQueuedFrames.empty() || !newDataLatched))) {
         signalLayerUpdate();
     }
 
@@ -5939,7 +6034,9 @@ void SurfaceFlinger::setPowerModeInternal(const sp<DisplayDevice>& display, hal:
 
         getHwComposer().setPowerMode(displayId, mode);
         mVisibleRegionsDirty = true;
-        // from this point on, SF will stop drawing on this display
+        // from this point on, SF will stop drawing on this display, so don't hold on to the
+        // textures pooled for its cached sets
+        display->getCompositionDisplay()->trimLayerCachingTexturePool();
     } else if (mode == hal::PowerMode::DOZE || mode == hal::PowerMode::ON) {
         // Update display while dozing
         getHwComposer().setPowerMode(displayId, mode);
@@ -6131,14 +6228,18 @@ status_t SurfaceFlinger::doDump(int fd, const DumpArgs& args, bool asProto) {
         }
 
         if (dumpLayers) {
-            LayersTraceFileProto traceFileProto = SurfaceTracing::createLayersTraceFileProto();
-            LayersTraceProto* layersTrace = traceFileProto.add_entry();
-            LayersProto layersProto = dumpProtoFromMainThread();
-            layersTrace->mutable_layers()->Swap(&layersProto);
+            // The proto is only built to be serialized or printed, so allocate all of its
+            // messages on an arena, which is freed at once.
+            google::protobuf::Arena arena;
+            auto* traceFileProto =
+                    google::protobuf::Arena::CreateMessage<LayersTraceFileProto>(&arena);
+            *traceFileProto = SurfaceTracing::createLayersTraceFileProto();
+            LayersTraceProto* layersTrace = traceFileProto->add_entry();
+            dumpProtoFromMainThread(layersTrace->mutable_layers());
             dumpDisplayProto(*layersTrace);
 
             if (asProto) {
-                result.append(traceFileProto.SerializeAsString());
+                result.append(traceFileProto->SerializeAsString());
             } else {
                 // Dump info that we need to access from the main thread
                 const auto layerTree = LayerProtoParser::generateLayerTree(layersTrace->layers());
@@ -6221,8 +6322,10 @@ void SurfaceFlinger::dumpDrawCycle(bool prePrepare) {
     }
 
     if (mFileDump.fullDump) {
-        const LayersProto layersProto = dumpDrawingStateProto(SurfaceTracing::TRACE_ALL);
-        const auto layerTree = LayerProtoParser::generateLayerTree(layersProto);
+        google::protobuf::Arena arena;
+        auto* layersProto = google::protobuf::Arena::CreateMessage<LayersProto>(&arena);
+        dumpDrawingStateProto(SurfaceTracing::TRACE_ALL, layersProto);
+        const auto layerTree = LayerProtoParser::generateLayerTree(*layersProto);
         dumpsys.append(LayerProtoParser::layerTreeToString(layerTree));
         dumpsys.append("\n");
         dumpsys.append("Offscreen Layers:\n");
@@ -6365,6 +6468,11 @@ void SurfaceFlinger::dumpVSync(std::string& result) const {
     mScheduler->dumpVsync(result);
     StringAppendF(&result, "mHWCVsyncPendingState=%s mLastHWCVsyncState=%s\n",
                   to_string(mHWCVsyncPendingState).c_str(), to_string(mLastHWCVsyncState).c_str());
+
+    if (mPerDisplayFrameScheduling) {
+        result.append("\n");
+        mDisplayCompositionScheduler.dump(result);
+    }
 }
 
 void SurfaceFlinger::dumpPlannerInfo(const DumpArgs& args, std::string& result) const {
@@ -6523,17 +6631,17 @@ void SurfaceFlinger::dumpWideColorInfo(std::string& result) const {
     result.append("\n");
 }
 
-LayersProto SurfaceFlinger::dumpDrawingStateProto(uint32_t traceFlags) const {
+void SurfaceFlinger::dumpDrawingStateProto(uint32_t traceFlags,
+                                           LayersProto* outLayersProto) const {
     // If context is SurfaceTracing thread, mTracingLock blocks display transactions on main thread.
     const auto display = ON_MAIN_THREAD(getDefaultDisplayDeviceLocked());
 
-    LayersProto layersProto;
     Mutex::Autolock _l(mStateLock);
+    // Size the layer list up front rather than growing it layer by layer.
+    outLayersProto->mutable_layers()->Reserve(static_cast<int>(mNumLayers.load()));
     for (const sp<Layer>& layer : mDrawingState.layersSortedByZ) {
-        layer->writeToProto(layersProto, traceFlags, display.get());
+        layer->writeToProto(*outLayersProto, traceFlags, display.get());
     }
-
-    return layersProto;
 }
 
 void SurfaceFlinger::dumpDisplayProto(LayersTraceProto& layersTraceProto) const {
@@ -6576,8 +6684,8 @@ void SurfaceFlinger::dumpOffscreenLayersProto(LayersProto& layersProto, uint32_t
     }
 }
 
-LayersProto SurfaceFlinger::dumpProtoFromMainThread(uint32_t traceFlags) {
-    return schedule([=] { return dumpDrawingStateProto(traceFlags); }).get();
+void SurfaceFlinger::dumpProtoFromMainThread(LayersProto* outLayersProto, uint32_t traceFlags) {
+    schedule([=] { dumpDrawingStateProto(traceFlags, outLayersProto); }).get();
 }
 
 void SurfaceFlinger::dumpOffscreenLayers(std::string& result) {
@@ -8096,14 +8204,59 @@ status_t SurfaceFlinger::captureScreenCommon(
         }
 
         status_t result = NO_ERROR;
+        if (!mScreenCaptureThread) {
+            renderArea->render([&] {
+                result = renderScreenImpl(*renderArea, traverseLayers, buffer,
+                                          canCaptureBlackoutContent, regionSampling, grayscale,
+                                          captureResults);
+            });
+
+            captureResults.result = result;
+            captureListener->onScreenCaptureCompleted(captureResults);
+            return;
+        }
+
+        // Only snapshot the layers on the main thread, and release it while the capture is drawn.
+        ScreenCaptureSnapshot snapshot;
         renderArea->render([&] {
-            result = renderScreenImpl(*renderArea, traverseLayers, buffer,
-                                            canCaptureBlackoutContent, regionSampling, grayscale,
-                                            captureResults);
+            result = snapshotScreenImpl(*renderArea, traverseLayers, buffer,
+                                        canCaptureBlackoutContent, regionSampling, grayscale,
+                                        captureResults, &snapshot);
         });
+        if (result != NO_ERROR) {
+            captureResults.result = result;
+            captureListener->onScreenCaptureCompleted(captureResults);
+            return;
+        }
 
-        captureResults.result = result;
-        captureListener->onScreenCaptureCompleted(captureResults);
+        // The sampled buffers may be replaced before the capture is drawn, so the layers hold on
+        // to its release fence, and hold back releasing them until it is set.
+        const auto fencePromise = std::make_shared<std::promise<sp<Fence>>>();
+        const std::shared_future<sp<Fence>> releaseFence = fencePromise->get_future().share();
+        for (const auto& layer : snapshot.renderedLayers) {
+            layer->addPendingCaptureFence(releaseFence);
+        }
+
+        mScreenCaptureThread->post([=, snapshot = std::move(snapshot),
+                                    captureResults = std::move(captureResults)]() mutable {
+            captureResults.fence = drawScreenSnapshot(snapshot, buffer, /*onMainThread=*/false);
+            fencePromise->set_value(captureResults.fence);
+            captureResults.result = NO_ERROR;
+            captureListener->onScreenCaptureCompleted(captureResults);
+
+            // The layers are only accessed, and their last references are only dropped, on the
+            // main thread.
+            static_cast<void>(schedule([this,
+                                        renderedLayers = std::move(snapshot.renderedLayers)]() {
+                bool latchHeld = false;
+                for (const auto& layer : renderedLayers) {
+                    latchHeld |= layer->onCaptureDrawn();
+                }
+                if (latchHeld) {
+                    signalLayerUpdate();
+                }
+            }));
+        });
     }));
 
     return NO_ERROR;
@@ -8116,6 +8269,30 @@ status_t SurfaceFlinger::renderScreenImpl(
         ScreenCaptureResults& captureResults) {
     ATRACE_CALL();
 
+    ScreenCaptureSnapshot snapshot;
+    if (const status_t result =
+                snapshotScreenImpl(renderArea, traverseLayers, buffer, canCaptureBlackoutContent,
+                                   regionSampling, grayscale, captureResults, &snapshot);
+        result != NO_ERROR) {
+        return result;
+    }
+
+    captureResults.fence = drawScreenSnapshot(snapshot, buffer, /*onMainThread=*/true);
+    if (captureResults.fence->isValid()) {
+        for (const auto& layer : snapshot.renderedLayers) {
+            layer->onLayerDisplayed(captureResults.fence);
+        }
+    }
+    return NO_ERROR;
+}
+
+status_t SurfaceFlinger::snapshotScreenImpl(
+        const RenderArea& renderArea, TraverseLayersFunction traverseLayers,
+        const std::shared_ptr<renderengine::ExternalTexture>& buffer,
+        bool canCaptureBlackoutContent, bool regionSampling, bool grayscale,
+        ScreenCaptureResults& captureResults, ScreenCaptureSnapshot* outSnapshot) {
+    ATRACE_CALL();
+
     traverseLayers([&](Layer* layer) {
         captureResults.capturedSecureLayers =
                 captureResults.capturedSecureLayers || (layer->isVisible() && layer->isSecure());
@@ -8154,8 +8331,10 @@ status_t SurfaceFlinger::renderScreenImpl(
     const auto rotation = renderArea.getRotationFlags();
     const auto& layerStackSpaceRect = renderArea.getLayerStackSpaceRect();
 
-    renderengine::DisplaySettings clientCompositionDisplay;
-    std::vector<compositionengine::LayerFE::LayerSettings> clientCompositionLayers;
+    renderengine::DisplaySettings& clientCompositionDisplay = outSnapshot->display;
+    std::vector<compositionengine::LayerFE::LayerSettings>& clientCompositionLayers =
+            outSnapshot->layers;
+    outSnapshot->useProtected = useProtected;
 
     // assume that bounds are never offset, and that they are the same as the
     // buffer bounds.
@@ -8180,7 +8359,7 @@ status_t SurfaceFlinger::renderScreenImpl(
     clientCompositionLayers.push_back(fillLayer);
 
     const auto display = renderArea.getDisplayDevice();
-    std::vector<Layer*> renderedLayers;
+    std::vector<sp<Layer>>& renderedLayers = outSnapshot->renderedLayers;
     Region clearRegion = Region::INVALID_REGION;
     bool disableBlurs = false;
     traverseLayers([&](Layer* layer) {
@@ -8223,40 +8402,44 @@ status_t SurfaceFlinger::renderScreenImpl(
             clientCompositionLayers.insert(clientCompositionLayers.end(),
                                            std::make_move_iterator(results.begin()),
                                            std::make_move_iterator(results.end()));
-            renderedLayers.push_back(layer);
+            renderedLayers.emplace_back(layer);
         }
 
     });
 
+    clientCompositionDisplay.clearRegion = clearRegion;
+    return NO_ERROR;
+}
+
+sp<Fence> SurfaceFlinger::drawScreenSnapshot(
+        const ScreenCaptureSnapshot& snapshot,
+        const std::shared_ptr<renderengine::ExternalTexture>& buffer, bool onMainThread) {
+    ATRACE_CALL();
+
     std::vector<const renderengine::LayerSettings*> clientCompositionLayerPointers(
-            clientCompositionLayers.size());
-    std::transform(clientCompositionLayers.begin(), clientCompositionLayers.end(),
+            snapshot.layers.size());
+    std::transform(snapshot.layers.begin(), snapshot.layers.end(),
                    clientCompositionLayerPointers.begin(),
-                   std::pointer_traits<renderengine::LayerSettings*>::pointer_to);
+                   [](const renderengine::LayerSettings& settings) { return &settings; });
 
-    clientCompositionDisplay.clearRegion = clearRegion;
     // Use an empty fence for the buffer fence, since we just created the buffer so
     // there is no need for synchronization with the GPU.
     base::unique_fd bufferFence;
     base::unique_fd drawFence;
-    getRenderEngine().useProtectedContext(useProtected);
+    if (onMainThread) {
+        getRenderEngine().useProtectedContext(snapshot.useProtected);
+    }
 
     const constexpr bool kUseFramebufferCache = false;
-    getRenderEngine().drawLayers(clientCompositionDisplay, clientCompositionLayerPointers, buffer,
+    getRenderEngine().drawLayers(snapshot.display, clientCompositionLayerPointers, buffer,
                                  kUseFramebufferCache, std::move(bufferFence), &drawFence);
 
-    if (drawFence >= 0) {
-        sp<Fence> releaseFence = new Fence(dup(drawFence));
-        for (auto* layer : renderedLayers) {
-            layer->onLayerDisplayed(releaseFence);
-        }
+    if (onMainThread) {
+        // Always switch back to unprotected context.
+        getRenderEngine().useProtectedContext(false);
     }
 
-    captureResults.fence = new Fence(drawFence.release());
-    // Always switch back to unprotected context.
-    getRenderEngine().useProtectedContext(false);
-
-    return NO_ERROR;
+    return new Fence(drawFence.release());
 }
 
 void SurfaceFlinger::windowInfosReported() {
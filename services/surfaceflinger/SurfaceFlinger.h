@@ -23,6 +23,7 @@
  */
 
 #include <android-base/thread_annotations.h>
+#include <compositionengine/LayerFE.h>
 #include <compositionengine/OutputColorSetting.h>
 #include <cutils/atomic.h>
 #include <cutils/compiler.h>
@@ -35,6 +36,7 @@
 #include <gui/OccupancyTracker.h>
 #include <layerproto/LayerProtoHeader.h>
 #include <math/mat4.h>
+#include <renderengine/DisplaySettings.h>
 #include <renderengine/LayerSettings.h>
 #include <serviceutils/PriorityDumper.h>
 #include <system/graphics.h>
@@ -57,6 +59,7 @@
 #include "Fps.h"
 #include "FrameTracker.h"
 #include "LayerVector.h"
+#include "Scheduler/DisplayCompositionScheduler.h"
 #include "Scheduler/RefreshRateConfigs.h"
 #include "Scheduler/RefreshRateStats.h"
 #include "Scheduler/Scheduler.h"
@@ -117,8 +120,10 @@ class IGraphicBufferProducer;
 class Layer;
 class MessageBase;
 class RefreshRateOverlay;
+class MemoryPressureMonitor;
 class RegionSamplingThread;
 class RenderArea;
+class ScreenCaptureThread;
 class TimeStats;
 class FrameTracer;
 class WindowInfosListenerInvoker;
@@ -918,6 +923,14 @@ private:
     void updateFrameScheduler();
     void syncToDisplayHardware();
 
+    // Finds the displays which are not due for composition on this frame, since they refresh
+    // slower than the frames are scheduled, along with the layer stacks only they show.
+    void updateDeferredDisplays();
+    bool isLayerStackDeferred(ui::LayerStack) const;
+    // Adds the outputs of the displays to compose on this frame, leaving out the deferred displays
+    // unless the frame carries changes which the outputs only apply when composed.
+    void addOutputsToCompose(compositionengine::CompositionRefreshArgs&);
+
     void initScheduler(const sp<DisplayDevice>& display) REQUIRES(mStateLock);
     void updatePhaseConfiguration(const Fps&) REQUIRES(mStateLock);
     void setVsyncConfig(const VsyncModulator::VsyncConfig&, nsecs_t vsyncPeriod);
@@ -1029,6 +1042,30 @@ private:
                               bool canCaptureBlackoutContent, bool regionSampling,
                               bool grayscale, ScreenCaptureResults&) EXCLUDES(mStateLock);
 
+    // The composition state of the layers of a screen capture, from which the capture is drawn
+    // without accessing the layers.
+    struct ScreenCaptureSnapshot {
+        renderengine::DisplaySettings display;
+        std::vector<compositionengine::LayerFE::LayerSettings> layers;
+        // The layers to notify of the release fence of the capture.
+        std::vector<sp<Layer>> renderedLayers;
+        bool useProtected = false;
+    };
+
+    // Snapshots the layers to capture on the main thread. renderScreenImpl is the same as
+    // snapshotScreenImpl followed by drawScreenSnapshot.
+    status_t snapshotScreenImpl(const RenderArea&, TraverseLayersFunction,
+                                const std::shared_ptr<renderengine::ExternalTexture>&,
+                                bool canCaptureBlackoutContent, bool regionSampling,
+                                bool grayscale, ScreenCaptureResults&,
+                                ScreenCaptureSnapshot* outSnapshot) EXCLUDES(mStateLock);
+    // Draws a snapshot into the capture buffer, and returns the release fence of the capture. Off
+    // the main thread, the RenderEngine context is left to RenderEngine, which selects the one
+    // that can access the buffer.
+    sp<Fence> drawScreenSnapshot(const ScreenCaptureSnapshot&,
+                                 const std::shared_ptr<renderengine::ExternalTexture>&,
+                                 bool onMainThread);
+
 
     bool canAllocateHwcDisplayIdForVDS(uint64_t usage);
     bool skipColorLayer(const char* layerType);
@@ -1281,14 +1318,17 @@ private:
     void dumpDisplayIdentificationData(std::string& result) const REQUIRES(mStateLock);
     void dumpRawDisplayIdentificationData(const DumpArgs&, std::string& result) const;
     void dumpWideColorInfo(std::string& result) const REQUIRES(mStateLock);
-    LayersProto dumpDrawingStateProto(uint32_t traceFlags) const;
+    // Writes the drawing state of the layers to outLayersProto, which may be allocated on an
+    // arena.
+    void dumpDrawingStateProto(uint32_t traceFlags, LayersProto* outLayersProto) const;
     void dumpOffscreenLayersProto(LayersProto& layersProto,
                                   uint32_t traceFlags = SurfaceTracing::TRACE_ALL) const;
     void dumpDisplayProto(LayersTraceProto& layersTraceProto) const;
 
     // Dumps state from HW Composer
     void dumpHwc(std::string& result) const;
-    LayersProto dumpProtoFromMainThread(uint32_t traceFlags = SurfaceTracing::TRACE_ALL)
+    void dumpProtoFromMainThread(LayersProto* outLayersProto,
+                                 uint32_t traceFlags = SurfaceTracing::TRACE_ALL)
             EXCLUDES(mStateLock);
     void dumpOffscreenLayers(std::string& result) EXCLUDES(mStateLock);
     void dumpPlannerInfo(const DumpArgs& args, std::string& result) const REQUIRES(mStateLock);
@@ -1488,6 +1528,7 @@ private:
     bool mDebugDisableHWC = false;
     bool mDebugDisableTransformHint = false;
     bool mLayerCachingEnabled = false;
+    bool mClientTargetDamageEnabled = false;
     volatile nsecs_t mDebugInTransaction = 0;
     bool mForceFullDamage = false;
     bool mPropagateBackpressure = true;
@@ -1605,6 +1646,14 @@ private:
 
     std::atomic<nsecs_t> mExpectedPresentTime = 0;
     nsecs_t mScheduledPresentTime = 0;
+
+    // Composes each display at its own refresh rate, if enabled.
+    bool mPerDisplayFrameScheduling = false;
+    scheduler::DisplayCompositionScheduler mDisplayCompositionScheduler;
+    // Displays skipped on this frame, and the layer stacks whose buffers are latched once they
+    // are due, so that frames are not latched without being shown.
+    std::unordered_set<PhysicalDisplayId> mDeferredDisplays;
+    std::vector<ui::LayerStack> mDeferredLayerStacks;
     hal::Vsync mHWCVsyncPendingState = hal::Vsync::DISABLE;
     hal::Vsync mLastHWCVsyncState = hal::Vsync::DISABLE;
 
@@ -1613,6 +1662,10 @@ private:
 
     bool mLumaSampling = true;
     sp<RegionSamplingThread> mRegionSamplingThread;
+    // Draws screen captures after they are snapshotted, if RenderEngine runs on its own thread.
+    std::unique_ptr<ScreenCaptureThread> mScreenCaptureThread;
+    // Trims caches, such as the planner texture pools, when memory runs low.
+    std::unique_ptr<MemoryPressureMonitor> mMemoryPressureMonitor;
     sp<FpsReporter> mFpsReporter;
     sp<TunnelModeEnabledReporter> mTunnelModeEnabledReporter;
     ui::DisplayPrimaries mInternalDisplayPrimaries;
@@ -175,12 +175,13 @@ LayersTraceProto SurfaceTracing::Runner::traceLayers(const char* where) {
     LayersTraceProto entry;
     entry.set_elapsed_realtime_nanos(elapsedRealtimeNano());
     entry.set_where(where);
-    LayersProto layers(mFlinger.dumpDrawingStateProto(mConfig.flags));
+    // The entry outlives the trace, so it is built in place rather than on an arena.
+    LayersProto* layers = entry.mutable_layers();
+    mFlinger.dumpDrawingStateProto(mConfig.flags, layers);
 
     if (flagIsSet(SurfaceTracing::TRACE_EXTRA)) {
-        mFlinger.dumpOffscreenLayersProto(layers);
+        mFlinger.dumpOffscreenLayersProto(*layers);
     }
-    entry.mutable_layers()->Swap(&layers);
 
     if (flagIsSet(SurfaceTracing::TRACE_HWC)) {
         std::string hwcDump;
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <gui/SyncScreenCaptureListener.h>
 #include <gui/test/CallbackUtils.h>
 #include "LayerTransactionTest.h"
 
@@ -42,7 +43,7 @@ public:
         helper->mConditionVariable.notify_all();
     }
 
-    void getCallbackData(ReleaseCallbackId* callbackId) {
+    void getCallbackData(ReleaseCallbackId* callbackId, sp<Fence>* releaseFence = nullptr) {
         std::unique_lock lock(mMutex);
         if (mCallbackDataQueue.empty()) {
             if (!mConditionVariable.wait_for(lock, std::chrono::seconds(3),
@@ -54,6 +55,9 @@ public:
         auto callbackData = mCallbackDataQueue.front();
         mCallbackDataQueue.pop();
         *callbackId = callbackData.first;
+        if (releaseFence) {
+            *releaseFence = callbackData.second;
+        }
     }
 
     void verifyNoCallbacks() {
@@ -153,10 +157,12 @@ TEST_F(ReleaseBufferCallbackTest, DISABLED_PresentBuffer) {
     ReleaseCallbackId secondBufferCallbackId(secondBuffer->getId(), generateFrameNumber());
     submitBuffer(layer, secondBuffer, Fence::NO_FENCE, transactionCallback, secondBufferCallbackId,
                  *releaseCallback);
+    // The new buffer is latched without waiting for the capture, and the first buffer is released
+    // with the transaction callback only if the capture was drawn by then.
     expected = ExpectedResult();
     expected.addSurface(ExpectedResult::Transaction::PRESENTED, layer,
                         ExpectedResult::Buffer::NOT_ACQUIRED,
-                        ExpectedResult::PreviousBuffer::RELEASED);
+                        ExpectedResult::PreviousBuffer::UNKNOWN);
     ASSERT_NO_FATAL_FAILURE(waitForCallback(transactionCallback, expected));
     ASSERT_NO_FATAL_FAILURE(waitForReleaseBufferCallback(*releaseCallback, firstBufferCallbackId));
 }
@@ -389,4 +395,50 @@ TEST_F(ReleaseBufferCallbackTest, DISABLED_Merge_Different_Processes) {
     ASSERT_NO_FATAL_FAILURE(waitForReleaseBufferCallback(*releaseCallback, firstBufferCallbackId));
 }
 
+TEST_F(ReleaseBufferCallbackTest, CaptureDuringBufferUpdate) {
+    sp<SurfaceControl> layer = createBufferStateLayer();
+    CallbackHelper transactionCallback;
+    ReleaseBufferCallbackHelper* releaseCallback = getReleaseBufferCallbackHelper();
+
+    sp<GraphicBuffer> firstBuffer = getBuffer();
+    ReleaseCallbackId firstBufferCallbackId(firstBuffer->getId(), generateFrameNumber());
+    submitBuffer(layer, firstBuffer, Fence::NO_FENCE, transactionCallback, firstBufferCallbackId,
+                 *releaseCallback);
+    ExpectedResult expected;
+    expected.addSurface(ExpectedResult::Transaction::PRESENTED, layer,
+                        ExpectedResult::Buffer::NOT_ACQUIRED);
+    ASSERT_NO_FATAL_FAILURE(waitForCallback(transactionCallback, expected));
+
+    // Capture the layer without waiting, so that its buffer is replaced while it is captured.
+    LayerCaptureArgs captureArgs;
+    captureArgs.layerHandle = layer->getHandle();
+    captureArgs.sourceCrop = Rect(32, 32);
+    const sp<SyncScreenCaptureListener> captureListener = new SyncScreenCaptureListener();
+    ASSERT_EQ(NO_ERROR,
+              ComposerService::getComposerService()->captureLayers(captureArgs, captureListener));
+
+    sp<GraphicBuffer> secondBuffer = getBuffer();
+    ReleaseCallbackId secondBufferCallbackId(secondBuffer->getId(), generateFrameNumber());
+    submitBuffer(layer, secondBuffer, Fence::NO_FENCE, transactionCallback, secondBufferCallbackId,
+                 *releaseCallback);
+    expected = ExpectedResult();
+    expected.addSurface(ExpectedResult::Transaction::PRESENTED, layer,
+                        ExpectedResult::Buffer::NOT_ACQUIRED,
+                        ExpectedResult::PreviousBuffer::RELEASED);
+    ASSERT_NO_FATAL_FAILURE(waitForCallback(transactionCallback, expected));
+
+    ReleaseCallbackId releasedBufferCallbackId;
+    sp<Fence> releaseFence;
+    ASSERT_NO_FATAL_FAILURE(
+            releaseCallback->getCallbackData(&releasedBufferCallbackId, &releaseFence));
+    EXPECT_EQ(firstBufferCallbackId, releasedBufferCallbackId);
+
+    // The first buffer is only released once the capture is done sampling it.
+    const ScreenCaptureResults captureResults = captureListener->waitForResults();
+    ASSERT_EQ(NO_ERROR, captureResults.result);
+    ASSERT_NE(nullptr, releaseFence);
+    ASSERT_EQ(NO_ERROR, releaseFence->wait(Fence::TIMEOUT_NEVER));
+    EXPECT_GE(releaseFence->getSignalTime(), captureResults.fence->getSignalTime());
+}
+
 } // namespace android
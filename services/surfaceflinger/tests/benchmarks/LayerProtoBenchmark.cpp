@@ -0,0 +1,159 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <layerproto/LayerProtoHeader.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<size_t> gAllocationCount = 0;
+
+} // namespace
+
+// Count the allocations made by the benchmarks, which is why they are built on their own.
+void* operator new(size_t size) {
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size);
+    if (!ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace android::surfaceflinger {
+namespace {
+
+constexpr size_t kLayerCount = 300;
+// The number of layers which are children of each layer, forming a tree of windows.
+constexpr size_t kChildCount = 3;
+
+// Writes a layer with the sub-messages which Layer::writeToProto usually populates, including a
+// few multi-rect regions.
+void writeLayer(int32_t id, LayersProto* layersProto) {
+    LayerProto* layer = layersProto->add_layers();
+    layer->set_id(id);
+    layer->set_name("com.example.app/com.example.app.MainActivity#" + std::to_string(id));
+    layer->set_type("BufferStateLayer");
+    layer->set_parent(id > 0 ? (id - 1) / static_cast<int32_t>(kChildCount) : -1);
+    for (size_t i = 1; i <= kChildCount; i++) {
+        const int32_t child = id * static_cast<int32_t>(kChildCount) + static_cast<int32_t>(i);
+        if (child < static_cast<int32_t>(kLayerCount)) {
+            layer->add_children(child);
+        }
+    }
+
+    for (RegionProto* region : {layer->mutable_transparent_region(),
+                                layer->mutable_visible_region(), layer->mutable_damage_region()}) {
+        for (int32_t i = 0; i < 4; i++) {
+            RectProto* rect = region->add_rect();
+            rect->set_left(0);
+            rect->set_top(i * 100);
+            rect->set_right(1080);
+            rect->set_bottom(i * 100 + 50);
+        }
+    }
+
+    for (FloatRectProto* rect : {layer->mutable_source_bounds(), layer->mutable_bounds(),
+                                 layer->mutable_screen_bounds(),
+                                 layer->mutable_corner_radius_crop()}) {
+        rect->set_right(1080.f);
+        rect->set_bottom(2340.f);
+    }
+
+    RectProto* crop = layer->mutable_crop();
+    crop->set_right(1080);
+    crop->set_bottom(2340);
+
+    for (ColorProto* color : {layer->mutable_color(), layer->mutable_requested_color()}) {
+        color->set_r(1.f);
+        color->set_g(1.f);
+        color->set_b(1.f);
+        color->set_a(1.f);
+    }
+
+    for (TransformProto* transform :
+         {layer->mutable_transform(), layer->mutable_requested_transform(),
+          layer->mutable_buffer_transform()}) {
+        transform->set_dsdx(1.f);
+        transform->set_dtdy(1.f);
+    }
+
+    layer->mutable_position()->set_y(static_cast<float>(id));
+    layer->mutable_requested_position()->set_y(static_cast<float>(id));
+    layer->mutable_size()->set_w(1080);
+    layer->mutable_size()->set_h(2340);
+
+    ActiveBufferProto* buffer = layer->mutable_active_buffer();
+    buffer->set_width(1080);
+    buffer->set_height(2340);
+    buffer->set_stride(1088);
+    buffer->set_format(1);
+
+    layer->set_dataspace("BT709 sRGB Full range");
+    layer->set_pixel_format("RGBA_8888");
+}
+
+void writeLayers(LayersProto* layersProto) {
+    layersProto->mutable_layers()->Reserve(static_cast<int>(kLayerCount));
+    for (size_t id = 0; id < kLayerCount; id++) {
+        writeLayer(static_cast<int32_t>(id), layersProto);
+    }
+}
+
+// Snapshots the layers into a trace entry, with state.range(0) set to allocate its messages on an
+// arena as dumpsys does, and otherwise on the heap.
+void BM_SnapshotLayers(benchmark::State& state) {
+    const bool useArena = state.range(0) != 0;
+
+    size_t snapshotCount = 0;
+    const size_t allocationCount = gAllocationCount.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        if (useArena) {
+            google::protobuf::Arena arena;
+            auto* entry = google::protobuf::Arena::CreateMessage<LayersTraceProto>(&arena);
+            writeLayers(entry->mutable_layers());
+            benchmark::DoNotOptimize(entry);
+        } else {
+            LayersTraceProto entry;
+            writeLayers(entry.mutable_layers());
+            benchmark::DoNotOptimize(&entry);
+        }
+        snapshotCount++;
+    }
+
+    const size_t allocations = gAllocationCount.load(std::memory_order_relaxed) - allocationCount;
+    state.counters["Allocations"] = benchmark::Counter(static_cast<double>(allocations) /
+                                                       static_cast<double>(snapshotCount));
+}
+BENCHMARK(BM_SnapshotLayers)->Arg(0)->Arg(1);
+
+} // namespace
+} // namespace android::surfaceflinger
+
+BENCHMARK_MAIN();
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+
+#include "Scheduler/OneShotTimer.h"
+
+using namespace std::chrono_literals;
+
+namespace android::scheduler {
+namespace {
+
+// Reset of a timer that hasn't expired, as done by Scheduler on every touch event and buffer.
+void BM_Reset(benchmark::State& state) {
+    auto service = std::make_shared<OneShotTimerService>();
+    OneShotTimer timer("BM_Reset", 1s, [] {}, [] {}, std::make_unique<SteadyClock>(), service);
+    timer.start();
+
+    for (auto _ : state) {
+        timer.reset();
+    }
+
+    timer.stop();
+}
+BENCHMARK(BM_Reset);
+
+// A 240 Hz touch stream, which resets the touch timer and the idle timer on every event, with a
+// stream of the given length in milliseconds followed by enough idle time for both timers to
+// expire. Reports the wakeups per second of the timer thread, and the callbacks that ran.
+void BM_TouchStream240Hz(benchmark::State& state) {
+    constexpr auto kTouchPeriod = std::chrono::microseconds(4167);
+    constexpr auto kTouchTimeout = 200ms;
+    constexpr auto kIdleTimeout = 100ms;
+    const auto streamDuration = std::chrono::milliseconds(state.range(0));
+
+    auto service = std::make_shared<OneShotTimerService>();
+    std::atomic<int> callbacks = 0;
+    const auto callback = [&callbacks] { callbacks++; };
+
+    OneShotTimer touchTimer("TouchTimer", kTouchTimeout, callback, callback,
+                            std::make_unique<SteadyClock>(), service);
+    OneShotTimer idleTimer("IdleTimer", kIdleTimeout, callback, callback,
+                           std::make_unique<SteadyClock>(), service);
+    touchTimer.start();
+    idleTimer.start();
+
+    uint64_t touches = 0;
+    const uint64_t initialWakeups = service->getWakeupCount();
+    const auto start = std::chrono::steady_clock::now();
+
+    for (auto _ : state) {
+        const auto streamStart = std::chrono::steady_clock::now();
+        for (auto next = streamStart; next < streamStart + streamDuration; next += kTouchPeriod) {
+            std::this_thread::sleep_until(next);
+            touchTimer.reset();
+            idleTimer.reset();
+            touches++;
+        }
+        std::this_thread::sleep_for(kTouchTimeout + 10ms);
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    touchTimer.stop();
+    idleTimer.stop();
+
+    state.counters["touches"] = static_cast<double>(touches);
+    state.counters["callbacks"] = callbacks.load();
+    state.counters["wakeups/s"] =
+            static_cast<double>(service->getWakeupCount() - initialWakeups) / elapsed.count();
+}
+BENCHMARK(BM_TouchStream240Hz)
+        ->Arg(1000)
+        ->Iterations(1)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace android::scheduler
+
+BENCHMARK_MAIN();
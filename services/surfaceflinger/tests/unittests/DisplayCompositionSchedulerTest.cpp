@@ -0,0 +1,138 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "Scheduler/DisplayCompositionScheduler.h"
+
+namespace android::scheduler {
+namespace {
+
+constexpr PhysicalDisplayId kInternalDisplayId = PhysicalDisplayId::fromPort(0);
+constexpr PhysicalDisplayId kExternalDisplayId = PhysicalDisplayId::fromPort(1);
+
+constexpr nsecs_t k120HzPeriod = 8'333'333;
+constexpr nsecs_t k60HzPeriod = 16'666'667;
+constexpr nsecs_t k90HzPeriod = 11'111'111;
+
+class DisplayCompositionSchedulerTest : public testing::Test {
+protected:
+    // Runs a frame presenting at expectedPresentTime, and returns whether the display was
+    // composed, as SurfaceFlinger does.
+    bool runFrame(PhysicalDisplayId displayId, nsecs_t vsyncPeriod, nsecs_t framePeriod,
+                  nsecs_t expectedPresentTime) {
+        if (!mScheduler.isDue(displayId, vsyncPeriod, framePeriod, expectedPresentTime)) {
+            mScheduler.onSkipped(displayId);
+            return false;
+        }
+        mScheduler.onComposed(displayId, vsyncPeriod, expectedPresentTime);
+        return true;
+    }
+
+    DisplayCompositionScheduler mScheduler;
+};
+
+// A 60 Hz external display next to a 120 Hz internal display, whose vsync drives the frames. The
+// external display is composed on every other frame, and a buffer queued for it is shown within a
+// frame, i.e. on the next vsync of the external display.
+TEST_F(DisplayCompositionSchedulerTest, composesExternalDisplayAtItsOwnRate) {
+    constexpr size_t kFrameCount = 120;
+
+    std::vector<nsecs_t> externalPresentTimes;
+    std::optional<nsecs_t> pendingBufferTime;
+    nsecs_t maxExternalLatency = 0;
+    for (size_t frame = 0; frame < kFrameCount; frame++) {
+        const nsecs_t expectedPresentTime = static_cast<nsecs_t>(frame) * k120HzPeriod;
+        EXPECT_TRUE(
+                runFrame(kInternalDisplayId, k120HzPeriod, k120HzPeriod, expectedPresentTime));
+
+        // The external display gets a new buffer on every frame, which is latched once its
+        // display is due.
+        if (!pendingBufferTime) {
+            pendingBufferTime = expectedPresentTime;
+        }
+        if (runFrame(kExternalDisplayId, k60HzPeriod, k120HzPeriod, expectedPresentTime)) {
+            externalPresentTimes.push_back(expectedPresentTime);
+            maxExternalLatency =
+                    std::max(maxExternalLatency, expectedPresentTime - *pendingBufferTime);
+            pendingBufferTime.reset();
+        }
+    }
+
+    EXPECT_EQ(kFrameCount, mScheduler.getComposedCount(kInternalDisplayId));
+    EXPECT_EQ(0u, mScheduler.getSkippedCount(kInternalDisplayId));
+    EXPECT_EQ(kFrameCount / 2, mScheduler.getComposedCount(kExternalDisplayId));
+    EXPECT_EQ(kFrameCount / 2, mScheduler.getSkippedCount(kExternalDisplayId));
+
+    // Every composition of the external display lands on one of its vsyncs.
+    for (size_t i = 1; i < externalPresentTimes.size(); i++) {
+        EXPECT_NEAR(k60HzPeriod, externalPresentTimes[i] - externalPresentTimes[i - 1], 1);
+    }
+    EXPECT_EQ(k120HzPeriod, maxExternalLatency);
+}
+
+TEST_F(DisplayCompositionSchedulerTest, composesOnEveryFrameUnlessSlower) {
+    constexpr size_t kFrameCount = 60;
+    for (size_t frame = 0; frame < kFrameCount; frame++) {
+        const nsecs_t expectedPresentTime = static_cast<nsecs_t>(frame) * k60HzPeriod;
+        EXPECT_TRUE(runFrame(kInternalDisplayId, k60HzPeriod, k60HzPeriod, expectedPresentTime));
+        EXPECT_TRUE(runFrame(kExternalDisplayId, k120HzPeriod, k60HzPeriod, expectedPresentTime));
+    }
+    EXPECT_EQ(0u, mScheduler.getSkippedCount(kInternalDisplayId));
+    EXPECT_EQ(0u, mScheduler.getSkippedCount(kExternalDisplayId));
+}
+
+TEST_F(DisplayCompositionSchedulerTest, composesAtNearestFrameForUnevenRates) {
+    // A 60 Hz display next to a 90 Hz one is composed on two of every three frames, on the frame
+    // closest to its vsync.
+    constexpr size_t kFrameCount = 90;
+    for (size_t frame = 0; frame < kFrameCount; frame++) {
+        runFrame(kExternalDisplayId, k60HzPeriod, k90HzPeriod,
+                 static_cast<nsecs_t>(frame) * k90HzPeriod);
+    }
+    EXPECT_EQ(60u, mScheduler.getComposedCount(kExternalDisplayId));
+    EXPECT_EQ(30u, mScheduler.getSkippedCount(kExternalDisplayId));
+}
+
+TEST_F(DisplayCompositionSchedulerTest, composesRightAwayAfterIdle) {
+    EXPECT_TRUE(runFrame(kExternalDisplayId, k60HzPeriod, k120HzPeriod, 0));
+
+    // No frame was scheduled for a while, so the next one is due regardless of its phase.
+    const nsecs_t idleTime = 10 * k60HzPeriod + k120HzPeriod;
+    EXPECT_TRUE(runFrame(kExternalDisplayId, k60HzPeriod, k120HzPeriod, idleTime));
+    EXPECT_FALSE(runFrame(kExternalDisplayId, k60HzPeriod, k120HzPeriod, idleTime + k120HzPeriod));
+    EXPECT_TRUE(
+            runFrame(kExternalDisplayId, k60HzPeriod, k120HzPeriod, idleTime + 2 * k120HzPeriod));
+}
+
+TEST_F(DisplayCompositionSchedulerTest, forgetsRemovedDisplay) {
+    EXPECT_TRUE(runFrame(kExternalDisplayId, k60HzPeriod, k120HzPeriod, 0));
+    EXPECT_FALSE(runFrame(kExternalDisplayId, k60HzPeriod, k120HzPeriod, k120HzPeriod));
+
+    mScheduler.onDisplayRemoved(kExternalDisplayId);
+    EXPECT_EQ(0u, mScheduler.getComposedCount(kExternalDisplayId));
+    EXPECT_TRUE(mScheduler.isDue(kExternalDisplayId, k60HzPeriod, k120HzPeriod, k120HzPeriod));
+}
+
+} // namespace
+} // namespace android::scheduler
@@ -0,0 +1,239 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gtest/gtest.h>
+#include <ui/FrameStats.h>
+
+#include <atomic>
+#include <cinttypes>
+#include <deque>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "FrameTracker.h"
+
+namespace android {
+namespace {
+
+constexpr nsecs_t kPeriod = 16'666'667;
+constexpr nsecs_t kReadyLatency = 4'000'000;
+constexpr nsecs_t kPresentLatency = 2 * kPeriod;
+
+// The rows of dumpStats, oldest first.
+struct Row {
+    nsecs_t desiredPresentTime;
+    nsecs_t actualPresentTime;
+    nsecs_t frameReadyTime;
+};
+
+std::vector<Row> parseDump(const std::string& dump) {
+    std::vector<Row> rows;
+    std::istringstream stream(dump);
+    std::string line;
+    while (std::getline(stream, line) && !line.empty()) {
+        Row row;
+        EXPECT_EQ(3, sscanf(line.c_str(), "%" SCNd64 "\t%" SCNd64 "\t%" SCNd64,
+                            &row.desiredPresentTime, &row.actualPresentTime, &row.frameReadyTime))
+                << line;
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+nsecs_t getDesiredPresentTime(uint64_t frameNumber) {
+    return static_cast<nsecs_t>(frameNumber + 1) * kPeriod;
+}
+
+class FrameTrackerTest : public testing::Test {
+protected:
+    FrameTrackerTest() { mFrameTracker.setDisplayRefreshPeriod(kPeriod); }
+
+    // Records a frame whose present time is resolved from a fence, which is returned.
+    std::shared_ptr<FenceTime> recordFrame(uint64_t frameNumber) {
+        const nsecs_t desiredPresentTime = getDesiredPresentTime(frameNumber);
+        mFrameTracker.setDesiredPresentTime(desiredPresentTime);
+        mFrameTracker.setFrameReadyTime(desiredPresentTime + kReadyLatency);
+        auto presentFence = mFenceFactory.createFenceTimeForTest(Fence::NO_FENCE);
+        mFrameTracker.setActualPresentFence(presentFence);
+        mFrameTracker.advanceFrame();
+        return presentFence;
+    }
+
+    FenceToFenceTimeMap mFenceFactory;
+    FrameTracker mFrameTracker;
+};
+
+TEST_F(FrameTrackerTest, dumpsEmptyHistory) {
+    std::string dump;
+    mFrameTracker.dumpStats(dump);
+
+    const auto rows = parseDump(dump);
+    ASSERT_EQ(FrameTracker::NUM_FRAME_RECORDS - 1, rows.size());
+    for (const Row& row : rows) {
+        EXPECT_EQ(0, row.desiredPresentTime);
+        EXPECT_EQ(0, row.actualPresentTime);
+        EXPECT_EQ(0, row.frameReadyTime);
+    }
+    EXPECT_EQ('\n', dump.back());
+}
+
+TEST_F(FrameTrackerTest, resolvesPresentFencesWhenRead) {
+    auto presentFence = recordFrame(0);
+
+    std::string dump;
+    mFrameTracker.dumpStats(dump);
+    auto rows = parseDump(dump);
+    ASSERT_EQ(FrameTracker::NUM_FRAME_RECORDS - 1, rows.size());
+    EXPECT_EQ(getDesiredPresentTime(0), rows.back().desiredPresentTime);
+    EXPECT_EQ(INT64_MAX, rows.back().actualPresentTime);
+    EXPECT_EQ(getDesiredPresentTime(0) + kReadyLatency, rows.back().frameReadyTime);
+
+    presentFence->signalForTest(getDesiredPresentTime(0) + kPresentLatency);
+
+    dump.clear();
+    mFrameTracker.dumpStats(dump);
+    rows = parseDump(dump);
+    ASSERT_EQ(FrameTracker::NUM_FRAME_RECORDS - 1, rows.size());
+    EXPECT_EQ(getDesiredPresentTime(0) + kPresentLatency, rows.back().actualPresentTime);
+}
+
+TEST_F(FrameTrackerTest, getStatsSkipsFramesNotRecorded) {
+    for (uint64_t frameNumber = 0; frameNumber < 3; frameNumber++) {
+        recordFrame(frameNumber)->signalForTest(getDesiredPresentTime(frameNumber) +
+                                                kPresentLatency);
+    }
+
+    FrameStats stats;
+    mFrameTracker.getStats(&stats);
+    EXPECT_EQ(kPeriod, stats.refreshPeriodNano);
+    ASSERT_EQ(3u, stats.desiredPresentTimesNano.size());
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_EQ(getDesiredPresentTime(i), stats.desiredPresentTimesNano[i]);
+        EXPECT_EQ(getDesiredPresentTime(i) + kPresentLatency, stats.actualPresentTimesNano[i]);
+        EXPECT_EQ(getDesiredPresentTime(i) + kReadyLatency, stats.frameReadyTimesNano[i]);
+    }
+    EXPECT_EQ(kReadyLatency, mFrameTracker.getPreviousGfxInfo());
+}
+
+TEST_F(FrameTrackerTest, clearStatsHidesRecordedFrames) {
+    recordFrame(0);
+    recordFrame(1);
+    mFrameTracker.clearStats();
+    recordFrame(2);
+
+    FrameStats stats;
+    mFrameTracker.getStats(&stats);
+    ASSERT_EQ(1u, stats.desiredPresentTimesNano.size());
+    EXPECT_EQ(getDesiredPresentTime(2), stats.desiredPresentTimesNano[0]);
+
+    std::string dump;
+    mFrameTracker.dumpStats(dump);
+    const auto rows = parseDump(dump);
+    ASSERT_EQ(FrameTracker::NUM_FRAME_RECORDS - 1, rows.size());
+    EXPECT_EQ(0, rows[rows.size() - 2].desiredPresentTime);
+    EXPECT_EQ(getDesiredPresentTime(2), rows.back().desiredPresentTime);
+}
+
+// Records frames on one thread while other threads dump the latency, and checks that every dumped
+// frame is consistent, i.e. that no reader observes a record while the writer reuses it.
+TEST_F(FrameTrackerTest, concurrentLatencyDumps) {
+    constexpr uint64_t kFrameCount = 20'000;
+    constexpr size_t kReaderCount = 4;
+    // The present fence of a frame signals this many frames after it is recorded.
+    constexpr size_t kFencesInFlight = 2;
+
+    std::atomic<bool> done = false;
+    std::atomic<size_t> dumpCount = 0;
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < kReaderCount; i++) {
+        readers.emplace_back([&, i] {
+            while (!done) {
+                std::string dump;
+                mFrameTracker.dumpStats(dump);
+                const auto rows = parseDump(dump);
+                ASSERT_EQ(FrameTracker::NUM_FRAME_RECORDS - 1, rows.size());
+
+                nsecs_t lastDesiredPresentTime = 0;
+                for (const Row& row : rows) {
+                    if (row.desiredPresentTime == 0) {
+                        EXPECT_EQ(0, row.actualPresentTime);
+                        EXPECT_EQ(0, row.frameReadyTime);
+                        continue;
+                    }
+                    EXPECT_GT(row.desiredPresentTime, lastDesiredPresentTime);
+                    lastDesiredPresentTime = row.desiredPresentTime;
+                    EXPECT_EQ(row.desiredPresentTime + kReadyLatency, row.frameReadyTime);
+                    if (row.actualPresentTime != INT64_MAX) {
+                        EXPECT_EQ(row.desiredPresentTime + kPresentLatency,
+                                  row.actualPresentTime);
+                    }
+                }
+
+                // Exercise the other readers as well.
+                if (i == 0) {
+                    FrameStats stats;
+                    mFrameTracker.getStats(&stats);
+                    EXPECT_EQ(stats.desiredPresentTimesNano.size(),
+                              stats.actualPresentTimesNano.size());
+                } else if (i == 1) {
+                    const nsecs_t gfxInfo = mFrameTracker.getPreviousGfxInfo();
+                    EXPECT_TRUE(gfxInfo == kReadyLatency || gfxInfo == INT64_MAX) << gfxInfo;
+                } else if (i == 2 && dumpCount % 16 == 0) {
+                    mFrameTracker.clearStats();
+                }
+                dumpCount++;
+            }
+        });
+    }
+
+    std::deque<std::pair<uint64_t, std::shared_ptr<FenceTime>>> pendingFences;
+    for (uint64_t frameNumber = 0; frameNumber < kFrameCount; frameNumber++) {
+        pendingFences.emplace_back(frameNumber, recordFrame(frameNumber));
+        if (pendingFences.size() > kFencesInFlight) {
+            const auto& [signaledFrameNumber, fence] = pendingFences.front();
+            fence->signalForTest(getDesiredPresentTime(signaledFrameNumber) + kPresentLatency);
+            pendingFences.pop_front();
+        }
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_GT(dumpCount, 0u);
+
+    for (const auto& [frameNumber, fence] : pendingFences) {
+        fence->signalForTest(getDesiredPresentTime(frameNumber) + kPresentLatency);
+    }
+    recordFrame(kFrameCount);
+
+    // The last frames recorded after the readers stopped are complete.
+    FrameStats stats;
+    mFrameTracker.getStats(&stats);
+    ASSERT_FALSE(stats.desiredPresentTimesNano.empty());
+    const size_t count = stats.desiredPresentTimesNano.size();
+    EXPECT_EQ(getDesiredPresentTime(kFrameCount), stats.desiredPresentTimesNano[count - 1]);
+    for (size_t i = 0; i + 1 < count; i++) {
+        EXPECT_EQ(stats.desiredPresentTimesNano[i] + kPresentLatency,
+                  stats.actualPresentTimesNano[i]);
+    }
+}
+
+} // namespace
+} // namespace android
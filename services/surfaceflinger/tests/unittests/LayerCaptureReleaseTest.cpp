@@ -0,0 +1,170 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <future>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <gui/ITransactionCompletedListener.h>
+#include <log/log.h>
+#include <renderengine/ExternalTexture.h>
+#include <renderengine/mock/RenderEngine.h>
+
+#include "TestableSurfaceFlinger.h"
+#include "mock/DisplayHardware/MockComposer.h"
+#include "mock/MockEventThread.h"
+#include "mock/MockVsyncController.h"
+
+namespace android {
+
+using testing::_;
+using testing::Return;
+using FakeHwcDisplayInjector = TestableSurfaceFlinger::FakeHwcDisplayInjector;
+
+class FakeReleaseBufferListener : public BnTransactionCompletedListener {
+public:
+    void onTransactionCompleted(ListenerStats) override {}
+
+    void onReleaseBuffer(ReleaseCallbackId callbackId, sp<Fence>, uint32_t, uint32_t) override {
+        releasedBuffers.push_back(callbackId);
+    }
+
+    std::vector<ReleaseCallbackId> releasedBuffers;
+};
+
+// Covers the main thread latching a buffer which replaces one that a screen capture, drawn off the
+// main thread, still samples.
+class LayerCaptureReleaseTest : public testing::Test {
+public:
+    LayerCaptureReleaseTest() {
+        setupScheduler();
+        mFlinger.setupComposer(std::make_unique<Hwc2::mock::Composer>());
+    }
+
+protected:
+    void setupScheduler() {
+        auto eventThread = std::make_unique<mock::EventThread>();
+        auto sfEventThread = std::make_unique<mock::EventThread>();
+
+        EXPECT_CALL(*eventThread, registerDisplayEventConnection(_));
+        EXPECT_CALL(*eventThread, createEventConnection(_, _))
+                .WillOnce(Return(new EventThreadConnection(eventThread.get(), /*callingUid=*/0,
+                                                           ResyncCallback())));
+
+        EXPECT_CALL(*sfEventThread, registerDisplayEventConnection(_));
+        EXPECT_CALL(*sfEventThread, createEventConnection(_, _))
+                .WillOnce(Return(new EventThreadConnection(sfEventThread.get(), /*callingUid=*/0,
+                                                           ResyncCallback())));
+
+        auto vsyncController = std::make_unique<mock::VsyncController>();
+        auto vsyncTracker = std::make_unique<mock::VSyncTracker>();
+
+        EXPECT_CALL(*vsyncTracker, nextAnticipatedVSyncTimeFrom(_)).WillRepeatedly(Return(0));
+        EXPECT_CALL(*vsyncTracker, currentPeriod())
+                .WillRepeatedly(Return(FakeHwcDisplayInjector::DEFAULT_VSYNC_PERIOD));
+        mFlinger.setupScheduler(std::move(vsyncController), std::move(vsyncTracker),
+                                std::move(eventThread), std::move(sfEventThread));
+    }
+
+    sp<BufferStateLayer> createBufferStateLayer() {
+        sp<Client> client;
+        LayerCreationArgs args(mFlinger.flinger(), client, "buffer-state-layer", 100, 100, 0,
+                               LayerMetadata());
+        return new BufferStateLayer(args);
+    }
+
+    std::shared_ptr<renderengine::ExternalTexture> createBuffer() {
+        return std::make_shared<
+                renderengine::ExternalTexture>(new GraphicBuffer(1, 1, HAL_PIXEL_FORMAT_RGBA_8888,
+                                                                 1, 0),
+                                               mRenderEngine, false);
+    }
+
+    // Sets and latches the buffer as the main thread does, except for the composition state.
+    // Returns the handle of the transaction which set it.
+    sp<CallbackHandle> latchBuffer(const sp<BufferStateLayer>& layer,
+                                   const std::shared_ptr<renderengine::ExternalTexture>& buffer,
+                                   uint64_t frameNumber) {
+        layer->setBuffer(buffer, Fence::NO_FENCE, 10, 20, false, mClientCache, frameNumber,
+                         std::nullopt, {/*vsyncId*/ 1, /*inputEventId*/ 0}, mListener,
+                         mListenerEndpoint);
+        sp<CallbackHandle> handle = new CallbackHandle(mListenerEndpoint, {}, nullptr);
+        handle->releasePreviousBuffer = layer->mReleasePreviousBuffer;
+        layer->mDrawingState.callbackHandles.push_back(handle);
+
+        auto c = layer->getDrawingState();
+        layer->commitTransaction(c);
+        EXPECT_TRUE(layer->canReplaceCapturedBuffer());
+        bool recomputeVisibleRegions;
+        EXPECT_EQ(NO_ERROR, layer->updateTexImage(recomputeVisibleRegions, 15, 0));
+        EXPECT_EQ(NO_ERROR, layer->updateActiveBuffer());
+        return handle;
+    }
+
+    TestableSurfaceFlinger mFlinger;
+    renderengine::mock::RenderEngine mRenderEngine;
+    client_cache_t mClientCache;
+
+    sp<FakeReleaseBufferListener> mListener = new FakeReleaseBufferListener();
+    sp<IBinder> mListenerEndpoint = IInterface::asBinder(mListener);
+};
+
+TEST_F(LayerCaptureReleaseTest, latchesWhileCaptureIsDrawnAndHoldsBackRelease) {
+    sp<BufferStateLayer> layer = createBufferStateLayer();
+    const auto firstBuffer = createBuffer();
+    latchBuffer(layer, firstBuffer, 1);
+    layer->releasePendingBuffer(25);
+
+    std::promise<sp<Fence>> captureFence;
+    layer->addPendingCaptureFence(captureFence.get_future().share());
+
+    // The capture is not drawn yet, so latching used to wait for it here.
+    const sp<CallbackHandle> handle = latchBuffer(layer, createBuffer(), 2);
+    layer->releasePendingBuffer(35);
+    EXPECT_EQ(ReleaseCallbackId::INVALID_ID, handle->previousReleaseCallbackId);
+    EXPECT_TRUE(mListener->releasedBuffers.empty());
+
+    captureFence.set_value(Fence::NO_FENCE);
+    EXPECT_FALSE(layer->onCaptureDrawn());
+    ASSERT_EQ(1u, mListener->releasedBuffers.size());
+    EXPECT_EQ(ReleaseCallbackId(firstBuffer->getBuffer()->getId(), 1),
+              mListener->releasedBuffers[0]);
+}
+
+TEST_F(LayerCaptureReleaseTest, releasesThroughCallbackOnceCaptureIsDrawn) {
+    sp<BufferStateLayer> layer = createBufferStateLayer();
+    const auto firstBuffer = createBuffer();
+    latchBuffer(layer, firstBuffer, 1);
+    layer->releasePendingBuffer(25);
+
+    std::promise<sp<Fence>> captureFence;
+    layer->addPendingCaptureFence(captureFence.get_future().share());
+
+    const sp<CallbackHandle> handle = latchBuffer(layer, createBuffer(), 2);
+    captureFence.set_value(Fence::NO_FENCE);
+    layer->releasePendingBuffer(35);
+    EXPECT_EQ(ReleaseCallbackId(firstBuffer->getBuffer()->getId(), 1),
+              handle->previousReleaseCallbackId);
+
+    EXPECT_FALSE(layer->onCaptureDrawn());
+    EXPECT_TRUE(mListener->releasedBuffers.empty());
+}
+
+} // namespace android
@@ -21,6 +21,8 @@
 #include <utils/Log.h>
 #include <utils/Timers.h>
 
+#include <future>
+
 #include "AsyncCallRecorder.h"
 #include "Scheduler/OneShotTimer.h"
 #include "fake/FakeClock.h"
@@ -223,6 +225,103 @@ TEST_F(OneShotTimerTest, noCallbacksAfterStopTest) {
     EXPECT_FALSE(mResetTimerCallback.waitForUnexpectedCall().has_value());
 }
 
+TEST_F(OneShotTimerTest, resetWhileWaitingDoesNotWakeServiceTest) {
+    fake::FakeClock* clock = new fake::FakeClock();
+    auto service = std::make_shared<OneShotTimerService>();
+    mIdleTimer = std::make_unique<scheduler::OneShotTimer>("TestTimer", 1s,
+                                                           mResetTimerCallback.getInvocable(),
+                                                           mExpiredTimerCallback.getInvocable(),
+                                                           std::unique_ptr<fake::FakeClock>(clock),
+                                                           service);
+    mIdleTimer->start();
+    EXPECT_TRUE(mResetTimerCallback.waitForCall().has_value());
+    const uint64_t wakeups = service->getWakeupCount();
+
+    for (int i = 0; i < 100; i++) {
+        clock->advanceTime(1ms);
+        mIdleTimer->reset();
+    }
+
+    EXPECT_FALSE(mResetTimerCallback.waitForUnexpectedCall().has_value());
+    EXPECT_FALSE(mExpiredTimerCallback.waitForUnexpectedCall().has_value());
+    EXPECT_EQ(wakeups, service->getWakeupCount());
+    mIdleTimer->stop();
+}
+
+TEST_F(OneShotTimerTest, sharedServiceTest) {
+    fake::FakeClock* clock = new fake::FakeClock();
+    auto service = std::make_shared<OneShotTimerService>();
+    mIdleTimer = std::make_unique<scheduler::OneShotTimer>("TestTimer", 1ms,
+                                                           mResetTimerCallback.getInvocable(),
+                                                           mExpiredTimerCallback.getInvocable(),
+                                                           std::unique_ptr<fake::FakeClock>(clock),
+                                                           service);
+
+    AsyncCallRecorder<void (*)()> otherResetCallback;
+    AsyncCallRecorder<void (*)()> otherExpiredCallback;
+    fake::FakeClock* otherClock = new fake::FakeClock();
+    OneShotTimer otherTimer("OtherTimer", 1ms, otherResetCallback.getInvocable(),
+                            otherExpiredCallback.getInvocable(),
+                            std::unique_ptr<fake::FakeClock>(otherClock), service);
+
+    mIdleTimer->start();
+    otherTimer.start();
+    EXPECT_TRUE(mResetTimerCallback.waitForCall().has_value());
+    EXPECT_TRUE(otherResetCallback.waitForCall().has_value());
+
+    // Only the timer whose clock advanced expires.
+    clock->advanceTime(2ms);
+    EXPECT_TRUE(mExpiredTimerCallback.waitForCall().has_value());
+    EXPECT_FALSE(otherExpiredCallback.waitForUnexpectedCall().has_value());
+
+    otherClock->advanceTime(2ms);
+    EXPECT_TRUE(otherExpiredCallback.waitForCall().has_value());
+
+    // Stopping one timer doesn't affect the other.
+    otherTimer.stop();
+    mIdleTimer->reset();
+    EXPECT_TRUE(mResetTimerCallback.waitForCall().has_value());
+    clock->advanceTime(2ms);
+    EXPECT_TRUE(mExpiredTimerCallback.waitForCall().has_value());
+    EXPECT_FALSE(otherResetCallback.waitForUnexpectedCall().has_value());
+    mIdleTimer->stop();
+}
+
+TEST_F(OneShotTimerTest, blockingCallbackDoesNotStallOtherTimersTest) {
+    // Like the timeout of PowerAdvisor, which waits for the main thread.
+    std::promise<void> unblock;
+    std::shared_future<void> unblocked = unblock.get_future().share();
+    AsyncCallRecorder<void (*)()> blockingExpiredCallback;
+    auto recordBlockingExpired = blockingExpiredCallback.getInvocable();
+    fake::FakeClock* blockingClock = new fake::FakeClock();
+    OneShotTimer blockingTimer(
+            "BlockingTimer", 1ms, [] {},
+            [&] {
+                recordBlockingExpired();
+                unblocked.wait();
+            },
+            std::unique_ptr<fake::FakeClock>(blockingClock));
+
+    fake::FakeClock* clock = new fake::FakeClock();
+    mIdleTimer = std::make_unique<scheduler::OneShotTimer>("TestTimer", 1ms,
+                                                           mResetTimerCallback.getInvocable(),
+                                                           mExpiredTimerCallback.getInvocable(),
+                                                           std::unique_ptr<fake::FakeClock>(clock));
+
+    blockingTimer.start();
+    blockingClock->advanceTime(2ms);
+    EXPECT_TRUE(blockingExpiredCallback.waitForCall().has_value());
+
+    mIdleTimer->start();
+    EXPECT_TRUE(mResetTimerCallback.waitForCall().has_value());
+    clock->advanceTime(2ms);
+    EXPECT_TRUE(mExpiredTimerCallback.waitForCall().has_value());
+
+    unblock.set_value();
+    mIdleTimer->stop();
+    blockingTimer.stop();
+}
+
 } // namespace
 } // namespace scheduler
 } // namespace android
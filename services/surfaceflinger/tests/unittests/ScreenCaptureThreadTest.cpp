@@ -0,0 +1,94 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "ScreenCaptureThread.h"
+
+using namespace std::chrono_literals;
+
+namespace android {
+namespace {
+
+// Stands in for the RenderEngine work of a capture.
+constexpr auto kDrawDuration = 50ms;
+
+TEST(ScreenCaptureThreadTest, runsWorkInOrderOffCallingThread) {
+    ScreenCaptureThread thread;
+
+    std::vector<int> order;
+    std::promise<std::thread::id> workThreadId;
+    for (int i = 0; i < 3; i++) {
+        thread.post([&, i] {
+            order.push_back(i);
+            if (i == 2) {
+                workThreadId.set_value(std::this_thread::get_id());
+            }
+        });
+    }
+
+    EXPECT_NE(std::this_thread::get_id(), workThreadId.get_future().get());
+    EXPECT_EQ((std::vector<int>{0, 1, 2}), order);
+}
+
+TEST(ScreenCaptureThreadTest, runsPendingWorkWhenDestroyed) {
+    int count = 0;
+    {
+        ScreenCaptureThread thread;
+        for (int i = 0; i < 3; i++) {
+            thread.post([&] {
+                std::this_thread::sleep_for(1ms);
+                count++;
+            });
+        }
+    }
+    EXPECT_EQ(3, count);
+}
+
+// Compares the time the thread posting a capture spends on it when the capture is drawn inline, and
+// when it is posted to the capture thread. LayerCaptureReleaseTest covers the main thread latching
+// the captured layers meanwhile.
+TEST(ScreenCaptureThreadTest, releasesCallerWhileCaptureIsDrawn) {
+    const auto drawCapture = [] { std::this_thread::sleep_for(kDrawDuration); };
+
+    auto start = std::chrono::steady_clock::now();
+    drawCapture();
+    const auto inlineDuration = std::chrono::steady_clock::now() - start;
+
+    ScreenCaptureThread thread;
+    std::promise<void> drawn;
+    start = std::chrono::steady_clock::now();
+    thread.post([&] {
+        drawCapture();
+        drawn.set_value();
+    });
+    const auto postedDuration = std::chrono::steady_clock::now() - start;
+    drawn.get_future().wait();
+
+    EXPECT_GE(inlineDuration, kDrawDuration);
+    EXPECT_LT(postedDuration, kDrawDuration / 2);
+}
+
+} // namespace
+} // namespace android
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+#define LOG_TAG "LibSurfaceFlingerUnittests"
+
+#include <compositionengine/CompositionRefreshArgs.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "DisplayTransactionTestHelpers.h"
+
+namespace android {
+namespace {
+
+constexpr nsecs_t k120HzPeriod = 8'333'333;
+constexpr nsecs_t k60HzPeriod = 16'666'667;
+
+constexpr ui::LayerStack kInternalLayerStack = 0;
+constexpr ui::LayerStack kExternalLayerStack = 1;
+
+class PerDisplayFrameSchedulingTest : public DisplayTransactionTest {
+public:
+    void SetUp() override {
+        mFlinger.mutablePerDisplayFrameScheduling() = true;
+        // The initial color matrix change would otherwise compose every display.
+        mFlinger.mutableDrawingState().colorMatrixChanged = false;
+
+        // The frames follow the vsync of the internal display.
+        EXPECT_CALL(*mVSyncTracker, currentPeriod()).WillRepeatedly(Return(k120HzPeriod));
+        EXPECT_CALL(*mVSyncTracker, nextAnticipatedVSyncTimeFrom(_)).WillRepeatedly(Return(0));
+
+        mInternalDisplay = PrimaryDisplayVariant::makeFakeExistingDisplayInjector(this)
+                                   .setSupportedModes({makeMode(
+                                           PrimaryDisplayVariant::DISPLAY_ID::get(),
+                                           k120HzPeriod)})
+                                   .setActiveMode(kModeId)
+                                   .inject();
+        mInternalDisplay->getCompositionDisplay()->setLayerStackFilter(kInternalLayerStack,
+                                                                       /*isInternal=*/true);
+
+        mExternalDisplay = ExternalDisplayVariant::makeFakeExistingDisplayInjector(this)
+                                   .setSupportedModes({makeMode(
+                                           ExternalDisplayVariant::DISPLAY_ID::get(),
+                                           k60HzPeriod)})
+                                   .setActiveMode(kModeId)
+                                   .inject();
+        mExternalDisplay->getCompositionDisplay()->setLayerStackFilter(kExternalLayerStack,
+                                                                       /*isInternal=*/false);
+    }
+
+protected:
+    static DisplayModePtr makeMode(PhysicalDisplayId displayId, nsecs_t vsyncPeriod) {
+        return DisplayMode::Builder(hal::HWConfigId(kModeId.value()))
+                .setId(kModeId)
+                .setPhysicalDisplayId(displayId)
+                .setVsyncPeriod(static_cast<int32_t>(vsyncPeriod))
+                .setGroup(0)
+                .setHeight(1000)
+                .setWidth(1000)
+                .build();
+    }
+
+    // Runs the scheduling of the frame numbered frame as SurfaceFlinger does, deferring the
+    // displays which are not due at INVALIDATE, and selecting the outputs to compose at REFRESH.
+    compositionengine::CompositionRefreshArgs runFrame(size_t frame) {
+        mFlinger.mutableExpectedPresentTime() = static_cast<nsecs_t>(frame) * k120HzPeriod;
+        mFlinger.updateDeferredDisplays();
+
+        compositionengine::CompositionRefreshArgs refreshArgs;
+        mFlinger.addOutputsToCompose(refreshArgs);
+        return refreshArgs;
+    }
+
+    bool isComposed(const compositionengine::CompositionRefreshArgs& refreshArgs,
+                    const sp<DisplayDevice>& display) const {
+        return std::find(refreshArgs.outputs.begin(), refreshArgs.outputs.end(),
+                         display->getCompositionDisplay()) != refreshArgs.outputs.end();
+    }
+
+    static inline const DisplayModeId kModeId = DisplayModeId(0);
+
+    sp<DisplayDevice> mInternalDisplay;
+    sp<DisplayDevice> mExternalDisplay;
+};
+
+TEST_F(PerDisplayFrameSchedulingTest, composesEachDisplayAtItsOwnRate) {
+    constexpr size_t kFrameCount = 120;
+
+    std::vector<size_t> externalFrames;
+    for (size_t frame = 0; frame < kFrameCount; frame++) {
+        const auto refreshArgs = runFrame(frame);
+        EXPECT_TRUE(isComposed(refreshArgs, mInternalDisplay));
+
+        // Buffers shown only on the external display stay queued while it is skipped.
+        const bool externalComposed = isComposed(refreshArgs, mExternalDisplay);
+        EXPECT_NE(externalComposed, mFlinger.isLayerStackDeferred(kExternalLayerStack));
+        EXPECT_FALSE(mFlinger.isLayerStackDeferred(kInternalLayerStack));
+        if (externalComposed) {
+            externalFrames.push_back(frame);
+        }
+    }
+
+    const auto& scheduler = mFlinger.getDisplayCompositionScheduler();
+    const auto internalId = mInternalDisplay->getPhysicalId();
+    const auto externalId = mExternalDisplay->getPhysicalId();
+    EXPECT_EQ(kFrameCount, scheduler.getComposedCount(internalId));
+    EXPECT_EQ(0u, scheduler.getSkippedCount(internalId));
+    EXPECT_EQ(kFrameCount / 2, scheduler.getComposedCount(externalId));
+    EXPECT_EQ(kFrameCount / 2, scheduler.getSkippedCount(externalId));
+
+    // The external display is composed on the frame nearest to each of its vsyncs, so a buffer
+    // deferred for it is latched within a frame of the vsync it is shown on.
+    ASSERT_EQ(kFrameCount / 2, externalFrames.size());
+    for (size_t i = 0; i < externalFrames.size(); i++) {
+        const nsecs_t presentTime = static_cast<nsecs_t>(externalFrames[i]) * k120HzPeriod;
+        const nsecs_t vsyncTime = static_cast<nsecs_t>(i) * k60HzPeriod;
+        EXPECT_LE(std::abs(presentTime - vsyncTime), k120HzPeriod / 2) << "vsync " << i;
+    }
+}
+
+TEST_F(PerDisplayFrameSchedulingTest, composesDeferredDisplayForGeometryChanges) {
+    runFrame(0);
+
+    // The external display is not due on the next frame, but a geometry change must reach it.
+    mFlinger.mutableGeometryInvalid() = true;
+    const auto refreshArgs = runFrame(1);
+    EXPECT_TRUE(isComposed(refreshArgs, mInternalDisplay));
+    EXPECT_TRUE(isComposed(refreshArgs, mExternalDisplay));
+    EXPECT_EQ(0u,
+              mFlinger.getDisplayCompositionScheduler().getSkippedCount(
+                      mExternalDisplay->getPhysicalId()));
+}
+
+TEST_F(PerDisplayFrameSchedulingTest, composesEveryFrameWhenDisabled) {
+    mFlinger.mutablePerDisplayFrameScheduling() = false;
+
+    for (size_t frame = 0; frame < 4; frame++) {
+        const auto refreshArgs = runFrame(frame);
+        EXPECT_TRUE(isComposed(refreshArgs, mInternalDisplay));
+        EXPECT_TRUE(isComposed(refreshArgs, mExternalDisplay));
+        EXPECT_FALSE(mFlinger.isLayerStackDeferred(kExternalLayerStack));
+    }
+}
+
+} // namespace
+} // namespace android
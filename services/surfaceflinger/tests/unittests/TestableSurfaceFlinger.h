@@ -384,6 +384,14 @@ public:
 
     auto flushTransactionQueues() { return mFlinger->flushTransactionQueues(); };
 
+    void updateDeferredDisplays() { mFlinger->updateDeferredDisplays(); }
+    auto isLayerStackDeferred(ui::LayerStack layerStack) const {
+        return mFlinger->isLayerStackDeferred(layerStack);
+    }
+    void addOutputsToCompose(compositionengine::CompositionRefreshArgs& refreshArgs) {
+        mFlinger->addOutputsToCompose(refreshArgs);
+    }
+
     auto onTransact(uint32_t code, const Parcel& data, Parcel* reply, uint32_t flags) {
         return mFlinger->onTransact(code, data, reply, flags);
     }
@@ -402,6 +410,9 @@ public:
     const auto& getAnimFrameTracker() const { return mFlinger->mAnimFrameTracker; }
     const auto& getHasPoweredOff() const { return mFlinger->mHasPoweredOff; }
     const auto& getVisibleRegionsDirty() const { return mFlinger->mVisibleRegionsDirty; }
+    const auto& getDisplayCompositionScheduler() const {
+        return mFlinger->mDisplayCompositionScheduler;
+    }
     auto& getHwComposer() const {
         return static_cast<impl::HWComposer&>(mFlinger->getHwComposer());
     }
@@ -436,6 +447,8 @@ public:
     auto& mutablePowerAdvisor() { return mFlinger->mPowerAdvisor; }
     auto& mutableDebugDisableHWC() { return mFlinger->mDebugDisableHWC; }
     auto& mutableMaxRenderTargetSize() { return mFlinger->mMaxRenderTargetSize; }
+    auto& mutablePerDisplayFrameScheduling() { return mFlinger->mPerDisplayFrameScheduling; }
+    auto& mutableExpectedPresentTime() { return mFlinger->mExpectedPresentTime; }
 
     auto& mutableHwcDisplayData() { return getHwComposer().mDisplayData; }
     auto& mutableHwcPhysicalDisplayIdMap() { return getHwComposer().mPhysicalDisplayIdMap; }